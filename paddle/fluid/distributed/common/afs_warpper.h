@@ -66,6 +66,11 @@ class FsReadChannel {
     return 0;
   }
 
+  // read at most size bytes, return the number of bytes read
+  inline size_t read(char* data, size_t size) {
+    return fread_unlocked(data, 1, size, _file.get());
+  }
+
  private:
   uint32_t _buffer_size;
   FsChannelConfig _config;
@@ -114,6 +119,15 @@ class FsWriteChannel {
     return write_line(data.c_str(), data.size());
   }
 
+  // write raw bytes without line delimiter
+  inline uint32_t write(const char* data, size_t size) {
+    size_t write_count = fwrite_unlocked(data, 1, size, _file.get());
+    if (write_count != size) {
+      return -1;
+    }
+    return 0;
+  }
+
  private:
   uint32_t _buffer_size;
   FsChannelConfig _config;
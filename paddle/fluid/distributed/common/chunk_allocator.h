@@ -15,6 +15,12 @@
 #pragma once
 #include <glog/logging.h>
 
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
 namespace paddle {
 namespace distributed {
 
@@ -91,5 +97,146 @@ class ChunkAllocator {
   }
 };
 
+// Fast allocation and deallocation of rows whose byte size is only known at
+// runtime. Rows of one chunk are stored contiguously. acquire gives the id of
+// the chunk of a row, which release takes back, so a chunk knows when its
+// last row is released. Empty chunks are freed, but one is kept for the
+// next rows.
+class RowChunkAllocator {
+ public:
+  // chunk ids are below it
+  static const uint32_t MAX_CHUNK_NUM = 1U << 28;
+
+  explicit RowChunkAllocator(size_t row_bytes, size_t chunk_size = 256) {
+    _row_bytes = std::max(sizeof(Node), (row_bytes + sizeof(void*) - 1) /
+                                            sizeof(void*) * sizeof(void*));
+    _chunk_size = chunk_size;
+    _free_head = NONE;
+    _chunk_num = 0;
+    _empty_num = 0;
+    _counter = 0;
+  }
+  RowChunkAllocator(const RowChunkAllocator&) = delete;
+  ~RowChunkAllocator() {
+    for (auto& chunk : _chunks) {
+      free(chunk.rows);
+    }
+  }
+  void* acquire(uint32_t* chunk_id) {
+    if (_free_head == NONE) {
+      create_new_chunk();
+    }
+    uint32_t id = _free_head;
+    Chunk& chunk = _chunks[id];
+    Node* x = chunk.free_nodes;
+    chunk.free_nodes = x->next;
+    if (chunk.used++ == 0) {
+      _empty_num--;
+    }
+    if (chunk.free_nodes == NULL) {
+      unlink(id);
+    }
+    _counter++;
+    *chunk_id = id;
+    return x;
+  }
+  void release(void* x, uint32_t chunk_id) {
+    Chunk& chunk = _chunks[chunk_id];
+    Node* node = reinterpret_cast<Node*>(x);
+    node->next = chunk.free_nodes;
+    chunk.free_nodes = node;
+    if (node->next == NULL) {
+      link(chunk_id);
+    }
+    _counter--;
+    if (--chunk.used > 0) {
+      return;
+    }
+    if (_empty_num == 0) {
+      _empty_num++;
+      return;
+    }
+    unlink(chunk_id);
+    free(chunk.rows);
+    chunk.rows = NULL;
+    chunk.free_nodes = NULL;
+    _free_ids.push_back(chunk_id);
+    _chunk_num--;
+  }
+  size_t size() const { return _counter; }
+  // bytes of the chunks not freed
+  size_t memory_size() const { return _chunk_num * _chunk_size * _row_bytes; }
+
+ private:
+  static const uint32_t NONE = 0xffffffff;
+
+  struct Node {
+    Node* next;
+  };
+  struct Chunk {
+    char* rows;         // NULL once freed
+    Node* free_nodes;   // a list
+    size_t used;        // how many rows are acquired
+    uint32_t prev;      // in the list of chunks having free rows
+    uint32_t next;
+  };
+
+  size_t _row_bytes;   // bytes of one row, aligned to pointer size
+  size_t _chunk_size;  // how many rows in one chunk
+  std::vector<Chunk> _chunks;      // by id
+  std::vector<uint32_t> _free_ids;  // ids of the freed chunks
+  uint32_t _free_head;             // first chunk having free rows
+  size_t _chunk_num;               // chunks not freed
+  size_t _empty_num;               // chunks not freed without acquired rows
+  size_t _counter;                 // how many rows are acquired
+
+  void link(uint32_t id) {
+    Chunk& chunk = _chunks[id];
+    chunk.prev = NONE;
+    chunk.next = _free_head;
+    if (_free_head != NONE) {
+      _chunks[_free_head].prev = id;
+    }
+    _free_head = id;
+  }
+  void unlink(uint32_t id) {
+    Chunk& chunk = _chunks[id];
+    if (chunk.prev != NONE) {
+      _chunks[chunk.prev].next = chunk.next;
+    } else {
+      _free_head = chunk.next;
+    }
+    if (chunk.next != NONE) {
+      _chunks[chunk.next].prev = chunk.prev;
+    }
+  }
+  void create_new_chunk() {
+    char* rows = reinterpret_cast<char*>(malloc(_row_bytes * _chunk_size));
+    CHECK(rows != NULL);
+    uint32_t id;
+    if (_free_ids.empty()) {
+      CHECK(_chunks.size() < MAX_CHUNK_NUM);
+      id = _chunks.size();
+      _chunks.emplace_back();
+    } else {
+      id = _free_ids.back();
+      _free_ids.pop_back();
+    }
+    Chunk& chunk = _chunks[id];
+    chunk.rows = rows;
+    chunk.free_nodes = NULL;
+    chunk.used = 0;
+    // push in reverse order, so rows are handed out by ascending address
+    for (size_t i = _chunk_size; i > 0; i--) {
+      Node* node = reinterpret_cast<Node*>(rows + (i - 1) * _row_bytes);
+      node->next = chunk.free_nodes;
+      chunk.free_nodes = node;
+    }
+    link(id);
+    _chunk_num++;
+    _empty_num++;
+  }
+};
+
 }  // namespace distributed
 }  // namespace paddle
@@ -18,6 +18,9 @@
 #include <sstream>
 #include <string>
 
+#include "butil/object_pool.h"
+#include "paddle/fluid/distributed/ps/service/sparse_key_router.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_wire_codec.h"
 #include "paddle/fluid/framework/archive.h"
 
 static const int max_port = 65535;
@@ -56,6 +59,13 @@ DEFINE_int32(pserver_sparse_merge_thread, 1, "pserver sparse merge thread num");
 DEFINE_int32(pserver_sparse_table_shard_num, 1000,
              "sparse table shard for save & load");
 
+DEFINE_int32(pserver_sparse_push_wire_type, 0,
+             "type of the pushed sparse gradients, "
+             "fp32:0 fp16:1 bf16:2 int8:3, geo tables always push fp32");
+
+DEFINE_int32(pserver_sparse_pull_wire_type, 0,
+             "type of the pulled sparse values, fp32:0 fp16:1");
+
 namespace paddle {
 namespace framework {
 class Scope;
@@ -66,6 +76,21 @@ class Variable;
 namespace paddle {
 namespace distributed {
 
+inline int sparse_push_wire_type() {
+  CHECK(IsValidSparseWireType(FLAGS_pserver_sparse_push_wire_type))
+      << "invalid pserver_sparse_push_wire_type "
+      << FLAGS_pserver_sparse_push_wire_type;
+  return FLAGS_pserver_sparse_push_wire_type;
+}
+
+inline int sparse_pull_wire_type() {
+  CHECK(FLAGS_pserver_sparse_pull_wire_type == kSparseWireFp32 ||
+        FLAGS_pserver_sparse_pull_wire_type == kSparseWireFp16)
+      << "invalid pserver_sparse_pull_wire_type "
+      << FLAGS_pserver_sparse_pull_wire_type;
+  return FLAGS_pserver_sparse_pull_wire_type;
+}
+
 inline size_t get_sparse_shard(uint32_t shard_num, uint32_t server_num,
                                uint64_t key) {
   size_t remind = shard_num % server_num;
@@ -208,6 +233,12 @@ int32_t BrpcPsClient::Initialize() {
       _push_sparse_task_queue_map[table_id] =
           paddle::framework::MakeChannel<SparseAsyncTask *>();
       _push_sparse_merge_count_map[table_id] = 0;
+      // MemorySparseGeoTable only accepts fp32 pushes
+      _push_sparse_wire_type_map[table_id] =
+          worker_param.downpour_table_param(i).table_class() ==
+                  "MemorySparseGeoTable"
+              ? kSparseWireFp32
+              : sparse_push_wire_type();
     }
   }
 
@@ -244,6 +275,12 @@ int32_t BrpcPsClient::Initialize() {
   return 0;
 }
 
+uint32_t BrpcPsClient::SparsePushWireType(uint32_t table_id) {
+  auto itr = _push_sparse_wire_type_map.find(table_id);
+  return itr == _push_sparse_wire_type_map.end() ? sparse_push_wire_type()
+                                                 : itr->second;
+}
+
 int DownpourBrpcClosure::check_response(size_t request_idx, int cmd_id) {
   if (_cntls[request_idx]->Failed()) {
     LOG(ERROR) << "resquest cmd_id:" << cmd_id
@@ -404,16 +441,19 @@ std::future<int32_t> BrpcPsClient::SendSaveCmd(
 
 std::future<int32_t> BrpcPsClient::Shrink(uint32_t table_id,
                                           const std::string threshold) {
+  InvalidateSparsePullCache(table_id);
   return SendCmd(table_id, PS_SHRINK_TABLE, {threshold});
 }
 
 std::future<int32_t> BrpcPsClient::Load(const std::string &epoch,
                                         const std::string &mode) {
+  InvalidateSparsePullCache(-1);
   return SendCmd(-1, PS_LOAD_ALL_TABLE, {epoch, mode});
 }
 std::future<int32_t> BrpcPsClient::Load(uint32_t table_id,
                                         const std::string &epoch,
                                         const std::string &mode) {
+  InvalidateSparsePullCache(table_id);
   return SendCmd(table_id, PS_LOAD_ONE_TABLE, {epoch, mode});
 }
 
@@ -507,9 +547,11 @@ std::future<int32_t> BrpcPsClient::GetCacheThreshold(uint32_t table_id,
 }
 
 std::future<int32_t> BrpcPsClient::Clear() {
+  InvalidateSparsePullCache(-1);
   return SendCmd(-1, PS_CLEAR_ALL_TABLE, {});
 }
 std::future<int32_t> BrpcPsClient::Clear(uint32_t table_id) {
+  InvalidateSparsePullCache(table_id);
   return SendCmd(table_id, PS_CLEAR_ONE_TABLE, {});
 }
 
@@ -868,7 +910,10 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     auto value_ptr = value_ptrs[shard_idx];
 
     size_t kv_size = kvs.size();
-    uint32_t value_size = accessor->GetAccessorInfo().update_size;
+    uint32_t wire_type = SparsePushWireType(table_id);
+    size_t update_dim = accessor->GetAccessorInfo().update_dim;
+    size_t exact_dim = accessor->UpdateExactDim();
+    size_t value_size = SparseWireRowSize(wire_type, exact_dim, update_dim);
 
     // 发送RPC请求
     auto *push_request = closure->request(shard_idx);
@@ -876,6 +921,10 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     push_request->set_table_id(table_id);
     push_request->set_client_id(_client_id);
     push_request->add_params((char *)&kv_size, sizeof(uint32_t));  // NOLINT
+    if (wire_type != kSparseWireFp32) {
+      push_request->add_params((char *)&wire_type,  // NOLINT
+                               sizeof(uint32_t));
+    }
     auto *push_data = push_request->mutable_data();
     push_data->resize(kv_size * (sizeof(uint64_t) + value_size));
     char *push_data_ptr = const_cast<char *>(push_data->data());
@@ -883,7 +932,8 @@ std::future<int32_t> BrpcPsClient::PushSparseRawGradient(
     push_data_ptr += kv_size * sizeof(uint64_t);
 
     for (int i = 0; i < kv_size; ++i) {
-      memcpy(push_data_ptr, value_ptr[i], value_size);
+      SparseWireEncode(wire_type, exact_dim, update_dim, value_ptr[i],
+                       push_data_ptr);
       push_data_ptr += value_size;
     }
     PsService_Stub rpc_stub(GetSparseChannel(shard_idx));
@@ -963,9 +1013,9 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
       std::make_shared<CostTimer>("pserver_client_pull_sparse_local");
   size_t request_call_num = _server_channels.size();
 
-  auto shard_sorted_kvs = std::make_shared<
-      std::vector<std::vector<std::pair<uint64_t, float *>>>>();
-  shard_sorted_kvs->resize(request_call_num);
+  // the unique keys are pulled into the router, which scatters them back
+  auto *router = butil::get_object<SparseKeyRouter>();
+  router->Clear();
 
   const auto &server_param = _config.server_param().downpour_server_param();
   uint64_t shard_num = FLAGS_pserver_sparse_table_shard_num;
@@ -977,49 +1027,78 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
     }
   }
 
-  for (size_t i = 0; i < num; ++i) {
-    size_t shard_id = get_sparse_shard(shard_num, request_call_num, keys[i]);
-    shard_sorted_kvs->at(shard_id).push_back({keys[i], select_values[i]});
+  // only the keys missing in the cache are pulled from the servers
+  auto *cache = GetSparsePullCache(table_id);
+  uint64_t step = 0;
+  if (cache != NULL) {
+    step = cache->NextStep();
+    std::vector<size_t> miss_idx;
+    cache->Lookup(keys, num, select_values, step, &miss_idx);
+    for (auto i : miss_idx) {
+      router->Add(keys[i], select_values[i]);
+    }
+  } else {
+    for (size_t i = 0; i < num; ++i) {
+      router->Add(keys[i], select_values[i]);
+    }
   }
+  router->Route(request_call_num, [shard_num, request_call_num](uint64_t key) {
+    return get_sparse_shard(shard_num, request_call_num, key);
+  });
 
   auto *accessor = GetTableAccessor(table_id);
 
-  size_t value_size = accessor->GetAccessorInfo().select_size;
+  // values sent in a low precision are decoded into the routed values
+  uint32_t wire_type = sparse_pull_wire_type();
+  size_t select_dim = accessor->GetAccessorInfo().select_dim;
+  size_t exact_dim = accessor->SelectExactDim();
+  size_t wire_size = SparseWireRowSize(wire_type, exact_dim, select_dim);
+  float *routed_values = router->RoutedValues(select_dim);
 
   DownpourBrpcClosure *closure = new DownpourBrpcClosure(
-      request_call_num, [shard_sorted_kvs, value_size](void *done) {
+      request_call_num,
+      [router, routed_values, cache, step, wire_type, select_dim, exact_dim,
+       wire_size](void *done) {
         int ret = 0;
+        std::vector<char> wire_row(wire_size);
         auto *closure = reinterpret_cast<DownpourBrpcClosure *>(done);
-        for (size_t i = 0; i < shard_sorted_kvs->size(); ++i) {
+        const uint64_t *routed_keys = router->RoutedKeys();
+        for (size_t i = 0; i < router->ShardNum(); ++i) {
           if (closure->check_response(i, PS_PULL_SPARSE_TABLE) != 0) {
             ret = -1;
             break;
           }
 
-          auto &request_kvs = shard_sorted_kvs->at(i);
           auto &res_io_buffer = closure->cntl(i)->response_attachment();
           butil::IOBufBytesIterator io_buffer_itr(res_io_buffer);
-          uint64_t last_key = UINT64_MAX;
-          float *last_value_data = NULL;
-
-          for (size_t kv_idx = 0; kv_idx < request_kvs.size(); ++kv_idx) {
-            auto *kv_pair = &(request_kvs[kv_idx]);
-            if (kv_pair->first == last_key) {
-              memcpy(reinterpret_cast<void *>(kv_pair->second),
-                     reinterpret_cast<void *>(last_value_data), value_size);
-            } else {
-              last_key = kv_pair->first;
-              last_value_data = kv_pair->second;
-              if (value_size !=
-                  io_buffer_itr.copy_and_forward(
-                      reinterpret_cast<void *>(last_value_data), value_size)) {
-                LOG(WARNING) << "res data is lack or not in format";
-                ret = -1;
-                break;
-              }
+          size_t begin = router->ShardBegin(i);
+          size_t end = begin + router->ShardSize(i);
+          for (size_t pos = begin; pos < end; ++pos) {
+            float *value_data = routed_values + pos * select_dim;
+            void *dst = wire_type == kSparseWireFp32
+                            ? reinterpret_cast<void *>(value_data)
+                            : reinterpret_cast<void *>(wire_row.data());
+            if (wire_size != io_buffer_itr.copy_and_forward(dst, wire_size)) {
+              LOG(WARNING) << "res data is lack or not in format";
+              ret = -1;
+              break;
+            }
+            if (wire_type != kSparseWireFp32) {
+              SparseWireDecode(wire_type, exact_dim, select_dim,
+                               wire_row.data(), value_data);
+            }
+            if (cache != NULL) {
+              cache->Put(routed_keys[pos], value_data, step);
             }
           }
+          if (ret != 0) {
+            break;
+          }
         }
+        if (ret == 0) {
+          router->Scatter(select_dim);
+        }
+        butil::return_object(router);
         closure->set_promise_value(ret);
       });
   closure->add_timer(timer);
@@ -1028,38 +1107,15 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
   std::future<int> fut = promise->get_future();
 
   for (size_t i = 0; i < request_call_num; ++i) {
-    auto &sorted_kvs = shard_sorted_kvs->at(i);
-    std::sort(sorted_kvs.begin(), sorted_kvs.end(),
-              [](const std::pair<uint64_t, float *> &k1,
-                 const std::pair<uint64_t, float *> &k2) {
-                return k1.first < k2.first;
-              });
-
-    uint64_t last_key = UINT64_MAX;
-    uint32_t kv_request_count = 0;
-    size_t sorted_kv_size = sorted_kvs.size();
+    uint32_t kv_request_count = router->ShardSize(i);
+    size_t begin = router->ShardBegin(i);
     auto &request_buffer = closure->cntl(i)->request_attachment();
 
     request_buffer.append(reinterpret_cast<void *>(&is_training), sizeof(bool));
-    std::vector<uint32_t> keys_counter;
-    keys_counter.reserve(sorted_kv_size);
-
-    for (size_t kv_idx = 0; kv_idx < sorted_kv_size; ++kv_idx) {
-      ++kv_request_count;
-      uint32_t keys = 1;
-      last_key = sorted_kvs[kv_idx].first;
-      request_buffer.append(reinterpret_cast<void *>(&last_key),
-                            sizeof(uint64_t));
-      while (kv_idx < sorted_kv_size - 1 &&
-             last_key == sorted_kvs[kv_idx + 1].first) {
-        ++kv_idx;
-        ++keys;
-      }
-      keys_counter.push_back(keys);
-    }
-
-    request_buffer.append(reinterpret_cast<void *>(keys_counter.data()),
-                          sizeof(uint32_t) * keys_counter.size());
+    request_buffer.append(router->RoutedKeys() + begin,
+                          sizeof(uint64_t) * kv_request_count);
+    request_buffer.append(router->RoutedCounts() + begin,
+                          sizeof(uint32_t) * kv_request_count);
 
     if (kv_request_count == 0) {
       closure->Run();
@@ -1069,6 +1125,10 @@ std::future<int32_t> BrpcPsClient::PullSparse(float **select_values,
       closure->request(i)->set_client_id(_client_id);
       closure->request(i)->add_params((char *)&kv_request_count,  // NOLINT
                                       sizeof(uint32_t));
+      if (wire_type != kSparseWireFp32) {
+        closure->request(i)->add_params((char *)&wire_type,  // NOLINT
+                                        sizeof(uint32_t));
+      }
       PsService_Stub rpc_stub(GetCmdChannel(i));
       closure->cntl(i)->set_log_id(butil::gettimeofday_ms());
       rpc_stub.service(closure->cntl(i), closure->request(i),
@@ -1293,6 +1353,8 @@ int32_t BrpcPsClient::RecvAndSaveTable(const uint64_t table_id,
                         save_key.data(), save_key.size(), true);
     status.wait();
   } else {
+    // save the latest values rather than the cached ones
+    InvalidateSparsePullCache(table_id);
     auto status = PullSparse(reinterpret_cast<float **>(save_vec.data()),
                              table_id, save_key.data(), save_key.size(), true);
     status.wait();
@@ -1647,8 +1709,15 @@ int BrpcPsClient::PushSparseAsyncShardPush(
   push_request->set_client_id(_client_id);
   push_request->add_params(reinterpret_cast<char *>(&merged_kv_count),
                            sizeof(uint32_t));  // NOLINT
+  uint32_t wire_type = SparsePushWireType(table_id);
+  if (wire_type != kSparseWireFp32) {
+    push_request->add_params(reinterpret_cast<char *>(&wire_type),
+                             sizeof(uint32_t));
+  }
   auto *push_data = push_request->mutable_data();
-  int update_size = accessor->GetAccessorInfo().update_size;
+  size_t update_dim = accessor->GetAccessorInfo().update_dim;
+  size_t exact_dim = accessor->UpdateExactDim();
+  size_t update_size = SparseWireRowSize(wire_type, exact_dim, update_dim);
   push_data->resize(merged_kv_count * (sizeof(uint64_t) + update_size));
   char *push_data_ptr = const_cast<char *>(push_data->data());
   memcpy(push_data_ptr, merged_key_list.data(),
@@ -1657,8 +1726,9 @@ int BrpcPsClient::PushSparseAsyncShardPush(
   for (int i = 0; i < merged_kv_count; ++i) {
     const char *task_data_ptr = merged_value_list[i].data();
 
-    memcpy(push_data_ptr, (float *)(task_data_ptr),  // NOLINT
-           update_size);
+    SparseWireEncode(wire_type, exact_dim, update_dim,
+                     reinterpret_cast<const float *>(task_data_ptr),
+                     push_data_ptr);
     push_data_ptr += update_size;
   }
   PsService_Stub rpc_stub(GetSparseChannel(shard_idx));
@@ -277,6 +277,10 @@ class BrpcPsClient : public PSClient {
   std::unordered_map<uint32_t, paddle::framework::Channel<SparseAsyncTask *>>
       _push_sparse_task_queue_map;
   std::unordered_map<uint32_t, uint32_t> _push_sparse_merge_count_map;
+  // wire type of the pushed sparse gradients of each table, see
+  // pserver_sparse_push_wire_type
+  std::unordered_map<uint32_t, uint32_t> _push_sparse_wire_type_map;
+  uint32_t SparsePushWireType(uint32_t table_id);
 
   std::thread _print_thread;
 
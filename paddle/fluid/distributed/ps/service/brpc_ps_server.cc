@@ -19,6 +19,7 @@
 #include "butil/object_pool.h"
 #include "paddle/fluid/distributed/common/cost_timer.h"
 #include "paddle/fluid/distributed/ps/table/depends/sparse_utils.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_wire_codec.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
 #include "paddle/fluid/framework/archive.h"
 #include "paddle/fluid/platform/profiler.h"
@@ -507,6 +508,15 @@ int32_t BrpcPsService::PullSparse(Table *table, const PsRequestMessage &request,
   CostTimer timer("pserver_server_pull_sparse");
   uint32_t num = *(uint32_t *)(request.params(0).c_str());
   auto dim = table->ValueAccesor()->GetAccessorInfo().select_dim;
+  // the optional params(1) is the SparseWireType of the response values
+  uint32_t wire_type = kSparseWireFp32;
+  if (request.params_size() > 1) {
+    wire_type = *(uint32_t *)(request.params(1).c_str());
+    if (!IsValidSparseWireType(wire_type)) {
+      set_response_code(response, -1, "invalid sparse wire type");
+      return 0;
+    }
+  }
 
   thread_local std::string req_buffer;
   req_buffer.reserve(req_buffer_size);
@@ -527,8 +537,21 @@ int32_t BrpcPsService::PullSparse(Table *table, const PsRequestMessage &request,
   table->Pull(table_context);
   // table->PullSparse(res_data->data(), value);
 
-  cntl->response_attachment().append((char *)(res_data->data()),
-                                     res_data->size() * sizeof(float));
+  if (wire_type == kSparseWireFp32) {
+    cntl->response_attachment().append((char *)(res_data->data()),
+                                       res_data->size() * sizeof(float));
+  } else {
+    size_t exact_dim = table->ValueAccesor()->SelectExactDim();
+    size_t row_size = SparseWireRowSize(wire_type, exact_dim, dim);
+    thread_local std::string wire_buffer;
+    wire_buffer.resize(num * row_size);
+    for (uint32_t i = 0; i < num; ++i) {
+      SparseWireEncode(wire_type, exact_dim, dim, res_data->data() + i * dim,
+                       &wire_buffer[i * row_size]);
+    }
+    cntl->response_attachment().append(wire_buffer.data(),
+                                       wire_buffer.size());
+  }
   butil::return_object(res_data);
   return 0;
 }
@@ -556,12 +579,40 @@ int32_t BrpcPsService::PushSparse(Table *table, const PsRequestMessage &request,
   Push Content:
   |---keysData---|---valuesData---|
   |---8*{num}B---|----------------|
+  the optional params(1) is the SparseWireType of the values
   */
   TableContext table_context;
   table_context.value_type = Sparse;
   table_context.push_context.keys = (const uint64_t *)push_data.data();
-  table_context.push_context.values =
-      (const float *)(push_data.data() + sizeof(uint64_t) * num);
+  uint32_t wire_type = kSparseWireFp32;
+  if (request.params_size() > 1) {
+    wire_type = *(uint32_t *)(request.params(1).c_str());
+    if (!IsValidSparseWireType(wire_type)) {
+      set_response_code(response, -1, "invalid sparse wire type");
+      return 0;
+    }
+  }
+  if (wire_type == kSparseWireFp32) {
+    table_context.push_context.values =
+        (const float *)(push_data.data() + sizeof(uint64_t) * num);
+  } else {
+    // the table decodes num rows of the wire size, a short request would
+    // be read past its end
+    auto info = table->ValueAccesor()->GetAccessorInfo();
+    size_t row_size = SparseWireRowSize(
+        wire_type, table->ValueAccesor()->UpdateExactDim(),
+        info.update_size / sizeof(float));
+    if (push_data.size() !=
+        static_cast<size_t>(num) * (sizeof(uint64_t) + row_size)) {
+      set_response_code(response, -1,
+                        "push sparse data size does not match the num of "
+                        "sparse_key and the sparse wire type");
+      return 0;
+    }
+    table_context.push_context.wire_values =
+        push_data.data() + sizeof(uint64_t) * num;
+    table_context.push_context.wire_type = wire_type;
+  }
   table_context.num = num;
   // const uint64_t *keys = (const uint64_t *)push_data.data();
   // const float *values = (const float *)(push_data.data() + sizeof(uint64_t) *
@@ -16,6 +16,8 @@ limitations under the License. */
 
 #include <google/protobuf/text_format.h>
 
+#include <cmath>
+
 #include "gflags/gflags.h"
 #include "paddle/fluid/distributed/ps/service/brpc_ps_client.h"
 #include "paddle/fluid/distributed/ps/wrapper/fleet.h"
@@ -25,6 +27,20 @@ limitations under the License. */
 #define LEARNING_RATE_DECAY_COUNTER "@LR_DECAY_COUNTER@"
 #define STEP_COUNTER "@PS_STEP_COUNTER@"
 
+DEFINE_bool(communicator_adaptive_send, false,
+            "size the merges of the async communicator from the queue depth "
+            "and the send latency, and send every table on its own");
+DEFINE_double(communicator_geo_sparse_topk_ratio, 1.0,
+              "fraction of the touched rows of a sparse table a geo trainer "
+              "sends per round, those of the largest delta, the others stay "
+              "local and are sent in a later round");
+DEFINE_double(communicator_geo_sparse_threshold, 0.0,
+              "sparse rows whose geo delta L2 norm is below it stay local "
+              "until the delta grows");
+DEFINE_int32(communicator_geo_sparse_max_hold_rounds, 10,
+             "a sparse row held back by the geo top-k or threshold for this "
+             "many rounds is sent in the next round whatever its delta");
+
 namespace paddle {
 namespace distributed {
 
@@ -473,77 +489,154 @@ void AsyncCommunicator::RecvNoBarrier() {
 }
 
 void AsyncCommunicator::SendByCommunicator() {
-  std::vector<std::future<void>> tasks;
-  tasks.reserve(send_varname_to_ctx_.size());
+  if (!FLAGS_communicator_adaptive_send) {
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(send_varname_to_ctx_.size());
+    for (auto &iter : send_varname_to_ctx_) {
+      auto &ctx = iter.second;
+      auto send_recv_task = [this, &ctx] {
+        double send_ms = 0;
+        MergeAndSend(ctx, max_merge_var_num_, send_wait_times_ * 10, 10,
+                     &send_ms);
+      };
+      tasks.emplace_back(send_threadpool_->enqueue(std::move(send_recv_task)));
+    }
+    for (auto &task : tasks) {
+      task.wait();
+    }
+    return;
+  }
 
+  // every context sends on its own, so a slow table does not hold the
+  // others, a context starts its next round once the last one is done
+  bool started = false;
   for (auto &iter : send_varname_to_ctx_) {
+    auto &task = send_tasks_[iter.first];
+    if (task.valid() && task.wait_for(std::chrono::seconds(0)) !=
+                            std::future_status::ready) {
+      continue;
+    }
     auto &ctx = iter.second;
+    auto &check_queue = send_varname_to_queue_[ctx.origin_varnames[0]];
+    if (check_queue->Size() == 0) continue;
+    auto *policy = &merge_policies_.at(iter.first);
+    auto send_recv_task = [this, &ctx, &check_queue, policy] {
+      double start_us = GetCurrentUS();
+      double send_ms = 0;
+      int merge_num = policy->MergeNum(check_queue->Size());
+      int wait_ms = policy->WaitMs();
+      // the wait follows the send latency and can be a few ms, a 10ms
+      // poll would overshoot it
+      int wait_step_ms = std::max(1, std::min(10, wait_ms / 4));
+      int merged =
+          MergeAndSend(ctx, merge_num, wait_ms, wait_step_ms, &send_ms);
+      policy->Update(start_us, merged, send_ms);
+    };
+    task = send_threadpool_->enqueue(std::move(send_recv_task));
+    started = true;
+  }
+  if (!started) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
 
-    auto send_recv_task = [this, &ctx] {
-      auto &varnames = ctx.origin_varnames;
-      auto &table_id = ctx.table_id;
-      size_t var_nums = varnames.size();
-      auto &check_queue = send_varname_to_queue_[varnames[0]];
-      std::vector<std::vector<std::shared_ptr<Variable>>> vars;
-      vars.resize(var_nums);
-      int merged_var_num = 0;
-      int wait_times = 0;
-      while (merged_var_num < max_merge_var_num_) {
-        if (check_queue->Size() == 0) {
-          VLOG(4) << "wait_times -> " << wait_times;
-          if (wait_times >= send_wait_times_) {
-            break;
-          }
-          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-          wait_times++;
-          continue;
-        } else {
-          wait_times = 0;
-          for (size_t i = 0; i < var_nums; i++) {
-            auto &var_name = varnames[i];
-            auto &var_queue = send_varname_to_queue_[var_name];
-            vars[i].push_back(var_queue->Pop());
-          }
-          merged_var_num++;
-        }
+int AsyncCommunicator::MergeAndSend(const CommContext &ctx, int merge_num,
+                                    int wait_ms, int wait_step_ms,
+                                    double *send_ms) {
+  auto &varnames = ctx.origin_varnames;
+  auto &table_id = ctx.table_id;
+  size_t var_nums = varnames.size();
+  auto &check_queue = send_varname_to_queue_[varnames[0]];
+  std::vector<std::vector<std::shared_ptr<Variable>>> vars;
+  vars.resize(var_nums);
+  int merged_var_num = 0;
+  int waited_ms = 0;
+  while (merged_var_num < merge_num) {
+    if (check_queue->Size() == 0) {
+      VLOG(4) << "waited_ms -> " << waited_ms;
+      if (waited_ms >= wait_ms) {
+        break;
       }
-      if (merged_var_num == 0) return;
-
+      std::this_thread::sleep_for(std::chrono::milliseconds(wait_step_ms));
+      waited_ms += wait_step_ms;
+      continue;
+    } else {
+      waited_ms = 0;
       for (size_t i = 0; i < var_nums; i++) {
         auto &var_name = varnames[i];
-        if (var_name == STEP_COUNTER) {
-          MergeVars<int64_t>(var_name, vars[i], send_scope_.get(), 1);
-        } else {
-          MergeVars<float>(var_name, vars[i], send_scope_.get(), 1);
-        }
+        auto &var_queue = send_varname_to_queue_[var_name];
+        vars[i].push_back(var_queue->Pop());
       }
+      merged_var_num++;
+    }
+  }
+  if (merged_var_num == 0) return 0;
 
-      if (ctx.is_tensor_table) {
-        SendGlobalStep(ctx, merged_var_num, send_scope_.get());
-      } else if (ctx.is_sparse) {
-        PADDLE_ENFORCE_EQ(
-            varnames.size(), 1,
-            platform::errors::InvalidArgument(
-                "sparse variables can only be merged by one variables"));
-        RpcSendSparse(varnames[0], table_id, *send_scope_);
-      } else {
-        RpcSendDense(ctx, *send_scope_);
-        if (!independent_recv_ &&
-            recv_varname_to_ctx_.find(table_id) != recv_varname_to_ctx_.end()) {
-          auto recv_varnames = recv_varname_to_ctx_.at(table_id);
-          RpcRecvDense(recv_varnames, table_id, recv_scope_);
-        }
-      }
-      if (independent_recv_) {
-        grad_num_.fetch_add(1, std::memory_order_relaxed);
-      }
-    };
-    tasks.emplace_back(send_threadpool_->enqueue(std::move(send_recv_task)));
+  for (size_t i = 0; i < var_nums; i++) {
+    auto &var_name = varnames[i];
+    if (var_name == STEP_COUNTER) {
+      MergeVars<int64_t>(var_name, vars[i], send_scope_.get(), 1);
+    } else {
+      MergeVars<float>(var_name, vars[i], send_scope_.get(), 1);
+    }
   }
-  for (auto &task : tasks) {
-    task.wait();
+
+  double send_start_us = GetCurrentUS();
+  if (ctx.is_tensor_table) {
+    SendGlobalStep(ctx, merged_var_num, send_scope_.get());
+  } else if (ctx.is_sparse) {
+    PADDLE_ENFORCE_EQ(
+        varnames.size(), 1,
+        platform::errors::InvalidArgument(
+            "sparse variables can only be merged by one variables"));
+    RpcSendSparse(varnames[0], table_id, *send_scope_);
+  } else {
+    RpcSendDense(ctx, *send_scope_);
+    if (!independent_recv_ &&
+        recv_varname_to_ctx_.find(table_id) != recv_varname_to_ctx_.end()) {
+      auto recv_varnames = recv_varname_to_ctx_.at(table_id);
+      RpcRecvDense(recv_varnames, table_id, recv_scope_);
+    }
   }
-  return;
+  *send_ms = (GetCurrentUS() - send_start_us) / 1000;
+  if (independent_recv_) {
+    grad_num_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return merged_var_num;
+}
+
+int AdaptiveMergePolicy::MergeNum(size_t queue_size) const {
+  if (arrival_per_ms_ < 0 || send_ms_ < 0) {
+    return max_merge_num_;
+  }
+  double expected = std::ceil(arrival_per_ms_ * send_ms_);
+  double merge_num = std::max(static_cast<double>(queue_size), expected);
+  return static_cast<int>(
+      std::min(std::max(merge_num, 1.0), static_cast<double>(max_merge_num_)));
+}
+
+int AdaptiveMergePolicy::WaitMs() const {
+  if (send_ms_ < 0) {
+    return max_wait_ms_;
+  }
+  return std::min(max_wait_ms_, static_cast<int>(std::ceil(send_ms_)) + 1);
+}
+
+void AdaptiveMergePolicy::Update(double start_us, int merge_num,
+                                 double send_ms) {
+  // weight of the newest measure in the moving averages
+  const double alpha = 0.2;
+  if (merge_num > 0) {
+    send_ms_ =
+        send_ms_ < 0 ? send_ms : (1 - alpha) * send_ms_ + alpha * send_ms;
+  }
+  if (last_start_us_ >= 0 && start_us > last_start_us_) {
+    double rate = merge_num / ((start_us - last_start_us_) / 1000);
+    arrival_per_ms_ = arrival_per_ms_ < 0
+                          ? rate
+                          : (1 - alpha) * arrival_per_ms_ + alpha * rate;
+  }
+  last_start_us_ = start_us;
 }
 
 void AsyncCommunicator::PushDensePostProcessing() {
@@ -565,6 +658,11 @@ void AsyncCommunicator::MainThread() {
     SendByCommunicator();
     RpcProfilerControl();
   }
+  for (auto &iter : send_tasks_) {
+    if (iter.second.valid()) {
+      iter.second.wait();
+    }
+  }
   VLOG(1) << "communicator stopped, send thread exit";
 }
 
@@ -572,6 +670,8 @@ void AsyncCommunicator::PullSparseToTensorSync(
     const uint64_t table_id, int fea_dim, uint64_t padding_id,
     platform::Place place, bool is_training,
     std::vector<const LoDTensor *> *inputs, std::vector<LoDTensor *> *outputs) {
+  // repeated keys are merged by the client, which pulls every key once
+  // and copies its value to all the outputs of the key
   std::vector<uint64_t> fea_keys;
   std::vector<float *> pull_result_ptr;
   fea_keys.reserve(MAX_FEASIGN_NUM / 100);
@@ -779,6 +879,9 @@ void AsyncCommunicator::InitImpl(const RpcCtxMap &send_varname_to_ctx,
           std::make_shared<BlockingQueue<std::shared_ptr<Variable>>>(
               send_queue_size_);
     }
+    merge_policies_.emplace(
+        iter.first,
+        AdaptiveMergePolicy(max_merge_var_num_, send_wait_times_ * 10));
   }
   send_threadpool_.reset(new ::ThreadPool(thread_pool_size_));
 }
@@ -1055,6 +1158,7 @@ void GeoCommunicator::InitImpl(const RpcCtxMap &send_varname_to_ctx,
             "sparse variables can only be merged by one variables"));
     for (auto &splited_var : ctx.splited_varnames) {
       parallel_task_nums_ += 1;
+      geo_residual_ids_[splited_var];
       sparse_id_queues_.insert(
           std::pair<std::string, paddle::framework::Channel<
                                      std::shared_ptr<std::vector<int64_t>>>>(
@@ -1263,10 +1367,24 @@ std::vector<int64_t> GeoCommunicator::MergeSparseIds(
 
 void GeoCommunicator::SendSparse(const std::string &varname,
                                  std::vector<int64_t> &sparse_ids, int table_id,
-                                 int ep_idx) {
+                                 int ep_idx, bool send_all) {
   platform::RecordEvent record_event("GeoCommunicator->SendSparse",
                                      platform::TracerEventType::Communication,
                                      1);
+  auto &residual_ids = geo_residual_ids_.at(varname);
+  // the rounds the ids of this send have been held back
+  std::unordered_map<int64_t, int> held_rounds;
+  held_rounds.swap(residual_ids);
+  if (!held_rounds.empty()) {
+    for (auto id : sparse_ids) {
+      held_rounds.emplace(id, 0);
+    }
+    sparse_ids.clear();
+    sparse_ids.reserve(held_rounds.size());
+    for (auto &held : held_rounds) {
+      sparse_ids.push_back(held.first);
+    }
+  }
   if (sparse_ids.size() == 0) {
     return;
   }
@@ -1297,18 +1415,62 @@ void GeoCommunicator::SendSparse(const std::string &varname,
   var_t_value->Resize({static_cast<int64_t>(sparse_ids.size()), dims1});
   auto *t_value = var_t_value->mutable_data<float>(cpu_ctx.GetPlace());
 
-  t_delta->set_rows(sparse_ids);
-  t_delta->set_height(t_latest.dims()[0]);
-
   auto blas = phi::funcs::GetBlas<platform::CPUDeviceContext, float>(cpu_ctx);
   float coefficient = 1.0 / static_cast<float>(trainers_);
 
-  std::vector<float *> push_g_vec;
   for (auto j = 0; j < static_cast<int>(sparse_ids.size()); ++j) {
     blas.VSUB(dims1, t_latest.data<float>() + sparse_ids[j] * dims1,
               t_old->data<float>() + sparse_ids[j] * dims1,
               t_value + j * dims1);
     blas.SCAL(dims1, coefficient, t_value + j * dims1);
+  }
+
+  // the rows kept back leave old as it is, so their delta stays in
+  // latest - old and adds up until they are sent
+  if (!send_all && (FLAGS_communicator_geo_sparse_topk_ratio < 1.0 ||
+                    FLAGS_communicator_geo_sparse_threshold > 0)) {
+    std::vector<size_t> kept;
+    SelectGeoDeltaRows(t_value, sparse_ids.size(), dims1,
+                       FLAGS_communicator_geo_sparse_topk_ratio,
+                       FLAGS_communicator_geo_sparse_threshold, &kept);
+    size_t next = 0;
+    size_t sent = 0;
+    for (size_t j = 0; j < sparse_ids.size(); ++j) {
+      bool send = next < kept.size() && kept[next] == j;
+      if (send) {
+        ++next;
+      } else {
+        // a row held back too long is sent, so the held rows stay bounded
+        auto held = held_rounds.find(sparse_ids[j]);
+        int rounds = held == held_rounds.end() ? 0 : held->second;
+        if (rounds >= FLAGS_communicator_geo_sparse_max_hold_rounds) {
+          send = true;
+        } else {
+          residual_ids[sparse_ids[j]] = rounds + 1;
+        }
+      }
+      if (send) {
+        if (sent != j) {
+          sparse_ids[sent] = sparse_ids[j];
+          std::copy_n(t_value + j * dims1, dims1, t_value + sent * dims1);
+        }
+        ++sent;
+      }
+    }
+    VLOG(1) << "GeoCommunicator::SendSparse " << varname << " sends " << sent
+            << " of " << sparse_ids.size() << " rows";
+    sparse_ids.resize(sent);
+    var_t_value->Resize({static_cast<int64_t>(sparse_ids.size()), dims1});
+    if (sparse_ids.empty()) {
+      return;
+    }
+  }
+
+  t_delta->set_rows(sparse_ids);
+  t_delta->set_height(t_latest.dims()[0]);
+
+  std::vector<float *> push_g_vec;
+  for (auto j = 0; j < static_cast<int>(sparse_ids.size()); ++j) {
     blas.VADD(dims1, t_old->data<float>() + sparse_ids[j] * dims1,
               t_value + j * dims1,
               t_old->data<float>() + sparse_ids[j] * dims1);
@@ -1387,6 +1549,29 @@ void GeoCommunicator::RecvSparse(const std::string &varname, int table_id,
   VLOG(1) << "Finish Recv Sparse " << param << ", table_id: " << table_id;
 }
 
+void GeoCommunicator::SendSparseResidual() {
+  for (auto &iter : send_varname_to_ctx_) {
+    auto &ctx = iter.second;
+    if (!ctx.is_sparse) {
+      continue;
+    }
+    for (size_t ep_idx = 0; ep_idx < ctx.splited_varnames.size(); ep_idx++) {
+      auto &splited_varname = ctx.splited_varnames[ep_idx];
+      if (geo_residual_ids_.at(splited_varname).empty()) {
+        continue;
+      }
+      std::vector<int64_t> sparse_ids;
+      SendSparse(splited_varname, sparse_ids, ctx.table_id, ep_idx, true);
+    }
+  }
+}
+
+void GeoCommunicator::Stop() {
+  AsyncCommunicator::Stop();
+  // the main thread is joined, the held back rows are sent in a last round
+  SendSparseResidual();
+}
+
 void GeoCommunicator::MainThread() {
   VLOG(3) << "MainThread start and wait";
 
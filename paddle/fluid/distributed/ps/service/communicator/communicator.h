@@ -17,8 +17,11 @@ limitations under the License. */
 #include <ThreadPool.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
+#include <future>  // NOLINT
 #include <map>
 #include <memory>
 #include <numeric>
@@ -52,6 +55,7 @@ struct CommContext;
 }  // namespace paddle
 
 DECLARE_bool(communicator_is_sgd_optimizer);
+DECLARE_bool(communicator_adaptive_send);
 
 namespace paddle {
 namespace distributed {
@@ -153,6 +157,99 @@ template <typename T, int MajorType = Eigen::RowMajor,
           typename IndexType = Eigen::DenseIndex>
 using EigenVector = framework::EigenVector<T, MajorType, IndexType>;
 
+// Sums the rows of the inputs into out in one pass over them. A hash map
+// gives every distinct row its place in out, in the order the rows first
+// show up, and the values of a row are added in place.
+template <typename T>
+inline void MergeSparseAdd(
+    const std::vector<const phi::SelectedRows *> &inputs,
+    phi::SelectedRows *out) {
+  int64_t width = -1;
+  size_t row_num = 0;
+  for (auto *input : inputs) {
+    if (input->rows().empty()) continue;
+    if (width < 0) {
+      width = input->value().dims()[1];
+      out->set_height(input->height());
+    }
+    PADDLE_ENFORCE_EQ(width, input->value().dims()[1],
+                      platform::errors::InvalidArgument(
+                          "All inputs should have same dimension."));
+    PADDLE_ENFORCE_EQ(out->height(), input->height(),
+                      platform::errors::InvalidArgument(
+                          "All inputs should have same height."));
+    row_num += input->rows().size();
+  }
+  if (width < 0) return;
+
+  auto *out_rows = out->mutable_rows();
+  out_rows->clear();
+  out_rows->reserve(row_num);
+  auto *out_value = out->mutable_value();
+  T *out_data = out_value->mutable_data<T>(
+      phi::make_ddim({static_cast<int64_t>(row_num), width}),
+      platform::CPUPlace());
+  std::unordered_map<int64_t, size_t> row_to_pos;
+  row_to_pos.reserve(row_num);
+  for (auto *input : inputs) {
+    auto &rows = input->rows();
+    if (rows.empty()) continue;
+    const T *in_data = input->value().data<T>();
+    for (size_t i = 0; i < rows.size(); i++) {
+      const T *src = in_data + i * width;
+      auto iter = row_to_pos.emplace(rows[i], out_rows->size());
+      T *dst = out_data + iter.first->second * width;
+      if (iter.second) {
+        out_rows->push_back(rows[i]);
+        std::copy(src, src + width, dst);
+      } else {
+        for (int64_t j = 0; j < width; j++) {
+          dst[j] += src[j];
+        }
+      }
+    }
+  }
+  // the allocation for row_num rows holds the distinct ones
+  out_value->Resize(
+      phi::make_ddim({static_cast<int64_t>(out_rows->size()), width}));
+}
+
+// Picks the rows of a geo delta worth sending, rows of row_num * dim
+// floats. Rows whose L2 norm is below threshold are left out, and of the
+// others only the ceil(topk_ratio * row_num) of the largest norm are kept.
+// kept gets the positions of the rows, ascending.
+inline void SelectGeoDeltaRows(const float *deltas, size_t row_num,
+                               int64_t dim, double topk_ratio,
+                               double threshold, std::vector<size_t> *kept) {
+  kept->clear();
+  std::vector<std::pair<float, size_t>> norms;
+  norms.reserve(row_num);
+  for (size_t i = 0; i < row_num; i++) {
+    const float *row = deltas + i * dim;
+    float norm = 0;
+    for (int64_t j = 0; j < dim; j++) {
+      norm += row[j] * row[j];
+    }
+    norm = std::sqrt(norm);
+    if (norm >= threshold) {
+      norms.emplace_back(norm, i);
+    }
+  }
+  size_t topk = static_cast<size_t>(std::ceil(topk_ratio * row_num));
+  if (topk < norms.size()) {
+    std::nth_element(
+        norms.begin(), norms.begin() + topk, norms.end(),
+        [](const std::pair<float, size_t> &a,
+           const std::pair<float, size_t> &b) { return a.first > b.first; });
+    norms.resize(topk);
+  }
+  kept->reserve(norms.size());
+  for (auto &norm : norms) {
+    kept->push_back(norm.second);
+  }
+  std::sort(kept->begin(), kept->end());
+}
+
 template <typename T>
 inline void MergeVars(const std::string &var_name,
                       const std::vector<std::shared_ptr<Variable>> &vars,
@@ -207,10 +304,7 @@ inline void MergeVars(const std::string &var_name,
     }
     paddle::platform::CPUDeviceContext dev_ctx;
     if (merge_add) {
-      paddle::operators::math::scatter::MergeAdd<
-          paddle::platform::CPUDeviceContext, T>
-          merge_add;
-      merge_add(dev_ctx, inputs, out_slr);
+      MergeSparseAdd<T>(inputs, out_slr);
     } else {
       paddle::operators::math::scatter::MergeAverage<
           paddle::platform::CPUDeviceContext, T>
@@ -226,6 +320,32 @@ inline void MergeVars(const std::string &var_name,
   }
 }
 
+// Sizes the merges of one send context from its load. Moving averages of
+// the rate the gradients arrive at and of the send latency tell how many
+// gradients arrive while one send is in flight. A merge takes that many,
+// or the whole backlog when the queue is deeper, within [1, max_merge_num],
+// and does not wait for the next gradient longer than a send takes.
+class AdaptiveMergePolicy {
+ public:
+  AdaptiveMergePolicy(int max_merge_num, int max_wait_ms)
+      : max_merge_num_(std::max(max_merge_num, 1)),
+        max_wait_ms_(std::max(max_wait_ms, 0)) {}
+
+  int MergeNum(size_t queue_size) const;
+  int WaitMs() const;
+  // a round started at start_us merged merge_num gradients and spent
+  // send_ms in the send
+  void Update(double start_us, int merge_num, double send_ms);
+
+ private:
+  int max_merge_num_;
+  int max_wait_ms_;
+  double last_start_us_ = -1;
+  // moving averages, negative until measured
+  double arrival_per_ms_ = -1;
+  double send_ms_ = -1;
+};
+
 using RpcCtxMap = std::unordered_map<std::string, CommContext>;
 using RecvCtxMap = std::unordered_map<uint64_t, std::vector<std::string>>;
 using SparseValue = std::unordered_map<int64_t, std::vector<float>>;
@@ -441,6 +561,12 @@ class AsyncCommunicator : public Communicator {
 
   virtual void SendByCommunicator();
 
+  // pops up to merge_num gradients of a context, polling the queue every
+  // wait_step_ms for at most wait_ms for every next one, merges and sends
+  // them, returns the number merged
+  int MergeAndSend(const CommContext &ctx, int merge_num, int wait_ms,
+                   int wait_step_ms, double *send_ms);
+
   virtual void RecvByCommunicator();
 
   virtual void RecvNoBarrier();
@@ -472,6 +598,10 @@ class AsyncCommunicator : public Communicator {
                      std::shared_ptr<BlockingQueue<std::shared_ptr<Variable>>>>
       send_varname_to_queue_;
   std::unique_ptr<::ThreadPool> send_threadpool_{nullptr};
+  // with FLAGS_communicator_adaptive_send, the send in flight and the merge
+  // policy of every context
+  std::unordered_map<std::string, std::future<void>> send_tasks_;
+  std::unordered_map<std::string, AdaptiveMergePolicy> merge_policies_;
 
   int min_send_grad_num_before_recv_;
   int thread_pool_size_;
@@ -583,13 +713,19 @@ class GeoCommunicator : public AsyncCommunicator {
   void RecvDense(const CommContext &send_ctx);
 
   std::vector<int64_t> MergeSparseIds(const std::string &varname);
+  // send_all sends every row, the held back ones too, without the top-k or
+  // threshold selection
   void SendSparse(const std::string &varname,
                   std::vector<int64_t> &sparse_ids,  // NOLINT
-                  int table_id, int ep_idx);
+                  int table_id, int ep_idx, bool send_all = false);
   void RecvSparse(const std::string &varname, int table_id, int ep_idx);
+  // send the sparse rows still held back, so no delta is lost at the end
+  void SendSparseResidual();
 
   void MainThread() override;
 
+  void Stop() override;
+
   void InitEnvs() {
     independent_recv_ = false;
     min_send_grad_num_before_recv_ = 0;
@@ -631,6 +767,11 @@ class GeoCommunicator : public AsyncCommunicator {
   std::unordered_map<std::string, paddle::framework::Channel<
                                       std::shared_ptr<std::vector<int64_t>>>>
       sparse_id_queues_;
+  // ids of every splited sparse var whose delta was kept back by the top-k
+  // or threshold selection, sent again with the next ids, each with the
+  // number of rounds it has been held back
+  std::unordered_map<std::string, std::unordered_map<int64_t, int>>
+      geo_residual_ids_;
 };
 
 }  // namespace distributed
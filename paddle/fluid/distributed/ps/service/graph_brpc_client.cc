@@ -311,7 +311,7 @@ std::future<int32_t> GraphBrpcClient::batch_sample_neighbors(
     // std::vector<std::vector<std::pair<int64_t, float>>> &res,
     std::vector<std::vector<int64_t>> &res,
     std::vector<std::vector<float>> &res_weight, bool need_weight,
-    int server_index) {
+    int server_index, bool with_replacement) {
   if (server_index != -1) {
     res.resize(node_ids.size());
     if (need_weight) {
@@ -366,6 +366,7 @@ std::future<int32_t> GraphBrpcClient::batch_sample_neighbors(
                                     sizeof(int64_t) * node_ids.size());
     closure->request(0)->add_params((char *)&sample_size, sizeof(int));
     closure->request(0)->add_params((char *)&need_weight, sizeof(bool));
+    closure->request(0)->add_params((char *)&with_replacement, sizeof(bool));
     ;
     // PsService_Stub rpc_stub(GetCmdChannel(server_index));
     GraphPsService_Stub rpc_stub = getServiceStub(GetCmdChannel(server_index));
@@ -469,6 +470,8 @@ std::future<int32_t> GraphBrpcClient::batch_sample_neighbors(
         ->add_params((char *)&sample_size, sizeof(int));
     closure->request(request_idx)
         ->add_params((char *)&need_weight, sizeof(bool));
+    closure->request(request_idx)
+        ->add_params((char *)&with_replacement, sizeof(bool));
     // PsService_Stub rpc_stub(GetCmdChannel(server_index));
     GraphPsService_Stub rpc_stub = getServiceStub(GetCmdChannel(server_index));
     closure->cntl(request_idx)->set_log_id(butil::gettimeofday_ms());
@@ -520,6 +523,158 @@ std::future<int32_t> GraphBrpcClient::random_sample_nodes(
   return fut;
 }
 
+std::future<int32_t> GraphBrpcClient::sample_subgraph(
+    uint32_t table_id, int idx_, const std::vector<int64_t> &seeds,
+    const std::vector<int> &fanouts, bool need_weight, GraphSubgraph &res,
+    int server_index) {
+  res.clear();
+  if (seeds.empty()) {
+    auto promise = std::make_shared<std::promise<int32_t>>();
+    promise->set_value(0);
+    return promise->get_future();
+  }
+  if (server_index == -1) {
+    server_index = get_server_index_by_id(seeds[0]);
+  }
+  auto callback = [&res, need_weight](void *done) {
+    int ret = 0;
+    auto *closure = (DownpourBrpcClosure *)done;
+    if (closure->check_response(0, PS_GRAPH_SAMPLE_SUBGRAPH) != 0) {
+      ret = -1;
+    } else {
+      butil::IOBufBytesIterator io_buffer_itr(
+          closure->cntl(0)->response_attachment());
+      size_t node_num, hop_num;
+      io_buffer_itr.copy_and_forward(&node_num, sizeof(size_t));
+      io_buffer_itr.copy_and_forward(&hop_num, sizeof(size_t));
+      res.node_ids.resize(node_num);
+      io_buffer_itr.copy_and_forward(res.node_ids.data(),
+                                     sizeof(int64_t) * node_num);
+      res.hop_offsets.resize(hop_num + 1);
+      io_buffer_itr.copy_and_forward(res.hop_offsets.data(),
+                                     sizeof(int) * (hop_num + 1));
+      size_t edge_num = res.hop_offsets.back();
+      res.edge_src.resize(edge_num);
+      io_buffer_itr.copy_and_forward(res.edge_src.data(),
+                                     sizeof(int) * edge_num);
+      res.edge_dst.resize(edge_num);
+      io_buffer_itr.copy_and_forward(res.edge_dst.data(),
+                                     sizeof(int) * edge_num);
+      if (need_weight) {
+        res.edge_weight.resize(edge_num);
+        io_buffer_itr.copy_and_forward(res.edge_weight.data(),
+                                       sizeof(float) * edge_num);
+      }
+    }
+    closure->set_promise_value(ret);
+  };
+  DownpourBrpcClosure *closure = new DownpourBrpcClosure(1, callback);
+  auto promise = std::make_shared<std::promise<int32_t>>();
+  closure->add_promise(promise);
+  std::future<int> fut = promise->get_future();
+  closure->request(0)->set_cmd_id(PS_GRAPH_SAMPLE_SUBGRAPH);
+  closure->request(0)->set_table_id(table_id);
+  closure->request(0)->set_client_id(_client_id);
+  closure->request(0)->add_params((char *)&idx_, sizeof(int));
+  closure->request(0)->add_params((char *)seeds.data(),
+                                  sizeof(int64_t) * seeds.size());
+  closure->request(0)->add_params((char *)fanouts.data(),
+                                  sizeof(int) * fanouts.size());
+  closure->request(0)->add_params((char *)&need_weight, sizeof(bool));
+  GraphPsService_Stub rpc_stub = getServiceStub(GetCmdChannel(server_index));
+  closure->cntl(0)->set_log_id(butil::gettimeofday_ms());
+  rpc_stub.service(closure->cntl(0), closure->request(0), closure->response(0),
+                   closure);
+  return fut;
+}
+
+std::future<int32_t> GraphBrpcClient::send_sample_cache_cmd(
+    uint32_t table_id, int cmd_id, const std::string &path) {
+  DownpourBrpcClosure *closure = new DownpourBrpcClosure(
+      server_size,
+      [cmd_id, server_size = this->server_size](void *done) {
+        int ret = 0;
+        auto *closure = (DownpourBrpcClosure *)done;
+        for (size_t request_idx = 0; request_idx < server_size; ++request_idx) {
+          if (closure->check_response(request_idx, cmd_id) != 0) {
+            ret = -1;
+          }
+        }
+        closure->set_promise_value(ret);
+      });
+  auto promise = std::make_shared<std::promise<int32_t>>();
+  closure->add_promise(promise);
+  std::future<int> fut = promise->get_future();
+  for (size_t i = 0; i < server_size; i++) {
+    closure->request(i)->set_cmd_id(cmd_id);
+    closure->request(i)->set_table_id(table_id);
+    closure->request(i)->set_client_id(_client_id);
+    closure->request(i)->add_params(path);
+    GraphPsService_Stub rpc_stub = getServiceStub(GetCmdChannel(i));
+    closure->cntl(i)->set_log_id(butil::gettimeofday_ms());
+    rpc_stub.service(closure->cntl(i), closure->request(i),
+                     closure->response(i), closure);
+  }
+  return fut;
+}
+
+std::future<int32_t> GraphBrpcClient::save_sample_cache(
+    uint32_t table_id, const std::string &path) {
+  return send_sample_cache_cmd(table_id, PS_GRAPH_SAVE_SAMPLE_CACHE, path);
+}
+
+std::future<int32_t> GraphBrpcClient::load_sample_cache(
+    uint32_t table_id, const std::string &path) {
+  return send_sample_cache_cmd(table_id, PS_GRAPH_LOAD_SAMPLE_CACHE, path);
+}
+
+std::future<int32_t> GraphBrpcClient::get_sample_cache_stat(
+    uint32_t table_id, GraphSampleCacheStat &stat) {
+  stat = GraphSampleCacheStat();
+  DownpourBrpcClosure *closure = new DownpourBrpcClosure(
+      server_size,
+      [&stat, server_size = this->server_size](void *done) {
+        int ret = 0;
+        auto *closure = (DownpourBrpcClosure *)done;
+        for (size_t request_idx = 0; request_idx < server_size; ++request_idx) {
+          if (closure->check_response(request_idx,
+                                      PS_GRAPH_SAMPLE_CACHE_STAT) != 0) {
+            ret = -1;
+            continue;
+          }
+          size_t counters[7];
+          butil::IOBufBytesIterator io_buffer_itr(
+              closure->cntl(request_idx)->response_attachment());
+          if (io_buffer_itr.copy_and_forward(counters, sizeof(counters)) !=
+              sizeof(counters)) {
+            ret = -1;
+            continue;
+          }
+          stat.hit += counters[0];
+          stat.miss += counters[1];
+          stat.insert += counters[2];
+          stat.reject += counters[3];
+          stat.evict += counters[4];
+          stat.expire += counters[5];
+          stat.size += counters[6];
+        }
+        closure->set_promise_value(ret);
+      });
+  auto promise = std::make_shared<std::promise<int32_t>>();
+  closure->add_promise(promise);
+  std::future<int> fut = promise->get_future();
+  for (size_t i = 0; i < server_size; i++) {
+    closure->request(i)->set_cmd_id(PS_GRAPH_SAMPLE_CACHE_STAT);
+    closure->request(i)->set_table_id(table_id);
+    closure->request(i)->set_client_id(_client_id);
+    GraphPsService_Stub rpc_stub = getServiceStub(GetCmdChannel(i));
+    closure->cntl(i)->set_log_id(butil::gettimeofday_ms());
+    rpc_stub.service(closure->cntl(i), closure->request(i),
+                     closure->response(i), closure);
+  }
+  return fut;
+}
+
 std::future<int32_t> GraphBrpcClient::pull_graph_list(
     uint32_t table_id, int type_id, int idx_, int server_index, int start,
     int size, int step, std::vector<FeatureNode> &res) {
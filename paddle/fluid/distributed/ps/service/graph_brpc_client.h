@@ -62,13 +62,32 @@ class GraphBrpcClient : public BrpcPsClient {
  public:
   GraphBrpcClient() {}
   virtual ~GraphBrpcClient() {}
-  // given a batch of nodes, sample graph_neighbors for each of them
+  // given a batch of nodes, sample graph_neighbors for each of them, with
+  // with_replacement the neighbors are drawn independently and may repeat
   virtual std::future<int32_t> batch_sample_neighbors(
       uint32_t table_id, int idx, std::vector<int64_t> node_ids,
       int sample_size, std::vector<std::vector<int64_t>>& res,
       std::vector<std::vector<float>>& res_weight, bool need_weight,
+      int server_index = -1, bool with_replacement = false);
+
+  // sample fanouts[h] neighbors at hop h from the seeds in one request to
+  // a server, which runs all the hops, by default the server of the first
+  // seed
+  virtual std::future<int32_t> sample_subgraph(
+      uint32_t table_id, int idx, const std::vector<int64_t>& seeds,
+      const std::vector<int>& fanouts, bool need_weight, GraphSubgraph& res,
       int server_index = -1);
 
+  // save or load the neighbor sample cache on every server, each server
+  // has its own part file named after path
+  virtual std::future<int32_t> save_sample_cache(uint32_t table_id,
+                                                 const std::string& path);
+  virtual std::future<int32_t> load_sample_cache(uint32_t table_id,
+                                                 const std::string& path);
+  // the neighbor sample cache counters summed over the servers
+  virtual std::future<int32_t> get_sample_cache_stat(
+      uint32_t table_id, GraphSampleCacheStat& stat);
+
   virtual std::future<int32_t> pull_graph_list(uint32_t table_id, int type_id,
                                                int idx, int server_index,
                                                int start, int size, int step,
@@ -112,6 +131,9 @@ class GraphBrpcClient : public BrpcPsClient {
   }
 
  private:
+  std::future<int32_t> send_sample_cache_cmd(uint32_t table_id, int cmd_id,
+                                             const std::string& path);
+
   int shard_num;
   size_t server_size;
   ::google::protobuf::RpcChannel* local_channel;
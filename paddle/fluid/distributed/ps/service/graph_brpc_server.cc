@@ -216,6 +216,14 @@ int32_t GraphBrpcService::Initialize() {
       &GraphBrpcService::graph_set_node_feat;
   _service_handler_map[PS_GRAPH_SAMPLE_NODES_FROM_ONE_SERVER] =
       &GraphBrpcService::sample_neighbors_across_multi_servers;
+  _service_handler_map[PS_GRAPH_SAMPLE_SUBGRAPH] =
+      &GraphBrpcService::graph_sample_subgraph;
+  _service_handler_map[PS_GRAPH_SAVE_SAMPLE_CACHE] =
+      &GraphBrpcService::graph_save_sample_cache;
+  _service_handler_map[PS_GRAPH_LOAD_SAMPLE_CACHE] =
+      &GraphBrpcService::graph_load_sample_cache;
+  _service_handler_map[PS_GRAPH_SAMPLE_CACHE_STAT] =
+      &GraphBrpcService::graph_sample_cache_stat;
   // _service_handler_map[PS_GRAPH_USE_NEIGHBORS_SAMPLE_CACHE] =
   //     &GraphBrpcService::use_neighbors_sample_cache;
   // _service_handler_map[PS_GRAPH_LOAD_GRAPH_SPLIT_CONFIG] =
@@ -411,6 +419,8 @@ int32_t GraphBrpcService::graph_random_sample_neighbors(
   int64_t *node_data = (int64_t *)(request.params(1).c_str());
   int sample_size = *(int64_t *)(request.params(2).c_str());
   bool need_weight = *(bool *)(request.params(3).c_str());
+  bool with_replacement =
+      request.params_size() > 4 && *(bool *)(request.params(4).c_str());
   // size_t node_num = request.params(0).size() / sizeof(int64_t);
   // int64_t *node_data = (int64_t *)(request.params(0).c_str());
   // int sample_size = *(int64_t *)(request.params(1).c_str());
@@ -419,7 +429,7 @@ int32_t GraphBrpcService::graph_random_sample_neighbors(
   std::vector<int> actual_sizes(node_num, 0);
   ((GraphTable *)table)
       ->random_sample_neighbors(idx_, node_data, sample_size, buffers,
-                                actual_sizes, need_weight);
+                                actual_sizes, need_weight, with_replacement);
 
   cntl->response_attachment().append(&node_num, sizeof(size_t));
   cntl->response_attachment().append(actual_sizes.data(),
@@ -503,6 +513,8 @@ int32_t GraphBrpcService::sample_neighbors_across_multi_servers(
   int64_t *node_data = (int64_t *)(request.params(1).c_str());
   int sample_size = *(int64_t *)(request.params(2).c_str());
   bool need_weight = *(int64_t *)(request.params(3).c_str());
+  bool with_replacement =
+      request.params_size() > 4 && *(bool *)(request.params(4).c_str());
 
   // size_t node_num = request.params(0).size() / sizeof(int64_t),
   //        size_of_size_t = sizeof(size_t);
@@ -630,6 +642,8 @@ int32_t GraphBrpcService::sample_neighbors_across_multi_servers(
         ->add_params((char *)&sample_size, sizeof(int));
     closure->request(request_idx)
         ->add_params((char *)&need_weight, sizeof(bool));
+    closure->request(request_idx)
+        ->add_params((char *)&with_replacement, sizeof(bool));
     PsService_Stub rpc_stub(
         ((GraphBrpcServer *)GetServer())->GetCmdChannel(server_index));
     // GraphPsService_Stub rpc_stub =
@@ -642,13 +656,212 @@ int32_t GraphBrpcService::sample_neighbors_across_multi_servers(
     ((GraphTable *)table)
         ->random_sample_neighbors(idx_, node_id_buckets.back().data(),
                                   sample_size, local_buffers,
-                                  local_actual_sizes, need_weight);
+                                  local_actual_sizes, need_weight,
+                                  with_replacement);
   }
   local_promise.get()->set_value(0);
   if (remote_call_num == 0) func(closure);
   fut.get();
   return 0;
 }
+int32_t GraphBrpcService::graph_sample_subgraph(
+    Table *table, const PsRequestMessage &request, PsResponseMessage &response,
+    brpc::Controller *cntl) {
+  CHECK_TABLE_EXIST(table, request, response)
+  if (request.params_size() < 4) {
+    set_response_code(
+        response, -1,
+        "graph_sample_subgraph request requires at least 4 arguments");
+    return 0;
+  }
+  int idx_ = *(int *)(request.params(0).c_str());
+  const int64_t *seed_data = (const int64_t *)(request.params(1).c_str());
+  std::vector<int64_t> seeds(
+      seed_data, seed_data + request.params(1).size() / sizeof(int64_t));
+  const int *fanout_data = (const int *)(request.params(2).c_str());
+  std::vector<int> fanouts(
+      fanout_data, fanout_data + request.params(2).size() / sizeof(int));
+  bool need_weight = *(bool *)(request.params(3).c_str());
+  auto *graph_table = (GraphTable *)table;
+  size_t rank = GetRank();
+
+  // the nodes of this server are sampled from the table, the others by
+  // one PS_GRAPH_SAMPLE_NEIGHBORS request to each server holding some
+  auto sample_neighbors = [&](const std::vector<int64_t> &ids, int fanout,
+                              std::vector<std::vector<int64_t>> &neighbors,
+                              std::vector<std::vector<float>> &weights) {
+    std::vector<std::vector<int64_t>> server_ids(server_size);
+    std::vector<std::vector<size_t>> server_pos(server_size);
+    for (size_t i = 0; i < ids.size(); i++) {
+      int server_index = graph_table->get_server_index_by_id(ids[i]);
+      server_ids[server_index].push_back(ids[i]);
+      server_pos[server_index].push_back(i);
+    }
+    neighbors.assign(ids.size(), {});
+    weights.assign(need_weight ? ids.size() : 0, {});
+    std::vector<int> request2server;
+    for (size_t server_index = 0; server_index < server_size; server_index++) {
+      if (server_index != rank && !server_ids[server_index].empty()) {
+        request2server.push_back(server_index);
+      }
+    }
+    int32_t ret = 0;
+    std::future<int32_t> fut;
+    if (!request2server.empty()) {
+      DownpourBrpcClosure *closure = new DownpourBrpcClosure(
+          request2server.size(), [&](void *done) {
+            int ret = 0;
+            auto *closure = (DownpourBrpcClosure *)done;
+            for (size_t request_idx = 0; request_idx < request2server.size();
+                 ++request_idx) {
+              if (closure->check_response(request_idx,
+                                          PS_GRAPH_SAMPLE_NEIGHBORS) != 0) {
+                ret = -1;
+                continue;
+              }
+              auto &pos = server_pos[request2server[request_idx]];
+              butil::IOBufBytesIterator io_buffer_itr(
+                  closure->cntl(request_idx)->response_attachment());
+              size_t node_num;
+              io_buffer_itr.copy_and_forward(&node_num, sizeof(size_t));
+              std::vector<int> actual_sizes(node_num);
+              io_buffer_itr.copy_and_forward(actual_sizes.data(),
+                                             sizeof(int) * node_num);
+              for (size_t node_idx = 0; node_idx < node_num; ++node_idx) {
+                for (int start = 0; start < actual_sizes[node_idx];) {
+                  int64_t id;
+                  io_buffer_itr.copy_and_forward(&id, GraphNode::id_size);
+                  neighbors[pos[node_idx]].push_back(id);
+                  start += GraphNode::id_size;
+                  if (need_weight) {
+                    float weight;
+                    io_buffer_itr.copy_and_forward(&weight,
+                                                   GraphNode::weight_size);
+                    weights[pos[node_idx]].push_back(weight);
+                    start += GraphNode::weight_size;
+                  }
+                }
+              }
+            }
+            closure->set_promise_value(ret);
+          });
+      auto promise = std::make_shared<std::promise<int32_t>>();
+      closure->add_promise(promise);
+      fut = promise->get_future();
+      for (size_t request_idx = 0; request_idx < request2server.size();
+           ++request_idx) {
+        int server_index = request2server[request_idx];
+        auto &node_ids = server_ids[server_index];
+        closure->request(request_idx)->set_cmd_id(PS_GRAPH_SAMPLE_NEIGHBORS);
+        closure->request(request_idx)->set_table_id(request.table_id());
+        closure->request(request_idx)->set_client_id(rank);
+        closure->request(request_idx)->add_params((char *)&idx_, sizeof(int));
+        closure->request(request_idx)
+            ->add_params((char *)node_ids.data(),
+                         sizeof(int64_t) * node_ids.size());
+        closure->request(request_idx)->add_params((char *)&fanout, sizeof(int));
+        closure->request(request_idx)
+            ->add_params((char *)&need_weight, sizeof(bool));
+        PsService_Stub rpc_stub(
+            ((GraphBrpcServer *)GetServer())->GetCmdChannel(server_index));
+        closure->cntl(request_idx)->set_log_id(butil::gettimeofday_ms());
+        rpc_stub.service(closure->cntl(request_idx),
+                         closure->request(request_idx),
+                         closure->response(request_idx), closure);
+      }
+    }
+    if (!server_ids[rank].empty()) {
+      std::vector<std::vector<int64_t>> local_neighbors;
+      std::vector<std::vector<float>> local_weights;
+      ret = graph_table->sample_neighbors(idx_, server_ids[rank], fanout,
+                                          need_weight, local_neighbors,
+                                          local_weights);
+      auto &pos = server_pos[rank];
+      for (size_t i = 0; i < local_neighbors.size(); i++) {
+        neighbors[pos[i]].swap(local_neighbors[i]);
+        if (need_weight) {
+          weights[pos[i]].swap(local_weights[i]);
+        }
+      }
+    }
+    if (!request2server.empty() && fut.get() != 0) {
+      ret = -1;
+    }
+    return ret;
+  };
+
+  GraphSubgraph subgraph;
+  if (graph_table->sample_subgraph(idx_, seeds, fanouts, need_weight,
+                                   &subgraph, sample_neighbors) != 0) {
+    set_response_code(response, -1, "graph_sample_subgraph failed");
+    return 0;
+  }
+  size_t node_num = subgraph.node_ids.size();
+  size_t hop_num = fanouts.size();
+  size_t edge_num = subgraph.edge_src.size();
+  cntl->response_attachment().append(&node_num, sizeof(size_t));
+  cntl->response_attachment().append(&hop_num, sizeof(size_t));
+  cntl->response_attachment().append(subgraph.node_ids.data(),
+                                     sizeof(int64_t) * node_num);
+  cntl->response_attachment().append(subgraph.hop_offsets.data(),
+                                     sizeof(int) * (hop_num + 1));
+  cntl->response_attachment().append(subgraph.edge_src.data(),
+                                     sizeof(int) * edge_num);
+  cntl->response_attachment().append(subgraph.edge_dst.data(),
+                                     sizeof(int) * edge_num);
+  if (need_weight) {
+    cntl->response_attachment().append(subgraph.edge_weight.data(),
+                                       sizeof(float) * edge_num);
+  }
+  return 0;
+}
+
+int32_t GraphBrpcService::graph_save_sample_cache(
+    Table *table, const PsRequestMessage &request, PsResponseMessage &response,
+    brpc::Controller *cntl) {
+  CHECK_TABLE_EXIST(table, request, response)
+  if (request.params_size() < 1) {
+    set_response_code(
+        response, -1,
+        "graph_save_sample_cache request requires at least 1 argument");
+    return 0;
+  }
+  if (((GraphTable *)table)->save_neighbor_sample_cache(request.params(0)) !=
+      0) {
+    set_response_code(response, -1, "graph_save_sample_cache failed");
+  }
+  return 0;
+}
+
+int32_t GraphBrpcService::graph_load_sample_cache(
+    Table *table, const PsRequestMessage &request, PsResponseMessage &response,
+    brpc::Controller *cntl) {
+  CHECK_TABLE_EXIST(table, request, response)
+  if (request.params_size() < 1) {
+    set_response_code(
+        response, -1,
+        "graph_load_sample_cache request requires at least 1 argument");
+    return 0;
+  }
+  if (((GraphTable *)table)->load_neighbor_sample_cache(request.params(0)) !=
+      0) {
+    set_response_code(response, -1, "graph_load_sample_cache failed");
+  }
+  return 0;
+}
+
+int32_t GraphBrpcService::graph_sample_cache_stat(
+    Table *table, const PsRequestMessage &request, PsResponseMessage &response,
+    brpc::Controller *cntl) {
+  CHECK_TABLE_EXIST(table, request, response)
+  GraphSampleCacheStat stat =
+      ((GraphTable *)table)->get_neighbor_sample_cache_stat();
+  size_t counters[] = {stat.hit,   stat.miss,   stat.insert, stat.reject,
+                       stat.evict, stat.expire, stat.size};
+  cntl->response_attachment().append(counters, sizeof(counters));
+  return 0;
+}
+
 int32_t GraphBrpcService::graph_set_node_feat(Table *table,
                                               const PsRequestMessage &request,
                                               PsResponseMessage &response,
@@ -121,6 +121,25 @@ class GraphBrpcService : public PsBaseService {
                                                 PsResponseMessage &response,
                                                 brpc::Controller *cntl);
 
+  // samples the multi-hop neighborhood of some seeds and returns it as one
+  // deduplicated and renumbered subgraph
+  int32_t graph_sample_subgraph(Table *table, const PsRequestMessage &request,
+                                PsResponseMessage &response,
+                                brpc::Controller *cntl);
+
+  // save or load the neighbor sample cache of the table, params(0) is the
+  // path the part files of the servers start with
+  int32_t graph_save_sample_cache(Table *table, const PsRequestMessage &request,
+                                  PsResponseMessage &response,
+                                  brpc::Controller *cntl);
+  int32_t graph_load_sample_cache(Table *table, const PsRequestMessage &request,
+                                  PsResponseMessage &response,
+                                  brpc::Controller *cntl);
+  // the counters of the neighbor sample cache, see GraphSampleCacheStat
+  int32_t graph_sample_cache_stat(Table *table, const PsRequestMessage &request,
+                                  PsResponseMessage &response,
+                                  brpc::Controller *cntl);
+
   int32_t use_neighbors_sample_cache(Table *table,
                                      const PsRequestMessage &request,
                                      PsResponseMessage &response,
@@ -14,12 +14,16 @@
 
 #include "paddle/fluid/distributed/ps/service/ps_client.h"
 
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "paddle/fluid/distributed/ps/service/brpc_ps_client.h"
 #include "paddle/fluid/distributed/ps/service/graph_brpc_client.h"
 #include "paddle/fluid/distributed/ps/service/ps_local_client.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
 
+DECLARE_int32(pserver_client_sparse_cache_capacity);
+DECLARE_int32(pserver_client_sparse_cache_staleness_steps);
+
 namespace paddle {
 namespace distributed {
 REGISTER_PSCORE_CLASS(PSClient, BrpcPsClient);
@@ -51,6 +55,16 @@ int32_t PSClient::Configure(
     accessor->Initialize();
     _table_accessors[work_param.downpour_table_param(i).table_id()].reset(
         accessor);
+    size_t select_size = accessor->GetAccessorInfo().select_size;
+    if (FLAGS_pserver_client_sparse_cache_capacity > 0 &&
+        work_param.downpour_table_param(i).type() == PS_SPARSE_TABLE &&
+        select_size > 0) {
+      _sparse_pull_caches[work_param.downpour_table_param(i).table_id()]
+          .reset(new SparsePullCache(
+              FLAGS_pserver_client_sparse_cache_capacity,
+              FLAGS_pserver_client_sparse_cache_staleness_steps,
+              select_size));
+    }
   }
   return Initialize();
 }
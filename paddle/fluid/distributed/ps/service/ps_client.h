@@ -25,6 +25,7 @@
 #include "paddle/fluid/distributed/ps.pb.h"
 #include "paddle/fluid/distributed/ps/service/env.h"
 #include "paddle/fluid/distributed/ps/service/sendrecv.pb.h"
+#include "paddle/fluid/distributed/ps/service/sparse_pull_cache.h"
 #include "paddle/fluid/distributed/ps/table/accessor.h"
 #include "paddle/fluid/distributed/ps/table/graph/graph_node.h"
 #include "paddle/fluid/platform/timer.h"
@@ -218,6 +219,15 @@ class PSClient {
     return itr->second.get();
   }
 
+  // NULL if the pulled values of the sparse table are not cached
+  SparsePullCache *GetSparsePullCache(size_t table_id) {
+    auto itr = _sparse_pull_caches.find(table_id);
+    if (itr == _sparse_pull_caches.end()) {
+      return NULL;
+    }
+    return itr->second.get();
+  }
+
   virtual size_t GetServerNums() = 0;
 
   virtual std::future<int32_t> PushDenseRawGradient(int table_id,
@@ -283,12 +293,22 @@ class PSClient {
 
  protected:
   virtual int32_t Initialize() = 0;
+  // drop the cached values of a table, or of all tables for table_id -1
+  void InvalidateSparsePullCache(int table_id) {
+    for (auto &cache : _sparse_pull_caches) {
+      if (table_id < 0 || cache.first == static_cast<uint32_t>(table_id)) {
+        cache.second->Invalidate();
+      }
+    }
+  }
   size_t _client_id;
   PSParameter _config;
   std::map<uint64_t, std::vector<paddle::distributed::Region>>
       _dense_pull_regions;
   PSEnvironment *_env;
   std::unordered_map<uint32_t, std::shared_ptr<ValueAccessor>> _table_accessors;
+  std::unordered_map<uint32_t, std::shared_ptr<SparsePullCache>>
+      _sparse_pull_caches;
   std::unordered_map<int32_t, MsgHandlerFunc>
       _msg_handler_map;  // 处理client2client消息
 };
@@ -51,6 +51,7 @@ int32_t PsLocalClient::Initialize() {
 ::std::future<int32_t> PsLocalClient::Load(uint32_t table_id,
                                            const std::string& epoch,
                                            const std::string& mode) {
+  InvalidateSparsePullCache(table_id);
   // TODO
   auto* table_ptr = GetTable(table_id);
   table_ptr->Load(epoch, mode);
@@ -76,10 +77,12 @@ int32_t PsLocalClient::Initialize() {
 }
 
 ::std::future<int32_t> PsLocalClient::Clear() {
+  InvalidateSparsePullCache(-1);
   // TODO
   return done();
 }
 ::std::future<int32_t> PsLocalClient::Clear(uint32_t table_id) {
+  InvalidateSparsePullCache(table_id);
   // TODO
   return done();
 }
@@ -224,35 +227,58 @@ int32_t PsLocalClient::Initialize() {
   return done();
 }
 
-//::std::future<int32_t> PsLocalClient::PullSparse(float** select_values,
-//                                                  size_t table_id,
-//                                                  const uint64_t* keys,
-//                                                  size_t num) {
-//  // FIXME
-//  // auto timer =
-//  // std::make_shared<CostTimer>("pslib_downpour_client_pull_sparse");
-//  // auto local_timer =
-//  // std::make_shared<CostTimer>("pslib_downpour_client_pull_sparse_local");
-//  //将key拆分到各shard请求，并记录原始对应value指针
-//  auto* accessor = GetTableAccessor(table_id);
-//  auto* table_ptr = GetTable(table_id);
-//  size_t value_size = accessor->select_size();
-//
-//  // table_ptr->PullSparse(keys, num);
-//  std::vector<float> res_data;
-//  res_data.resize(num * value_size / sizeof(float));
-//  table_ptr->PullSparse(res_data.data(), keys, num);
-//  // memcpy(select_values[0], res_data->data(), res_data->size() *
-//  // sizeof(float));
-//  size_t offset = 0;
-//  for (int i = 0; i < num; ++i) {
-//    memcpy(select_values[i], (char*)res_data.data() + offset, value_size);
-//    offset += value_size;
-//  }
-//
-//  // return fut;
-//  return done();
-//}
+::std::future<int32_t> PsLocalClient::PullSparse(float** select_values,
+                                                 size_t table_id,
+                                                 const uint64_t* keys,
+                                                 size_t num,
+                                                 bool is_training) {
+  auto* accessor = GetTableAccessor(table_id);
+  auto* table_ptr = GetTable(table_id);
+  size_t value_size = accessor->GetAccessorInfo().select_size;
+
+  // only the keys missing in the cache are pulled from the table
+  auto* cache = GetSparsePullCache(table_id);
+  uint64_t step = 0;
+  std::vector<uint64_t> pull_keys;
+  std::vector<float*> pull_values;
+  if (cache != NULL) {
+    step = cache->NextStep();
+    std::vector<size_t> miss_idx;
+    cache->Lookup(keys, num, select_values, step, &miss_idx);
+    for (auto i : miss_idx) {
+      pull_keys.push_back(keys[i]);
+      pull_values.push_back(select_values[i]);
+    }
+  } else {
+    pull_keys.assign(keys, keys + num);
+    pull_values.assign(select_values, select_values + num);
+  }
+  if (pull_keys.empty()) {
+    return done();
+  }
+
+  std::vector<uint32_t> frequencies(pull_keys.size(), 1);
+  PullSparseValue pull_value(pull_keys, frequencies,
+                             value_size / sizeof(float));
+  pull_value.is_training_ = is_training;
+  std::vector<float> res_data(pull_keys.size() * value_size / sizeof(float));
+
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.pull_context.pull_value = pull_value;
+  table_context.pull_context.values = res_data.data();
+  table_context.num = pull_keys.size();
+  table_ptr->Pull(table_context);
+
+  const char* res_ptr = reinterpret_cast<const char*>(res_data.data());
+  for (size_t i = 0; i < pull_keys.size(); ++i) {
+    memcpy(pull_values[i], res_ptr + i * value_size, value_size);
+    if (cache != NULL) {
+      cache->Put(pull_keys[i], pull_values[i], step);
+    }
+  }
+  return done();
+}
 
 ::std::future<int32_t> PsLocalClient::PullSparsePtr(char** select_values,
                                                     size_t table_id,
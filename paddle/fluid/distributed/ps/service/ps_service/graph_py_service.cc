@@ -403,6 +403,53 @@ GraphPyClient::batch_sample_neighbors(std::string name,
   return res;
 }
 
+std::pair<std::vector<std::vector<int64_t>>, std::vector<float>>
+GraphPyClient::sample_subgraph(std::string name, std::vector<int64_t> seeds,
+                               std::vector<int> fanouts, bool return_weight) {
+  GraphSubgraph subgraph;
+  if (edge_to_id.find(name) != edge_to_id.end()) {
+    int idx = edge_to_id[name];
+    auto status = get_ps_client()->sample_subgraph(0, idx, seeds, fanouts,
+                                                   return_weight, subgraph);
+    status.wait();
+  }
+  // res.first[0]: nodes, the seeds first
+  // res.first[1]: edge src, index into the nodes
+  // res.first[2]: edge dst, index into the nodes
+  // res.first[3]: edge offset of every hop
+  // res.second: edges weight
+  std::pair<std::vector<std::vector<int64_t>>, std::vector<float>> res;
+  res.first.push_back(subgraph.node_ids);
+  res.first.emplace_back(subgraph.edge_src.begin(), subgraph.edge_src.end());
+  res.first.emplace_back(subgraph.edge_dst.begin(), subgraph.edge_dst.end());
+  res.first.emplace_back(subgraph.hop_offsets.begin(),
+                         subgraph.hop_offsets.end());
+  res.second = subgraph.edge_weight;
+  return res;
+}
+
+int32_t GraphPyClient::save_sample_cache(std::string path) {
+  auto status = get_ps_client()->save_sample_cache(0, path);
+  status.wait();
+  return status.get();
+}
+
+int32_t GraphPyClient::load_sample_cache(std::string path) {
+  auto status = get_ps_client()->load_sample_cache(0, path);
+  status.wait();
+  return status.get();
+}
+
+std::map<std::string, size_t> GraphPyClient::get_sample_cache_stat() {
+  GraphSampleCacheStat stat;
+  auto status = get_ps_client()->get_sample_cache_stat(0, stat);
+  status.wait();
+  return {{"hit", stat.hit},         {"miss", stat.miss},
+          {"insert", stat.insert},   {"reject", stat.reject},
+          {"evict", stat.evict},     {"expire", stat.expire},
+          {"size", stat.size}};
+}
+
 std::vector<int64_t> GraphPyClient::random_sample_nodes(std::string name,
                                                         int server_index,
                                                         int sample_size) {
@@ -19,6 +19,7 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <thread>  // NOLINT
@@ -179,8 +180,15 @@ class GraphPyClient : public GraphPyService {
   batch_sample_neighbors(std::string name, std::vector<int64_t> node_ids,
                          int sample_size, bool return_weight,
                          bool return_edges);
+  std::pair<std::vector<std::vector<int64_t>>, std::vector<float>>
+  sample_subgraph(std::string name, std::vector<int64_t> seeds,
+                  std::vector<int> fanouts, bool return_weight);
   std::vector<int64_t> random_sample_nodes(std::string name, int server_index,
                                            int sample_size);
+  // the neighbor sample cache of the servers, 0 on success
+  int32_t save_sample_cache(std::string path);
+  int32_t load_sample_cache(std::string path);
+  std::map<std::string, size_t> get_sample_cache_stat();
   std::vector<std::vector<std::string>> get_node_feat(
       std::string name, std::vector<int64_t> node_ids,
       std::vector<std::string> feature_names);
@@ -0,0 +1,160 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// Routes the keys of a sparse pull to the shards serving them:
+//   Add every key and the value it is pulled into,
+//   Route removes the repeated keys with a hash table and partitions the
+//   unique keys by shard with a counting sort,
+//   the values of the unique keys are pulled shard by shard into
+//   RoutedValues, and Scatter copies them back to the value of every key.
+// The buffers are kept between batches, so a router reused for batches of
+// similar size does not allocate. Not thread safe.
+class SparseKeyRouter {
+ public:
+  void Clear() {
+    _keys.clear();
+    _values.clear();
+  }
+  void Add(uint64_t key, float* value) {
+    _keys.push_back(key);
+    _values.push_back(value);
+  }
+  size_t KeyNum() const { return _keys.size(); }
+
+  // shard_of(key) returns the shard of a key in [0, shard_num)
+  template <typename ShardFunc>
+  void Route(size_t shard_num, ShardFunc shard_of) {
+    size_t num = _keys.size();
+    size_t capacity = 16;
+    while (capacity < num * 2) {
+      capacity <<= 1;
+    }
+    _slots.assign(capacity, static_cast<uint32_t>(kEmptySlot));
+    _unique_keys.clear();
+    _unique_counts.clear();
+    _inverse.resize(num);
+    for (size_t i = 0; i < num; ++i) {
+      uint64_t key = _keys[i];
+      size_t slot = Mix(key) & (capacity - 1);
+      while (_slots[slot] != kEmptySlot && _unique_keys[_slots[slot]] != key) {
+        slot = (slot + 1) & (capacity - 1);
+      }
+      if (_slots[slot] == kEmptySlot) {
+        _slots[slot] = _unique_keys.size();
+        _unique_keys.push_back(key);
+        _unique_counts.push_back(0);
+      }
+      ++_unique_counts[_slots[slot]];
+      _inverse[i] = _slots[slot];
+    }
+
+    size_t unique_num = _unique_keys.size();
+    _shard_offsets.assign(shard_num + 1, 0);
+    _unique_shards.resize(unique_num);
+    for (size_t u = 0; u < unique_num; ++u) {
+      _unique_shards[u] = shard_of(_unique_keys[u]);
+      ++_shard_offsets[_unique_shards[u] + 1];
+    }
+    for (size_t shard = 0; shard < shard_num; ++shard) {
+      _shard_offsets[shard + 1] += _shard_offsets[shard];
+    }
+    _cursors.assign(_shard_offsets.begin(), _shard_offsets.end() - 1);
+    _routed_keys.resize(unique_num);
+    _routed_counts.resize(unique_num);
+    _positions.resize(unique_num);
+    for (size_t u = 0; u < unique_num; ++u) {
+      uint32_t pos = _cursors[_unique_shards[u]]++;
+      _routed_keys[pos] = _unique_keys[u];
+      _routed_counts[pos] = _unique_counts[u];
+      _positions[u] = pos;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      _inverse[i] = _positions[_inverse[i]];
+    }
+  }
+
+  size_t ShardNum() const { return _shard_offsets.size() - 1; }
+  size_t UniqueNum() const { return _routed_keys.size(); }
+  // the unique keys of shard are [ShardBegin, ShardBegin + ShardSize) in
+  // the routed order
+  size_t ShardBegin(size_t shard) const { return _shard_offsets[shard]; }
+  size_t ShardSize(size_t shard) const {
+    return _shard_offsets[shard + 1] - _shard_offsets[shard];
+  }
+  const uint64_t* RoutedKeys() const { return _routed_keys.data(); }
+  // times a routed key was added
+  const uint32_t* RoutedCounts() const { return _routed_counts.data(); }
+
+  // buffer of value_num floats for every routed key
+  float* RoutedValues(size_t value_num) {
+    _routed_values.resize(UniqueNum() * value_num);
+    return _routed_values.data();
+  }
+  // pointers to the rows of RoutedValues
+  float** RoutedValuePtrs(size_t value_num) {
+    float* values = RoutedValues(value_num);
+    _routed_value_ptrs.resize(UniqueNum());
+    for (size_t i = 0; i < _routed_value_ptrs.size(); ++i) {
+      _routed_value_ptrs[i] = values + i * value_num;
+    }
+    return _routed_value_ptrs.data();
+  }
+  // copy the row of RoutedValues of every added key to its value
+  void Scatter(size_t value_num) const {
+    for (size_t i = 0; i < _keys.size(); ++i) {
+      memcpy(_values[i], _routed_values.data() + _inverse[i] * value_num,
+             value_num * sizeof(float));
+    }
+  }
+
+ private:
+  static const uint32_t kEmptySlot = UINT32_MAX;
+
+  static uint64_t Mix(uint64_t key) {
+    key = (key ^ (key >> 33)) * 0xff51afd7ed558ccdULL;
+    return key ^ (key >> 33);
+  }
+
+  std::vector<uint64_t> _keys;
+  std::vector<float*> _values;
+  // index of the unique key of every added key, then its routed position
+  std::vector<uint32_t> _inverse;
+
+  std::vector<uint32_t> _slots;
+  std::vector<uint64_t> _unique_keys;
+  std::vector<uint32_t> _unique_counts;
+  std::vector<uint32_t> _unique_shards;
+  std::vector<uint32_t> _positions;
+
+  std::vector<size_t> _shard_offsets{0};
+  std::vector<size_t> _cursors;
+  std::vector<uint64_t> _routed_keys;
+  std::vector<uint32_t> _routed_counts;
+  std::vector<float> _routed_values;
+  std::vector<float*> _routed_value_ptrs;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,169 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/service/sparse_pull_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "gflags/gflags.h"
+
+DEFINE_int32(pserver_client_sparse_cache_capacity, 0,
+             "hot keys whose pulled sparse values are cached by the client "
+             "of every sparse table, 0 disables the cache");
+DEFINE_int32(pserver_client_sparse_cache_staleness_steps, 10,
+             "pulls of a table for which a cached value is served");
+
+namespace paddle {
+namespace distributed {
+
+SparsePullCache::SparsePullCache(size_t capacity, uint32_t max_staleness_steps,
+                                 size_t value_size)
+    : _segment_capacity(std::max<size_t>(capacity / kSegmentNum, 1)),
+      _max_staleness_steps(max_staleness_steps),
+      _value_size(value_size),
+      _value_num(value_size / sizeof(float)),
+      _key_wire_bytes(sizeof(uint64_t) + sizeof(uint32_t) + value_size) {
+  _sketch_width = 64;
+  while (_sketch_width < _segment_capacity * 8) {
+    _sketch_width <<= 1;
+  }
+  for (auto& segment : _segments) {
+    segment.sketch.resize(_sketch_width * kSketchDepth, 0);
+  }
+}
+
+uint64_t SparsePullCache::Mix(uint64_t key) {
+  key += 0x9e3779b97f4a7c15ULL;
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+  return key ^ (key >> 31);
+}
+
+void SparsePullCache::Increment(Segment* segment, uint64_t mixed) {
+  uint64_t h2 = (mixed >> 32) | 1;
+  for (size_t d = 0; d < kSketchDepth; ++d) {
+    uint8_t& counter =
+        segment->sketch[d * _sketch_width + ((mixed + d * h2) &
+                                             (_sketch_width - 1))];
+    if (counter < UINT8_MAX) {
+      ++counter;
+    }
+  }
+  if (++segment->sample_num >= _sketch_width * 10) {
+    for (auto& counter : segment->sketch) {
+      counter >>= 1;
+    }
+    segment->sample_num = 0;
+  }
+}
+
+uint8_t SparsePullCache::Frequency(const Segment& segment,
+                                   uint64_t mixed) const {
+  uint64_t h2 = (mixed >> 32) | 1;
+  uint8_t freq = UINT8_MAX;
+  for (size_t d = 0; d < kSketchDepth; ++d) {
+    freq = std::min(freq, segment.sketch[d * _sketch_width +
+                                         ((mixed + d * h2) &
+                                          (_sketch_width - 1))]);
+  }
+  return freq;
+}
+
+void SparsePullCache::Lookup(const uint64_t* keys, size_t num, float** values,
+                             uint64_t step, std::vector<size_t>* miss_idx) {
+  size_t hit_num = 0;
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t mixed = Mix(keys[i]);
+    auto& segment = SegmentOf(mixed);
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    Increment(&segment, mixed);
+    auto it = segment.entries.find(keys[i]);
+    if (it != segment.entries.end() && Fresh(it->second, step)) {
+      memcpy(values[i], it->second.value.data(), _value_size);
+      ++hit_num;
+    } else {
+      miss_idx->push_back(i);
+    }
+  }
+  _lookup_num += num;
+  _hit_num += hit_num;
+}
+
+void SparsePullCache::Put(uint64_t key, const float* value, uint64_t step) {
+  if (step < _valid_step) {
+    return;
+  }
+  uint64_t mixed = Mix(key);
+  auto& segment = SegmentOf(mixed);
+  std::lock_guard<std::mutex> lock(segment.mutex);
+  auto it = segment.entries.find(key);
+  if (it == segment.entries.end()) {
+    if (Frequency(segment, mixed) < kAdmitFreq) {
+      return;
+    }
+    it = segment.entries.emplace(key, Entry()).first;
+    it->second.step = 0;
+    it->second.value.resize(_value_num);
+  } else if (it->second.step > step) {
+    // a later pull already refreshed the key
+    return;
+  }
+  it->second.step = step;
+  memcpy(it->second.value.data(), value, _value_size);
+  if (segment.entries.size() > _segment_capacity + _segment_capacity / 4) {
+    Prune(&segment, step);
+  }
+}
+
+void SparsePullCache::Prune(Segment* segment, uint64_t step) {
+  std::vector<std::pair<uint8_t, uint64_t>> freqs;
+  freqs.reserve(segment->entries.size());
+  for (auto& entry : segment->entries) {
+    uint8_t freq =
+        Fresh(entry.second, step) ? Frequency(*segment, Mix(entry.first)) : 0;
+    freqs.emplace_back(freq, entry.first);
+  }
+  std::nth_element(freqs.begin(), freqs.begin() + _segment_capacity,
+                   freqs.end(),
+                   [](const std::pair<uint8_t, uint64_t>& a,
+                      const std::pair<uint8_t, uint64_t>& b) {
+                     return a.first > b.first;
+                   });
+  for (size_t i = _segment_capacity; i < freqs.size(); ++i) {
+    segment->entries.erase(freqs[i].second);
+  }
+}
+
+void SparsePullCache::Invalidate() {
+  _valid_step = _step + 1;
+  for (auto& segment : _segments) {
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    segment.entries.clear();
+  }
+}
+
+size_t SparsePullCache::Size() {
+  size_t size = 0;
+  for (auto& segment : _segments) {
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    size += segment.entries.size();
+  }
+  return size;
+}
+
+}  // namespace distributed
+}  // namespace paddle
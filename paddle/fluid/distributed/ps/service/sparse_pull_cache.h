@@ -0,0 +1,119 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// Worker side cache of the pulled sparse values of the hottest keys.
+// Every pull of a table is one step. A value pulled at step s is served
+// locally up to step s + max_staleness_steps - 1, and never after
+// Invalidate. The keys are counted in a count-min sketch when looked up,
+// only keys seen more than once are cached, and when the cache is full the
+// least frequent ones are dropped, so it holds about the capacity hottest
+// keys. Thread safe.
+class SparsePullCache {
+ public:
+  struct Stat {
+    uint64_t lookup_num;
+    uint64_t hit_num;
+    // bytes of keys and values a pull would exchange with the servers
+    // without the cache, and the bytes of the missed keys
+    uint64_t request_bytes;
+    uint64_t sent_bytes;
+    double HitRatio() const {
+      return lookup_num == 0 ? 0 : static_cast<double>(hit_num) / lookup_num;
+    }
+  };
+
+  // value_size is the select size of the accessor in bytes
+  SparsePullCache(size_t capacity, uint32_t max_staleness_steps,
+                  size_t value_size);
+
+  // start a pull, return its step
+  uint64_t NextStep() { return ++_step; }
+  // copy the fresh values of the keys to values[i], append the index of
+  // every other key to miss_idx
+  void Lookup(const uint64_t* keys, size_t num, float** values, uint64_t step,
+              std::vector<size_t>* miss_idx);
+  // offer the value of a key pulled from the servers at step
+  void Put(uint64_t key, const float* value, uint64_t step);
+  // drop every cached value, called when the table is loaded, cleared or
+  // shrinked on the servers
+  void Invalidate();
+
+  size_t Size();
+  Stat GetStat() {
+    return {_lookup_num, _hit_num, _lookup_num * _key_wire_bytes,
+            (_lookup_num - _hit_num) * _key_wire_bytes};
+  }
+
+ private:
+  static const size_t kSegmentNum = 16;
+  static const size_t kSketchDepth = 4;
+  static const uint8_t kAdmitFreq = 2;
+
+  struct Entry {
+    uint64_t step;
+    std::vector<float> value;
+  };
+  struct Segment {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::vector<uint8_t> sketch;
+    size_t sample_num = 0;
+  };
+
+  static uint64_t Mix(uint64_t key);
+  // the sketch is indexed by the low bits
+  Segment& SegmentOf(uint64_t mixed) {
+    return _segments[(mixed >> 60) % kSegmentNum];
+  }
+  // count-min sketch, halved every 10 * width increments
+  void Increment(Segment* segment, uint64_t mixed);
+  uint8_t Frequency(const Segment& segment, uint64_t mixed) const;
+  bool Fresh(const Entry& entry, uint64_t step) const {
+    return entry.step >= _valid_step &&
+           entry.step + _max_staleness_steps > step;
+  }
+  // keep the segment_capacity most frequent fresh entries
+  void Prune(Segment* segment, uint64_t step);
+
+  size_t _segment_capacity;
+  uint32_t _max_staleness_steps;
+  size_t _value_size;
+  size_t _value_num;
+  // key, key counter and value of one key in a pull
+  size_t _key_wire_bytes;
+  size_t _sketch_width;
+  Segment _segments[kSegmentNum];
+
+  std::atomic<uint64_t> _step{0};
+  // values pulled before this step are invalid
+  std::atomic<uint64_t> _valid_step{0};
+  std::atomic<uint64_t> _lookup_num{0};
+  std::atomic<uint64_t> _hit_num{0};
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -45,6 +45,7 @@ struct DataConverter {
   int param;
   std::string converter;
   std::string deconverter;
+  bool binary;
 };
 
 struct AccessorInfo {
@@ -81,8 +82,9 @@ class ValueAccessor {
             _config.table_accessor_save_param(i).converter();
         std::string deconverter =
             _config.table_accessor_save_param(i).deconverter();
+        bool binary = _config.table_accessor_save_param(i).binary();
         _data_coverter_map[param] = std::make_shared<DataConverter>();
-        *(_data_coverter_map[param]) = {param, converter, deconverter};
+        *(_data_coverter_map[param]) = {param, converter, deconverter, binary};
       }
     }
     return 0;
@@ -111,6 +113,22 @@ class ValueAccessor {
       return (*itr).second->deconverter;
     }
   }
+  // save/load in binary block format instead of text lines
+  virtual bool IsBinaryFormat(int param) {
+    auto itr = _data_coverter_map.find(param);
+    if (itr == _data_coverter_map.end()) {
+      return false;
+    } else {
+      return (*itr).second->binary;
+    }
+  }
+  // bits an embedx weight is stored in, recorded by the binary format
+  virtual int EmbedxQuantBits() { return 32; }
+  // leading floats of a push value, such as slot, show and click, that are
+  // sent in fp32 by a low precision push, see sparse_wire_codec.h
+  virtual size_t UpdateExactDim() { return _accessor_info.update_dim; }
+  // leading floats of a pull value sent in fp32 by a low precision pull
+  virtual size_t SelectExactDim() { return _accessor_info.select_dim; }
   // 判断该value是否进行shrink
   virtual bool Shrink(float* value) = 0;
 
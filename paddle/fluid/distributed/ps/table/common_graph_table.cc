@@ -18,15 +18,21 @@
 
 #include <algorithm>
 #include <chrono>
+#include <numeric>
 #include <set>
 #include <sstream>
 
+#include "gflags/gflags.h"
 #include "paddle/fluid/distributed/common/utils.h"
 #include "paddle/fluid/distributed/ps/table/graph/graph_node.h"
 #include "paddle/fluid/framework/generator.h"
 #include "paddle/fluid/string/printf.h"
 #include "paddle/fluid/string/string_helper.h"
 
+DEFINE_bool(graph_edges_use_csr, true,
+            "store the loaded edges of a graph table as csr instead of in "
+            "the nodes");
+
 namespace paddle {
 namespace distributed {
 
@@ -893,11 +899,72 @@ void GraphShard::clear() {
   }
   bucket.clear();
   node_location.clear();
+  csr.reset();
+  csr_row_pos.clear();
+}
+
+void GraphShard::build_csr() {
+  if (csr != nullptr) {
+    return;
+  }
+  bool is_weighted = false;
+  size_t edge_num = 0;
+  for (auto *node : bucket) {
+    GraphNode *graph_node = dynamic_cast<GraphNode *>(node);
+    if (graph_node == nullptr) {
+      return;
+    }
+    is_weighted = is_weighted || graph_node->is_weighted_edges();
+    edge_num += node->get_neighbor_size();
+  }
+  // the rows are sorted by node id, the bucket keeps its order for the
+  // node samples and the batches read by position
+  std::vector<int> row_pos(bucket.size());
+  std::iota(row_pos.begin(), row_pos.end(), 0);
+  std::sort(row_pos.begin(), row_pos.end(), [this](int a, int b) {
+    return (int64_t)bucket[a]->get_id() < (int64_t)bucket[b]->get_id();
+  });
+  std::vector<int64_t> ids(bucket.size());
+  std::vector<uint64_t> offsets(bucket.size() + 1, 0);
+  std::vector<int64_t> neighbor_ids(edge_num);
+  std::vector<float> weights(is_weighted ? edge_num : 0);
+  for (size_t row = 0; row < bucket.size(); row++) {
+    Node *node = bucket[row_pos[row]];
+    ids[row] = node->get_id();
+    uint64_t offset = offsets[row];
+    for (size_t i = 0; i < node->get_neighbor_size(); i++) {
+      neighbor_ids[offset + i] = node->get_neighbor_id(i);
+      if (is_weighted) {
+        weights[offset + i] = node->get_neighbor_weight(i);
+      }
+    }
+    offsets[row + 1] = offset + node->get_neighbor_size();
+  }
+  csr.reset(new GraphCSR(std::move(ids), std::move(offsets),
+                         std::move(neighbor_ids), std::move(weights)));
+  for (size_t row = 0; row < bucket.size(); row++) {
+    ((GraphNode *)bucket[row_pos[row]])->bind_csr(csr.get(), row);
+  }
+  csr_row_pos = std::move(row_pos);
+  std::unordered_map<int64_t, int>().swap(node_location);
+}
+
+void GraphShard::release_csr() {
+  if (csr == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < bucket.size(); i++) {
+    node_location[bucket[i]->get_id()] = i;
+    ((GraphNode *)bucket[i])->unbind_csr();
+  }
+  csr.reset();
+  std::vector<int>().swap(csr_row_pos);
 }
 
 GraphShard::~GraphShard() { clear(); }
 
 void GraphShard::delete_node(int64_t id) {
+  release_csr();
   auto iter = node_location.find(id);
   if (iter == node_location.end()) return;
   int pos = iter->second;
@@ -910,6 +977,7 @@ void GraphShard::delete_node(int64_t id) {
   bucket.pop_back();
 }
 GraphNode *GraphShard::add_graph_node(int64_t id) {
+  release_csr();
   if (node_location.find(id) == node_location.end()) {
     node_location[id] = bucket.size();
     bucket.push_back(new GraphNode(id));
@@ -918,6 +986,7 @@ GraphNode *GraphShard::add_graph_node(int64_t id) {
 }
 
 GraphNode *GraphShard::add_graph_node(Node *node) {
+  release_csr();
   auto id = node->get_id();
   if (node_location.find(id) == node_location.end()) {
     node_location[id] = bucket.size();
@@ -926,6 +995,7 @@ GraphNode *GraphShard::add_graph_node(Node *node) {
   return (GraphNode *)bucket[node_location[id]];
 }
 FeatureNode *GraphShard::add_feature_node(int64_t id) {
+  release_csr();
   if (node_location.find(id) == node_location.end()) {
     node_location[id] = bucket.size();
     bucket.push_back(new FeatureNode(id));
@@ -934,10 +1004,15 @@ FeatureNode *GraphShard::add_feature_node(int64_t id) {
 }
 
 void GraphShard::add_neighbor(int64_t id, int64_t dst_id, float weight) {
+  release_csr();
   find_node(id)->add_edge(dst_id, weight);
 }
 
 Node *GraphShard::find_node(int64_t id) {
+  if (csr != nullptr) {
+    int64_t row = csr->find(id);
+    return row < 0 ? nullptr : bucket[csr_row_pos[row]];
+  }
   auto iter = node_location.find(id);
   return iter == node_location.end() ? nullptr : bucket[iter->second];
 }
@@ -1175,6 +1250,9 @@ int32_t GraphTable::load_edges(const std::string &path, bool reverse_edge,
     return 0;
   }
 #endif
+  if (FLAGS_graph_edges_use_csr) {
+    return build_csr(idx);
+  }
   for (auto &shard : edge_shards[idx]) {
     auto bucket = shard->get_bucket();
     for (size_t i = 0; i < bucket.size(); i++) {
@@ -1185,6 +1263,42 @@ int32_t GraphTable::load_edges(const std::string &path, bool reverse_edge,
   return 0;
 }
 
+int32_t GraphTable::build_csr(int idx) {
+  auto &shards = edge_shards[idx];
+  std::vector<std::future<int>> tasks;
+  for (size_t i = 0; i < shards.size(); i++) {
+    size_t pool_idx = get_thread_pool_index_by_shard_index(i + shard_start);
+    tasks.push_back(_shards_task_pool[pool_idx]->enqueue([&shards, i]() -> int {
+      shards[i]->build_csr();
+      return 0;
+    }));
+  }
+  size_t edge_num = 0, memory_size = 0;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    tasks[i].get();
+    if (shards[i]->get_csr() != nullptr) {
+      edge_num += shards[i]->get_csr()->edge_num();
+      memory_size += shards[i]->get_csr()->memory_size();
+    }
+  }
+  VLOG(0) << "build csr of " << edge_num << " edges of edge type " << idx
+          << " in " << memory_size << " bytes";
+  return 0;
+}
+
+const GraphCSR *GraphTable::find_csr(int idx, int64_t id, int64_t *row) {
+  size_t shard_id = id % shard_num;
+  if (shard_id >= shard_end || shard_id < shard_start) {
+    return nullptr;
+  }
+  const GraphCSR *csr = edge_shards[idx][shard_id - shard_start]->get_csr();
+  if (csr == nullptr) {
+    return nullptr;
+  }
+  *row = csr->find(id);
+  return *row < 0 ? nullptr : csr;
+}
+
 Node *GraphTable::find_node(int type_id, int idx, int64_t id) {
   size_t shard_id = id % shard_num;
   if (shard_id >= shard_end || shard_id < shard_start) {
@@ -1280,7 +1394,7 @@ int32_t GraphTable::random_sample_nodes(int type_id, int idx, int sample_size,
 int32_t GraphTable::random_sample_neighbors(
     int idx, int64_t *node_ids, int sample_size,
     std::vector<std::shared_ptr<char>> &buffers, std::vector<int> &actual_sizes,
-    bool need_weight) {
+    bool need_weight, bool with_replacement) {
   size_t node_num = buffers.size();
   std::function<void(char *)> char_del = [](char *c) { delete[] c; };
   std::vector<std::future<int>> tasks;
@@ -1297,76 +1411,73 @@ int32_t GraphTable::random_sample_neighbors(
     if (seq_id[i].size() == 0) continue;
     tasks.push_back(_shards_task_pool[i]->enqueue([&, i, this]() -> int {
       int64_t node_id;
-      std::vector<std::pair<SampleKey, SampleResult>> r;
-      LRUResponse response = LRUResponse::blocked;
-      if (use_cache) {
-        response =
-            scaled_lru->query(i, id_list[i].data(), id_list[i].size(), r);
-      }
-      int index = 0;
-      std::vector<SampleResult> sample_res;
-      std::vector<SampleKey> sample_keys;
+      bool cached = use_cache && !with_replacement;
+      SampleResult cached_result(0, static_cast<char *>(nullptr));
       auto &rng = _shards_task_rng_pool[i];
       for (size_t k = 0; k < id_list[i].size(); k++) {
-        if (index < (int)r.size() &&
-            r[index].first.node_key == id_list[i][k].node_key) {
-          int idy = seq_id[i][k];
-          actual_sizes[idy] = r[index].second.actual_size;
-          buffers[idy] = r[index].second.buffer;
-          index++;
-        } else {
-          node_id = id_list[i][k].node_key;
-          Node *node = find_node(0, idx, node_id);
-          int idy = seq_id[i][k];
-          int &actual_size = actual_sizes[idy];
-          if (node == nullptr) {
+        int idy = seq_id[i][k];
+        if (cached && sample_cache->query(id_list[i][k], &cached_result)) {
+          actual_sizes[idy] = cached_result.actual_size;
+          buffers[idy] = cached_result.buffer;
+          continue;
+        }
+        node_id = id_list[i][k].node_key;
+        // sample from the csr directly when the edges are stored in one
+        int64_t row = -1;
+        const GraphCSR *csr = find_csr(idx, node_id, &row);
+        Node *node = csr != nullptr ? nullptr : find_node(0, idx, node_id);
+        int &actual_size = actual_sizes[idy];
+        if (csr == nullptr && node == nullptr) {
 #ifdef PADDLE_WITH_HETERPS
-            if (search_level == 2) {
-              VLOG(2) << "enter sample from ssd for node_id " << node_id;
-              char *buffer_addr = random_sample_neighbor_from_ssd(
-                  idx, node_id, sample_size, rng, actual_size);
-              if (actual_size != 0) {
-                std::shared_ptr<char> &buffer = buffers[idy];
-                buffer.reset(buffer_addr, char_del);
-              }
-              VLOG(2) << "actual sampled size from ssd = " << actual_sizes[idy];
-              continue;
+          if (search_level == 2) {
+            VLOG(2) << "enter sample from ssd for node_id " << node_id;
+            char *buffer_addr = random_sample_neighbor_from_ssd(
+                idx, node_id, sample_size, rng, actual_size);
+            if (actual_size != 0) {
+              std::shared_ptr<char> &buffer = buffers[idy];
+              buffer.reset(buffer_addr, char_del);
             }
-#endif
-            actual_size = 0;
+            VLOG(2) << "actual sampled size from ssd = " << actual_sizes[idy];
             continue;
           }
-          std::shared_ptr<char> &buffer = buffers[idy];
-          std::vector<int> res = node->sample_k(sample_size, rng);
-          actual_size =
-              res.size() * (need_weight ? (Node::id_size + Node::weight_size)
-                                        : Node::id_size);
-          int offset = 0;
-          int64_t id;
-          float weight;
-          char *buffer_addr = new char[actual_size];
-          if (response == LRUResponse::ok) {
-            sample_keys.emplace_back(idx, node_id, sample_size, need_weight);
-            sample_res.emplace_back(actual_size, buffer_addr);
-            buffer = sample_res.back().buffer;
-          } else {
-            buffer.reset(buffer_addr, char_del);
-          }
-          for (int &x : res) {
-            id = node->get_neighbor_id(x);
-            memcpy(buffer_addr + offset, &id, Node::id_size);
-            offset += Node::id_size;
-            if (need_weight) {
-              weight = node->get_neighbor_weight(x);
-              memcpy(buffer_addr + offset, &weight, Node::weight_size);
-              offset += Node::weight_size;
-            }
+#endif
+          actual_size = 0;
+          continue;
+        }
+        std::shared_ptr<char> &buffer = buffers[idy];
+        std::vector<int> res;
+        if (with_replacement) {
+          res = csr != nullptr
+                    ? csr->sample_k_with_replacement(row, sample_size, rng)
+                    : node->sample_k_with_replacement(sample_size, rng);
+        } else {
+          res = csr != nullptr ? csr->sample_k(row, sample_size, rng)
+                               : node->sample_k(sample_size, rng);
+        }
+        actual_size =
+            res.size() * (need_weight ? (Node::id_size + Node::weight_size)
+                                      : Node::id_size);
+        int offset = 0;
+        int64_t id;
+        float weight;
+        char *buffer_addr = new char[actual_size];
+        buffer.reset(buffer_addr, char_del);
+        for (int &x : res) {
+          id = csr != nullptr ? csr->get_neighbor_id(row, x)
+                              : node->get_neighbor_id(x);
+          memcpy(buffer_addr + offset, &id, Node::id_size);
+          offset += Node::id_size;
+          if (need_weight) {
+            weight = csr != nullptr ? csr->get_neighbor_weight(row, x)
+                                    : node->get_neighbor_weight(x);
+            memcpy(buffer_addr + offset, &weight, Node::weight_size);
+            offset += Node::weight_size;
           }
         }
-      }
-      if (sample_res.size()) {
-        scaled_lru->insert(i, sample_keys.data(), sample_res.data(),
-                           sample_keys.size());
+        if (cached) {
+          sample_cache->insert(id_list[i][k],
+                               SampleResult(actual_size, buffer));
+        }
       }
       return 0;
     }));
@@ -1377,6 +1488,128 @@ int32_t GraphTable::random_sample_neighbors(
   return 0;
 }
 
+// every server keeps the samples of its own nodes in its part file
+static std::string sample_cache_part_path(const std::string &path,
+                                          size_t shard_idx) {
+  return paddle::string::format_string("%s.part-%05zu", path.c_str(),
+                                       shard_idx);
+}
+
+int32_t GraphTable::save_neighbor_sample_cache(const std::string &path) {
+  if (sample_cache == nullptr) {
+    return -1;
+  }
+  return sample_cache->save(sample_cache_part_path(path, _shard_idx));
+}
+
+int32_t GraphTable::load_neighbor_sample_cache(const std::string &path) {
+  if (sample_cache == nullptr) {
+    return -1;
+  }
+  std::string part_path = sample_cache_part_path(path, _shard_idx);
+  int32_t ret = sample_cache->load(part_path);
+  auto stat = sample_cache->get_stat();
+  VLOG(0) << "load neighbor sample cache from " << part_path << " ret " << ret
+          << ", " << stat.size << " samples";
+  return ret;
+}
+
+GraphSampleCacheStat GraphTable::get_neighbor_sample_cache_stat() {
+  if (sample_cache == nullptr) {
+    return GraphSampleCacheStat();
+  }
+  return sample_cache->get_stat();
+}
+
+int32_t GraphTable::sample_neighbors(
+    int idx, const std::vector<int64_t> &ids, int sample_size,
+    bool need_weight, std::vector<std::vector<int64_t>> &neighbors,
+    std::vector<std::vector<float>> &weights) {
+  size_t node_num = ids.size();
+  std::vector<std::shared_ptr<char>> buffers(node_num);
+  std::vector<int> actual_sizes(node_num, 0);
+  int32_t ret = random_sample_neighbors(idx, const_cast<int64_t *>(ids.data()),
+                                        sample_size, buffers, actual_sizes,
+                                        need_weight);
+  if (ret != 0) {
+    return ret;
+  }
+  neighbors.assign(node_num, {});
+  weights.assign(need_weight ? node_num : 0, {});
+  for (size_t i = 0; i < node_num; i++) {
+    char *buffer = buffers[i].get();
+    int offset = 0;
+    while (offset < actual_sizes[i]) {
+      int64_t id;
+      memcpy(&id, buffer + offset, Node::id_size);
+      neighbors[i].push_back(id);
+      offset += Node::id_size;
+      if (need_weight) {
+        float weight;
+        memcpy(&weight, buffer + offset, Node::weight_size);
+        weights[i].push_back(weight);
+        offset += Node::weight_size;
+      }
+    }
+  }
+  return 0;
+}
+
+int32_t GraphTable::sample_subgraph(int idx, const std::vector<int64_t> &seeds,
+                                    const std::vector<int> &fanouts,
+                                    bool need_weight, GraphSubgraph *subgraph,
+                                    NeighborSampleFunc sample_neighbors) {
+  if (!sample_neighbors) {
+    sample_neighbors = [&](const std::vector<int64_t> &ids, int fanout,
+                           std::vector<std::vector<int64_t>> &neighbors,
+                           std::vector<std::vector<float>> &weights) {
+      return this->sample_neighbors(idx, ids, fanout, need_weight, neighbors,
+                                    weights);
+    };
+  }
+  subgraph->clear();
+  auto &node_ids = subgraph->node_ids;
+  std::unordered_map<int64_t, int> node_index;
+  for (int64_t id : seeds) {
+    if (node_index.emplace(id, node_ids.size()).second) {
+      node_ids.push_back(id);
+    }
+  }
+  // the nodes first reached by the last hop are [begin, node_ids.size())
+  size_t begin = 0;
+  subgraph->hop_offsets.push_back(0);
+  std::vector<std::vector<int64_t>> neighbors;
+  std::vector<std::vector<float>> weights;
+  for (int fanout : fanouts) {
+    size_t end = node_ids.size();
+    if (begin < end) {
+      std::vector<int64_t> frontier(node_ids.begin() + begin,
+                                    node_ids.begin() + end);
+      int32_t ret = sample_neighbors(frontier, fanout, neighbors, weights);
+      if (ret != 0) {
+        return ret;
+      }
+      for (size_t i = 0; i < frontier.size(); i++) {
+        for (size_t j = 0; j < neighbors[i].size(); j++) {
+          auto iter =
+              node_index.emplace(neighbors[i][j], node_ids.size()).first;
+          if (iter->second == static_cast<int>(node_ids.size())) {
+            node_ids.push_back(neighbors[i][j]);
+          }
+          subgraph->edge_src.push_back(begin + i);
+          subgraph->edge_dst.push_back(iter->second);
+          if (need_weight) {
+            subgraph->edge_weight.push_back(weights[i][j]);
+          }
+        }
+      }
+    }
+    subgraph->hop_offsets.push_back(subgraph->edge_src.size());
+    begin = end;
+  }
+  return 0;
+}
+
 int32_t GraphTable::get_node_feat(int idx, const std::vector<int64_t> &node_ids,
                                   const std::vector<std::string> &feature_names,
                                   std::vector<std::vector<std::string>> &res) {
@@ -1611,7 +1844,8 @@ int32_t GraphTable::Initialize(const GraphParameter &graph) {
   if (use_cache) {
     cache_size_limit = graph.cache_size_limit();
     cache_ttl = graph.cache_ttl();
-    make_neighbor_sample_cache((size_t)cache_size_limit, (size_t)cache_ttl);
+    make_neighbor_sample_cache((size_t)cache_size_limit, (size_t)cache_ttl,
+                               (size_t)graph.cache_admit_count());
   }
   _shards_task_pool.resize(task_pool_size_);
   for (size_t i = 0; i < _shards_task_pool.size(); ++i) {
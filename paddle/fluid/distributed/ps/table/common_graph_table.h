@@ -42,6 +42,7 @@
 #include "paddle/fluid/distributed/ps/table/common_table.h"
 #include "paddle/fluid/distributed/ps/table/graph/class_macro.h"
 #include "paddle/fluid/distributed/ps/table/graph/graph_node.h"
+#include "paddle/fluid/distributed/ps/table/graph/graph_sample_cache.h"
 #include "paddle/fluid/string/string_helper.h"
 #include "paddle/phi/core/utils/rw_lock.h"
 
@@ -80,289 +81,51 @@ class GraphShard {
   void clear();
   void add_neighbor(int64_t id, int64_t dst_id, float weight);
   std::unordered_map<int64_t, int> &get_node_location() {
+    release_csr();
     return node_location;
   }
+  // move the edges of the graph nodes into a csr sorted by node id, which
+  // then replaces node_location, a later change of the shard frees it, the
+  // order of the bucket is kept
+  void build_csr();
+  const GraphCSR *get_csr() { return csr.get(); }
 
  private:
+  // restore node_location and the edges of the nodes
+  void release_csr();
+
   std::unordered_map<int64_t, int> node_location;
   std::vector<Node *> bucket;
+  std::unique_ptr<GraphCSR> csr;
+  // bucket[csr_row_pos[row]] is the node of a row of the csr
+  std::vector<int> csr_row_pos;
 };
 
-enum LRUResponse { ok = 0, blocked = 1, err = 2 };
-
-struct SampleKey {
-  int idx;
-  int64_t node_key;
-  size_t sample_size;
-  bool is_weighted;
-  SampleKey(int _idx, int64_t _node_key, size_t _sample_size,
-            bool _is_weighted) {
-    idx = _idx;
-    node_key = _node_key;
-    sample_size = _sample_size;
-    is_weighted = _is_weighted;
-  }
-  bool operator==(const SampleKey &s) const {
-    return idx == s.idx && node_key == s.node_key &&
-           sample_size == s.sample_size && is_weighted == s.is_weighted;
-  }
-};
-
-class SampleResult {
- public:
-  size_t actual_size;
-  std::shared_ptr<char> buffer;
-  SampleResult(size_t _actual_size, std::shared_ptr<char> &_buffer)
-      : actual_size(_actual_size), buffer(_buffer) {}
-  SampleResult(size_t _actual_size, char *_buffer)
-      : actual_size(_actual_size),
-        buffer(_buffer, [](char *p) { delete[] p; }) {}
-  ~SampleResult() {}
-};
-
-template <typename K, typename V>
-class LRUNode {
- public:
-  LRUNode(K _key, V _data, size_t _ttl) : key(_key), data(_data), ttl(_ttl) {
-    next = pre = NULL;
-  }
-  K key;
-  V data;
-  size_t ttl;
-  // time to live
-  LRUNode<K, V> *pre, *next;
-};
-template <typename K, typename V>
-class ScaledLRU;
-
-template <typename K, typename V>
-class RandomSampleLRU {
- public:
-  RandomSampleLRU(ScaledLRU<K, V> *_father) {
-    father = _father;
-    remove_count = 0;
-    node_size = 0;
-    node_head = node_end = NULL;
-    global_ttl = father->ttl;
-    total_diff = 0;
-  }
-
-  ~RandomSampleLRU() {
-    LRUNode<K, V> *p;
-    while (node_head != NULL) {
-      p = node_head->next;
-      delete node_head;
-      node_head = p;
-    }
-  }
-  LRUResponse query(K *keys, size_t length, std::vector<std::pair<K, V>> &res) {
-    if (pthread_rwlock_tryrdlock(&father->rwlock) != 0)
-      return LRUResponse::blocked;
-    // pthread_rwlock_rdlock(&father->rwlock);
-    int init_size = node_size - remove_count;
-    process_redundant(length * 3);
-
-    for (size_t i = 0; i < length; i++) {
-      auto iter = key_map.find(keys[i]);
-      if (iter != key_map.end()) {
-        res.emplace_back(keys[i], iter->second->data);
-        iter->second->ttl--;
-        if (iter->second->ttl == 0) {
-          remove(iter->second);
-          if (remove_count != 0) remove_count--;
-        } else {
-          move_to_tail(iter->second);
-        }
-      }
-    }
-    total_diff += node_size - remove_count - init_size;
-    if (total_diff >= 500 || total_diff < -500) {
-      father->handle_size_diff(total_diff);
-      total_diff = 0;
-    }
-    pthread_rwlock_unlock(&father->rwlock);
-    return LRUResponse::ok;
-  }
-  LRUResponse insert(K *keys, V *data, size_t length) {
-    if (pthread_rwlock_tryrdlock(&father->rwlock) != 0)
-      return LRUResponse::blocked;
-    // pthread_rwlock_rdlock(&father->rwlock);
-    int init_size = node_size - remove_count;
-    process_redundant(length * 3);
-    for (size_t i = 0; i < length; i++) {
-      auto iter = key_map.find(keys[i]);
-      if (iter != key_map.end()) {
-        move_to_tail(iter->second);
-        iter->second->ttl = global_ttl;
-        iter->second->data = data[i];
-      } else {
-        LRUNode<K, V> *temp = new LRUNode<K, V>(keys[i], data[i], global_ttl);
-        add_new(temp);
-      }
-    }
-    total_diff += node_size - remove_count - init_size;
-    if (total_diff >= 500 || total_diff < -500) {
-      father->handle_size_diff(total_diff);
-      total_diff = 0;
-    }
-
-    pthread_rwlock_unlock(&father->rwlock);
-    return LRUResponse::ok;
-  }
-  void remove(LRUNode<K, V> *node) {
-    fetch(node);
-    node_size--;
-    key_map.erase(node->key);
-    delete node;
-  }
-
-  void process_redundant(int process_size) {
-    int length = std::min(remove_count, process_size);
-    while (length--) {
-      remove(node_head);
-      remove_count--;
-    }
-    // std::cerr<<"after remove_count = "<<remove_count<<std::endl;
-  }
-
-  void move_to_tail(LRUNode<K, V> *node) {
-    fetch(node);
-    place_at_tail(node);
-  }
-
-  void add_new(LRUNode<K, V> *node) {
-    node->ttl = global_ttl;
-    place_at_tail(node);
-    node_size++;
-    key_map[node->key] = node;
-  }
-  void place_at_tail(LRUNode<K, V> *node) {
-    if (node_end == NULL) {
-      node_head = node_end = node;
-      node->next = node->pre = NULL;
-    } else {
-      node_end->next = node;
-      node->pre = node_end;
-      node->next = NULL;
-      node_end = node;
-    }
-  }
-
-  void fetch(LRUNode<K, V> *node) {
-    if (node->pre) {
-      node->pre->next = node->next;
-    } else {
-      node_head = node->next;
-    }
-    if (node->next) {
-      node->next->pre = node->pre;
-    } else {
-      node_end = node->pre;
-    }
+// A subgraph sampled hop by hop from some seeds. The nodes are numbered by
+// their position in node_ids, the seeds first, then the nodes reached by
+// each hop in order. Edge e goes from edge_src[e] to edge_dst[e], the edges
+// of hop h are [hop_offsets[h], hop_offsets[h + 1]), edge_weight is only
+// filled when the weights are asked for.
+struct GraphSubgraph {
+  std::vector<int64_t> node_ids;
+  std::vector<int> edge_src;
+  std::vector<int> edge_dst;
+  std::vector<float> edge_weight;
+  std::vector<int> hop_offsets;
+  void clear() {
+    node_ids.clear();
+    edge_src.clear();
+    edge_dst.clear();
+    edge_weight.clear();
+    hop_offsets.clear();
   }
-
- private:
-  std::unordered_map<K, LRUNode<K, V> *> key_map;
-  ScaledLRU<K, V> *father;
-  size_t global_ttl, size_limit;
-  int node_size, total_diff;
-  LRUNode<K, V> *node_head, *node_end;
-  friend class ScaledLRU<K, V>;
-  int remove_count;
 };
 
-template <typename K, typename V>
-class ScaledLRU {
- public:
-  ScaledLRU(size_t _shard_num, size_t size_limit, size_t _ttl)
-      : size_limit(size_limit), ttl(_ttl) {
-    shard_num = _shard_num;
-    pthread_rwlock_init(&rwlock, NULL);
-    stop = false;
-    thread_pool.reset(new ::ThreadPool(1));
-    global_count = 0;
-    lru_pool = std::vector<RandomSampleLRU<K, V>>(shard_num,
-                                                  RandomSampleLRU<K, V>(this));
-    shrink_job = std::thread([this]() -> void {
-      while (true) {
-        {
-          std::unique_lock<std::mutex> lock(mutex_);
-          cv_.wait_for(lock, std::chrono::milliseconds(20000));
-          if (stop) {
-            return;
-          }
-        }
-        auto status =
-            thread_pool->enqueue([this]() -> int { return Shrink(); });
-        status.wait();
-      }
-    });
-    shrink_job.detach();
-  }
-  ~ScaledLRU() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    stop = true;
-    cv_.notify_one();
-  }
-  LRUResponse query(size_t index, K *keys, size_t length,
-                    std::vector<std::pair<K, V>> &res) {
-    return lru_pool[index].query(keys, length, res);
-  }
-  LRUResponse insert(size_t index, K *keys, V *data, size_t length) {
-    return lru_pool[index].insert(keys, data, length);
-  }
-  int Shrink() {
-    int node_size = 0;
-    for (size_t i = 0; i < lru_pool.size(); i++) {
-      node_size += lru_pool[i].node_size - lru_pool[i].remove_count;
-    }
-
-    if ((size_t)node_size <= size_t(1.1 * size_limit) + 1) return 0;
-    if (pthread_rwlock_wrlock(&rwlock) == 0) {
-      global_count = 0;
-      for (size_t i = 0; i < lru_pool.size(); i++) {
-        global_count += lru_pool[i].node_size - lru_pool[i].remove_count;
-      }
-      if ((size_t)global_count > size_limit) {
-        size_t remove = global_count - size_limit;
-        for (size_t i = 0; i < lru_pool.size(); i++) {
-          lru_pool[i].total_diff = 0;
-          lru_pool[i].remove_count +=
-              1.0 * (lru_pool[i].node_size - lru_pool[i].remove_count) /
-              global_count * remove;
-        }
-      }
-      pthread_rwlock_unlock(&rwlock);
-      return 0;
-    }
-    return 0;
-  }
-
-  void handle_size_diff(int diff) {
-    if (diff != 0) {
-      __sync_fetch_and_add(&global_count, diff);
-      if (global_count > int(1.25 * size_limit)) {
-        thread_pool->enqueue([this]() -> int { return Shrink(); });
-      }
-    }
-  }
-
-  size_t get_ttl() { return ttl; }
-
- private:
-  pthread_rwlock_t rwlock;
-  size_t shard_num;
-  int global_count;
-  size_t size_limit, total, hit;
-  size_t ttl;
-  bool stop;
-  std::thread shrink_job;
-  std::vector<RandomSampleLRU<K, V>> lru_pool;
-  mutable std::mutex mutex_;
-  std::condition_variable cv_;
-  std::shared_ptr<::ThreadPool> thread_pool;
-  friend class RandomSampleLRU<K, V>;
-};
+// samples the neighbors of ids, and their weights if asked for
+typedef std::function<int32_t(const std::vector<int64_t> &ids, int fanout,
+                              std::vector<std::vector<int64_t>> &neighbors,
+                              std::vector<std::vector<float>> &weights)>
+    NeighborSampleFunc;
 
 /*
 #ifdef PADDLE_WITH_HETERPS
@@ -456,10 +219,27 @@ class GraphTable : public Table {
                                   int &actual_size, bool need_feature,
                                   int step);
 
+  // with_replacement draws sample_size neighbors independently, they may
+  // repeat and are not cached
   virtual int32_t random_sample_neighbors(
       int idx, int64_t *node_ids, int sample_size,
       std::vector<std::shared_ptr<char>> &buffers,
-      std::vector<int> &actual_sizes, bool need_weight);
+      std::vector<int> &actual_sizes, bool need_weight,
+      bool with_replacement = false);
+
+  // random_sample_neighbors decoded to the neighbor ids of every node
+  int32_t sample_neighbors(int idx, const std::vector<int64_t> &ids,
+                           int sample_size, bool need_weight,
+                           std::vector<std::vector<int64_t>> &neighbors,
+                           std::vector<std::vector<float>> &weights);
+  // samples fanouts[h] neighbors of each node first reached by hop h - 1,
+  // starting from the seeds, the nodes are deduplicated and renumbered.
+  // The hops run in the shard task pools of this table, sample_neighbors
+  // replaces them to reach the nodes of other servers.
+  int32_t sample_subgraph(int idx, const std::vector<int64_t> &seeds,
+                          const std::vector<int> &fanouts, bool need_weight,
+                          GraphSubgraph *subgraph,
+                          NeighborSampleFunc sample_neighbors = nullptr);
 
   int32_t random_sample_nodes(int type_id, int idx, int sample_size,
                               std::unique_ptr<char[]> &buffers,
@@ -476,6 +256,8 @@ class GraphTable : public Table {
 
   int32_t load_edges(const std::string &path, bool reverse,
                      const std::string &edge_type);
+  // store the edges of the shards of an edge type as csr
+  int32_t build_csr(int idx);
 
   std::vector<std::vector<int64_t>> get_all_id(int type, int idx,
                                                int slice_num);
@@ -488,6 +270,9 @@ class GraphTable : public Table {
 
   int32_t get_server_index_by_id(int64_t id);
   Node *find_node(int type_id, int idx, int64_t id);
+  // the csr holding the edges of a node and its row, nullptr if the node
+  // is not in a csr
+  const GraphCSR *find_csr(int idx, int64_t id, int64_t *row);
 
   virtual int32_t Pull(TableContext &context) { return 0; }
   virtual int32_t Push(TableContext &context) { return 0; }
@@ -528,17 +313,26 @@ class GraphTable : public Table {
 
   size_t get_server_num() { return server_num; }
   void clear_graph(int idx);
-  virtual int32_t make_neighbor_sample_cache(size_t size_limit, size_t ttl) {
+  // a sample is cached once its node was sampled admit_count times lately,
+  // and then served ttl times
+  virtual int32_t make_neighbor_sample_cache(size_t size_limit, size_t ttl,
+                                             size_t admit_count = 2) {
     {
       std::unique_lock<std::mutex> lock(mutex_);
-      if (use_cache == false) {
-        scaled_lru.reset(new ScaledLRU<SampleKey, SampleResult>(
-            task_pool_size_, size_limit, ttl));
+      if (sample_cache == nullptr) {
+        sample_cache.reset(new GraphSampleCache(task_pool_size_, size_limit,
+                                                ttl, admit_count));
         use_cache = true;
       }
     }
     return 0;
   }
+  // snapshot of the cached samples, to warm start a later run once the
+  // same graph is loaded, 0 on success. The servers are sent these by
+  // GraphBrpcClient::save_sample_cache and load_sample_cache.
+  int32_t save_neighbor_sample_cache(const std::string &path);
+  int32_t load_neighbor_sample_cache(const std::string &path);
+  GraphSampleCacheStat get_neighbor_sample_cache_stat();
   virtual void load_node_weight(int type_id, int idx, std::string path);
 #ifdef PADDLE_WITH_HETERPS
   // virtual int32_t start_graph_sampling() {
@@ -600,7 +394,7 @@ class GraphTable : public Table {
 
   std::vector<std::shared_ptr<::ThreadPool>> _shards_task_pool;
   std::vector<std::shared_ptr<std::mt19937_64>> _shards_task_rng_pool;
-  std::shared_ptr<ScaledLRU<SampleKey, SampleResult>> scaled_lru;
+  std::shared_ptr<GraphSampleCache> sample_cache;
   std::unordered_set<int64_t> extra_nodes;
   std::unordered_map<int64_t, size_t> extra_nodes_to_thread_index;
   bool use_cache, use_duplicate_nodes;
@@ -663,13 +457,3 @@ class BasicBfsGraphSampler : public GraphSampler {
 }  // namespace distributed
 
 };  // namespace paddle
-
-namespace std {
-
-template <>
-struct hash<paddle::distributed::SampleKey> {
-  size_t operator()(const paddle::distributed::SampleKey &s) const {
-    return s.idx ^ s.node_key ^ s.sample_size;
-  }
-};
-}  // namespace std
@@ -17,6 +17,7 @@
 #include <gflags/gflags.h>
 
 #include "glog/logging.h"
+#include "paddle/fluid/distributed/common/local_random.h"
 #include "paddle/fluid/string/string_helper.h"
 
 namespace paddle {
@@ -35,6 +36,11 @@ int CtrCommonAccessor::Initialize() {
   common_feature_value.embed_sgd_dim = _embed_sgd_rule->Dim();
   common_feature_value.embedx_dim = _config.embedx_dim();
   common_feature_value.embedx_sgd_dim = _embedx_sgd_rule->Dim();
+  common_feature_value.embedx_quant_bits =
+      _config.ctr_accessor_param().embedx_quant_bits();
+  CHECK(IsValidEmbedxQuantBits(common_feature_value.embedx_quant_bits))
+      << "embedx_quant_bits should be 32, 16 or 8, but got "
+      << common_feature_value.embedx_quant_bits;
   _show_click_decay_rate = _config.ctr_accessor_param().show_click_decay_rate();
   _ssd_unseenday_threshold =
       _config.ctr_accessor_param().ssd_unseenday_threshold();
@@ -56,8 +62,9 @@ void CtrCommonAccessor::InitAccessorInfo() {
   _accessor_info.select_size = _accessor_info.select_dim * sizeof(float);
   _accessor_info.update_dim = 4 + embedx_dim;
   _accessor_info.update_size = _accessor_info.update_dim * sizeof(float);
-  _accessor_info.mf_size =
-      (embedx_dim + common_feature_value.embedx_sgd_dim) * sizeof(float);
+  _accessor_info.mf_size = (common_feature_value.EmbedxWDim() +
+                            common_feature_value.embedx_sgd_dim) *
+                           sizeof(float);
 }
 
 bool CtrCommonAccessor::Shrink(float* value) {
@@ -181,9 +188,20 @@ int32_t CtrCommonAccessor::Create(float** values, size_t num) {
     value[common_feature_value.SlotIndex()] = -1;
     _embed_sgd_rule->InitValue(value + common_feature_value.EmbedWIndex(),
                                value + common_feature_value.EmbedG2SumIndex());
-    _embedx_sgd_rule->InitValue(value + common_feature_value.EmbedxWIndex(),
+    if (!IsEmbedxQuantized()) {
+      _embedx_sgd_rule->InitValue(
+          value + common_feature_value.EmbedxWIndex(),
+          value + common_feature_value.EmbedxG2SumIndex(), false);
+      continue;
+    }
+    thread_local std::vector<float> embedx_w;
+    embedx_w.resize(embedx_dim);
+    _embedx_sgd_rule->InitValue(embedx_w.data(),
                                 value + common_feature_value.EmbedxG2SumIndex(),
                                 false);
+    EmbedxQuantEncode(common_feature_value.embedx_quant_bits, embedx_dim,
+                      embedx_w.data(),
+                      value + common_feature_value.EmbedxWIndex());
   }
   return 0;
 }
@@ -213,9 +231,9 @@ int32_t CtrCommonAccessor::Select(float** select_values, const float** values,
         value[common_feature_value.ClickIndex()];
     select_value[CtrCommonPullValue::EmbedWIndex()] =
         value[common_feature_value.EmbedWIndex()];
-    memcpy(select_value + CtrCommonPullValue::EmbedxWIndex(),
-           value + common_feature_value.EmbedxWIndex(),
-           embedx_dim * sizeof(float));
+    EmbedxQuantDecode(common_feature_value.embedx_quant_bits, embedx_dim,
+                      value + common_feature_value.EmbedxWIndex(),
+                      select_value + CtrCommonPullValue::EmbedxWIndex());
   }
   return 0;
 }
@@ -246,6 +264,15 @@ int32_t CtrCommonAccessor::Merge(float** update_values,
 int32_t CtrCommonAccessor::Update(float** update_values,
                                   const float** push_values, size_t num) {
   auto embedx_dim = _config.embedx_dim();
+  // embedx rows are updated by the sgd rule in one batch at the end
+  thread_local std::vector<float*> embedx_w;
+  thread_local std::vector<float*> embedx_sgd;
+  thread_local std::vector<const float*> embedx_g;
+  thread_local std::vector<float> embedx_scale;
+  embedx_w.clear();
+  embedx_sgd.clear();
+  embedx_g.clear();
+  embedx_scale.clear();
   for (size_t value_item = 0; value_item < num; ++value_item) {
     float* update_value = update_values[value_item];
     const float* push_value = push_values[value_item];
@@ -269,11 +296,32 @@ int32_t CtrCommonAccessor::Update(float** update_values,
         update_value + common_feature_value.EmbedWIndex(),
         update_value + common_feature_value.EmbedG2SumIndex(),
         push_value + CtrCommonPushValue::EmbedGIndex(), push_show);
+    if (!IsEmbedxQuantized()) {
+      embedx_w.push_back(update_value + common_feature_value.EmbedxWIndex());
+      embedx_sgd.push_back(update_value +
+                           common_feature_value.EmbedxG2SumIndex());
+      embedx_g.push_back(push_value + CtrCommonPushValue::EmbedxGIndex());
+      embedx_scale.push_back(push_show);
+      continue;
+    }
+    // update in fp32, the optimizer state is never quantized
+    thread_local std::vector<float> embedx_buffer;
+    embedx_buffer.resize(embedx_dim);
+    EmbedxQuantDecode(common_feature_value.embedx_quant_bits, embedx_dim,
+                      update_value + common_feature_value.EmbedxWIndex(),
+                      embedx_buffer.data());
     _embedx_sgd_rule->UpdateValue(
-        update_value + common_feature_value.EmbedxWIndex(),
+        embedx_buffer.data(),
         update_value + common_feature_value.EmbedxG2SumIndex(),
         push_value + CtrCommonPushValue::EmbedxGIndex(), push_show);
+    EmbedxQuantEncode(common_feature_value.embedx_quant_bits, embedx_dim,
+                      embedx_buffer.data(),
+                      update_value + common_feature_value.EmbedxWIndex(),
+                      &local_random_engine());
   }
+  _embedx_sgd_rule->UpdateValueBatch(embedx_w.data(), embedx_sgd.data(),
+                                     embedx_g.data(), embedx_scale.data(),
+                                     embedx_w.size());
   return 0;
 }
 
@@ -321,7 +369,17 @@ std::string CtrCommonAccessor::ParseToString(const float* v, int param) {
   auto score = ShowClickScore(show, click);
   if (score >= _config.embedx_threshold() &&
       param > common_feature_value.EmbedxWIndex()) {
-    for (auto i = common_feature_value.EmbedxWIndex();
+    // text is always fp32, quantized weights are written dequantized
+    int embedx_dim = _config.embedx_dim();
+    thread_local std::vector<float> embedx_w;
+    embedx_w.resize(embedx_dim);
+    EmbedxQuantDecode(common_feature_value.embedx_quant_bits, embedx_dim,
+                      v + common_feature_value.EmbedxWIndex(),
+                      embedx_w.data());
+    for (auto w : embedx_w) {
+      os << " " << w;
+    }
+    for (auto i = common_feature_value.EmbedxG2SumIndex();
          i < common_feature_value.Dim(); ++i) {
       os << " " << v[i];
     }
@@ -331,12 +389,34 @@ std::string CtrCommonAccessor::ParseToString(const float* v, int param) {
 
 int CtrCommonAccessor::ParseFromString(const std::string& str, float* value) {
   int embedx_dim = _config.embedx_dim();
+  if (!IsEmbedxQuantized()) {
+    _embedx_sgd_rule->InitValue(
+        value + common_feature_value.EmbedxWIndex(),
+        value + common_feature_value.EmbedxG2SumIndex());
+    auto ret = paddle::string::str_to_float(str.data(), value);
+    CHECK(ret >= 6) << "expect more than 6 real:" << ret;
+    return ret;
+  }
 
-  _embedx_sgd_rule->InitValue(value + common_feature_value.EmbedxWIndex(),
-                              value + common_feature_value.EmbedxG2SumIndex());
-  auto ret = paddle::string::str_to_float(str.data(), value);
+  // parse the fp32 text into a buffer, then quantize embedx_w into value
+  int embedx_w_index = common_feature_value.EmbedxWIndex();
+  int embedx_g2sum_dim = common_feature_value.embedx_sgd_dim;
+  thread_local std::vector<float> buffer;
+  buffer.resize(embedx_w_index + embedx_dim + embedx_g2sum_dim);
+  _embedx_sgd_rule->InitValue(buffer.data() + embedx_w_index,
+                              buffer.data() + embedx_w_index + embedx_dim);
+  auto ret = paddle::string::str_to_float(str.data(), buffer.data());
   CHECK(ret >= 6) << "expect more than 6 real:" << ret;
-  return ret;
+  memcpy(value, buffer.data(), embedx_w_index * sizeof(float));
+  if (ret <= embedx_w_index) {
+    return ret;
+  }
+  EmbedxQuantEncode(common_feature_value.embedx_quant_bits, embedx_dim,
+                    buffer.data() + embedx_w_index, value + embedx_w_index);
+  memcpy(value + common_feature_value.EmbedxG2SumIndex(),
+         buffer.data() + embedx_w_index + embedx_dim,
+         embedx_g2sum_dim * sizeof(float));
+  return common_feature_value.Dim();
 }
 
 }  // namespace distributed
@@ -21,6 +21,7 @@
 #include "paddle/fluid/distributed/common/registerer.h"
 #include "paddle/fluid/distributed/ps.pb.h"
 #include "paddle/fluid/distributed/ps/table/accessor.h"
+#include "paddle/fluid/distributed/ps/table/depends/embedx_quant.h"
 #include "paddle/fluid/distributed/ps/table/sparse_sgd_rule.h"
 
 namespace paddle {
@@ -38,11 +39,11 @@ class CtrCommonAccessor : public ValueAccessor {
        float click;
        float embed_w;
        std::vector<float> embed_g2sum;
-       std::vector<float> embedx_w;
+       std::vector<float> embedx_w;  // packed by embedx_quant_bits
        std::<vector>float embedx_g2sum;
        */
 
-    int Dim() { return 6 + embed_sgd_dim + embedx_sgd_dim + embedx_dim; }
+    int Dim() { return 6 + embed_sgd_dim + embedx_sgd_dim + EmbedxWDim(); }
     int DimSize(size_t dim, int embedx_dim) { return sizeof(float); }
     int Size() { return Dim() * sizeof(float); }
     int SlotIndex() { return 0; }
@@ -53,7 +54,9 @@ class CtrCommonAccessor : public ValueAccessor {
     int EmbedWIndex() { return ClickIndex() + 1; }
     int EmbedG2SumIndex() { return EmbedWIndex() + 1; }
     int EmbedxWIndex() { return EmbedG2SumIndex() + embed_sgd_dim; }
-    int EmbedxG2SumIndex() { return EmbedxWIndex() + embedx_dim; }
+    int EmbedxG2SumIndex() { return EmbedxWIndex() + EmbedxWDim(); }
+    // float slots taken by the stored embedx_w
+    int EmbedxWDim() { return EmbedxQuantDim(embedx_quant_bits, embedx_dim); }
 
     float& UnseenDays(float* val) { return val[UnseenDaysIndex()]; }
     float& DeltaScore(float* val) { return val[DeltaScoreIndex()]; }
@@ -68,6 +71,7 @@ class CtrCommonAccessor : public ValueAccessor {
     int embed_sgd_dim;
     int embedx_dim;
     int embedx_sgd_dim;
+    int embedx_quant_bits = 32;
   };
 
   struct CtrCommonPushValue {
@@ -138,6 +142,12 @@ class CtrCommonAccessor : public ValueAccessor {
   virtual int Initialize();
   // 初始化AccessorInfo
   virtual void InitAccessorInfo();
+  // the gradients and weights are sent in low precision
+  virtual size_t UpdateExactDim() { return CtrCommonPushValue::EmbedGIndex(); }
+  virtual size_t SelectExactDim() { return CtrCommonPullValue::EmbedWIndex(); }
+  virtual int EmbedxQuantBits() {
+    return common_feature_value.embedx_quant_bits;
+  }
   // 判断该value是否进行shrink
   virtual bool Shrink(float* value);
   // 判断该value是否保存到ssd
@@ -184,6 +194,9 @@ class CtrCommonAccessor : public ValueAccessor {
   }
 
  private:
+  bool IsEmbedxQuantized() {
+    return common_feature_value.embedx_quant_bits != 32;
+  }
   // float ShowClickScore(float show, float click);
 
   // SparseValueSGDRule* _embed_sgd_rule;
@@ -160,6 +160,9 @@ class CtrDoubleAccessor : public ValueAccessor {
   virtual int Initialize();
   // 初始化AccessorInfo
   virtual void InitAccessorInfo();
+  // the gradients and weights are sent in low precision
+  virtual size_t UpdateExactDim() { return CtrDoublePushValue::EmbedGIndex(); }
+  virtual size_t SelectExactDim() { return CtrDoublePullValue::EmbedWIndex(); }
   // 判断该value是否进行shrink
   virtual bool Shrink(float* value);
   virtual bool NeedExtendMF(float* value);
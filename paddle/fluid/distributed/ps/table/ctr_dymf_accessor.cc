@@ -35,6 +35,9 @@ int CtrDymfAccessor::Initialize() {
   common_feature_value.embed_sgd_dim = _embed_sgd_rule->Dim();
   common_feature_value.embedx_dim = _config.embedx_dim();
   common_feature_value.embedx_sgd_dim = _embedx_sgd_rule->Dim();
+  // values are copied to and from the gpu table as raw fp32
+  CHECK_EQ(_config.ctr_accessor_param().embedx_quant_bits(), 32)
+      << "CtrDymfAccessor does not support quantized embedx";
   _show_click_decay_rate = _config.ctr_accessor_param().show_click_decay_rate();
   _ssd_unseenday_threshold =
       _config.ctr_accessor_param().ssd_unseenday_threshold();
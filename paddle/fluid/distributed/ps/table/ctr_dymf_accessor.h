@@ -153,6 +153,9 @@ class CtrDymfAccessor : public ValueAccessor {
   virtual int Initialize();
   // 初始化AccessorInfo
   virtual void InitAccessorInfo();
+  // the gradients and weights are sent in low precision
+  virtual size_t UpdateExactDim() { return CtrDymfPushValue::EmbedGIndex(); }
+  virtual size_t SelectExactDim() { return CtrDymfPullValue::EmbedWIndex(); }
   // 判断该value是否进行shrink
   virtual bool Shrink(float* value);
   // 判断该value是否保存到ssd
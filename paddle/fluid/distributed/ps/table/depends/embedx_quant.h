@@ -0,0 +1,140 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "paddle/phi/common/float16.h"
+
+namespace paddle {
+namespace distributed {
+
+// Storage of the embedx weights inside the float slots of a feature value:
+//   32 bits: dim floats, unchanged
+//   16 bits: dim fp16 values, two per slot
+//    8 bits: a float per-row scale, then dim int8 values, four per slot
+// Unused bytes of the last slot are zero.
+//
+// An update smaller than half a quantization step would be rounded away
+// every time, so the updates encode with stochastic rounding: a weight is
+// rounded up with the probability of its distance to the lower value, which
+// keeps the stored weight unbiased without an fp32 copy.
+inline bool IsValidEmbedxQuantBits(int bits) {
+  return bits == 32 || bits == 16 || bits == 8;
+}
+
+// number of float slots taken by dim weights
+inline int EmbedxQuantDim(int bits, int dim) {
+  if (bits == 16) {
+    return (dim + 1) / 2;
+  } else if (bits == 8) {
+    return 1 + (dim + 3) / 4;
+  }
+  return dim;
+}
+
+// the next fp16 value towards +inf or -inf
+inline phi::dtype::float16 EmbedxQuantFp16Step(phi::dtype::float16 h,
+                                               bool up) {
+  bool negative = (h.x & 0x8000) != 0;
+  if ((h.x & 0x7fff) == 0) {
+    h.x = up ? 0x0001 : 0x8001;
+  } else if (negative == up) {
+    --h.x;
+  } else {
+    ++h.x;
+  }
+  return h;
+}
+
+inline phi::dtype::float16 EmbedxQuantFp16Round(
+    float w, std::default_random_engine* engine) {
+  phi::dtype::float16 h(w);
+  float value = static_cast<float>(h);
+  if (engine == nullptr || !std::isfinite(value) || value == w) {
+    return h;
+  }
+  phi::dtype::float16 other = EmbedxQuantFp16Step(h, value < w);
+  float other_value = static_cast<float>(other);
+  float p = (w - value) / (other_value - value);
+  std::uniform_real_distribution<float> dist(0, 1);
+  return dist(*engine) < p ? other : h;
+}
+
+// rounds to the nearest value, or stochastically when engine is set
+inline void EmbedxQuantEncode(int bits, int dim, const float* w,
+                              float* packed,
+                              std::default_random_engine* engine = nullptr) {
+  if (bits == 16) {
+    char* dst = reinterpret_cast<char*>(packed);
+    memset(dst, 0, EmbedxQuantDim(bits, dim) * sizeof(float));
+    for (int i = 0; i < dim; ++i) {
+      phi::dtype::float16 h = EmbedxQuantFp16Round(w[i], engine);
+      memcpy(dst + i * sizeof(h), &h, sizeof(h));
+    }
+  } else if (bits == 8) {
+    float max_abs = 0.0;
+    for (int i = 0; i < dim; ++i) {
+      max_abs = std::max(max_abs, std::fabs(w[i]));
+    }
+    float scale = max_abs / 127;
+    float inv_scale = scale > 0 ? 1 / scale : 0;
+    packed[0] = scale;
+    char* dst = reinterpret_cast<char*>(packed + 1);
+    memset(dst, 0, (EmbedxQuantDim(bits, dim) - 1) * sizeof(float));
+    std::uniform_real_distribution<float> dist(0, 1);
+    for (int i = 0; i < dim; ++i) {
+      float q = w[i] * inv_scale;
+      if (engine == nullptr) {
+        q = std::round(q);
+      } else {
+        float lower = std::floor(q);
+        q = dist(*engine) < q - lower ? lower + 1 : lower;
+      }
+      q = std::min(127.0f, std::max(-127.0f, q));
+      dst[i] = static_cast<int8_t>(q);
+    }
+  } else {
+    memcpy(packed, w, dim * sizeof(float));
+  }
+}
+
+inline void EmbedxQuantDecode(int bits, int dim, const float* packed,
+                              float* w) {
+  if (bits == 16) {
+    const char* src = reinterpret_cast<const char*>(packed);
+    for (int i = 0; i < dim; ++i) {
+      phi::dtype::float16 h;
+      memcpy(&h, src + i * sizeof(h), sizeof(h));
+      w[i] = static_cast<float>(h);
+    }
+  } else if (bits == 8) {
+    float scale = packed[0];
+    const int8_t* src = reinterpret_cast<const int8_t*>(packed + 1);
+    for (int i = 0; i < dim; ++i) {
+      w[i] = src[i] * scale;
+    }
+  } else {
+    memcpy(w, packed, dim * sizeof(float));
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -14,11 +14,18 @@
 
 #pragma once
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mct/hash-map.hpp>
+#include <mutex>  // NOLINT
 #include <vector>
 
 #include "gflags/gflags.h"
 #include "paddle/fluid/distributed/common/chunk_allocator.h"
+#include "paddle/phi/core/utils/rw_lock.h"
 
 namespace paddle {
 namespace distributed {
@@ -27,19 +34,189 @@ static const int CTR_SPARSE_SHARD_BUCKET_NUM_BITS = 6;
 static const size_t CTR_SPARSE_SHARD_BUCKET_NUM =
     static_cast<size_t>(1) << CTR_SPARSE_SHARD_BUCKET_NUM_BITS;
 
+// Rows of FixedFeatureValue are carved from chunks shared by all rows of the
+// same length, instead of one heap allocation per row. Every length is a
+// size class of its own, so rows grown by mf extension simply move to the
+// class of the extended length. A size class is striped by thread to keep
+// lock contention low. A row goes back to the stripe that gave it, even when
+// released by another thread such as a shrink, so the chunks it empties are
+// freed.
+class FeatureRowPool {
+ public:
+  // slot gets the stripe and chunk of the row, which Release takes back
+  static float* Acquire(size_t size, uint32_t* slot) {
+    if (size == 0) {
+      return NULL;
+    }
+    if (size > MAX_ROW_SIZE) {
+      return reinterpret_cast<float*>(malloc(size * sizeof(float)));
+    }
+    size_t stripe_idx = StripeIndex();
+    auto& stripe = GetSizeClass(size)->stripes[stripe_idx];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    uint32_t chunk_id = 0;
+    float* row = reinterpret_cast<float*>(stripe.alloc->acquire(&chunk_id));
+    *slot = static_cast<uint32_t>(stripe_idx << STRIPE_SHIFT) | chunk_id;
+    return row;
+  }
+
+  static void Release(float* row, size_t size, uint32_t slot) {
+    if (row == NULL) {
+      return;
+    }
+    if (size > MAX_ROW_SIZE) {
+      free(row);
+      return;
+    }
+    auto& stripe = GetSizeClass(size)->stripes[slot >> STRIPE_SHIFT];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    stripe.alloc->release(row, slot & (RowChunkAllocator::MAX_CHUNK_NUM - 1));
+  }
+
+  // bytes held by the chunks of all size classes
+  static size_t MemorySize() {
+    size_t total = 0;
+    for (size_t size = 1; size <= MAX_ROW_SIZE; ++size) {
+      SizeClass* cls = SizeClasses()[size].load(std::memory_order_acquire);
+      if (cls == NULL) {
+        continue;
+      }
+      for (auto& stripe : cls->stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        total += stripe.alloc->memory_size();
+      }
+    }
+    return total;
+  }
+
+ private:
+  static const size_t MAX_ROW_SIZE = 1024;  // longer rows use malloc
+  static const size_t STRIPE_NUM = 16;
+  // a slot is the stripe above the chunk id
+  static const int STRIPE_SHIFT = 28;
+  static_assert(RowChunkAllocator::MAX_CHUNK_NUM == 1U << STRIPE_SHIFT &&
+                    STRIPE_NUM <= 1U << (32 - STRIPE_SHIFT),
+                "a slot holds the stripe and the chunk id");
+
+  struct Stripe {
+    std::mutex mutex;
+    std::unique_ptr<RowChunkAllocator> alloc;
+    // keep stripes on different cache lines
+    char padding[64];
+  };
+  struct SizeClass {
+    explicit SizeClass(size_t size) {
+      for (auto& stripe : stripes) {
+        stripe.alloc.reset(new RowChunkAllocator(size * sizeof(float)));
+      }
+    }
+    Stripe stripes[STRIPE_NUM];
+  };
+
+  static std::atomic<SizeClass*>* SizeClasses() {
+    // size classes live as long as the process, rows may outlive tables
+    static std::atomic<SizeClass*> classes[MAX_ROW_SIZE + 1];
+    return classes;
+  }
+
+  static SizeClass* GetSizeClass(size_t size) {
+    auto& slot = SizeClasses()[size];
+    SizeClass* cls = slot.load(std::memory_order_acquire);
+    if (cls == NULL) {
+      SizeClass* new_cls = new SizeClass(size);
+      if (slot.compare_exchange_strong(cls, new_cls)) {
+        cls = new_cls;
+      } else {
+        delete new_cls;
+      }
+    }
+    return cls;
+  }
+
+  static size_t StripeIndex() {
+    static std::atomic<size_t> counter{0};
+    thread_local size_t index = counter++ % STRIPE_NUM;
+    return index;
+  }
+};
+
 class FixedFeatureValue {
  public:
   FixedFeatureValue() {}
-  ~FixedFeatureValue() {}
-  float* data() { return _data.data(); }
-  size_t size() { return _data.size(); }
-  void resize(size_t size) { _data.resize(size); }
-  void shrink_to_fit() { _data.shrink_to_fit(); }
+  FixedFeatureValue(const FixedFeatureValue& other) { assign(other); }
+  FixedFeatureValue& operator=(const FixedFeatureValue& other) {
+    if (this != &other) {
+      assign(other);
+    }
+    return *this;
+  }
+  ~FixedFeatureValue() { FeatureRowPool::Release(_data, _size, _slot); }
+  float* data() { return _data; }
+  size_t size() { return _size; }
+  // same as std::vector: keep the leading values, fill new ones with 0
+  void resize(size_t size) {
+    if (size == _size) {
+      return;
+    }
+    uint32_t slot = 0;
+    float* data = FeatureRowPool::Acquire(size, &slot);
+    size_t keep = std::min(size, static_cast<size_t>(_size));
+    if (keep > 0) {
+      memcpy(data, _data, keep * sizeof(float));
+    }
+    if (size > keep) {
+      memset(data + keep, 0, (size - keep) * sizeof(float));
+    }
+    FeatureRowPool::Release(_data, _size, _slot);
+    _data = data;
+    _size = size;
+    _slot = slot;
+  }
+  // rows are always allocated with the exact size
+  void shrink_to_fit() {}
 
  private:
-  std::vector<float> _data;
+  void assign(const FixedFeatureValue& other) {
+    resize(other._size);
+    if (_size > 0) {
+      memcpy(_data, other._data, _size * sizeof(float));
+    }
+  }
+
+  float* _data = NULL;
+  uint32_t _size = 0;
+  // where FeatureRowPool took the row from, in the padding after _size
+  uint32_t _slot = 0;
 };
 
+// Scoped read or write lock of a shard bucket, does nothing if lock is NULL.
+class ScopedBucketLock {
+ public:
+  ScopedBucketLock(phi::RWLock* lock, bool write) : _lock(lock) {
+    if (_lock == NULL) {
+      return;
+    }
+    if (write) {
+      _lock->WRLock();
+    } else {
+      _lock->RDLock();
+    }
+  }
+  ~ScopedBucketLock() {
+    if (_lock != NULL) {
+      _lock->UNLock();
+    }
+  }
+  ScopedBucketLock(const ScopedBucketLock&) = delete;
+  ScopedBucketLock& operator=(const ScopedBucketLock&) = delete;
+
+ private:
+  phi::RWLock* _lock;
+};
+
+// Every bucket owns its map, allocator and lock, so buckets of a shard can
+// be accessed by different threads. Locking is the caller's duty: it is only
+// needed when the shard is shared by concurrent tasks, see set_concurrent.
 template <class KEY, class VALUE>
 struct alignas(64) SparseTableShard {
  public:
@@ -92,8 +269,39 @@ struct alignas(64) SparseTableShard {
   };
 
   ~SparseTableShard() { clear(); }
-  bool empty() { return _alloc.size() == 0; }
-  size_t size() { return _alloc.size(); }
+  bool empty() { return size() == 0; }
+  size_t size() {
+    size_t total = 0;
+    for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
+      total += _alloc[bucket].size();
+    }
+    return total;
+  }
+  // enable the bucket locks returned by bucket_lock
+  void set_concurrent(bool concurrent) { _concurrent = concurrent; }
+  bool concurrent() { return _concurrent; }
+  // NULL if the shard is not accessed concurrently
+  phi::RWLock* bucket_lock(size_t bucket) {
+    return _concurrent ? &_locks[bucket] : NULL;
+  }
+  size_t bucket_of(const KEY& key) { return compute_bucket(_hasher(key)); }
+  // buckets updated since they were last written by a delta or base save
+  void mark_dirty(size_t bucket) {
+    if (!_dirty[bucket].load(std::memory_order_relaxed)) {
+      _dirty[bucket].store(true, std::memory_order_relaxed);
+    }
+  }
+  bool dirty(size_t bucket) {
+    return _dirty[bucket].load(std::memory_order_relaxed);
+  }
+  void clear_dirty(size_t bucket) {
+    _dirty[bucket].store(false, std::memory_order_relaxed);
+  }
+  void set_all_dirty(bool dirty) {
+    for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
+      _dirty[bucket].store(dirty, std::memory_order_relaxed);
+    }
+  }
   void set_max_load_factor(float x) {
     for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
       _buckets[bucket].max_load_factor(x);
@@ -105,7 +313,7 @@ struct alignas(64) SparseTableShard {
     for (size_t bucket = 0; bucket < CTR_SPARSE_SHARD_BUCKET_NUM; bucket++) {
       map_type& data = _buckets[bucket];
       for (auto it = data.begin(); it != data.end(); ++it) {
-        _alloc.release((VALUE*)(void*)it->second);  // NOLINT
+        _alloc[bucket].release((VALUE*)(void*)it->second);  // NOLINT
       }
       data.clear();
     }
@@ -148,14 +356,14 @@ struct alignas(64) SparseTableShard {
     auto res = _buckets[bucket].insert_with_hash({key, NULL}, hash);
 
     if (res.second) {
-      res.first->second = _alloc.acquire(std::forward<ARGS>(args)...);
+      res.first->second = _alloc[bucket].acquire(std::forward<ARGS>(args)...);
     }
 
     return {{res.first, bucket, _buckets}, res.second};
   }
   iterator erase(iterator it) {
-    _alloc.release((VALUE*)(void*)it.it->second);  // NOLINT
     size_t bucket = it.bucket;
+    _alloc[bucket].release((VALUE*)(void*)it.it->second);  // NOLINT
     auto it2 = _buckets[bucket].erase(it.it);
     while (it2 == _buckets[bucket].end() &&
            bucket + 1 < CTR_SPARSE_SHARD_BUCKET_NUM) {
@@ -164,15 +372,15 @@ struct alignas(64) SparseTableShard {
     return {it2, bucket, _buckets};
   }
   void quick_erase(iterator it) {
-    _alloc.release((VALUE*)(void*)it.it->second);  // NOLINT
+    _alloc[it.bucket].release((VALUE*)(void*)it.it->second);  // NOLINT
     _buckets[it.bucket].quick_erase(it.it);
   }
   local_iterator erase(size_t bucket, local_iterator it) {
-    _alloc.release((VALUE*)(void*)it.it->second);  // NOLINT
+    _alloc[bucket].release((VALUE*)(void*)it.it->second);  // NOLINT
     return {_buckets[bucket].erase(it.it)};
   }
   void quick_erase(size_t bucket, local_iterator it) {
-    _alloc.release((VALUE*)(void*)it.it->second);  // NOLINT
+    _alloc[bucket].release((VALUE*)(void*)it.it->second);  // NOLINT
     _buckets[bucket].quick_erase(it.it);
   }
   size_t erase(const KEY& key) {
@@ -193,8 +401,11 @@ struct alignas(64) SparseTableShard {
 
  private:
   map_type _buckets[CTR_SPARSE_SHARD_BUCKET_NUM];
-  ChunkAllocator<VALUE> _alloc;
+  ChunkAllocator<VALUE> _alloc[CTR_SPARSE_SHARD_BUCKET_NUM];
+  phi::RWLock _locks[CTR_SPARSE_SHARD_BUCKET_NUM];
+  std::atomic<bool> _dirty[CTR_SPARSE_SHARD_BUCKET_NUM] = {};
   std::hash<KEY> _hasher;
+  bool _concurrent = false;
 };
 
 }  // namespace distributed
@@ -0,0 +1,106 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// Count-min sketch of 4 bit counters estimating how often a key is accessed.
+// All counters are halved every sample_size increments, so the estimate
+// follows recent popularity as in TinyLFU. Not thread safe.
+class FrequencySketch {
+ public:
+  static const uint32_t MAX_FREQUENCY = 15;
+
+  explicit FrequencySketch(size_t capacity) {
+    size_t width = MIN_WIDTH;
+    while (width < capacity && width < MAX_WIDTH) {
+      width <<= 1;
+    }
+    _width_mask = width - 1;
+    _table.resize(DEPTH * width / COUNTERS_PER_WORD, 0);
+    _sample_size = capacity < MIN_WIDTH ? 10 * MIN_WIDTH : 10 * capacity;
+    _additions = 0;
+  }
+
+  void Increment(uint64_t key) {
+    uint64_t hash = Mix(key);
+    bool added = false;
+    for (int i = 0; i < DEPTH; ++i) {
+      size_t pos = CounterIndex(hash, i);
+      uint64_t& word = _table[pos / COUNTERS_PER_WORD];
+      int shift = (pos % COUNTERS_PER_WORD) * 4;
+      if (((word >> shift) & 0xF) < MAX_FREQUENCY) {
+        word += (1ULL << shift);
+        added = true;
+      }
+    }
+    if (added && ++_additions >= _sample_size) {
+      Reset();
+    }
+  }
+
+  uint32_t Frequency(uint64_t key) const {
+    uint64_t hash = Mix(key);
+    uint32_t frequency = MAX_FREQUENCY;
+    for (int i = 0; i < DEPTH; ++i) {
+      size_t pos = CounterIndex(hash, i);
+      uint64_t word = _table[pos / COUNTERS_PER_WORD];
+      uint32_t count = (word >> ((pos % COUNTERS_PER_WORD) * 4)) & 0xF;
+      frequency = count < frequency ? count : frequency;
+    }
+    return frequency;
+  }
+
+  // age all counters
+  void Reset() {
+    for (auto& word : _table) {
+      word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    _additions /= 2;
+  }
+
+ private:
+  static const int DEPTH = 4;
+  static const size_t COUNTERS_PER_WORD = 16;
+  static const size_t MIN_WIDTH = 1 << 10;
+  static const size_t MAX_WIDTH = 1 << 20;
+
+  static uint64_t Mix(uint64_t key) {
+    // splitmix64 finalizer
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+  }
+
+  size_t CounterIndex(uint64_t hash, int row) const {
+    uint64_t h = Mix(hash + row);
+    return row * (_width_mask + 1) + (h & _width_mask);
+  }
+
+  size_t _width_mask;
+  std::vector<uint64_t> _table;
+  size_t _sample_size;
+  size_t _additions;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -23,6 +23,7 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace paddle {
 namespace distributed {
@@ -122,10 +123,38 @@ class RocksDBHandler {
     if (s.IsNotFound()) {
       return 1;
     }
-    assert(s.ok());
+    if (!s.ok()) {
+      LOG(ERROR) << "rocksdb get failed: " << s.ToString();
+      return -1;
+    }
     return 0;
   }
 
+  // look up num keys in one call, status[i] is 0 if keys[i] is found, 1 if
+  // it is not found and -1 if it can not be read, in which case -1 is
+  // returned. Keys in bytewise order can be passed with sorted_input to
+  // save the sorting inside rocksdb.
+  int multi_get(int id, size_t num, const rocksdb::Slice* keys,
+                rocksdb::PinnableSlice* values, int* status,
+                bool sorted_input = false) {
+    std::vector<rocksdb::Status> s(num);
+    _db->MultiGet(rocksdb::ReadOptions(), _handles[id], num, keys, values,
+                  s.data(), sorted_input);
+    int ret = 0;
+    for (size_t i = 0; i < num; ++i) {
+      if (s[i].ok()) {
+        status[i] = 0;
+      } else if (s[i].IsNotFound()) {
+        status[i] = 1;
+      } else {
+        LOG(ERROR) << "rocksdb multi_get failed: " << s[i].ToString();
+        status[i] = -1;
+        ret = -1;
+      }
+    }
+    return ret;
+  }
+
   int del_data(int id, const char* key, int key_len) {
     rocksdb::WriteOptions options;
     options.disableWAL = true;
@@ -0,0 +1,256 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace paddle {
+namespace distributed {
+
+// Binary layout of one sparse shard file:
+//
+//   | magic (u32) | version (u32) | quant_bits (u32) | value_dim (u32) |
+//   | block | block | ... |
+//
+// where quant_bits and value_dim describe the accessor layout the values are
+// stored in, so a file is not loaded by a table with another layout.
+//
+// Every block is length prefixed so it can be consumed without parsing:
+//
+//   | key_num (u32) | reserved (u32) | value_num (u64) |
+//   | keys (u64 x key_num) |
+//   | value sizes (u32 x key_num, padded to 8 bytes) |
+//   | values (f32 x value_num, padded to 8 bytes) |
+//
+// All sections start on an 8 byte boundary, so a block can be read in place
+// from an mmap'ed file.
+static const uint32_t SPARSE_BINARY_MAGIC = 0x42535350;  // "PSSB"
+static const uint32_t SPARSE_BINARY_VERSION = 2;
+static const size_t SPARSE_BINARY_BLOCK_KEY_NUM = 8192;
+// first read of a block body from a stream, later reads double it
+static const size_t SPARSE_BINARY_READ_CHUNK_BYTES = 1 << 20;
+
+struct SparseBinaryFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t quant_bits;
+  uint32_t value_dim;
+};
+
+struct SparseBinaryBlockHeader {
+  uint32_t key_num;
+  uint32_t reserved;
+  uint64_t value_num;
+};
+
+inline size_t SparseBinaryAlign(size_t bytes) { return (bytes + 7) & ~7UL; }
+
+struct SparseBinaryBlock {
+  uint32_t key_num;
+  const uint64_t* keys;
+  const uint32_t* sizes;
+  const float* values;
+};
+
+class SparseBinaryWriter {
+ public:
+  // write_func returns 0 on success
+  typedef std::function<int(const char* data, size_t size)> WriteFunc;
+
+  explicit SparseBinaryWriter(
+      WriteFunc write_func, size_t block_key_num = SPARSE_BINARY_BLOCK_KEY_NUM)
+      : _write_func(write_func), _block_key_num(block_key_num) {
+    _keys.reserve(_block_key_num);
+    _sizes.reserve(_block_key_num);
+  }
+
+  int WriteHeader(uint32_t quant_bits, uint32_t value_dim) {
+    SparseBinaryFileHeader header = {SPARSE_BINARY_MAGIC, SPARSE_BINARY_VERSION,
+                                     quant_bits, value_dim};
+    return _write_func(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  int Append(uint64_t key, const float* value, uint32_t size) {
+    _keys.push_back(key);
+    _sizes.push_back(size);
+    _values.insert(_values.end(), value, value + size);
+    if (_keys.size() >= _block_key_num) {
+      return Flush();
+    }
+    return 0;
+  }
+
+  // write the pending block, if any
+  int Flush() {
+    if (_keys.empty()) {
+      return 0;
+    }
+    SparseBinaryBlockHeader header;
+    header.key_num = _keys.size();
+    header.reserved = 0;
+    header.value_num = _values.size();
+    // pad the sizes and values sections with zero
+    _sizes.resize(SparseBinaryAlign(_sizes.size() * sizeof(uint32_t)) /
+                  sizeof(uint32_t));
+    _values.resize(SparseBinaryAlign(_values.size() * sizeof(float)) /
+                   sizeof(float));
+    int ret = 0;
+    ret |= _write_func(reinterpret_cast<const char*>(&header), sizeof(header));
+    ret |= _write_func(reinterpret_cast<const char*>(_keys.data()),
+                       _keys.size() * sizeof(uint64_t));
+    ret |= _write_func(reinterpret_cast<const char*>(_sizes.data()),
+                       _sizes.size() * sizeof(uint32_t));
+    ret |= _write_func(reinterpret_cast<const char*>(_values.data()),
+                       _values.size() * sizeof(float));
+    _keys.clear();
+    _sizes.clear();
+    _values.clear();
+    return ret == 0 ? 0 : -1;
+  }
+
+ private:
+  WriteFunc _write_func;
+  size_t _block_key_num;
+  std::vector<uint64_t> _keys;
+  std::vector<uint32_t> _sizes;
+  std::vector<float> _values;
+};
+
+class SparseBinaryReader {
+ public:
+  // read_func returns the number of bytes read
+  typedef std::function<size_t(char* data, size_t size)> ReadFunc;
+
+  // read blocks from a stream, block data is copied into an inner buffer
+  explicit SparseBinaryReader(ReadFunc read_func)
+      : _read_func(read_func), _data(NULL), _data_size(0), _offset(0) {}
+  // read blocks in place from a memory region, e.g. an mmap'ed file
+  SparseBinaryReader(const char* data, size_t size)
+      : _data(data), _data_size(size), _offset(0) {}
+
+  // return 0 if the header is valid, -1 otherwise
+  int ReadHeader(SparseBinaryFileHeader* header) {
+    if (Read(reinterpret_cast<char*>(header), sizeof(*header)) !=
+        sizeof(*header)) {
+      LOG(ERROR) << "SparseBinaryReader read header failed";
+      return -1;
+    }
+    if (header->magic != SPARSE_BINARY_MAGIC ||
+        header->version != SPARSE_BINARY_VERSION) {
+      LOG(ERROR) << "SparseBinaryReader unexpected magic: " << header->magic
+                 << " version: " << header->version;
+      return -1;
+    }
+    return 0;
+  }
+
+  // return 1 if a block is read, 0 at the end of file, -1 on broken data
+  int Next(SparseBinaryBlock* block) {
+    SparseBinaryBlockHeader header;
+    size_t read_size = Read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (read_size == 0) {
+      return 0;
+    }
+    if (read_size != sizeof(header)) {
+      LOG(ERROR) << "SparseBinaryReader read truncated block header";
+      return -1;
+    }
+    if (header.value_num > (SIZE_MAX >> 3)) {
+      LOG(ERROR) << "SparseBinaryReader unexpected value_num: "
+                 << header.value_num;
+      return -1;
+    }
+    size_t keys_bytes = header.key_num * sizeof(uint64_t);
+    size_t sizes_bytes = SparseBinaryAlign(header.key_num * sizeof(uint32_t));
+    size_t values_bytes = SparseBinaryAlign(header.value_num * sizeof(float));
+    size_t body_bytes = keys_bytes + sizes_bytes + values_bytes;
+
+    const char* body = NULL;
+    if (_data != NULL) {
+      if (_offset + body_bytes > _data_size) {
+        LOG(ERROR) << "SparseBinaryReader read truncated block";
+        return -1;
+      }
+      body = _data + _offset;
+      _offset += body_bytes;
+    } else {
+      // the sizes in the header are not trusted, the buffer grows with the
+      // bytes actually read, so a broken header fails at the end of the
+      // stream instead of allocating what it claims
+      size_t read_bytes = 0;
+      while (read_bytes < body_bytes) {
+        size_t chunk_bytes =
+            std::min(body_bytes - read_bytes,
+                     std::max(read_bytes, SPARSE_BINARY_READ_CHUNK_BYTES));
+        // uint64_t keeps the buffer 8 bytes aligned
+        _buffer.resize(SparseBinaryAlign(read_bytes + chunk_bytes) /
+                       sizeof(uint64_t));
+        char* buffer = reinterpret_cast<char*>(_buffer.data());
+        if (_read_func(buffer + read_bytes, chunk_bytes) != chunk_bytes) {
+          LOG(ERROR) << "SparseBinaryReader read truncated block";
+          return -1;
+        }
+        read_bytes += chunk_bytes;
+      }
+      body = reinterpret_cast<const char*>(_buffer.data());
+    }
+    const uint32_t* sizes =
+        reinterpret_cast<const uint32_t*>(body + keys_bytes);
+    // the values of the keys must lie in the block
+    uint64_t size_sum = 0;
+    for (uint32_t i = 0; i < header.key_num; ++i) {
+      size_sum += sizes[i];
+    }
+    if (size_sum > header.value_num) {
+      LOG(ERROR) << "SparseBinaryReader value sizes sum " << size_sum
+                 << " exceeds value_num " << header.value_num;
+      return -1;
+    }
+    block->key_num = header.key_num;
+    block->keys = reinterpret_cast<const uint64_t*>(body);
+    block->sizes = sizes;
+    block->values =
+        reinterpret_cast<const float*>(body + keys_bytes + sizes_bytes);
+    return 1;
+  }
+
+ private:
+  size_t Read(char* dst, size_t size) {
+    if (_data == NULL) {
+      return _read_func(dst, size);
+    }
+    size_t remain = _data_size - _offset;
+    size_t read_size = size < remain ? size : remain;
+    memcpy(dst, _data + _offset, read_size);
+    _offset += read_size;
+    return read_size;
+  }
+
+  ReadFunc _read_func;
+  const char* _data;
+  size_t _data_size;
+  size_t _offset;
+  std::vector<uint64_t> _buffer;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,240 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/channel.h"
+
+namespace paddle {
+namespace distributed {
+
+// Parsed rows handed to one insert thread, the values of row i are
+// values[offsets[i], offsets[i + 1]).
+struct SparseLoadBlock {
+  size_t size() const { return keys.size(); }
+  const float* value(size_t i) const { return values.data() + offsets[i]; }
+  int value_size(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+  std::vector<uint64_t> keys;
+  std::vector<size_t> shard_ids;
+  std::vector<size_t> offsets{0};
+  std::vector<float> values;
+};
+
+// Loads text sparse files in three stages connected by bounded channels:
+//   reader threads read the lines of whole files into blocks,
+//   parse threads turn lines into keys and values,
+//   insert threads store the rows.
+// Every local shard is owned by exactly one insert thread, so inserting
+// needs no lock. A file failing to read is read again from the start, its
+// rows are inserted again and overwrite the ones already loaded.
+class SparseLoadPipeline {
+ public:
+  struct Option {
+    int reader_thread_num = 4;
+    int parse_thread_num = 8;
+    int insert_thread_num = 8;
+    // lines or rows of one block in the channels
+    size_t block_size = 1024;
+    // blocks buffered in one channel
+    size_t channel_capacity = 64;
+    int max_retry = 3;
+  };
+  // call line_func for every line of a file, return 0 on success
+  typedef std::function<int(size_t file_idx,
+                            const std::function<void(std::string*)>& line_func)>
+      ReadFunc;
+  // parse a line of a file, return the value size or -1 to drop the line
+  typedef std::function<int(size_t file_idx, const std::string& line,
+                            uint64_t* key, float* value)>
+      ParseFunc;
+  // local shard of a key
+  typedef std::function<size_t(uint64_t key)> ShardFunc;
+  // store the rows of a block, called by the insert thread of thread_idx
+  typedef std::function<void(int thread_idx, const SparseLoadBlock& block)>
+      InsertFunc;
+
+  SparseLoadPipeline(const Option& option, size_t shard_num,
+                     size_t max_value_size)
+      : _option(option),
+        _shard_num(shard_num),
+        _max_value_size(max_value_size) {
+    _option.reader_thread_num = std::max(_option.reader_thread_num, 1);
+    _option.parse_thread_num = std::max(_option.parse_thread_num, 1);
+    _option.insert_thread_num = std::max(
+        1, std::min(_option.insert_thread_num, static_cast<int>(shard_num)));
+    _option.block_size = std::max<size_t>(_option.block_size, 1);
+    _option.channel_capacity = std::max<size_t>(_option.channel_capacity, 1);
+  }
+
+  // the insert thread owning a local shard
+  int InsertThreadOf(size_t shard_id) const {
+    return shard_id % _option.insert_thread_num;
+  }
+  int InsertThreadNum() const { return _option.insert_thread_num; }
+
+  // load files [0, file_num), return -1 if a file still fails to read
+  // after max_retry retries
+  int32_t Run(size_t file_num, ReadFunc read_func, ParseFunc parse_func,
+              ShardFunc shard_func, InsertFunc insert_func) {
+    auto line_channel =
+        paddle::framework::MakeChannel<LineBlock>(_option.channel_capacity);
+    std::vector<paddle::framework::Channel<SparseLoadBlock>> row_channels;
+    for (int i = 0; i < _option.insert_thread_num; ++i) {
+      row_channels.push_back(paddle::framework::MakeChannel<SparseLoadBlock>(
+          _option.channel_capacity));
+    }
+
+    std::atomic<size_t> next_file{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < _option.reader_thread_num; ++i) {
+      readers.emplace_back([&]() {
+        for (size_t file_idx = next_file++; file_idx < file_num;
+             file_idx = next_file++) {
+          if (ReadFile(file_idx, read_func, line_channel.get()) != 0) {
+            failed = true;
+          }
+        }
+      });
+    }
+
+    std::vector<std::thread> parsers;
+    for (int i = 0; i < _option.parse_thread_num; ++i) {
+      parsers.emplace_back([&]() {
+        ParseLines(line_channel.get(), parse_func, shard_func, &row_channels);
+      });
+    }
+
+    std::vector<std::thread> inserters;
+    for (int i = 0; i < _option.insert_thread_num; ++i) {
+      inserters.emplace_back([&, i]() {
+        SparseLoadBlock block;
+        while (row_channels[i]->Get(block)) {
+          insert_func(i, block);
+        }
+      });
+    }
+
+    for (auto& t : readers) {
+      t.join();
+    }
+    line_channel->Close();
+    for (auto& t : parsers) {
+      t.join();
+    }
+    for (auto& channel : row_channels) {
+      channel->Close();
+    }
+    for (auto& t : inserters) {
+      t.join();
+    }
+    return failed ? -1 : 0;
+  }
+
+ private:
+  struct LineBlock {
+    size_t file_idx;
+    std::vector<std::string> lines;
+  };
+
+  int ReadFile(size_t file_idx, const ReadFunc& read_func,
+               paddle::framework::ChannelObject<LineBlock>* line_channel) {
+    for (int retry_num = 0; retry_num <= _option.max_retry; ++retry_num) {
+      LineBlock block;
+      block.file_idx = file_idx;
+      block.lines.reserve(_option.block_size);
+      auto line_func = [&](std::string* line) {
+        block.lines.push_back(std::move(*line));
+        if (block.lines.size() == _option.block_size) {
+          line_channel->Put(std::move(block));
+          block.lines.clear();
+          block.lines.reserve(_option.block_size);
+        }
+      };
+      int ret = -1;
+      try {
+        ret = read_func(file_idx, line_func);
+      } catch (...) {
+        ret = -1;
+      }
+      if (!block.lines.empty()) {
+        line_channel->Put(std::move(block));
+      }
+      if (ret == 0) {
+        return 0;
+      }
+      LOG(ERROR) << "SparseLoadPipeline read file " << file_idx
+                 << " failed, retry_num=" << retry_num + 1;
+    }
+    return -1;
+  }
+
+  void ParseLines(
+      paddle::framework::ChannelObject<LineBlock>* line_channel,
+      const ParseFunc& parse_func, const ShardFunc& shard_func,
+      std::vector<paddle::framework::Channel<SparseLoadBlock>>* row_channels) {
+    std::vector<SparseLoadBlock> blocks(_option.insert_thread_num);
+    std::vector<float> value(_max_value_size);
+    LineBlock line_block;
+    while (line_channel->Get(line_block)) {
+      for (auto& line : line_block.lines) {
+        uint64_t key = 0;
+        int value_size =
+            parse_func(line_block.file_idx, line, &key, value.data());
+        if (value_size < 0) {
+          continue;
+        }
+        size_t shard_id = shard_func(key);
+        CHECK(shard_id < _shard_num)
+            << "key " << key << " is routed to shard " << shard_id;
+        int thread_idx = InsertThreadOf(shard_id);
+        auto& block = blocks[thread_idx];
+        block.keys.push_back(key);
+        block.shard_ids.push_back(shard_id);
+        block.values.insert(block.values.end(), value.begin(),
+                            value.begin() + value_size);
+        block.offsets.push_back(block.values.size());
+        if (block.size() == _option.block_size) {
+          (*row_channels)[thread_idx]->Put(std::move(block));
+          block = SparseLoadBlock();
+        }
+      }
+    }
+    for (int i = 0; i < _option.insert_thread_num; ++i) {
+      if (blocks[i].size() > 0) {
+        (*row_channels)[i]->Put(std::move(blocks[i]));
+      }
+    }
+  }
+
+  Option _option;
+  size_t _shard_num;
+  size_t _max_value_size;
+};
+
+}  // namespace distributed
+}  // namespace paddle
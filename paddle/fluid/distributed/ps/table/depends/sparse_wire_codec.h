@@ -0,0 +1,129 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "paddle/phi/common/bfloat16.h"
+#include "paddle/phi/common/float16.h"
+
+namespace paddle {
+namespace distributed {
+
+// Encoding of the sparse push and pull values sent between client and
+// server. A row of dim floats is sent as its first exact_dim floats in fp32,
+// for the counts and ids named by the accessor, followed by the other
+// dim - exact_dim floats in the wire type:
+//   kSparseWireFp32: 4 bytes each, the row is unchanged
+//   kSparseWireFp16, kSparseWireBf16: 2 bytes each
+//   kSparseWireInt8: a float scale, then 1 byte each
+// Rows are packed without padding.
+enum SparseWireType {
+  kSparseWireFp32 = 0,
+  kSparseWireFp16 = 1,
+  kSparseWireBf16 = 2,
+  kSparseWireInt8 = 3,
+};
+
+inline bool IsValidSparseWireType(int type) {
+  return type >= kSparseWireFp32 && type <= kSparseWireInt8;
+}
+
+inline size_t SparseWireRowSize(int type, size_t exact_dim, size_t dim) {
+  size_t coded_dim = dim - exact_dim;
+  if (type == kSparseWireFp16 || type == kSparseWireBf16) {
+    return exact_dim * sizeof(float) + coded_dim * 2;
+  } else if (type == kSparseWireInt8) {
+    return (exact_dim + 1) * sizeof(float) + coded_dim;
+  }
+  return dim * sizeof(float);
+}
+
+inline void SparseWireEncode(int type, size_t exact_dim, size_t dim,
+                             const float* value, char* out) {
+  if (type == kSparseWireFp32) {
+    memcpy(out, value, dim * sizeof(float));
+    return;
+  }
+  memcpy(out, value, exact_dim * sizeof(float));
+  out += exact_dim * sizeof(float);
+  const float* coded = value + exact_dim;
+  size_t coded_dim = dim - exact_dim;
+  if (type == kSparseWireFp16) {
+    for (size_t i = 0; i < coded_dim; ++i) {
+      phi::dtype::float16 h(coded[i]);
+      memcpy(out + i * sizeof(h), &h, sizeof(h));
+    }
+  } else if (type == kSparseWireBf16) {
+    for (size_t i = 0; i < coded_dim; ++i) {
+      phi::dtype::bfloat16 h(coded[i]);
+      memcpy(out + i * sizeof(h), &h, sizeof(h));
+    }
+  } else if (type == kSparseWireInt8) {
+    float max_abs = 0.0;
+    for (size_t i = 0; i < coded_dim; ++i) {
+      max_abs = std::max(max_abs, std::fabs(coded[i]));
+    }
+    float scale = max_abs / 127;
+    float inv_scale = scale > 0 ? 1 / scale : 0;
+    memcpy(out, &scale, sizeof(float));
+    out += sizeof(float);
+    for (size_t i = 0; i < coded_dim; ++i) {
+      float q = std::round(coded[i] * inv_scale);
+      q = std::min(127.0f, std::max(-127.0f, q));
+      out[i] = static_cast<int8_t>(q);
+    }
+  }
+}
+
+inline void SparseWireDecode(int type, size_t exact_dim, size_t dim,
+                             const char* in, float* value) {
+  if (type == kSparseWireFp32) {
+    memcpy(value, in, dim * sizeof(float));
+    return;
+  }
+  memcpy(value, in, exact_dim * sizeof(float));
+  in += exact_dim * sizeof(float);
+  float* coded = value + exact_dim;
+  size_t coded_dim = dim - exact_dim;
+  if (type == kSparseWireFp16) {
+    for (size_t i = 0; i < coded_dim; ++i) {
+      phi::dtype::float16 h;
+      memcpy(&h, in + i * sizeof(h), sizeof(h));
+      coded[i] = static_cast<float>(h);
+    }
+  } else if (type == kSparseWireBf16) {
+    for (size_t i = 0; i < coded_dim; ++i) {
+      phi::dtype::bfloat16 h;
+      memcpy(&h, in + i * sizeof(h), sizeof(h));
+      coded[i] = static_cast<float>(h);
+    }
+  } else if (type == kSparseWireInt8) {
+    float scale;
+    memcpy(&scale, in, sizeof(float));
+    const int8_t* src = reinterpret_cast<const int8_t*>(in + sizeof(float));
+    for (size_t i = 0; i < coded_dim; ++i) {
+      coded[i] = src[i] * scale;
+    }
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,135 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/table/graph/graph_csr.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "paddle/fluid/distributed/ps/table/graph/graph_weighted_sampler.h"
+namespace paddle {
+namespace distributed {
+
+GraphCSR::GraphCSR(std::vector<int64_t> &&ids, std::vector<uint64_t> &&offsets,
+                   std::vector<int64_t> &&neighbor_ids,
+                   std::vector<float> &&weights)
+    : ids(std::move(ids)),
+      offsets(std::move(offsets)),
+      neighbor_ids(std::move(neighbor_ids)),
+      weights(std::move(weights)) {
+  if (this->weights.empty()) {
+    return;
+  }
+  alias_prob.resize(this->weights.size());
+  alias_idx.resize(this->weights.size());
+  for (size_t row = 0; row < row_num(); row++) {
+    size_t begin = this->offsets[row];
+    AliasSampler::build_table(this->weights.data() + begin, degree(row),
+                              alias_prob.data() + begin,
+                              alias_idx.data() + begin);
+  }
+}
+
+int64_t GraphCSR::find(int64_t id) const {
+  auto iter = std::lower_bound(ids.begin(), ids.end(), id);
+  if (iter == ids.end() || *iter != id) {
+    return -1;
+  }
+  return iter - ids.begin();
+}
+
+std::vector<int> GraphCSR::sample_k(
+    size_t row, int k, const std::shared_ptr<std::mt19937_64> rng) const {
+  int n = degree(row);
+  if (k >= n) {
+    std::vector<int> sample_result(n);
+    std::iota(sample_result.begin(), sample_result.end(), 0);
+    return sample_result;
+  }
+  if (weights.empty()) {
+    return uniform_sample_k(row, k, rng.get());
+  }
+  return weighted_sample_k(row, k, rng.get());
+}
+
+std::vector<int> GraphCSR::sample_k_with_replacement(
+    size_t row, int k, const std::shared_ptr<std::mt19937_64> rng) const {
+  int n = degree(row);
+  std::vector<int> sample_result;
+  if (n == 0) {
+    return sample_result;
+  }
+  sample_result.reserve(k);
+  if (weights.empty()) {
+    std::uniform_int_distribution<int> distrib(0, n - 1);
+    while (k--) {
+      sample_result.push_back(distrib(*rng));
+    }
+    return sample_result;
+  }
+  const float *prob = alias_prob.data() + offsets[row];
+  const uint32_t *alias = alias_idx.data() + offsets[row];
+  while (k--) {
+    sample_result.push_back(AliasSampler::draw(prob, alias, n, rng.get()));
+  }
+  return sample_result;
+}
+
+// Floyd's algorithm, the result is scanned for repeats when k is small
+std::vector<int> GraphCSR::uniform_sample_k(size_t row, int k,
+                                            std::mt19937_64 *rng) const {
+  int n = degree(row);
+  std::vector<int> sample_result;
+  sample_result.reserve(k);
+  if (k <= 64) {
+    for (int j = n - k; j < n; j++) {
+      std::uniform_int_distribution<int> distrib(0, j);
+      int t = distrib(*rng);
+      if (std::find(sample_result.begin(), sample_result.end(), t) !=
+          sample_result.end()) {
+        t = j;
+      }
+      sample_result.push_back(t);
+    }
+    return sample_result;
+  }
+  std::vector<int> idx(n);
+  std::iota(idx.begin(), idx.end(), 0);
+  for (int i = 0; i < k; i++) {
+    std::uniform_int_distribution<int> distrib(i, n - 1);
+    std::swap(idx[i], idx[distrib(*rng)]);
+  }
+  idx.resize(k);
+  return idx;
+}
+
+std::vector<int> GraphCSR::weighted_sample_k(size_t row, int k,
+                                             std::mt19937_64 *rng) const {
+  size_t begin = offsets[row];
+  return AliasSampler::sample_without_replacement(
+      weights.data() + begin, alias_prob.data() + begin,
+      alias_idx.data() + begin, degree(row), k, rng);
+}
+
+size_t GraphCSR::memory_size() const {
+  return ids.capacity() * sizeof(int64_t) +
+         offsets.capacity() * sizeof(uint64_t) +
+         neighbor_ids.capacity() * sizeof(int64_t) +
+         weights.capacity() * sizeof(float) +
+         alias_prob.capacity() * sizeof(float) +
+         alias_idx.capacity() * sizeof(uint32_t);
+}
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,78 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+namespace paddle {
+namespace distributed {
+
+// Immutable adjacency of the nodes of a graph shard in compressed sparse
+// row layout. Row r is the node ids[r], its neighbors are
+// neighbor_ids[offsets[r], offsets[r + 1]) with the weights at the same
+// positions, the weights are empty for an unweighted graph. The rows are
+// sorted by id, so a node is found by a binary search. A weighted graph also
+// keeps the alias table of every row at the positions of its edges.
+class GraphCSR {
+ public:
+  GraphCSR() {}
+  // ids must be sorted and offsets hold ids.size() + 1 entries
+  GraphCSR(std::vector<int64_t> &&ids, std::vector<uint64_t> &&offsets,
+           std::vector<int64_t> &&neighbor_ids, std::vector<float> &&weights);
+
+  size_t row_num() const { return ids.size(); }
+  size_t edge_num() const { return neighbor_ids.size(); }
+  bool is_weighted() const { return !weights.empty(); }
+  // row of a node, -1 if the node has no row
+  int64_t find(int64_t id) const;
+
+  int64_t get_id(size_t row) const { return ids[row]; }
+  size_t degree(size_t row) const { return offsets[row + 1] - offsets[row]; }
+  int64_t get_neighbor_id(size_t row, int idx) const {
+    return neighbor_ids[offsets[row] + idx];
+  }
+  float get_neighbor_weight(size_t row, int idx) const {
+    return weights.empty() ? 1. : weights[offsets[row] + idx];
+  }
+  // k distinct neighbor indexes of a row, uniformly or in proportion to the
+  // weights, all of them if the degree is at most k
+  std::vector<int> sample_k(size_t row, int k,
+                            const std::shared_ptr<std::mt19937_64> rng) const;
+  // k independent draws of a row, a neighbor may repeat, none if the row
+  // has no neighbor
+  std::vector<int> sample_k_with_replacement(
+      size_t row, int k, const std::shared_ptr<std::mt19937_64> rng) const;
+
+  // bytes of the arrays
+  size_t memory_size() const;
+
+ private:
+  std::vector<int> uniform_sample_k(size_t row, int k,
+                                    std::mt19937_64 *rng) const;
+  std::vector<int> weighted_sample_k(size_t row, int k,
+                                     std::mt19937_64 *rng) const;
+
+  std::vector<int64_t> ids;
+  std::vector<uint64_t> offsets;
+  std::vector<int64_t> neighbor_ids;
+  std::vector<float> weights;
+  std::vector<float> alias_prob;
+  // index of the alias inside the row
+  std::vector<uint32_t> alias_idx;
+};
+}  // namespace distributed
+}  // namespace paddle
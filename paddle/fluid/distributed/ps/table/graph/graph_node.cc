@@ -66,16 +66,50 @@ void GraphNode::build_edges(bool is_weighted) {
   }
 }
 void GraphNode::build_sampler(std::string sample_type) {
+  if (csr != nullptr) {
+    return;
+  }
   if (sampler != nullptr) {
+    refresh_sampler();
     return;
   }
   if (sample_type == "random") {
     sampler = new RandomSampler();
   } else if (sample_type == "weighted") {
-    sampler = new WeightedSampler();
+    sampler = new AliasSampler();
   }
   sampler->build(edges);
 }
+void GraphNode::bind_csr(const GraphCSR* csr, size_t row) {
+  if (sampler != nullptr) {
+    delete sampler;
+    sampler = nullptr;
+  }
+  sampler_stale = false;
+  if (edges != nullptr) {
+    delete edges;
+    edges = nullptr;
+  }
+  this->csr = csr;
+  csr_row = row;
+}
+
+void GraphNode::unbind_csr() {
+  if (csr == nullptr) {
+    return;
+  }
+  const GraphCSR* old_csr = csr;
+  csr = nullptr;
+  build_edges(old_csr->is_weighted());
+  for (size_t i = 0; i < old_csr->degree(csr_row); i++) {
+    edges->add_edge(old_csr->get_neighbor_id(csr_row, i),
+                    old_csr->get_neighbor_weight(csr_row, i));
+  }
+  // a weighted sampler needs an edge
+  bool weighted = old_csr->is_weighted() && edges->size() > 0;
+  build_sampler(weighted ? "weighted" : "random");
+}
+
 void FeatureNode::to_buffer(char* buffer, bool need_feature) {
   memcpy(buffer, &id, id_size);
   buffer += id_size;
@@ -19,6 +19,7 @@
 #include <sstream>
 #include <vector>
 
+#include "paddle/fluid/distributed/ps/table/graph/graph_csr.h"
 #include "paddle/fluid/distributed/ps/table/graph/graph_weighted_sampler.h"
 namespace paddle {
 namespace distributed {
@@ -39,6 +40,10 @@ class Node {
       int k, const std::shared_ptr<std::mt19937_64> rng) {
     return std::vector<int>();
   }
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng) {
+    return std::vector<int>();
+  }
   virtual uint64_t get_neighbor_id(int idx) { return 0; }
   virtual float get_neighbor_weight(int idx) { return 1.; }
 
@@ -58,25 +63,85 @@ class Node {
 
 class GraphNode : public Node {
  public:
-  GraphNode() : Node(), sampler(nullptr), edges(nullptr) {}
-  GraphNode(uint64_t id) : Node(id), sampler(nullptr), edges(nullptr) {}
+  GraphNode()
+      : Node(),
+        sampler(nullptr),
+        sampler_stale(false),
+        edges(nullptr),
+        csr(nullptr) {}
+  GraphNode(uint64_t id)
+      : Node(id),
+        sampler(nullptr),
+        sampler_stale(false),
+        edges(nullptr),
+        csr(nullptr) {}
   virtual ~GraphNode();
   virtual void build_edges(bool is_weighted);
   virtual void build_sampler(std::string sample_type);
   virtual void add_edge(uint64_t id, float weight) {
     edges->add_edge(id, weight);
+    // rebuilt once by the next sample or build_sampler, not on every edge
+    // of a load
+    if (sampler != nullptr) {
+      sampler_stale = true;
+    }
   }
   virtual std::vector<int> sample_k(
       int k, const std::shared_ptr<std::mt19937_64> rng) {
+    if (csr != nullptr) {
+      return csr->sample_k(csr_row, k, rng);
+    }
+    refresh_sampler();
     return sampler->sample_k(k, rng);
   }
-  virtual uint64_t get_neighbor_id(int idx) { return edges->get_id(idx); }
-  virtual float get_neighbor_weight(int idx) { return edges->get_weight(idx); }
-  virtual size_t get_neighbor_size() { return edges->size(); }
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng) {
+    if (csr != nullptr) {
+      return csr->sample_k_with_replacement(csr_row, k, rng);
+    }
+    refresh_sampler();
+    return sampler->sample_k_with_replacement(k, rng);
+  }
+  virtual uint64_t get_neighbor_id(int idx) {
+    if (csr != nullptr) {
+      return csr->get_neighbor_id(csr_row, idx);
+    }
+    return edges->get_id(idx);
+  }
+  virtual float get_neighbor_weight(int idx) {
+    if (csr != nullptr) {
+      return csr->get_neighbor_weight(csr_row, idx);
+    }
+    return edges->get_weight(idx);
+  }
+  virtual size_t get_neighbor_size() {
+    if (csr != nullptr) {
+      return csr->degree(csr_row);
+    }
+    return edges == nullptr ? 0 : edges->size();
+  }
+  // read the edges from a row of the csr of the shard, and free the own ones
+  void bind_csr(const GraphCSR *csr, size_t row);
+  // copy the edges of the csr row back, before the csr is freed
+  void unbind_csr();
+  bool is_weighted_edges() {
+    return dynamic_cast<WeightedGraphEdgeBlob *>(edges) != nullptr;
+  }
 
  protected:
+  // rebuild the sampler over the edges added since it was built
+  void refresh_sampler() {
+    if (sampler_stale) {
+      sampler->build(edges);
+      sampler_stale = false;
+    }
+  }
+
   Sampler *sampler;
+  bool sampler_stale;
   GraphEdgeBlob *edges;
+  const GraphCSR *csr;
+  size_t csr_row;
 };
 
 class FeatureNode : public Node {
@@ -0,0 +1,296 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/table/graph/graph_sample_cache.h"
+
+#include <algorithm>
+#include <fstream>
+namespace paddle {
+namespace distributed {
+
+static const uint32_t kSnapshotVersion = 1;
+// a sample is an int64 id, followed by a float weight when weighted
+static const size_t kSampleIdBytes = sizeof(int64_t);
+static const size_t kSampleWeightBytes = sizeof(float);
+
+GraphSampleCache::GraphSampleCache(size_t stripe_num, size_t capacity,
+                                   size_t ttl, size_t admit_count)
+    : ttl(std::max<size_t>(ttl, 1)), admit_count(admit_count) {
+  stripe_num = std::max<size_t>(stripe_num, 1);
+  stripe_capacity = std::max<size_t>(capacity / stripe_num, 1);
+  size_t frequency_size = 1024;
+  while (frequency_size < 8 * stripe_capacity) {
+    frequency_size <<= 1;
+  }
+  for (size_t i = 0; i < stripe_num; i++) {
+    stripes.emplace_back(new Stripe());
+    stripes.back()->frequency.resize(frequency_size, 0);
+    stripes.back()->entries.reserve(std::min<size_t>(stripe_capacity, 1024));
+  }
+}
+
+uint64_t GraphSampleCache::mix(const SampleKey &key) {
+  uint64_t x = static_cast<uint64_t>(key.node_key) ^
+               (static_cast<uint64_t>(key.idx) << 48) ^
+               (static_cast<uint64_t>(key.sample_size) << 32) ^
+               (key.is_weighted ? 0x9e3779b97f4a7c15ULL : 0);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// two counters picked by bits the stripe index does not use, the smaller
+// one is the estimate
+size_t GraphSampleCache::estimate(const Stripe &stripe, uint64_t hash) const {
+  size_t mask = stripe.frequency.size() - 1;
+  return std::min(stripe.frequency[(hash >> 16) & mask],
+                  stripe.frequency[(hash >> 40) & mask]);
+}
+
+void GraphSampleCache::add_frequency(Stripe *stripe, uint64_t hash) {
+  auto &frequency = stripe->frequency;
+  size_t mask = frequency.size() - 1;
+  for (size_t pos : {(hash >> 16) & mask, (hash >> 40) & mask}) {
+    if (frequency[pos] < UINT8_MAX) {
+      frequency[pos]++;
+    }
+  }
+  // halve the counts, so that old popularity fades
+  if (++stripe->frequency_add >=
+      std::max(frequency.size(), 10 * stripe_capacity)) {
+    for (auto &count : frequency) {
+      count >>= 1;
+    }
+    stripe->frequency_add = 0;
+  }
+}
+
+bool GraphSampleCache::query(const SampleKey &key, SampleResult *result) {
+  uint64_t hash = mix(key);
+  Stripe &stripe = get_stripe(hash);
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  auto iter = stripe.index.find(key);
+  if (iter == stripe.index.end()) {
+    stripe.stat.miss++;
+    add_frequency(&stripe, hash);
+    return false;
+  }
+  stripe.stat.hit++;
+  add_frequency(&stripe, hash);
+  Entry &entry = stripe.entries[iter->second];
+  *result = entry.value;
+  entry.referenced = true;
+  if (--entry.ttl == 0) {
+    stripe.stat.expire++;
+    remove(&stripe, iter->second);
+  }
+  return true;
+}
+
+void GraphSampleCache::insert(const SampleKey &key,
+                              const SampleResult &result) {
+  uint64_t hash = mix(key);
+  Stripe &stripe = get_stripe(hash);
+  std::lock_guard<std::mutex> lock(stripe.mutex);
+  if (stripe.index.find(key) == stripe.index.end()) {
+    size_t frequency = estimate(stripe, hash);
+    bool admit = frequency >= admit_count;
+    // a full stripe only trades its victim for a more frequent key, the
+    // clock is left as it is until the key is admitted
+    if (admit && stripe.entries.size() >= stripe_capacity) {
+      const SampleKey &victim_key = stripe.entries[peek_victim(stripe)].key;
+      admit = frequency > estimate(stripe, mix(victim_key));
+    }
+    if (!admit) {
+      stripe.stat.reject++;
+      return;
+    }
+  }
+  put(&stripe, key, result, ttl);
+}
+
+void GraphSampleCache::put(Stripe *stripe, const SampleKey &key,
+                           const SampleResult &result, size_t entry_ttl) {
+  stripe->stat.insert++;
+  auto iter = stripe->index.find(key);
+  if (iter != stripe->index.end()) {
+    Entry &entry = stripe->entries[iter->second];
+    entry.value = result;
+    entry.ttl = entry_ttl;
+    entry.referenced = true;
+    return;
+  }
+  auto &entries = stripe->entries;
+  if (entries.size() < stripe_capacity) {
+    stripe->index.emplace(key, entries.size());
+    entries.push_back(Entry{key, result, entry_ttl, false});
+    return;
+  }
+  stripe->stat.evict++;
+  Entry &entry = entries[victim(stripe)];
+  stripe->index.erase(entry.key);
+  entry = Entry{key, result, entry_ttl, false};
+  stripe->index.emplace(key, stripe->hand);
+  stripe->hand = (stripe->hand + 1) % entries.size();
+}
+
+// moves the hand to the first entry not referenced since the hand passed
+// it last
+size_t GraphSampleCache::victim(Stripe *stripe) {
+  auto &entries = stripe->entries;
+  while (entries[stripe->hand].referenced) {
+    entries[stripe->hand].referenced = false;
+    stripe->hand = (stripe->hand + 1) % entries.size();
+  }
+  return stripe->hand;
+}
+
+// the entry victim would return, without clearing the reference bits
+size_t GraphSampleCache::peek_victim(const Stripe &stripe) const {
+  auto &entries = stripe.entries;
+  size_t pos = stripe.hand;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (!entries[pos].referenced) {
+      return pos;
+    }
+    pos = (pos + 1) % entries.size();
+  }
+  // all referenced, victim clears them in a full turn and stops at the hand
+  return stripe.hand;
+}
+
+void GraphSampleCache::remove(Stripe *stripe, size_t pos) {
+  auto &entries = stripe->entries;
+  stripe->index.erase(entries[pos].key);
+  if (pos + 1 != entries.size()) {
+    entries[pos] = entries.back();
+    stripe->index[entries[pos].key] = pos;
+  }
+  entries.pop_back();
+  if (stripe->hand >= entries.size()) {
+    stripe->hand = 0;
+  }
+}
+
+GraphSampleCacheStat GraphSampleCache::get_stat() {
+  GraphSampleCacheStat stat;
+  for (auto &stripe : stripes) {
+    std::lock_guard<std::mutex> lock(stripe->mutex);
+    stat.hit += stripe->stat.hit;
+    stat.miss += stripe->stat.miss;
+    stat.insert += stripe->stat.insert;
+    stat.reject += stripe->stat.reject;
+    stat.evict += stripe->stat.evict;
+    stat.expire += stripe->stat.expire;
+    stat.size += stripe->entries.size();
+  }
+  return stat;
+}
+
+// version, entry number, then for every entry its key, the ttl left and
+// the sample bytes
+int32_t GraphSampleCache::save(const std::string &path) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    return -1;
+  }
+  uint64_t entry_num = get_stat().size;
+  file.write(reinterpret_cast<const char *>(&kSnapshotVersion),
+             sizeof(uint32_t));
+  std::streampos num_pos = file.tellp();
+  file.write(reinterpret_cast<const char *>(&entry_num), sizeof(uint64_t));
+  entry_num = 0;
+  for (auto &stripe : stripes) {
+    std::lock_guard<std::mutex> lock(stripe->mutex);
+    for (auto &entry : stripe->entries) {
+      int32_t idx = entry.key.idx;
+      int64_t node_key = entry.key.node_key;
+      uint64_t sample_size = entry.key.sample_size;
+      uint8_t is_weighted = entry.key.is_weighted;
+      uint64_t entry_ttl = entry.ttl;
+      uint64_t actual_size = entry.value.actual_size;
+      file.write(reinterpret_cast<const char *>(&idx), sizeof(idx));
+      file.write(reinterpret_cast<const char *>(&node_key), sizeof(node_key));
+      file.write(reinterpret_cast<const char *>(&sample_size),
+                 sizeof(sample_size));
+      file.write(reinterpret_cast<const char *>(&is_weighted),
+                 sizeof(is_weighted));
+      file.write(reinterpret_cast<const char *>(&entry_ttl),
+                 sizeof(entry_ttl));
+      file.write(reinterpret_cast<const char *>(&actual_size),
+                 sizeof(actual_size));
+      file.write(entry.value.buffer.get(), actual_size);
+      entry_num++;
+    }
+  }
+  // the entries may have changed since the count
+  file.seekp(num_pos);
+  file.write(reinterpret_cast<const char *>(&entry_num), sizeof(uint64_t));
+  return file.good() ? 0 : -1;
+}
+
+int32_t GraphSampleCache::load(const std::string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return -1;
+  }
+  const int64_t file_size = static_cast<int64_t>(file.tellg());
+  file.seekg(0);
+  uint32_t version = 0;
+  uint64_t entry_num = 0;
+  file.read(reinterpret_cast<char *>(&version), sizeof(uint32_t));
+  file.read(reinterpret_cast<char *>(&entry_num), sizeof(uint64_t));
+  if (!file || version != kSnapshotVersion) {
+    return -1;
+  }
+  for (uint64_t i = 0; i < entry_num; i++) {
+    int32_t idx;
+    int64_t node_key;
+    uint64_t sample_size, entry_ttl, actual_size;
+    uint8_t is_weighted;
+    file.read(reinterpret_cast<char *>(&idx), sizeof(idx));
+    file.read(reinterpret_cast<char *>(&node_key), sizeof(node_key));
+    file.read(reinterpret_cast<char *>(&sample_size), sizeof(sample_size));
+    file.read(reinterpret_cast<char *>(&is_weighted), sizeof(is_weighted));
+    file.read(reinterpret_cast<char *>(&entry_ttl), sizeof(entry_ttl));
+    file.read(reinterpret_cast<char *>(&actual_size), sizeof(actual_size));
+    if (!file) {
+      return -1;
+    }
+    // sample_size is read from the file too, so a broken file must not
+    // make us allocate more than the bytes left in it
+    size_t sample_bytes =
+        kSampleIdBytes + (is_weighted ? kSampleWeightBytes : 0);
+    const int64_t left = file_size - static_cast<int64_t>(file.tellg());
+    if (actual_size > static_cast<uint64_t>(std::max<int64_t>(left, 0)) ||
+        actual_size % sample_bytes != 0 ||
+        actual_size / sample_bytes > sample_size) {
+      return -1;
+    }
+    char *buffer = new char[actual_size];
+    SampleResult result(actual_size, buffer);
+    file.read(buffer, actual_size);
+    if (static_cast<uint64_t>(file.gcount()) != actual_size) {
+      return -1;
+    }
+    SampleKey key(idx, node_key, sample_size, is_weighted);
+    Stripe &stripe = get_stripe(mix(key));
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    put(&stripe, key, result,
+        std::max<size_t>(1, std::min<size_t>(entry_ttl, ttl)));
+  }
+  return 0;
+}
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,149 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+namespace paddle {
+namespace distributed {
+
+struct SampleKey {
+  int idx;
+  int64_t node_key;
+  size_t sample_size;
+  bool is_weighted;
+  SampleKey(int _idx, int64_t _node_key, size_t _sample_size,
+            bool _is_weighted) {
+    idx = _idx;
+    node_key = _node_key;
+    sample_size = _sample_size;
+    is_weighted = _is_weighted;
+  }
+  bool operator==(const SampleKey &s) const {
+    return idx == s.idx && node_key == s.node_key &&
+           sample_size == s.sample_size && is_weighted == s.is_weighted;
+  }
+};
+
+class SampleResult {
+ public:
+  size_t actual_size;
+  std::shared_ptr<char> buffer;
+  SampleResult(size_t _actual_size, std::shared_ptr<char> &_buffer)
+      : actual_size(_actual_size), buffer(_buffer) {}
+  SampleResult(size_t _actual_size, char *_buffer)
+      : actual_size(_actual_size),
+        buffer(_buffer, [](char *p) { delete[] p; }) {}
+  ~SampleResult() {}
+};
+}  // namespace distributed
+}  // namespace paddle
+
+namespace std {
+
+template <>
+struct hash<paddle::distributed::SampleKey> {
+  size_t operator()(const paddle::distributed::SampleKey &s) const {
+    return s.idx ^ s.node_key ^ s.sample_size;
+  }
+};
+}  // namespace std
+
+namespace paddle {
+namespace distributed {
+
+struct GraphSampleCacheStat {
+  size_t hit = 0;
+  size_t miss = 0;
+  size_t insert = 0;
+  // inserts refused by the admission
+  size_t reject = 0;
+  // entries replaced by the clock to make room
+  size_t evict = 0;
+  // entries served ttl times
+  size_t expire = 0;
+  size_t size = 0;
+  double hit_rate() const {
+    return hit + miss == 0 ? 0 : static_cast<double>(hit) / (hit + miss);
+  }
+};
+
+// Cache of the neighbor samples of GraphTable, split into stripes by the
+// hash of the key, each with its own lock. A stripe replaces its entries
+// with the CLOCK algorithm. A cached sample is served ttl times, then it
+// is dropped, so a node is sampled again. A small frequency sketch, halved
+// from time to time, counts the recent queries of every key. A key is only
+// admitted once counted admit_count times, and into a full stripe only if
+// it is counted more often than the entry the clock would replace, so
+// nodes queried once do not push the frequent ones out.
+class GraphSampleCache {
+ public:
+  GraphSampleCache(size_t stripe_num, size_t capacity, size_t ttl,
+                   size_t admit_count = 2);
+
+  // true and the sample in result on a hit
+  bool query(const SampleKey &key, SampleResult *result);
+  void insert(const SampleKey &key, const SampleResult &result);
+
+  GraphSampleCacheStat get_stat();
+  size_t get_ttl() const { return ttl; }
+
+  // write the entries to a file, read them back, admitted without the
+  // frequency check, into a cache of any stripe number
+  int32_t save(const std::string &path);
+  int32_t load(const std::string &path);
+
+ private:
+  struct Entry {
+    SampleKey key;
+    SampleResult value;
+    size_t ttl;
+    bool referenced;
+  };
+  struct Stripe {
+    std::mutex mutex;
+    std::unordered_map<SampleKey, size_t> index;
+    // the clock, the hand points to the next entry to look at
+    std::vector<Entry> entries;
+    size_t hand = 0;
+    std::vector<uint8_t> frequency;
+    size_t frequency_add = 0;
+    GraphSampleCacheStat stat;
+  };
+
+  static uint64_t mix(const SampleKey &key);
+  Stripe &get_stripe(uint64_t hash) {
+    return *stripes[hash % stripes.size()];
+  }
+  size_t estimate(const Stripe &stripe, uint64_t hash) const;
+  void add_frequency(Stripe *stripe, uint64_t hash);
+  void put(Stripe *stripe, const SampleKey &key, const SampleResult &result,
+           size_t entry_ttl);
+  size_t victim(Stripe *stripe);
+  size_t peek_victim(const Stripe &stripe) const;
+  void remove(Stripe *stripe, size_t pos);
+
+  std::vector<std::unique_ptr<Stripe>> stripes;
+  size_t stripe_capacity;
+  size_t ttl;
+  size_t admit_count;
+};
+}  // namespace distributed
+}  // namespace paddle
@@ -14,9 +14,14 @@
 
 #include "paddle/fluid/distributed/ps/table/graph/graph_weighted_sampler.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <memory>
+#include <numeric>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 
 #include "paddle/fluid/framework/generator.h"
 namespace paddle {
@@ -58,6 +63,21 @@ std::vector<int> RandomSampler::sample_k(
   return sample_result;
 }
 
+std::vector<int> RandomSampler::sample_k_with_replacement(
+    int k, const std::shared_ptr<std::mt19937_64> rng) {
+  int n = edges->size();
+  std::vector<int> sample_result;
+  if (n == 0) {
+    return sample_result;
+  }
+  std::uniform_int_distribution<int> distrib(0, n - 1);
+  sample_result.reserve(k);
+  while (k--) {
+    sample_result.push_back(distrib(*rng));
+  }
+  return sample_result;
+}
+
 WeightedSampler::WeightedSampler() {
   left = nullptr;
   right = nullptr;
@@ -130,6 +150,26 @@ std::vector<int> WeightedSampler::sample_k(
   return sample_result;
 }
 
+std::vector<int> WeightedSampler::sample_k_with_replacement(
+    int k, const std::shared_ptr<std::mt19937_64> rng) {
+  std::vector<int> sample_result;
+  std::uniform_real_distribution<float> distrib(0, 1.0);
+  while (k--) {
+    float query_weight = distrib(*rng) * weight;
+    WeightedSampler *node = this;
+    while (node->left != nullptr) {
+      if (node->left->weight >= query_weight) {
+        node = node->left;
+      } else {
+        query_weight -= node->left->weight;
+        node = node->right;
+      }
+    }
+    sample_result.push_back(node->idx);
+  }
+  return sample_result;
+}
+
 int WeightedSampler::sample(
     float query_weight,
     std::unordered_map<WeightedSampler *, float> &subtract_weight_map,
@@ -158,5 +198,155 @@ int WeightedSampler::sample(
   subtract_count_map[this]++;
   return return_idx;
 }
+
+void AliasSampler::build(GraphEdgeBlob *edges) {
+  this->edges = edges;
+  int n = edges->size();
+  prob.resize(n);
+  alias.resize(n);
+  build_table(
+      ((WeightedGraphEdgeBlob *)edges)->export_weight_array().data(), n,
+      prob.data(), alias.data());
+}
+
+// the edges added after build are not in the table, and never drawn
+std::vector<int> AliasSampler::sample_k(
+    int k, const std::shared_ptr<std::mt19937_64> rng) {
+  int n = prob.size();
+  if (k >= n) {
+    std::vector<int> sample_result(n);
+    std::iota(sample_result.begin(), sample_result.end(), 0);
+    return sample_result;
+  }
+  return sample_without_replacement(
+      ((WeightedGraphEdgeBlob *)edges)->export_weight_array().data(),
+      prob.data(), alias.data(), n, k, rng.get());
+}
+
+std::vector<int> AliasSampler::sample_k_with_replacement(
+    int k, const std::shared_ptr<std::mt19937_64> rng) {
+  int n = prob.size();
+  std::vector<int> sample_result;
+  if (n == 0) {
+    return sample_result;
+  }
+  sample_result.reserve(k);
+  while (k--) {
+    sample_result.push_back(draw(prob.data(), alias.data(), n, rng.get()));
+  }
+  return sample_result;
+}
+
+void AliasSampler::build_table(const float *weights, int n, float *prob,
+                               uint32_t *alias) {
+  double total = 0;
+  int positive = -1;
+  for (int i = 0; i < n; i++) {
+    if (weights[i] > 0) {
+      total += weights[i];
+      positive = i;
+    }
+  }
+  if (positive < 0) {
+    for (int i = 0; i < n; i++) {
+      prob[i] = 1;
+      alias[i] = i;
+    }
+    return;
+  }
+  // the buffers are reused by the rows of a csr
+  thread_local std::vector<double> scaled;
+  thread_local std::vector<uint32_t> small, large;
+  scaled.resize(n);
+  small.clear();
+  large.clear();
+  for (int i = 0; i < n; i++) {
+    scaled[i] = weights[i] > 0 ? weights[i] * n / total : 0;
+    if (scaled[i] < 1) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t s = small.back(), l = large.back();
+    small.pop_back();
+    prob[s] = scaled[s];
+    alias[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1;
+    if (scaled[l] < 1) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // left by rounding, the ones of zero weight still go to a positive one
+  for (uint32_t i : large) {
+    prob[i] = 1;
+    alias[i] = i;
+  }
+  for (uint32_t i : small) {
+    prob[i] = weights[i] > 0 ? 1 : 0;
+    alias[i] = weights[i] > 0 ? i : positive;
+  }
+}
+
+int AliasSampler::draw(const float *prob, const uint32_t *alias, int n,
+                       std::mt19937_64 *rng) {
+  // the high half picks the edge, the low half is the coin
+  uint64_t r = (*rng)();
+  int i = ((r >> 32) * static_cast<uint64_t>(n)) >> 32;
+  float coin = (r & 0xffffffffULL) * (1.0f / 4294967296.0f);
+  return coin < prob[i] ? i : alias[i];
+}
+
+std::vector<int> AliasSampler::sample_without_replacement(
+    const float *weights, const float *prob, const uint32_t *alias, int n,
+    int k, std::mt19937_64 *rng) {
+  std::vector<int> sample_result;
+  sample_result.reserve(k);
+  // a repeat is found by a scan of the result, so only for small k
+  if (k <= 32) {
+    int attempts = 4 * k + 16;
+    while (static_cast<int>(sample_result.size()) < k && attempts-- > 0) {
+      int x = draw(prob, alias, n, rng);
+      if (std::find(sample_result.begin(), sample_result.end(), x) ==
+          sample_result.end()) {
+        sample_result.push_back(x);
+      }
+    }
+    if (static_cast<int>(sample_result.size()) == k) {
+      return sample_result;
+    }
+  }
+  // the largest keys among the edges not drawn yet
+  int m = k - sample_result.size();
+  std::vector<char> drawn(sample_result.empty() ? 0 : n, 0);
+  for (int x : sample_result) {
+    drawn[x] = 1;
+  }
+  // the edges of zero weight rank below the positive ones and among
+  // themselves by u alone, so they fill the rest uniformly, as all the
+  // edges of a row without a positive weight do
+  std::uniform_real_distribution<double> distrib(0, 1.0);
+  std::vector<std::tuple<bool, double, int>> keys;
+  keys.reserve(n - sample_result.size());
+  for (int i = 0; i < n; i++) {
+    if (!drawn.empty() && drawn[i]) {
+      continue;
+    }
+    double u = distrib(*rng);
+    bool positive = weights[i] > 0;
+    keys.emplace_back(positive, positive ? std::log(u) / weights[i] : u, i);
+  }
+  std::nth_element(keys.begin(), keys.begin() + m, keys.end(),
+                   [](const std::tuple<bool, double, int> &a,
+                      const std::tuple<bool, double, int> &b) {
+                     return a > b;
+                   });
+  for (int i = 0; i < m; i++) {
+    sample_result.push_back(std::get<2>(keys[i]));
+  }
+  return sample_result;
+}
 }  // namespace distributed
 }  // namespace paddle
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #pragma once
+#include <cstdint>
 #include <ctime>
 #include <memory>
 #include <random>
@@ -29,6 +30,9 @@ class Sampler {
   virtual void build(GraphEdgeBlob *edges) = 0;
   virtual std::vector<int> sample_k(
       int k, const std::shared_ptr<std::mt19937_64> rng) = 0;
+  // k independent draws, an index may repeat
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng) = 0;
 };
 
 class RandomSampler : public Sampler {
@@ -37,6 +41,8 @@ class RandomSampler : public Sampler {
   virtual void build(GraphEdgeBlob *edges);
   virtual std::vector<int> sample_k(int k,
                                     const std::shared_ptr<std::mt19937_64> rng);
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng);
   GraphEdgeBlob *edges;
 };
 
@@ -53,6 +59,8 @@ class WeightedSampler : public Sampler {
   virtual void build_one(WeightedGraphEdgeBlob *edges, int start, int end);
   virtual std::vector<int> sample_k(int k,
                                     const std::shared_ptr<std::mt19937_64> rng);
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng);
 
  private:
   int sample(float query_weight,
@@ -60,5 +68,39 @@ class WeightedSampler : public Sampler {
              std::unordered_map<WeightedSampler *, int> &subtract_count_map,
              float &subtract);
 };
+
+// Walker's alias method: a draw picks an edge i uniformly and keeps it with
+// probability prob[i], otherwise it takes the edge alias[i]. The tables are
+// built in O(n) by Vose's method and a draw is O(1). The static functions
+// work on tables stored elsewhere, as the rows of GraphCSR are.
+class AliasSampler : public Sampler {
+ public:
+  virtual ~AliasSampler() {}
+  virtual void build(GraphEdgeBlob *edges);
+  virtual std::vector<int> sample_k(int k,
+                                    const std::shared_ptr<std::mt19937_64> rng);
+  virtual std::vector<int> sample_k_with_replacement(
+      int k, const std::shared_ptr<std::mt19937_64> rng);
+
+  // a weight that is not positive is never drawn, if no weight is positive
+  // the draws are uniform
+  static void build_table(const float *weights, int n, float *prob,
+                          uint32_t *alias);
+  static int draw(const float *prob, const uint32_t *alias, int n,
+                  std::mt19937_64 *rng);
+  // k < n distinct indexes drawn one after another in proportion to the
+  // weights. Small k draws from the alias table and redraws the repeats,
+  // when the repeats are too many, or k is large, the rest is taken by the
+  // k largest keys log(u) / weight (Efraimidis and Spirakis). Edges of zero
+  // weight are only taken once the positive ones run out, uniformly.
+  static std::vector<int> sample_without_replacement(
+      const float *weights, const float *prob, const uint32_t *alias, int n,
+      int k, std::mt19937_64 *rng);
+
+ private:
+  GraphEdgeBlob *edges;
+  std::vector<float> prob;
+  std::vector<uint32_t> alias;
+};
 }  // namespace distributed
 }  // namespace paddle
@@ -31,6 +31,10 @@ int32_t MemorySparseGeoTable::Pull(TableContext& context) {
 
 int32_t MemorySparseGeoTable::Push(TableContext& context) {
   CHECK(context.value_type == Sparse);
+  if (context.push_context.wire_values != nullptr) {
+    LOG(ERROR) << "MemorySparseGeoTable only accepts fp32 pushes";
+    return -1;
+  }
   if (!context.push_context.is_param) {
     return PushSparse(context.push_context.keys, context.push_context.values,
                       context.num);
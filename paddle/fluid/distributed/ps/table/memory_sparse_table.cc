@@ -14,7 +14,11 @@
 
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 
+#include <fcntl.h>
 #include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <sstream>
 
@@ -31,6 +35,30 @@ DEFINE_bool(pserver_create_value_when_push, true,
 DEFINE_bool(pserver_enable_create_feasign_randomly, false,
             "pserver_enable_create_feasign_randomly");
 DEFINE_int32(pserver_table_save_max_retry, 3, "pserver_table_save_max_retry");
+DEFINE_bool(pserver_sparse_concurrent_pull, false,
+            "pserver pull keys of one shard on all task pools, guarded by "
+            "per bucket rwlocks instead of a single shard thread");
+DEFINE_int32(pserver_sparse_concurrent_pull_batch, 1024,
+             "key num of one pull task when pserver_sparse_concurrent_pull");
+DEFINE_bool(pserver_load_binary_with_mmap, true,
+            "pserver mmap local binary sparse shard files when load");
+DEFINE_bool(pserver_load_pipeline, true,
+            "pserver load text sparse files with reader, parse and insert "
+            "threads connected by channels");
+DEFINE_int32(pserver_load_reader_thread_num, 4,
+             "reader thread num of the pserver load pipeline");
+DEFINE_int32(pserver_load_parse_thread_num, 8,
+             "parse thread num of the pserver load pipeline");
+DEFINE_int32(pserver_load_insert_thread_num, 8,
+             "insert thread num of the pserver load pipeline");
+DEFINE_int32(pserver_shrink_bucket_num_per_step, 4,
+             "bucket num shrinked by one task before the shard task pool "
+             "runs the pull and push tasks queued behind it");
+DEFINE_bool(pserver_delta_save_dirty_bucket_only, false,
+            "xbox delta save only visits the buckets pushed or pulled by "
+            "pointer since the last xbox delta or base save. Off by "
+            "default: a row pulled by pointer before a save and written "
+            "after it is left out of the deltas until it is touched again");
 
 namespace paddle {
 namespace distributed {
@@ -64,12 +92,21 @@ int32_t MemorySparseTable::InitializeValue() {
           << " _real_local_shard_num: " << _real_local_shard_num;
 
   _local_shards.reset(new shard_type[_real_local_shard_num]);
+  _concurrent_pull = FLAGS_pserver_sparse_concurrent_pull;
+  for (int i = 0; i < _real_local_shard_num; ++i) {
+    _local_shards[i].set_concurrent(_concurrent_pull);
+  }
 
   return 0;
 }
 
 int32_t MemorySparseTable::Load(const std::string& path,
                                 const std::string& param) {
+  // loaded rows are not in the last delta or base, save them in the next
+  // delta
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    _local_shards[i].set_all_dirty(true);
+  }
   std::string table_path = TableDir(path);
   auto file_list = _afs_client.list(table_path);
 
@@ -94,6 +131,37 @@ int32_t MemorySparseTable::Load(const std::string& path,
 
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
+  bool is_binary = _value_accesor->IsBinaryFormat(load_param);
+
+  if (!is_binary && FLAGS_pserver_load_pipeline) {
+    auto read_func =
+        [&](size_t file_idx,
+            const std::function<void(std::string*)>& line_func) -> int {
+      FsChannelConfig channel_config;
+      channel_config.path = file_list[file_start_idx + file_idx];
+      channel_config.converter =
+          _value_accesor->Converter(load_param).converter;
+      channel_config.deconverter =
+          _value_accesor->Converter(load_param).deconverter;
+      int err_no = 0;
+      std::string line_data;
+      auto read_channel = _afs_client.open_r(channel_config, 0, &err_no);
+      while (read_channel->read_line(line_data) == 0 &&
+             line_data.size() > 1) {
+        line_func(&line_data);
+      }
+      read_channel->close();
+      return err_no == -1 ? -1 : 0;
+    };
+    if (LoadTextPipelined(_real_local_shard_num, read_func) != 0) {
+      LOG(ERROR) << "MemorySparseTable load failed reach max limit!";
+      exit(-1);
+    }
+    LOG(INFO) << "MemorySparseTable load success, path from "
+              << file_list[file_start_idx] << " to "
+              << file_list[file_start_idx + _real_local_shard_num - 1];
+    return 0;
+  }
 
   int thread_num = _real_local_shard_num < 15 ? _real_local_shard_num : 15;
   omp_set_num_threads(thread_num);
@@ -118,18 +186,29 @@ int32_t MemorySparseTable::Load(const std::string& path,
       char* end = NULL;
       auto& shard = _local_shards[i];
       try {
-        while (read_channel->read_line(line_data) == 0 &&
-               line_data.size() > 1) {
-          uint64_t key = std::strtoul(line_data.data(), &end, 10);
-          auto& value = shard[key];
-          value.resize(feature_value_size);
-          int parse_size = _value_accesor->ParseFromString(++end, value.data());
-          value.resize(parse_size);
-
-          // for debug
-          for (int ii = 0; ii < parse_size; ++ii) {
-            VLOG(2) << "MemorySparseTable::load key: " << key << " value " << ii
-                    << ": " << value.data()[ii] << " local_shard: " << i;
+        if (is_binary) {
+          SparseBinaryReader reader([&read_channel](char* data, size_t size) {
+            return read_channel->read(data, size);
+          });
+          if (LoadShardBinary(i, &reader) != 0) {
+            err_no = -1;
+          }
+        } else {
+          while (read_channel->read_line(line_data) == 0 &&
+                 line_data.size() > 1) {
+            uint64_t key = std::strtoul(line_data.data(), &end, 10);
+            auto& value = shard[key];
+            value.resize(feature_value_size);
+            int parse_size =
+                _value_accesor->ParseFromString(++end, value.data());
+            value.resize(parse_size);
+
+            // for debug
+            for (int ii = 0; ii < parse_size; ++ii) {
+              VLOG(2) << "MemorySparseTable::load key: " << key << " value "
+                      << ii << ": " << value.data()[ii]
+                      << " local_shard: " << i;
+            }
           }
         }
         read_channel->close();
@@ -160,8 +239,14 @@ int32_t MemorySparseTable::Load(const std::string& path,
 
 int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
                                        const std::string& param) {
+  // loaded rows are not in the last delta or base, save them in the next
+  // delta
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    _local_shards[i].set_all_dirty(true);
+  }
   std::string table_path = TableDir(path);
   auto file_list = paddle::framework::localfs_list(table_path);
+  std::sort(file_list.begin(), file_list.end());
 
   int load_param = atoi(param.c_str());
   auto expect_shard_num = _sparse_table_shard_num;
@@ -179,6 +264,31 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
 
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
+  bool is_binary = _value_accesor->IsBinaryFormat(load_param);
+
+  if (!is_binary && FLAGS_pserver_load_pipeline) {
+    auto read_func =
+        [&](size_t file_idx,
+            const std::function<void(std::string*)>& line_func) -> int {
+      std::ifstream file(file_list[file_start_idx + file_idx]);
+      if (!file.is_open()) {
+        return -1;
+      }
+      std::string line_data;
+      while (std::getline(file, line_data) && line_data.size() > 1) {
+        line_func(&line_data);
+      }
+      return file.bad() ? -1 : 0;
+    };
+    if (LoadTextPipelined(_real_local_shard_num, read_func) != 0) {
+      LOG(ERROR) << "MemorySparseTable load failed reach max limit!";
+      exit(-1);
+    }
+    LOG(INFO) << "MemorySparseTable load success, path from "
+              << file_list[file_start_idx] << " to "
+              << file_list[file_start_idx + _real_local_shard_num - 1];
+    return 0;
+  }
 
   int thread_num = _real_local_shard_num < 15 ? _real_local_shard_num : 15;
   omp_set_num_threads(thread_num);
@@ -191,18 +301,25 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
       is_read_failed = false;
       err_no = 0;
       std::string line_data;
-      std::ifstream file(file_list[file_start_idx + i]);
       char* end = NULL;
       auto& shard = _local_shards[i];
       try {
-        while (std::getline(file, line_data) && line_data.size() > 1) {
-          uint64_t key = std::strtoul(line_data.data(), &end, 10);
-          auto& value = shard[key];
-          value.resize(feature_value_size);
-          int parse_size = _value_accesor->ParseFromString(++end, value.data());
-          value.resize(parse_size);
+        if (is_binary) {
+          if (LoadLocalShardBinary(i, file_list[file_start_idx + i]) != 0) {
+            err_no = -1;
+          }
+        } else {
+          std::ifstream file(file_list[file_start_idx + i]);
+          while (std::getline(file, line_data) && line_data.size() > 1) {
+            uint64_t key = std::strtoul(line_data.data(), &end, 10);
+            auto& value = shard[key];
+            value.resize(feature_value_size);
+            int parse_size =
+                _value_accesor->ParseFromString(++end, value.data());
+            value.resize(parse_size);
+          }
+          file.close();
         }
-        file.close();
         if (err_no == -1) {
           ++retry_num;
           is_read_failed = true;
@@ -229,6 +346,61 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
   return 0;
 }
 
+int32_t MemorySparseTable::LoadWithDelta(
+    const std::string& base_path, const std::string& base_param,
+    const std::vector<std::string>& delta_paths,
+    const std::string& delta_param) {
+  if (Load(base_path, base_param) != 0) {
+    LOG(ERROR) << "MemorySparseTable load base failed, path:" << base_path;
+    return -1;
+  }
+  for (auto& delta_path : delta_paths) {
+    if (Load(delta_path, delta_param) != 0) {
+      LOG(ERROR) << "MemorySparseTable load delta failed, path:"
+                 << delta_path;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+SparseLoadPipeline::Option MemorySparseTable::LoadPipelineOption() {
+  SparseLoadPipeline::Option option;
+  option.reader_thread_num = FLAGS_pserver_load_reader_thread_num;
+  option.parse_thread_num = FLAGS_pserver_load_parse_thread_num;
+  option.insert_thread_num = FLAGS_pserver_load_insert_thread_num;
+  option.max_retry = FLAGS_pserver_table_save_max_retry;
+  return option;
+}
+
+int32_t MemorySparseTable::LoadTextPipelined(
+    size_t file_num, SparseLoadPipeline::ReadFunc read_func) {
+  size_t feature_value_size =
+      _value_accesor->GetAccessorInfo().size / sizeof(float);
+  SparseLoadPipeline pipeline(LoadPipelineOption(), _real_local_shard_num,
+                              feature_value_size);
+  auto parse_func = [this](size_t file_idx, const std::string& line,
+                           uint64_t* key, float* value) -> int {
+    char* end = NULL;
+    *key = std::strtoul(line.data(), &end, 10);
+    return _value_accesor->ParseFromString(++end, value);
+  };
+  // same routing as push, every shard is filled by one insert thread
+  auto shard_func = [this](uint64_t key) -> size_t {
+    return (key % _sparse_table_shard_num) % _avg_local_shard_num;
+  };
+  auto insert_func = [this](int thread_idx, const SparseLoadBlock& block) {
+    for (size_t i = 0; i < block.size(); ++i) {
+      auto& value = _local_shards[block.shard_ids[i]][block.keys[i]];
+      value.resize(block.value_size(i));
+      memcpy(value.data(), block.value(i),
+             block.value_size(i) * sizeof(float));
+    }
+  };
+  return pipeline.Run(file_num, read_func, parse_func, shard_func,
+                      insert_func);
+}
+
 int32_t MemorySparseTable::Save(const std::string& dirname,
                                 const std::string& param) {
   VLOG(0) << "MemorySparseTable::save dirname: " << dirname;
@@ -240,6 +412,7 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
   std::atomic<uint32_t> feasign_size_all{0};
 
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
+  bool is_binary = _value_accesor->IsBinaryFormat(save_param);
 
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
   omp_set_num_threads(thread_num);
@@ -263,26 +436,54 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
     int retry_num = 0;
     int err_no = 0;
     auto& shard = _local_shards[i];
+    // taken once, as a retry has to write the buckets whose dirty bits
+    // are already cleared
+    std::vector<size_t> buckets = BucketsToSave(i, save_param);
+    if (save_param == 1 || save_param == 2) {
+      ClearDirtyBuckets(i, buckets);
+    }
     do {
       err_no = 0;
       feasign_size = 0;
       is_write_failed = false;
       auto write_channel =
           _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
-      for (auto it = shard.begin(); it != shard.end(); ++it) {
-        if (_value_accesor->Save(it.value().data(), save_param)) {
-          std::string format_value = _value_accesor->ParseToString(
-              it.value().data(), it.value().size());
-          if (0 != write_channel->write_line(paddle::string::format_string(
-                       "%lu %s", it.key(), format_value.c_str()))) {
-            ++retry_num;
-            is_write_failed = true;
-            LOG(ERROR)
-                << "MemorySparseTable save prefix failed, retry it! path:"
-                << channel_config.path << " , retry_num=" << retry_num;
+      if (is_binary) {
+        int64_t ret = SaveShardBinary(
+            i, save_param, buckets,
+            [&write_channel](const char* data, size_t size) {
+              return write_channel->write(data, size) == 0 ? 0 : -1;
+            });
+        if (ret < 0) {
+          ++retry_num;
+          is_write_failed = true;
+          LOG(ERROR) << "MemorySparseTable save prefix failed, retry it! path:"
+                     << channel_config.path << " , retry_num=" << retry_num;
+        } else {
+          feasign_size = ret;
+        }
+      } else {
+        for (size_t bucket : buckets) {
+          ScopedBucketLock lock(shard.bucket_lock(bucket), false);
+          for (auto it = shard.begin(bucket); it != shard.end(bucket); ++it) {
+            if (_value_accesor->Save(it.value().data(), save_param)) {
+              std::string format_value = _value_accesor->ParseToString(
+                  it.value().data(), it.value().size());
+              if (0 != write_channel->write_line(paddle::string::format_string(
+                           "%lu %s", it.key(), format_value.c_str()))) {
+                ++retry_num;
+                is_write_failed = true;
+                LOG(ERROR)
+                    << "MemorySparseTable save prefix failed, retry it! path:"
+                    << channel_config.path << " , retry_num=" << retry_num;
+                break;
+              }
+              ++feasign_size;
+            }
+          }
+          if (is_write_failed) {
             break;
           }
-          ++feasign_size;
         }
       }
       write_channel->close();
@@ -302,8 +503,10 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
       }
     } while (is_write_failed);
     feasign_size_all += feasign_size;
-    for (auto it = shard.begin(); it != shard.end(); ++it) {
-      _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+    for (size_t bucket : buckets) {
+      for (auto it = shard.begin(bucket); it != shard.end(bucket); ++it) {
+        _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+      }
     }
     LOG(INFO) << "MemorySparseTable save prefix success, path: "
               << channel_config.path;
@@ -318,38 +521,198 @@ int32_t MemorySparseTable::SaveLocalFS(const std::string& dirname,
   int save_param =
       atoi(param.c_str());  // checkpoint:0  xbox delta:1  xbox base:2
   std::string table_path = TableDir(dirname);
-  int feasign_cnt = 0;
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
 
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
   std::atomic<uint32_t> feasign_size_all{0};
+  std::atomic<bool> is_write_failed{false};
+  bool is_binary = _value_accesor->IsBinaryFormat(save_param);
 
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
-    feasign_cnt = 0;
+    int64_t feasign_cnt = 0;
     auto& shard = _local_shards[i];
     std::string file_name = paddle::string::format_string(
         "%s/part-%s-%03d-%05d", table_path.c_str(), prefix.c_str(), _shard_idx,
         file_start_idx + i);
     std::ofstream os;
     os.open(file_name);
-    for (auto it = shard.begin(); it != shard.end(); ++it) {
-      if (_value_accesor->Save(it.value().data(), save_param)) {
-        std::string format_value =
-            _value_accesor->ParseToString(it.value().data(), it.value().size());
-        std::string out_line = paddle::string::format_string(
-            "%lu %s\n", it.key(), format_value.c_str());
-        // VLOG(2) << out_line.c_str();
-        os.write(out_line.c_str(), sizeof(char) * out_line.size());
-        ++feasign_cnt;
+    std::vector<size_t> buckets = BucketsToSave(i, save_param);
+    if (save_param == 1 || save_param == 2) {
+      ClearDirtyBuckets(i, buckets);
+    }
+    if (is_binary) {
+      feasign_cnt = SaveShardBinary(
+          i, save_param, buckets, [&os](const char* data, size_t size) {
+            os.write(data, size);
+            return os.good() ? 0 : -1;
+          });
+    } else {
+      for (size_t bucket : buckets) {
+        ScopedBucketLock lock(shard.bucket_lock(bucket), false);
+        for (auto it = shard.begin(bucket); it != shard.end(bucket); ++it) {
+          if (_value_accesor->Save(it.value().data(), save_param)) {
+            std::string format_value = _value_accesor->ParseToString(
+                it.value().data(), it.value().size());
+            std::string out_line = paddle::string::format_string(
+                "%lu %s\n", it.key(), format_value.c_str());
+            // VLOG(2) << out_line.c_str();
+            os.write(out_line.c_str(), sizeof(char) * out_line.size());
+            ++feasign_cnt;
+          }
+        }
       }
     }
     os.close();
+    if (feasign_cnt < 0 || !os) {
+      is_write_failed = true;
+      LOG(ERROR) << "MemorySparseTable save prefix failed, path:"
+                 << file_name;
+      continue;
+    }
     LOG(INFO) << "MemorySparseTable save prefix success, path:" << file_name
               << "feasign_cnt: " << feasign_cnt;
   }
-  return 0;
+  return is_write_failed ? -1 : 0;
+}
+
+int64_t MemorySparseTable::SaveShardBinary(
+    size_t shard_idx, int save_param, const std::vector<size_t>& buckets,
+    SparseBinaryWriter::WriteFunc write_func) {
+  SparseBinaryWriter writer(write_func);
+  if (writer.WriteHeader(_value_accesor->EmbedxQuantBits(),
+                         _value_accesor->GetAccessorInfo().dim) != 0) {
+    return -1;
+  }
+  int64_t feasign_size = 0;
+  auto& shard = _local_shards[shard_idx];
+  for (size_t bucket : buckets) {
+    ScopedBucketLock lock(shard.bucket_lock(bucket), false);
+    for (auto it = shard.begin(bucket); it != shard.end(bucket); ++it) {
+      if (_value_accesor->Save(it.value().data(), save_param)) {
+        if (writer.Append(it.key(), it.value().data(), it.value().size()) !=
+            0) {
+          return -1;
+        }
+        ++feasign_size;
+      }
+    }
+  }
+  if (writer.Flush() != 0) {
+    return -1;
+  }
+  return feasign_size;
+}
+
+std::vector<size_t> MemorySparseTable::BucketsToSave(size_t shard_idx,
+                                                     int save_param) {
+  auto& shard = _local_shards[shard_idx];
+  std::vector<size_t> buckets;
+  buckets.reserve(shard.bucket_count());
+  for (size_t bucket = 0; bucket < shard.bucket_count(); ++bucket) {
+    // a row of a bucket not pushed or pulled by pointer since the last
+    // delta or base keeps a delta score below delta_threshold, so the
+    // delta would not save it
+    if (save_param != 1 || !FLAGS_pserver_delta_save_dirty_bucket_only ||
+        shard.dirty(bucket)) {
+      buckets.push_back(bucket);
+    }
+  }
+  return buckets;
+}
+
+void MemorySparseTable::ClearDirtyBuckets(size_t shard_idx,
+                                          const std::vector<size_t>& buckets) {
+  auto& shard = _local_shards[shard_idx];
+  if (shard.concurrent()) {
+    // a push marks its bucket and updates the row under the bucket lock
+    for (size_t bucket : buckets) {
+      ScopedBucketLock lock(shard.bucket_lock(bucket), true);
+      shard.clear_dirty(bucket);
+    }
+    return;
+  }
+  // without the bucket locks the pushes of a shard run on its task thread
+  _shards_task_pool[shard_idx % _task_pool_size]
+      ->enqueue([&shard, &buckets]() {
+        for (size_t bucket : buckets) {
+          shard.clear_dirty(bucket);
+        }
+      })
+      .wait();
+}
+
+int32_t MemorySparseTable::LoadShardBinary(size_t shard_idx,
+                                           SparseBinaryReader* reader) {
+  SparseBinaryFileHeader header;
+  if (reader->ReadHeader(&header) != 0) {
+    return -1;
+  }
+  // the values are copied as stored, so the layout must match the accessor
+  int quant_bits = _value_accesor->EmbedxQuantBits();
+  size_t value_dim = _value_accesor->GetAccessorInfo().dim;
+  if (header.quant_bits != static_cast<uint32_t>(quant_bits) ||
+      header.value_dim != value_dim) {
+    LOG(ERROR) << "MemorySparseTable binary file saved with quant_bits: "
+               << header.quant_bits << " value_dim: " << header.value_dim
+               << ", but the accessor has quant_bits: " << quant_bits
+               << " value_dim: " << value_dim;
+    return -1;
+  }
+  auto& shard = _local_shards[shard_idx];
+  SparseBinaryBlock block;
+  int ret = 0;
+  while ((ret = reader->Next(&block)) > 0) {
+    const float* value_data = block.values;
+    for (uint32_t i = 0; i < block.key_num; ++i) {
+      auto& value = shard[block.keys[i]];
+      value.resize(block.sizes[i]);
+      memcpy(value.data(), value_data, block.sizes[i] * sizeof(float));
+      value_data += block.sizes[i];
+    }
+  }
+  return ret == 0 ? 0 : -1;
+}
+
+int32_t MemorySparseTable::LoadLocalShardBinary(size_t shard_idx,
+                                                const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "MemorySparseTable open binary file failed, path:" << path;
+    return -1;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return -1;
+  }
+  size_t file_size = file_stat.st_size;
+  int32_t ret = -1;
+  if (FLAGS_pserver_load_binary_with_mmap && file_size > 0) {
+    void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, file_size, MADV_SEQUENTIAL);
+      SparseBinaryReader reader(static_cast<const char*>(data), file_size);
+      ret = LoadShardBinary(shard_idx, &reader);
+      munmap(data, file_size);
+      close(fd);
+      return ret;
+    }
+    LOG(WARNING) << "MemorySparseTable mmap failed, fallback to read, path:"
+                 << path;
+  }
+  FILE* fp = fdopen(fd, "rb");
+  if (fp == NULL) {
+    close(fd);
+    return -1;
+  }
+  SparseBinaryReader reader([fp](char* data, size_t size) {
+    return fread_unlocked(data, 1, size, fp);
+  });
+  ret = LoadShardBinary(shard_idx, &reader);
+  fclose(fp);
+  return ret;
 }
 
 int64_t MemorySparseTable::LocalSize() {
@@ -408,7 +771,11 @@ int32_t MemorySparseTable::Pull(TableContext& context) {
 
 int32_t MemorySparseTable::Push(TableContext& context) {
   CHECK(context.value_type == Sparse);
-  if (!context.use_ptr) {
+  if (context.push_context.wire_values != nullptr) {
+    return PushSparseWire(context.push_context.keys,
+                          context.push_context.wire_values,
+                          context.push_context.wire_type, context.num);
+  } else if (!context.use_ptr) {
     return PushSparse(context.push_context.keys, context.push_context.values,
                       context.num);
   } else {
@@ -420,16 +787,6 @@ int32_t MemorySparseTable::Push(TableContext& context) {
 int32_t MemorySparseTable::PullSparse(float* pull_values,
                                       const PullSparseValue& pull_value) {
   CostTimer timer("pserver_sparse_select_all");
-  std::vector<std::future<int>> tasks(_real_local_shard_num);
-
-  const size_t value_size =
-      _value_accesor->GetAccessorInfo().size / sizeof(float);
-  size_t mf_value_size =
-      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
-  size_t select_value_size =
-      _value_accesor->GetAccessorInfo().select_size / sizeof(float);
-  // std::atomic<uint32_t> missed_keys{0};
-
   std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
       _real_local_shard_num);
   size_t num = pull_value.numel_;
@@ -438,52 +795,15 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
                    _avg_local_shard_num;
     task_keys[shard_id].push_back({pull_value.feasigns_[i], i});
   }
-  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    tasks[shard_id] =
-        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-            [this, shard_id, &task_keys, value_size, pull_values, mf_value_size,
-             select_value_size]() -> int {
-              auto& local_shard = _local_shards[shard_id];
-              float data_buffer[value_size];  // NOLINT
-              float* data_buffer_ptr = data_buffer;
-
-              auto& keys = task_keys[shard_id];
-              for (size_t i = 0; i < keys.size(); i++) {
-                uint64_t key = keys[i].first;
-                auto itr = local_shard.find(key);
-                size_t data_size = value_size - mf_value_size;
-                if (itr == local_shard.end()) {
-                  // ++missed_keys;
-                  if (FLAGS_pserver_create_value_when_push) {
-                    memset(data_buffer, 0, sizeof(float) * data_size);
-                  } else {
-                    auto& feature_value = local_shard[key];
-                    feature_value.resize(data_size);
-                    float* data_ptr = feature_value.data();
-                    _value_accesor->Create(&data_buffer_ptr, 1);
-                    memcpy(data_ptr, data_buffer_ptr,
-                           data_size * sizeof(float));
-                  }
-                } else {
-                  data_size = itr.value().size();
-                  memcpy(data_buffer_ptr, itr.value().data(),
-                         data_size * sizeof(float));
-                }
-                for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
-                  data_buffer[mf_idx] = 0.0;
-                }
-                auto offset = keys[i].second;
-                float* select_data = pull_values + select_value_size * offset;
-                _value_accesor->Select(&select_data,
-                                       (const float**)&data_buffer_ptr, 1);
-              }
-
-              return 0;
-            });
-  }
-
-  for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
-    tasks[shard_id].wait();
+  auto tasks = EnqueuePullTasks(
+      task_keys,
+      [this, pull_values](size_t shard_id,
+                          const std::pair<uint64_t, int>* keys,
+                          size_t key_num) -> int {
+        return PullSparseKeys(shard_id, keys, key_num, pull_values);
+      });
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i].wait();
   }
   return 0;
 }
@@ -491,57 +811,187 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
 int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
                                          const uint64_t* keys, size_t num) {
   CostTimer timer("pscore_sparse_select_all");
-  size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
-  size_t mf_value_size =
-      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
-
-  std::vector<std::future<int>> tasks(_real_local_shard_num);
   std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
       _real_local_shard_num);
   for (size_t i = 0; i < num; ++i) {
     int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
     task_keys[shard_id].push_back({keys[i], i});
   }
-  // std::atomic<uint32_t> missed_keys{0};
+  auto tasks = EnqueuePullTasks(
+      task_keys,
+      [this, pull_values](size_t shard_id,
+                          const std::pair<uint64_t, int>* keys,
+                          size_t key_num) -> int {
+        return PullSparsePtrKeys(shard_id, keys, key_num, pull_values);
+      });
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i].wait();
+  }
+  return 0;
+}
+
+std::vector<std::future<int>> MemorySparseTable::EnqueuePullTasks(
+    const std::vector<std::vector<std::pair<uint64_t, int>>>& task_keys,
+    PullKeysFunc pull_func) {
+  std::vector<std::future<int>> tasks;
+  if (!_concurrent_pull) {
+    tasks.resize(_real_local_shard_num);
+    for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+      tasks[shard_id] =
+          _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+              [shard_id, &task_keys, pull_func]() -> int {
+                auto& keys = task_keys[shard_id];
+                return pull_func(shard_id, keys.data(), keys.size());
+              });
+    }
+    return tasks;
+  }
+  // split the keys of every shard into batches spread over all task pools,
+  // so a hot shard is no longer served by a single thread
+  size_t batch_size = FLAGS_pserver_sparse_concurrent_pull_batch;
   for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    tasks[shard_id] =
-        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-            [this, shard_id, &task_keys, pull_values, value_size,
-             mf_value_size]() -> int {
-              auto& keys = task_keys[shard_id];
-              auto& local_shard = _local_shards[shard_id];
-              float data_buffer[value_size];
-              float* data_buffer_ptr = data_buffer;
-              for (int i = 0; i < keys.size(); ++i) {
-                uint64_t key = keys[i].first;
-                auto itr = local_shard.find(key);
-                size_t data_size = value_size - mf_value_size;
-                FixedFeatureValue* ret = NULL;
-                if (itr == local_shard.end()) {
-                  // ++missed_keys;
-                  auto& feature_value = local_shard[key];
-                  feature_value.resize(data_size);
-                  float* data_ptr = feature_value.data();
-                  _value_accesor->Create(&data_buffer_ptr, 1);
-                  memcpy(data_ptr, data_buffer_ptr, data_size * sizeof(float));
-                  ret = &feature_value;
-                } else {
-                  ret = itr.value_ptr();
-                }
-                int pull_data_idx = keys[i].second;
-                pull_values[pull_data_idx] = (char*)ret;
-              }
-              return 0;
-            });
+    auto& keys = task_keys[shard_id];
+    for (size_t begin = 0; begin < keys.size(); begin += batch_size) {
+      size_t key_num = std::min(batch_size, keys.size() - begin);
+      size_t pool_idx = _pull_pool_idx++ % _shards_task_pool.size();
+      tasks.push_back(_shards_task_pool[pool_idx]->enqueue(
+          [shard_id, &keys, begin, key_num, pull_func]() -> int {
+            return pull_func(shard_id, keys.data() + begin, key_num);
+          }));
+    }
   }
-  for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
-    tasks[shard_id].wait();
+  return tasks;
+}
+
+int32_t MemorySparseTable::PullSparseKeys(size_t shard_id,
+                                          const std::pair<uint64_t, int>* keys,
+                                          size_t num, float* pull_values) {
+  const size_t value_size =
+      _value_accesor->GetAccessorInfo().size / sizeof(float);
+  size_t mf_value_size =
+      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+  size_t select_value_size =
+      _value_accesor->GetAccessorInfo().select_size / sizeof(float);
+
+  auto& local_shard = _local_shards[shard_id];
+  float data_buffer[value_size];  // NOLINT
+  float* data_buffer_ptr = data_buffer;
+  for (size_t i = 0; i < num; i++) {
+    uint64_t key = keys[i].first;
+    size_t bucket = local_shard.bucket_of(key);
+    size_t data_size = value_size - mf_value_size;
+    bool found = false;
+    {
+      ScopedBucketLock lock(local_shard.bucket_lock(bucket), false);
+      auto itr = local_shard.find(key);
+      if (itr != local_shard.end()) {
+        found = true;
+        data_size = itr.value().size();
+        memcpy(data_buffer_ptr, itr.value().data(),
+               data_size * sizeof(float));
+      }
+    }
+    if (!found) {
+      if (FLAGS_pserver_create_value_when_push) {
+        memset(data_buffer, 0, sizeof(float) * data_size);
+      } else {
+        ScopedBucketLock lock(local_shard.bucket_lock(bucket), true);
+        auto res = local_shard.emplace(key);
+        auto& feature_value = res.first.value();
+        if (res.second) {
+          feature_value.resize(data_size);
+          _value_accesor->Create(&data_buffer_ptr, 1);
+          memcpy(feature_value.data(), data_buffer_ptr,
+                 data_size * sizeof(float));
+        } else {
+          // created by a concurrent pull between the two locks
+          data_size = feature_value.size();
+          memcpy(data_buffer_ptr, feature_value.data(),
+                 data_size * sizeof(float));
+        }
+      }
+    }
+    for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
+      data_buffer[mf_idx] = 0.0;
+    }
+    auto offset = keys[i].second;
+    float* select_data = pull_values + select_value_size * offset;
+    _value_accesor->Select(&select_data, (const float**)&data_buffer_ptr, 1);
+  }
+  return 0;
+}
+
+int32_t MemorySparseTable::PullSparsePtrKeys(
+    size_t shard_id, const std::pair<uint64_t, int>* keys, size_t num,
+    char** pull_values) {
+  size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
+  size_t mf_value_size =
+      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+
+  auto& local_shard = _local_shards[shard_id];
+  float data_buffer[value_size];  // NOLINT
+  float* data_buffer_ptr = data_buffer;
+  for (size_t i = 0; i < num; ++i) {
+    uint64_t key = keys[i].first;
+    size_t bucket = local_shard.bucket_of(key);
+    size_t data_size = value_size - mf_value_size;
+    FixedFeatureValue* ret = NULL;
+    {
+      ScopedBucketLock lock(local_shard.bucket_lock(bucket), false);
+      auto itr = local_shard.find(key);
+      if (itr != local_shard.end()) {
+        ret = itr.value_ptr();
+      }
+    }
+    if (ret == NULL) {
+      ScopedBucketLock lock(local_shard.bucket_lock(bucket), true);
+      auto res = local_shard.emplace(key);
+      if (res.second) {
+        auto& feature_value = res.first.value();
+        feature_value.resize(data_size);
+        _value_accesor->Create(&data_buffer_ptr, 1);
+        memcpy(feature_value.data(), data_buffer_ptr,
+               data_size * sizeof(float));
+      }
+      ret = res.first.value_ptr();
+    }
+    // the caller writes the row through the pointer, e.g. the gpu ps
+    // write-back, so the next delta save has to visit the bucket
+    local_shard.mark_dirty(bucket);
+    int pull_data_idx = keys[i].second;
+    pull_values[pull_data_idx] = (char*)ret;  // NOLINT
   }
   return 0;
 }
 
+void MemorySparseTable::UpdateBatch::Add(MemorySparseTable* table,
+                                         float* value, const float* push) {
+  if (!enabled) {
+    table->_value_accesor->Update(&value, &push, 1);
+    return;
+  }
+  values.push_back(value);
+  pushes.push_back(push);
+}
+
+void MemorySparseTable::UpdateBatch::Update(MemorySparseTable* table) {
+  if (!values.empty()) {
+    table->_value_accesor->Update(values.data(), pushes.data(),
+                                  values.size());
+  }
+  values.clear();
+  pushes.clear();
+}
+
 int32_t MemorySparseTable::PushSparse(const uint64_t* keys, const float* values,
                                       size_t num) {
+  return PushSparseWire(keys, reinterpret_cast<const char*>(values),
+                        kSparseWireFp32, num);
+}
+
+int32_t MemorySparseTable::PushSparseWire(const uint64_t* keys,
+                                          const char* values, int wire_type,
+                                          size_t num) {
   CostTimer timer("pserver_sparse_update_all");
   std::vector<std::future<int>> tasks(_real_local_shard_num);
   std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
@@ -557,20 +1007,42 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys, const float* values,
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
   size_t update_value_col =
       _value_accesor->GetAccessorInfo().update_size / sizeof(float);
+  size_t exact_col = _value_accesor->UpdateExactDim();
+  size_t wire_row_size =
+      SparseWireRowSize(wire_type, exact_col, update_value_col);
 
   for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
-        [this, shard_id, value_col, mf_value_col, update_value_col, values,
-         &task_keys]() -> int {
+        [this, shard_id, value_col, mf_value_col, update_value_col, exact_col,
+         wire_row_size, wire_type, values, &task_keys]() -> int {
           auto& keys = task_keys[shard_id];
           auto& local_shard = _local_shards[shard_id];
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
+          float update_buffer[update_value_col];  // NOLINT
+          UpdateBatch batch(local_shard);
+          // a batched row keeps its decoded push until the batch is updated
+          std::vector<float> decoded;
+          if (batch.enabled && wire_type != kSparseWireFp32) {
+            decoded.resize(keys.size() * update_value_col);
+          }
           for (int i = 0; i < keys.size(); ++i) {
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
+            const char* wire_row = values + push_data_idx * wire_row_size;
             const float* update_data =
-                values + push_data_idx * update_value_col;
+                reinterpret_cast<const float*>(wire_row);
+            if (wire_type != kSparseWireFp32) {
+              float* decode_buffer = batch.enabled
+                                         ? decoded.data() + i * update_value_col
+                                         : update_buffer;
+              SparseWireDecode(wire_type, exact_col, update_value_col,
+                               wire_row, decode_buffer);
+              update_data = decode_buffer;
+            }
+            size_t bucket = local_shard.bucket_of(key);
+            ScopedBucketLock lock(local_shard.bucket_lock(bucket), true);
+            local_shard.mark_dirty(bucket);
             auto itr = local_shard.find(key);
             if (itr == local_shard.end()) {
               if (FLAGS_pserver_enable_create_feasign_randomly &&
@@ -591,7 +1063,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys, const float* values,
             size_t value_size = feature_value.size();
 
             if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
+              batch.Add(this, value_data, update_data);
             } else {
               // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
               memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
@@ -605,6 +1077,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys, const float* values,
               memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
             }
           }
+          batch.Update(this);
           return 0;
         });
   }
@@ -639,10 +1112,14 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
           auto& local_shard = _local_shards[shard_id];
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
+          UpdateBatch batch(local_shard);
           for (int i = 0; i < keys.size(); ++i) {
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
             const float* update_data = values[push_data_idx];
+            size_t bucket = local_shard.bucket_of(key);
+            ScopedBucketLock lock(local_shard.bucket_lock(bucket), true);
+            local_shard.mark_dirty(bucket);
             auto itr = local_shard.find(key);
             if (itr == local_shard.end()) {
               if (FLAGS_pserver_enable_create_feasign_randomly &&
@@ -661,7 +1138,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
             if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
+              batch.Add(this, value_data, update_data);
             } else {
               // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
               memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
@@ -674,6 +1151,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
               memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
             }
           }
+          batch.Update(this);
           return 0;
         });
   }
@@ -688,19 +1166,70 @@ int32_t MemorySparseTable::Flush() { return 0; }
 
 int32_t MemorySparseTable::Shrink(const std::string& param) {
   VLOG(0) << "MemorySparseTable::Shrink";
-  // TODO(zhaocaibei123): implement with multi-thread
+  _shrinked_bucket_num = 0;
+  _shrink_total_bucket_num = 0;
+  _shrink_erased_num = 0;
+  _shrink_reclaimed_bytes = 0;
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    _shrink_total_bucket_num += _local_shards[shard_id].bucket_count();
+  }
+  // every shard is shrinked step by step on its own task pool, so pushes
+  // only wait for one step instead of the whole shard
+  std::vector<std::future<void>> tasks;
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    // Shrink
-    auto& shard = _local_shards[shard_id];
-    for (auto it = shard.begin(); it != shard.end();) {
+    auto done = std::make_shared<std::promise<void>>();
+    tasks.push_back(done->get_future());
+    _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+        [this, shard_id, done]() { ShrinkShardStep(shard_id, 0, done); });
+  }
+  for (auto& task : tasks) {
+    task.wait();
+  }
+  VLOG(0) << "MemorySparseTable::Shrink erased " << _shrink_erased_num
+          << " values, reclaimed " << _shrink_reclaimed_bytes << " bytes";
+  return 0;
+}
+
+void MemorySparseTable::ShrinkShardStep(
+    size_t shard_id, size_t begin_bucket,
+    std::shared_ptr<std::promise<void>> done) {
+  auto& shard = _local_shards[shard_id];
+  size_t end_bucket = std::min(
+      begin_bucket + std::max(FLAGS_pserver_shrink_bucket_num_per_step, 1),
+      shard.bucket_count());
+  uint64_t erased_num = 0;
+  uint64_t reclaimed_bytes = 0;
+  for (size_t bucket = begin_bucket; bucket < end_bucket; ++bucket) {
+    ScopedBucketLock lock(shard.bucket_lock(bucket), true);
+    for (auto it = shard.begin(bucket); it != shard.end(bucket);) {
       if (_value_accesor->Shrink(it.value().data())) {
-        it = shard.erase(it);
+        reclaimed_bytes +=
+            it.value().size() * sizeof(float) + sizeof(FixedFeatureValue);
+        ++erased_num;
+        it = shard.erase(bucket, it);
       } else {
         ++it;
       }
     }
   }
-  return 0;
+  _shrink_erased_num += erased_num;
+  _shrink_reclaimed_bytes += reclaimed_bytes;
+  size_t step_bucket_num = end_bucket - begin_bucket;
+  size_t shrinked_bucket_num =
+      _shrinked_bucket_num.fetch_add(step_bucket_num) + step_bucket_num;
+  if (end_bucket == shard.bucket_count()) {
+    VLOG(1) << "MemorySparseTable::Shrink shard " << shard_id
+            << " done, progress " << shrinked_bucket_num << "/"
+            << _shrink_total_bucket_num << " buckets, erased "
+            << _shrink_erased_num << " values, reclaimed "
+            << _shrink_reclaimed_bytes << " bytes";
+    done->set_value();
+    return;
+  }
+  _shards_task_pool[shard_id % _task_pool_size]->enqueue(
+      [this, shard_id, end_bucket, done]() {
+        ShrinkShardStep(shard_id, end_bucket, done);
+      });
 }
 
 void MemorySparseTable::Clear() { VLOG(0) << "clear coming soon"; }
@@ -18,6 +18,9 @@
 #include <assert.h>
 #include <pthread.h>
 
+#include <atomic>
+#include <functional>
+#include <future>  // NOLINT
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
@@ -29,6 +32,9 @@
 #include "paddle/fluid/distributed/ps/table/accessor.h"
 #include "paddle/fluid/distributed/ps/table/common_table.h"
 #include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_binary_io.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_load_pipeline.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_wire_codec.h"
 #include "paddle/fluid/string/string_helper.h"
 
 #define PSERVER_SAVE_SUFFIX ".shard"
@@ -71,6 +77,12 @@ class MemorySparseTable : public Table {
                        const std::string& param) override;
 
   int32_t LoadLocalFS(const std::string& path, const std::string& param);
+  // load a base save, then apply the delta saves in order, a row of a later
+  // save overwrites the same key of the earlier ones
+  int32_t LoadWithDelta(const std::string& base_path,
+                        const std::string& base_param,
+                        const std::vector<std::string>& delta_paths,
+                        const std::string& delta_param);
   int32_t SaveLocalFS(const std::string& path, const std::string& param,
                       const std::string& prefix);
 
@@ -86,21 +98,101 @@ class MemorySparseTable : public Table {
 
   int32_t PushSparse(const uint64_t* keys, const float** values, size_t num);
 
+  // push rows encoded by SparseWireEncode, decoded on the shard task pools
+  int32_t PushSparseWire(const uint64_t* keys, const char* values,
+                         int wire_type, size_t num);
+
   int32_t Flush() override;
   virtual int32_t Shrink(const std::string& param) override;
   void Clear() override;
 
+  // progress of the running or last Shrink
+  struct ShrinkStat {
+    size_t shrinked_bucket_num;
+    size_t total_bucket_num;
+    uint64_t erased_num;
+    // nominal sizes of the erased values, their rows go back to the
+    // FeatureRowPool and leave the process only once a whole chunk is
+    // empty, FeatureRowPool::MemorySize() tells what is held
+    uint64_t reclaimed_bytes;
+  };
+  ShrinkStat GetShrinkStat() {
+    return {_shrinked_bucket_num, _shrink_total_bucket_num, _shrink_erased_num,
+            _shrink_reclaimed_bytes};
+  }
+
   void* GetShard(size_t shard_idx) override {
     return &_local_shards[shard_idx];
   }
 
  protected:
+  // dump the rows of the buckets of a local shard in binary block format,
+  // return the number of rows written or -1 on failure
+  int64_t SaveShardBinary(size_t shard_idx, int save_param,
+                          const std::vector<size_t>& buckets,
+                          SparseBinaryWriter::WriteFunc write_func);
+  int32_t LoadShardBinary(size_t shard_idx, SparseBinaryReader* reader);
+  // the buckets a save with save_param visits: an xbox delta only visits
+  // the buckets pushed since the last xbox delta or base save
+  std::vector<size_t> BucketsToSave(size_t shard_idx, int save_param);
+  // clear the dirty bits of the buckets before they are written, a push
+  // before the clear is in the save and one after it marks its bucket again
+  void ClearDirtyBuckets(size_t shard_idx, const std::vector<size_t>& buckets);
+  int32_t LoadLocalShardBinary(size_t shard_idx, const std::string& path);
+  // options of SparseLoadPipeline from the pserver_load flags
+  SparseLoadPipeline::Option LoadPipelineOption();
+  // load the text files of the local shards in a SparseLoadPipeline
+  int32_t LoadTextPipelined(size_t file_num,
+                            SparseLoadPipeline::ReadFunc read_func);
+
+  typedef std::function<int(size_t shard_id,
+                            const std::pair<uint64_t, int>* keys, size_t num)>
+      PullKeysFunc;
+  // one task per local shard, or with concurrent pull, batches of keys
+  // spread over all task pools
+  std::vector<std::future<int>> EnqueuePullTasks(
+      const std::vector<std::vector<std::pair<uint64_t, int>>>& task_keys,
+      PullKeysFunc pull_func);
+  int32_t PullSparseKeys(size_t shard_id, const std::pair<uint64_t, int>* keys,
+                         size_t num, float* pull_values);
+  int32_t PullSparsePtrKeys(size_t shard_id,
+                            const std::pair<uint64_t, int>* keys, size_t num,
+                            char** pull_values);
+
+  // The rows of a push task already extended to the full value are updated
+  // in place by one accessor Update at the end of the task, which lets the
+  // sgd rule update their embedx in a batch. Only when the shard is not
+  // locked per bucket, as then no other thread reads its rows meanwhile.
+  struct UpdateBatch {
+    explicit UpdateBatch(shard_type& shard) : enabled(!shard.concurrent()) {}
+    // update the row now if the batch is disabled
+    void Add(MemorySparseTable* table, float* value, const float* push);
+    void Update(MemorySparseTable* table);
+
+    bool enabled;
+    std::vector<float*> values;
+    std::vector<const float*> pushes;
+  };
+
+  // shrink a few buckets of a shard on its task pool, then enqueue the next
+  // step behind the pull and push tasks queued meanwhile, done is set after
+  // the last bucket
+  void ShrinkShardStep(size_t shard_id, size_t begin_bucket,
+                       std::shared_ptr<std::promise<void>> done);
+
   const int _task_pool_size = 24;
   int _avg_local_shard_num;
   int _real_local_shard_num;
   int _sparse_table_shard_num;
   std::vector<std::shared_ptr<::ThreadPool>> _shards_task_pool;
   std::unique_ptr<shard_type[]> _local_shards;
+  // pull runs across task pools, shards are locked per bucket
+  bool _concurrent_pull = false;
+  std::atomic<size_t> _pull_pool_idx{0};
+  std::atomic<size_t> _shrinked_bucket_num{0};
+  size_t _shrink_total_bucket_num = 0;
+  std::atomic<uint64_t> _shrink_erased_num{0};
+  std::atomic<uint64_t> _shrink_reclaimed_bytes{0};
 };
 
 }  // namespace distributed
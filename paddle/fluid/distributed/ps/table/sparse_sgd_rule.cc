@@ -19,10 +19,24 @@
 #include "glog/logging.h"
 
 DEFINE_bool(enable_show_scale_gradient, true, "enable show scale gradient");
+DEFINE_bool(pserver_sparse_sgd_simd, false,
+            "update sparse values with avx2/avx512 kernels if cpu supports, "
+            "they accumulate in float where the scalar rules use double");
 
 namespace paddle {
 namespace distributed {
 
+// the rows of a batch are spread over the table, fetch the next one while
+// the current one is updated
+static inline void PrefetchRow(const float* w, const float* sgd,
+                               const float* grad) {
+#if defined(__GNUC__)
+  __builtin_prefetch(w, 1);
+  __builtin_prefetch(sgd, 1);
+  __builtin_prefetch(grad);
+#endif
+}
+
 void SparseNaiveSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
                                     size_t emb_dim) {
   _embedding_dim = emb_dim;
@@ -83,11 +97,22 @@ void SparseAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adagrad_param.weight_bounds(0);
     _max_bound = adagrad_param.weight_bounds(1);
   }
+  _kernels = FLAGS_pserver_sparse_sgd_simd
+                 ? GetSparseSGDKernels(_embedding_dim)
+                 : nullptr;
 }
 
 void SparseAdaGradSGDRule::UpdateValueWork(float* w, float* sgd,
                                            const float* grad, float scale) {
   float& g2sum = sgd[G2SumIndex()];
+  if (_kernels != nullptr) {
+    float ratio =
+        learning_rate_ * sqrt(_initial_g2sum / (_initial_g2sum + g2sum));
+    g2sum += _kernels->adagrad(w, grad, _embedding_dim, ratio, scale,
+                               _min_bound, _max_bound) /
+             _embedding_dim;
+    return;
+  }
   double add_g2sum = 0;
 
   for (int i = 0; i < _embedding_dim; i++) {
@@ -101,6 +126,17 @@ void SparseAdaGradSGDRule::UpdateValueWork(float* w, float* sgd,
   g2sum += add_g2sum / _embedding_dim;
 }
 
+void SparseAdaGradSGDRule::UpdateValueBatch(float** w, float** sgd,
+                                            const float** grad,
+                                            const float* scale, size_t num) {
+  for (size_t i = 0; i < num; ++i) {
+    if (i + 1 < num) {
+      PrefetchRow(w[i + 1], sgd[i + 1], grad[i + 1]);
+    }
+    SparseAdaGradSGDRule::UpdateValueWork(w[i], sgd[i], grad[i], scale[i]);
+  }
+}
+
 void SparseAdaGradSGDRule::InitValueWork(float* value, float* sgd,
                                          bool zero_init) {
   for (int i = 0; i < _embedding_dim; ++i) {
@@ -137,10 +173,19 @@ void StdAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adagrad_param.weight_bounds(0);
     _max_bound = adagrad_param.weight_bounds(1);
   }
+  _kernels = FLAGS_pserver_sparse_sgd_simd
+                 ? GetSparseSGDKernels(_embedding_dim)
+                 : nullptr;
 }
 
 void StdAdaGradSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
                                         float scale) {
+  if (_kernels != nullptr) {
+    _kernels->std_adagrad(w, sgd + G2SumIndex(), grad, _embedding_dim,
+                          learning_rate_, _initial_g2sum, scale, _min_bound,
+                          _max_bound);
+    return;
+  }
   for (int i = 0; i < _embedding_dim; i++) {
     float& g2sum = sgd[G2SumIndex() + i];
     double scaled_grad = grad[i] / scale;
@@ -151,6 +196,17 @@ void StdAdaGradSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
   }
 }
 
+void StdAdaGradSGDRule::UpdateValueBatch(float** w, float** sgd,
+                                         const float** grad, const float* scale,
+                                         size_t num) {
+  for (size_t i = 0; i < num; ++i) {
+    if (i + 1 < num) {
+      PrefetchRow(w[i + 1], sgd[i + 1], grad[i + 1]);
+    }
+    StdAdaGradSGDRule::UpdateValueWork(w[i], sgd[i], grad[i], scale[i]);
+  }
+}
+
 void StdAdaGradSGDRule::InitValueWork(float* value, float* sgd,
                                       bool zero_init) {
   for (int i = 0; i < _embedding_dim; ++i) {
@@ -188,6 +244,9 @@ void SparseAdamSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adam_param.weight_bounds(0);
     _max_bound = adam_param.weight_bounds(1);
   }
+  _kernels = FLAGS_pserver_sparse_sgd_simd
+                 ? GetSparseSGDKernels(_embedding_dim)
+                 : nullptr;
 }
 
 void SparseAdamSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
@@ -204,19 +263,35 @@ void SparseAdamSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
 
   // lr not change in one update
   lr *= sqrt(1 - beta2_pow_) / (1 - beta1_pow_);
-  for (int i = 0; i < _embedding_dim; i++) {
-    // Calculation
-    gsum[i] = _beta1_decay_rate * gsum[i] + (1 - _beta1_decay_rate) * g[i];
-    g2sum[i] =
-        _beta2_decay_rate * g2sum[i] + (1 - _beta2_decay_rate) * g[i] * g[i];
-    w[i] = w[i] - lr * (gsum[i] / (sqrt(g2sum[i]) + _ada_epsilon));
-    BoundValue(w[i]);
+  if (_kernels != nullptr) {
+    _kernels->adam(w, gsum, g2sum, g, _embedding_dim, lr, _beta1_decay_rate,
+                   _beta2_decay_rate, _ada_epsilon, _min_bound, _max_bound);
+  } else {
+    for (int i = 0; i < _embedding_dim; i++) {
+      // Calculation
+      gsum[i] = _beta1_decay_rate * gsum[i] + (1 - _beta1_decay_rate) * g[i];
+      g2sum[i] =
+          _beta2_decay_rate * g2sum[i] + (1 - _beta2_decay_rate) * g[i] * g[i];
+      w[i] = w[i] - lr * (gsum[i] / (sqrt(g2sum[i]) + _ada_epsilon));
+      BoundValue(w[i]);
+    }
   }
   // update beta_pow_decay
   (*beta1_pow) *= _beta1_decay_rate;
   (*beta2_pow) *= _beta2_decay_rate;
 }
 
+void SparseAdamSGDRule::UpdateValueBatch(float** w, float** sgd,
+                                         const float** grad, const float* scale,
+                                         size_t num) {
+  for (size_t i = 0; i < num; ++i) {
+    if (i + 1 < num) {
+      PrefetchRow(w[i + 1], sgd[i + 1], grad[i + 1]);
+    }
+    SparseAdamSGDRule::UpdateValueWork(w[i], sgd[i], grad[i], scale[i]);
+  }
+}
+
 void SparseAdamSGDRule::InitValueWork(float* value, float* sgd,
                                       bool zero_init) {
   for (int i = 0; i < _embedding_dim; ++i) {
@@ -22,6 +22,7 @@
 #include "paddle/fluid/distributed/common/local_random.h"  // for local_uniform_real_distribution
 #include "paddle/fluid/distributed/common/registerer.h"
 #include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/table/sparse_sgd_rule_kernel.h"
 
 namespace paddle {
 namespace distributed {
@@ -47,6 +48,19 @@ class SparseValueSGDRule {
                    float scale = 1) {
     UpdateValueWork(w, sgd, push_value, scale);
   }
+  // update num rows in one call, row i is w[i], sgd[i], push_value[i] and
+  // scale[i], the rows are updated in order so a row may repeat
+  virtual void UpdateValueBatch(float** w, float** sgd,
+                                const float** push_value, const float* scale,
+                                size_t num) {
+    for (size_t i = 0; i < num; ++i) {
+      UpdateValueWork(w[i], sgd[i], push_value[i], scale[i]);
+    }
+  }
+  // name of the vector kernels in use, "scalar" if none
+  const char* KernelName() const {
+    return _kernels == nullptr ? "scalar" : _kernels->name;
+  }
   template <class T>
   void BoundValue(T& w) {  // NOLINT
     if (!(w >= _min_bound)) {
@@ -63,6 +77,8 @@ class SparseValueSGDRule {
   float _max_bound;
   float _initial_range;
   size_t _embedding_dim;
+  // chosen by LoadConfig of the rules having vector kernels
+  const SparseSGDKernels* _kernels = nullptr;
 
  private:
   std::string _name;
@@ -89,6 +105,9 @@ class SparseAdaGradSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValueBatch(float** w, float** sgd,
+                                const float** push_value, const float* scale,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return 1; }
   size_t G2SumIndex() { return 0; }
@@ -104,6 +123,9 @@ class StdAdaGradSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValueBatch(float** w, float** sgd,
+                                const float** push_value, const float* scale,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return _embedding_dim; }
   size_t G2SumIndex() { return 0; }
@@ -119,6 +141,9 @@ class SparseAdamSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValueBatch(float** w, float** sgd,
+                                const float** push_value, const float* scale,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return _embedding_dim * 2 + 2; }
   size_t GSumIndex() { return 0; }
@@ -0,0 +1,142 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <immintrin.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "paddle/fluid/distributed/ps/table/sparse_sgd_rule_kernel.h"
+
+namespace paddle {
+namespace distributed {
+namespace {
+
+const size_t kBlock = 8;
+
+// same as SparseValueSGDRule::BoundValue, nan goes to min_bound
+inline __m256 Bound(__m256 w, __m256 min_bound, __m256 max_bound) {
+  return _mm256_min_ps(_mm256_max_ps(w, min_bound), max_bound);
+}
+
+inline float Bound(float w, float min_bound, float max_bound) {
+  if (!(w >= min_bound)) {
+    return min_bound;
+  } else if (!(w <= max_bound)) {
+    return max_bound;
+  }
+  return w;
+}
+
+inline float HorizontalSum(__m256 x) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(x),
+                          _mm256_extractf128_ps(x, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+float AdaGrad(float* w, const float* grad, size_t dim, float ratio,
+              float scale, float min_bound, float max_bound) {
+  const __m256 ratio_v = _mm256_set1_ps(ratio);
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 min_v = _mm256_set1_ps(min_bound);
+  const __m256 max_v = _mm256_set1_ps(max_bound);
+  __m256 g2sum_v = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + kBlock <= dim; i += kBlock) {
+    __m256 g = _mm256_div_ps(_mm256_loadu_ps(grad + i), scale_v);
+    __m256 x = _mm256_sub_ps(_mm256_loadu_ps(w + i), _mm256_mul_ps(ratio_v, g));
+    _mm256_storeu_ps(w + i, Bound(x, min_v, max_v));
+    g2sum_v = _mm256_add_ps(g2sum_v, _mm256_mul_ps(g, g));
+  }
+  float add_g2sum = HorizontalSum(g2sum_v);
+  for (; i < dim; ++i) {
+    float g = grad[i] / scale;
+    w[i] = Bound(w[i] - ratio * g, min_bound, max_bound);
+    add_g2sum += g * g;
+  }
+  return add_g2sum;
+}
+
+void StdAdaGrad(float* w, float* g2sum, const float* grad, size_t dim,
+                float lr, float initial_g2sum, float scale, float min_bound,
+                float max_bound) {
+  const __m256 lr_v = _mm256_set1_ps(lr);
+  const __m256 init_v = _mm256_set1_ps(initial_g2sum);
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 min_v = _mm256_set1_ps(min_bound);
+  const __m256 max_v = _mm256_set1_ps(max_bound);
+  size_t i = 0;
+  for (; i + kBlock <= dim; i += kBlock) {
+    __m256 g = _mm256_div_ps(_mm256_loadu_ps(grad + i), scale_v);
+    __m256 g2 = _mm256_loadu_ps(g2sum + i);
+    __m256 ratio = _mm256_mul_ps(
+        lr_v,
+        _mm256_sqrt_ps(_mm256_div_ps(init_v, _mm256_add_ps(init_v, g2))));
+    __m256 x = _mm256_sub_ps(_mm256_loadu_ps(w + i), _mm256_mul_ps(ratio, g));
+    _mm256_storeu_ps(w + i, Bound(x, min_v, max_v));
+    _mm256_storeu_ps(g2sum + i, _mm256_add_ps(g2, _mm256_mul_ps(g, g)));
+  }
+  for (; i < dim; ++i) {
+    float g = grad[i] / scale;
+    float ratio = lr * sqrtf(initial_g2sum / (initial_g2sum + g2sum[i]));
+    w[i] = Bound(w[i] - ratio * g, min_bound, max_bound);
+    g2sum[i] += g * g;
+  }
+}
+
+void Adam(float* w, float* gsum, float* g2sum, const float* grad, size_t dim,
+          float lr, float beta1_decay_rate, float beta2_decay_rate,
+          float ada_epsilon, float min_bound, float max_bound) {
+  const float beta1_rest = 1 - beta1_decay_rate;
+  const float beta2_rest = 1 - beta2_decay_rate;
+  const __m256 lr_v = _mm256_set1_ps(lr);
+  const __m256 beta1_v = _mm256_set1_ps(beta1_decay_rate);
+  const __m256 beta2_v = _mm256_set1_ps(beta2_decay_rate);
+  const __m256 beta1_rest_v = _mm256_set1_ps(beta1_rest);
+  const __m256 beta2_rest_v = _mm256_set1_ps(beta2_rest);
+  const __m256 eps_v = _mm256_set1_ps(ada_epsilon);
+  const __m256 min_v = _mm256_set1_ps(min_bound);
+  const __m256 max_v = _mm256_set1_ps(max_bound);
+  size_t i = 0;
+  for (; i + kBlock <= dim; i += kBlock) {
+    __m256 g = _mm256_loadu_ps(grad + i);
+    __m256 m = _mm256_add_ps(_mm256_mul_ps(beta1_v, _mm256_loadu_ps(gsum + i)),
+                             _mm256_mul_ps(beta1_rest_v, g));
+    __m256 v = _mm256_add_ps(
+        _mm256_mul_ps(beta2_v, _mm256_loadu_ps(g2sum + i)),
+        _mm256_mul_ps(_mm256_mul_ps(beta2_rest_v, g), g));
+    __m256 step = _mm256_mul_ps(
+        lr_v, _mm256_div_ps(m, _mm256_add_ps(_mm256_sqrt_ps(v), eps_v)));
+    __m256 x = _mm256_sub_ps(_mm256_loadu_ps(w + i), step);
+    _mm256_storeu_ps(gsum + i, m);
+    _mm256_storeu_ps(g2sum + i, v);
+    _mm256_storeu_ps(w + i, Bound(x, min_v, max_v));
+  }
+  for (; i < dim; ++i) {
+    gsum[i] = beta1_decay_rate * gsum[i] + beta1_rest * grad[i];
+    g2sum[i] = beta2_decay_rate * g2sum[i] + beta2_rest * grad[i] * grad[i];
+    float x = w[i] - lr * (gsum[i] / (sqrtf(g2sum[i]) + ada_epsilon));
+    w[i] = Bound(x, min_bound, max_bound);
+  }
+}
+
+}  // namespace
+
+extern const SparseSGDKernels kAVX2SparseSGDKernels = {
+    "avx2", kBlock, AdaGrad, StdAdaGrad, Adam};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,48 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/distributed/ps/table/sparse_sgd_rule_kernel.h"
+
+#include "paddle/fluid/platform/cpu_info.h"
+
+namespace paddle {
+namespace distributed {
+
+// defined in sparse_sgd_rule_avx2.cc and sparse_sgd_rule_avx512.cc, which
+// are the only files built with the matching instruction set flags
+#ifdef PADDLE_WITH_SPARSE_SGD_AVX512
+extern const SparseSGDKernels kAVX512SparseSGDKernels;
+#endif
+#ifdef PADDLE_WITH_SPARSE_SGD_AVX2
+extern const SparseSGDKernels kAVX2SparseSGDKernels;
+#endif
+
+const SparseSGDKernels* GetSparseSGDKernels(size_t dim) {
+#ifdef PADDLE_WITH_SPARSE_SGD_AVX512
+  if (platform::MayIUse(platform::avx512f) &&
+      dim >= kAVX512SparseSGDKernels.block) {
+    return &kAVX512SparseSGDKernels;
+  }
+#endif
+#ifdef PADDLE_WITH_SPARSE_SGD_AVX2
+  if (platform::MayIUse(platform::avx2) &&
+      dim >= kAVX2SparseSGDKernels.block) {
+    return &kAVX2SparseSGDKernels;
+  }
+#endif
+  return nullptr;
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,55 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+
+namespace paddle {
+namespace distributed {
+
+// Vectorized inner loops of the sparse sgd rules, computed in float.
+// Every weight is clipped into [min_bound, max_bound] after its update.
+
+// w[i] -= ratio * grad[i] / scale, returns the sum of (grad[i] / scale)^2
+typedef float (*AdaGradKernel)(float* w, const float* grad, size_t dim,
+                               float ratio, float scale, float min_bound,
+                               float max_bound);
+// adagrad with one g2sum per dim
+typedef void (*StdAdaGradKernel)(float* w, float* g2sum, const float* grad,
+                                 size_t dim, float lr, float initial_g2sum,
+                                 float scale, float min_bound,
+                                 float max_bound);
+// adam moments and weights, lr is already bias corrected
+typedef void (*AdamKernel)(float* w, float* gsum, float* g2sum,
+                           const float* grad, size_t dim, float lr,
+                           float beta1_decay_rate, float beta2_decay_rate,
+                           float ada_epsilon, float min_bound,
+                           float max_bound);
+
+struct SparseSGDKernels {
+  const char* name;
+  // number of floats in one register
+  size_t block;
+  AdaGradKernel adagrad;
+  StdAdaGradKernel std_adagrad;
+  AdamKernel adam;
+};
+
+// The widest kernels the cpu supports whose block fits in dim, nullptr
+// when the scalar loops should be used.
+const SparseSGDKernels* GetSparseSGDKernels(size_t dim);
+
+}  // namespace distributed
+}  // namespace paddle
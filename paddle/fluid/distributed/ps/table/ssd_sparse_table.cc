@@ -14,6 +14,9 @@
 
 #include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
 
+#include <algorithm>
+#include <map>
+
 #include "paddle/fluid/distributed/common/cost_timer.h"
 #include "paddle/fluid/distributed/common/local_random.h"
 #include "paddle/fluid/distributed/common/topk_calculator.h"
@@ -23,9 +26,15 @@
 DECLARE_bool(pserver_print_missed_key_num_every_push);
 DECLARE_bool(pserver_create_value_when_push);
 DECLARE_bool(pserver_enable_create_feasign_randomly);
+DECLARE_bool(pserver_load_pipeline);
 DEFINE_bool(pserver_open_strict_check, false, "pserver_open_strict_check");
 DEFINE_string(rocksdb_path, "database", "path of sparse table rocksdb file");
 DEFINE_int32(pserver_load_batch_size, 5000, "load batch size for ssd");
+DEFINE_uint64(pserver_ssd_table_mem_capacity, 0,
+              "max feasign num kept in memory by a ssd sparse table on one "
+              "server, cold feasigns are demoted to rocksdb, 0 means no limit");
+DEFINE_double(pserver_ssd_table_demote_ratio, 0.9,
+              "demotion stops when a shard is below this ratio of capacity");
 
 namespace paddle {
 namespace distributed {
@@ -34,6 +43,21 @@ int32_t SSDSparseTable::Initialize() {
   MemorySparseTable::Initialize();
   _db = paddle::distributed::RocksDBHandler::GetInstance();
   _db->initialize(FLAGS_rocksdb_path, _real_local_shard_num);
+
+  _shard_mem_capacity = 0;
+  if (FLAGS_pserver_ssd_table_mem_capacity > 0 && _real_local_shard_num > 0) {
+    _shard_mem_capacity =
+        (FLAGS_pserver_ssd_table_mem_capacity + _real_local_shard_num - 1) /
+        _real_local_shard_num;
+    _sketches.resize(_real_local_shard_num);
+    for (size_t i = 0; i < _real_local_shard_num; ++i) {
+      _sketches[i].reset(new FrequencySketch(_shard_mem_capacity));
+    }
+    _admit_freq.assign(_real_local_shard_num, 0);
+    _clock_hand.assign(_real_local_shard_num, 0);
+    _demote_pending.assign(_real_local_shard_num, 0);
+    LOG(INFO) << "SSDSparseTable shard mem capacity: " << _shard_mem_capacity;
+  }
   return 0;
 }
 
@@ -42,12 +66,6 @@ int32_t SSDSparseTable::InitializeShard() { return 0; }
 int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
                                    size_t num) {
   CostTimer timer("pserver_downpour_sparse_select_all");
-  size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
-  size_t mf_value_size =
-      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
-  size_t select_value_size =
-      _value_accesor->GetAccessorInfo().select_size / sizeof(float);
-
   {  // 从table取值 or create
     std::vector<std::future<int>> tasks(_real_local_shard_num);
     std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
@@ -61,64 +79,21 @@ int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
     for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
       tasks[shard_id] =
           _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-              [this, shard_id, &task_keys, value_size, mf_value_size,
-               select_value_size, pull_values, keys, &missed_keys]() -> int {
-                auto& keys = task_keys[shard_id];
-                auto& local_shard = _local_shards[shard_id];
-                float data_buffer[value_size];
-                float* data_buffer_ptr = data_buffer;
-                for (int i = 0; i < keys.size(); ++i) {
-                  uint64_t key = keys[i].first;
-                  auto itr = local_shard.find(key);
-                  size_t data_size = value_size - mf_value_size;
-                  if (itr == local_shard.end()) {
-                    // pull rocksdb
-                    std::string tmp_string("");
-                    if (_db->get(shard_id, (char*)&key, sizeof(uint64_t),
-                                 tmp_string) > 0) {
-                      ++missed_keys;
-                      if (FLAGS_pserver_create_value_when_push) {
-                        memset(data_buffer, 0, sizeof(float) * data_size);
-                      } else {
-                        auto& feature_value = local_shard[key];
-                        feature_value.resize(data_size);
-                        float* data_ptr =
-                            const_cast<float*>(feature_value.data());
-                        _value_accesor->Create(&data_buffer_ptr, 1);
-                        memcpy(data_ptr, data_buffer_ptr,
-                               data_size * sizeof(float));
-                      }
-                    } else {
-                      data_size = tmp_string.size() / sizeof(float);
-                      memcpy(data_buffer_ptr,
-                             paddle::string::str_to_float(tmp_string),
-                             data_size * sizeof(float));
-                      // from rocksdb to mem
-                      auto& feature_value = local_shard[key];
-                      feature_value.resize(data_size);
-                      memcpy(const_cast<float*>(feature_value.data()),
-                             data_buffer_ptr, data_size * sizeof(float));
-                      _db->del_data(shard_id, (char*)&key, sizeof(uint64_t));
-                    }
-                  } else {
-                    data_size = itr.value().size();
-                    memcpy(data_buffer_ptr, itr.value().data(),
-                           data_size * sizeof(float));
-                  }
-                  for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
-                    data_buffer[mf_idx] = 0.0;
-                  }
-                  int pull_data_idx = keys[i].second;
-                  float* select_data =
-                      pull_values + pull_data_idx * select_value_size;
-                  _value_accesor->Select(&select_data,
-                                         (const float**)&data_buffer_ptr, 1);
-                }
-                return 0;
+              [this, shard_id, &task_keys, pull_values,
+               &missed_keys]() -> int {
+                return PullSparseShard(shard_id, task_keys[shard_id],
+                                       pull_values, &missed_keys);
               });
     }
+    int ret = 0;
     for (size_t i = 0; i < _real_local_shard_num; ++i) {
-      tasks[i].wait();
+      if (tasks[i].get() != 0) {
+        ret = -1;
+      }
+    }
+    if (ret != 0) {
+      LOG(ERROR) << "SSDSparseTable pull sparse failed";
+      return ret;
     }
     if (FLAGS_pserver_print_missed_key_num_every_push) {
       LOG(WARNING) << "total pull keys:" << num
@@ -128,6 +103,121 @@ int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
   return 0;
 }
 
+int32_t SSDSparseTable::PullSparseShard(
+    size_t shard_id, const std::vector<std::pair<uint64_t, int>>& keys,
+    float* pull_values, std::atomic<uint32_t>* missed_keys) {
+  size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
+  size_t mf_value_size =
+      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+  size_t select_value_size =
+      _value_accesor->GetAccessorInfo().select_size / sizeof(float);
+  auto& local_shard = _local_shards[shard_id];
+  FrequencySketch* sketch =
+      _shard_mem_capacity > 0 ? _sketches[shard_id].get() : NULL;
+  float data_buffer[value_size];
+  float* data_buffer_ptr = data_buffer;
+  uint64_t mem_hit = 0, ssd_hit = 0, miss = 0;
+  uint64_t promote = 0, reject = 0;
+  // copy data_size floats of a value into data_buffer and select from it
+  auto select = [=](const float* value, size_t data_size, int pull_data_idx) {
+    if (value != data_buffer_ptr) {
+      memcpy(data_buffer_ptr, value, data_size * sizeof(float));
+    }
+    for (size_t mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
+      data_buffer_ptr[mf_idx] = 0.0;
+    }
+    float* select_data = pull_values + pull_data_idx * select_value_size;
+    _value_accesor->Select(&select_data, (const float**)&data_buffer_ptr, 1);
+  };
+
+  // serve the keys in mem, and collect the others for one rocksdb read
+  std::vector<size_t> ssd_idx;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t key = keys[i].first;
+    if (sketch != NULL) {
+      sketch->Increment(key);
+    }
+    auto itr = local_shard.find(key);
+    if (itr == local_shard.end()) {
+      ssd_idx.push_back(i);
+      continue;
+    }
+    ++mem_hit;
+    select(itr.value().data(), itr.value().size(), keys[i].second);
+  }
+
+  if (!ssd_idx.empty()) {
+    // keys in the comparator (bytewise) order are read block by block
+    std::sort(ssd_idx.begin(), ssd_idx.end(), [&keys](size_t a, size_t b) {
+      return memcmp(&keys[a].first, &keys[b].first, sizeof(uint64_t)) < 0;
+    });
+    size_t ssd_num = ssd_idx.size();
+    std::vector<rocksdb::Slice> ssd_keys;
+    ssd_keys.reserve(ssd_num);
+    for (auto idx : ssd_idx) {
+      ssd_keys.emplace_back((const char*)&keys[idx].first, sizeof(uint64_t));
+    }
+    std::vector<rocksdb::PinnableSlice> ssd_values(ssd_num);
+    std::vector<int> ssd_status(ssd_num);
+    // the values not read are not served as found or missed ones
+    if (_db->multi_get(shard_id, ssd_num, ssd_keys.data(), ssd_values.data(),
+                       ssd_status.data(), true) != 0) {
+      return -1;
+    }
+
+    for (size_t j = 0; j < ssd_num; ++j) {
+      uint64_t key = keys[ssd_idx[j]].first;
+      int pull_data_idx = keys[ssd_idx[j]].second;
+      // a duplicated key may be moved into mem already
+      auto itr = local_shard.find(key);
+      if (itr != local_shard.end()) {
+        ++mem_hit;
+        select(itr.value().data(), itr.value().size(), pull_data_idx);
+        continue;
+      }
+      size_t data_size = value_size - mf_value_size;
+      if (ssd_status[j] != 0) {
+        ++(*missed_keys);
+        ++miss;
+        if (FLAGS_pserver_create_value_when_push) {
+          memset(data_buffer, 0, sizeof(float) * data_size);
+        } else {
+          auto& feature_value = local_shard[key];
+          feature_value.resize(data_size);
+          _value_accesor->Create(&data_buffer_ptr, 1);
+          memcpy(feature_value.data(), data_buffer_ptr,
+                 data_size * sizeof(float));
+        }
+      } else {
+        ++ssd_hit;
+        data_size = ssd_values[j].size() / sizeof(float);
+        memcpy(data_buffer_ptr, ssd_values[j].data(), ssd_values[j].size());
+        if (Admit(shard_id, key)) {
+          // from rocksdb to mem
+          auto& feature_value = local_shard[key];
+          feature_value.resize(data_size);
+          memcpy(feature_value.data(), data_buffer_ptr,
+                 data_size * sizeof(float));
+          _db->del_data(shard_id, (char*)&key, sizeof(uint64_t));
+          ++promote;
+        } else {
+          // too cold to evict a value in mem, serve from ssd
+          ++reject;
+        }
+      }
+      select(data_buffer_ptr, data_size, pull_data_idx);
+    }
+  }
+
+  _mem_hit_num += mem_hit;
+  _ssd_hit_num += ssd_hit;
+  _miss_num += miss;
+  _promote_num += promote;
+  _reject_num += reject;
+  TryDemote(shard_id);
+  return 0;
+}
+
 int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
                                    size_t num) {
   CostTimer timer("pserver_downpour_sparse_update_all");
@@ -160,22 +250,49 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
                   const float* update_data =
                       values + push_data_idx * update_value_col;
                   auto itr = local_shard.find(key);
-                  if (itr == local_shard.end()) {
+                  FixedFeatureValue* feature_value = NULL;
+                  // a value in rocksdb which is not admitted into mem is
+                  // updated here and written back
+                  FixedFeatureValue ssd_value;
+                  std::string tmp_string("");
+                  int ssd_ret = 1;
+                  if (itr == local_shard.end() && _shard_mem_capacity > 0) {
+                    ssd_ret = _db->get(shard_id, (char*)&key,
+                                       sizeof(uint64_t), tmp_string);
+                    // the value in rocksdb must not be overwritten by a
+                    // new one
+                    if (ssd_ret < 0) {
+                      return -1;
+                    }
+                  }
+                  if (itr != local_shard.end()) {
+                    feature_value = itr.value_ptr();
+                  } else if (ssd_ret == 0) {
+                    if (Admit(shard_id, key)) {
+                      feature_value = &local_shard[key];
+                      _db->del_data(shard_id, (char*)&key, sizeof(uint64_t));
+                      ++_promote_num;
+                    } else {
+                      feature_value = &ssd_value;
+                    }
+                    feature_value->resize(tmp_string.size() / sizeof(float));
+                    memcpy(feature_value->data(),
+                           paddle::string::str_to_float(tmp_string),
+                           tmp_string.size());
+                  } else {
                     if (FLAGS_pserver_enable_create_feasign_randomly &&
                         !_value_accesor->CreateValue(1, update_data)) {
                       continue;
                     }
                     auto value_size = value_col - mf_value_col;
-                    auto& feature_value = local_shard[key];
-                    feature_value.resize(value_size);
+                    feature_value = &local_shard[key];
+                    feature_value->resize(value_size);
                     _value_accesor->Create(&data_buffer_ptr, 1);
-                    memcpy(const_cast<float*>(feature_value.data()),
-                           data_buffer_ptr, value_size * sizeof(float));
-                    itr = local_shard.find(key);
+                    memcpy(feature_value->data(), data_buffer_ptr,
+                           value_size * sizeof(float));
                   }
-                  auto& feature_value = itr.value();
-                  float* value_data = const_cast<float*>(feature_value.data());
-                  size_t value_size = feature_value.size();
+                  float* value_data = feature_value->data();
+                  size_t value_size = feature_value->size();
 
                   if (value_size ==
                       value_col) {  // 已拓展到最大size, 则就地update
@@ -185,19 +302,32 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
                            value_size * sizeof(float));
                     _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
                     if (_value_accesor->NeedExtendMF(data_buffer)) {
-                      feature_value.resize(value_col);
-                      value_data = const_cast<float*>(feature_value.data());
+                      feature_value->resize(value_col);
+                      value_data = feature_value->data();
                       _value_accesor->Create(&value_data, 1);
                     }
                     memcpy(value_data, data_buffer_ptr,
                            value_size * sizeof(float));
                   }
+                  if (feature_value == &ssd_value) {
+                    _db->put(shard_id, (char*)&key, sizeof(uint64_t),
+                             (char*)ssd_value.data(),
+                             ssd_value.size() * sizeof(float));
+                  }
                 }
+                TryDemote(shard_id);
                 return 0;
               });
     }
+    int ret = 0;
     for (size_t i = 0; i < _real_local_shard_num; ++i) {
-      tasks[i].wait();
+      if (tasks[i].get() != 0) {
+        ret = -1;
+      }
+    }
+    if (ret != 0) {
+      LOG(ERROR) << "SSDSparseTable push sparse failed";
+      return ret;
     }
   }
   /*
@@ -225,6 +355,7 @@ int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
 }
 
 int32_t SSDSparseTable::Shrink(const std::string& param) {
+  WaitShardTasks();
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
@@ -295,12 +426,134 @@ int64_t SSDSparseTable::LocalSize() {
   return local_size;
 }
 
+std::pair<int64_t, int64_t> SSDSparseTable::PrintTableStat() {
+  uint64_t mem_hit = _mem_hit_num.load();
+  uint64_t ssd_hit = _ssd_hit_num.load();
+  uint64_t miss = _miss_num.load();
+  uint64_t total = mem_hit + ssd_hit + miss;
+  LOG(INFO) << "SSDSparseTable stat: mem_hit[" << mem_hit << "] ssd_hit["
+            << ssd_hit << "] miss[" << miss << "] mem_hit_rate["
+            << (total > 0 ? static_cast<double>(mem_hit) / total : 0.0)
+            << "] promote[" << _promote_num.load() << "] reject["
+            << _reject_num.load() << "] demote[" << _demote_num.load()
+            << "] shard_mem_capacity[" << _shard_mem_capacity << "]";
+  return MemorySparseTable::PrintTableStat();
+}
+
+bool SSDSparseTable::Admit(size_t shard_id, uint64_t key) {
+  if (_shard_mem_capacity == 0 ||
+      _local_shards[shard_id].size() < _shard_mem_capacity) {
+    return true;
+  }
+  return _sketches[shard_id]->Frequency(key) >= _admit_freq[shard_id];
+}
+
+void SSDSparseTable::TryDemote(size_t shard_id) {
+  if (_shard_mem_capacity == 0 || _demote_pending[shard_id] ||
+      _local_shards[shard_id].size() <= _shard_mem_capacity) {
+    return;
+  }
+  // runs after the queued pull/push tasks of the shard, nobody waits for it
+  _demote_pending[shard_id] = 1;
+  _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+      [this, shard_id]() -> int { return DemoteShard(shard_id); });
+}
+
+int32_t SSDSparseTable::DemoteShard(size_t shard_id) {
+  const size_t sample_num = 1024;
+  _demote_pending[shard_id] = 0;
+  auto& shard = _local_shards[shard_id];
+  auto& sketch = *_sketches[shard_id];
+  size_t shard_size = shard.size();
+  if (shard_size <= _shard_mem_capacity) {
+    return 0;
+  }
+  size_t target_size =
+      _shard_mem_capacity * FLAGS_pserver_ssd_table_demote_ratio;
+  size_t bucket_num = shard.bucket_count();
+  size_t& hand = _clock_hand[shard_id];
+
+  // estimate the frequency under which the surplus falls from a sample
+  std::vector<uint32_t> freqs;
+  freqs.reserve(sample_num);
+  for (size_t i = 0; i < bucket_num && freqs.size() < sample_num; ++i) {
+    size_t bucket = (hand + i) % bucket_num;
+    for (auto it = shard.begin(bucket);
+         it != shard.end(bucket) && freqs.size() < sample_num; ++it) {
+      freqs.push_back(sketch.Frequency(it.key()));
+    }
+  }
+  size_t rank = freqs.size() * (shard_size - target_size) / shard_size;
+  rank = std::min(rank, freqs.size() - 1);
+  std::nth_element(freqs.begin(), freqs.begin() + rank, freqs.end());
+  uint32_t threshold = freqs[rank];
+
+  // sweep buckets like a clock, raise the threshold after a full round
+  std::vector<uint64_t> keys;
+  std::vector<std::pair<char*, int>> ssd_keys;
+  std::vector<std::pair<char*, int>> ssd_values;
+  uint64_t demote_count = 0;
+  size_t visited = 0;
+  while (shard_size > target_size) {
+    size_t bucket = hand;
+    hand = (hand + 1) % bucket_num;
+    keys.clear();
+    ssd_keys.clear();
+    ssd_values.clear();
+    // keys must not reallocate, ssd_keys points into it
+    keys.reserve(shard.bucket_size(bucket));
+    for (auto it = shard.begin(bucket); it != shard.end(bucket); ++it) {
+      if (sketch.Frequency(it.key()) <= threshold) {
+        keys.push_back(it.key());
+        ssd_keys.emplace_back((char*)&keys.back(), sizeof(uint64_t));
+        ssd_values.emplace_back((char*)it.value().data(),
+                                it.value().size() * sizeof(float));
+      }
+    }
+    if (!keys.empty()) {
+      _db->put_batch(shard_id, ssd_keys, ssd_values, ssd_keys.size());
+      for (auto key : keys) {
+        shard.erase(key);
+      }
+      shard_size -= keys.size();
+      demote_count += keys.size();
+    }
+    if (++visited % bucket_num == 0 && shard_size > target_size) {
+      ++threshold;
+    }
+  }
+  // a threshold at the max frequency would reject every key once the shard
+  // is full, and with no admission the shard is never demoted again
+  _admit_freq[shard_id] = threshold < FrequencySketch::MAX_FREQUENCY
+                              ? threshold + 1
+                              : FrequencySketch::MAX_FREQUENCY;
+  _demote_num += demote_count;
+  VLOG(1) << "SSDSparseTable demote shard:" << shard_id
+          << " count:" << demote_count << " threshold:" << threshold
+          << " mem size:" << shard_size;
+  return 0;
+}
+
+void SSDSparseTable::WaitShardTasks() {
+  if (_shard_mem_capacity == 0) {
+    return;
+  }
+  std::vector<std::future<int>> tasks;
+  for (auto& pool : _shards_task_pool) {
+    tasks.push_back(pool->enqueue([]() -> int { return 0; }));
+  }
+  for (auto& task : tasks) {
+    task.wait();
+  }
+}
+
 int32_t SSDSparseTable::Save(const std::string& path,
                              const std::string& param) {
   if (_real_local_shard_num == 0) {
     _local_show_threshold = -1;
     return 0;
   }
+  WaitShardTasks();
   int save_param = atoi(param.c_str());  // batch_model:0  xbox:1
   //    if (save_param == 5) {
   //        return save_patch(path, save_param);
@@ -387,8 +640,9 @@ int32_t SSDSparseTable::Save(const std::string& path,
         continue;
       }
 
-      // delta and cache and revert is all in mem, base in rocksdb
-      if (save_param != 1) {
+      // delta and cache and revert is all in mem, base in rocksdb, unless
+      // values are demoted by the memory capacity
+      if (save_param != 1 || _shard_mem_capacity > 0) {
         auto* it = _db->get_iterator(i);
         for (it->SeekToFirst(); it->Valid(); it->Next()) {
           bool need_save = _value_accesor->Save(
@@ -409,7 +663,7 @@ int32_t SSDSparseTable::Save(const std::string& path,
                          << channel_config.path << ", retry_num=" << retry_num;
               break;
             }
-            if (save_param == 3) {
+            if (save_param == 3 || save_param == 1) {
               _db->put(i, it->key().data(), it->key().size(),
                        it->value().data(), it->value().size());
             }
@@ -630,6 +884,7 @@ int32_t SSDSparseTable::Load(size_t start_idx, size_t end_idx,
   if (start_idx >= file_list.size()) {
     return 0;
   }
+  WaitShardTasks();
   int load_param = atoi(param.c_str());
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
@@ -638,6 +893,17 @@ int32_t SSDSparseTable::Load(size_t start_idx, size_t end_idx,
 
   end_idx =
       end_idx < _sparse_table_shard_num ? end_idx : _sparse_table_shard_num;
+  if (FLAGS_pserver_load_pipeline) {
+    if (LoadPipelined(start_idx, end_idx, file_list, load_param) != 0) {
+      LOG(ERROR) << "SSDSparseTable load failed reach max limit!";
+      exit(-1);
+    }
+    LOG(INFO) << "load num:" << LocalSize();
+    LOG(INFO) << "SSDSparseTable load success, path from "
+              << file_list[start_idx] << " to " << file_list[end_idx - 1];
+    _cache_tk_size = LocalSize() * _config.sparse_table_cache_rate();
+    return 0;
+  }
   int thread_num = (end_idx - start_idx) < 20 ? (end_idx - start_idx) : 20;
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
@@ -754,5 +1020,95 @@ int32_t SSDSparseTable::Load(size_t start_idx, size_t end_idx,
   return 0;
 }
 
+int32_t SSDSparseTable::LoadPipelined(size_t start_idx, size_t end_idx,
+                                      const std::vector<std::string>& file_list,
+                                      int load_param) {
+  size_t feature_value_size =
+      _value_accesor->GetAccessorInfo().size / sizeof(float);
+  size_t mf_value_size =
+      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
+  SparseLoadPipeline pipeline(LoadPipelineOption(), _real_local_shard_num,
+                              feature_value_size);
+
+  auto read_func =
+      [&](size_t file_idx,
+          const std::function<void(std::string*)>& line_func) -> int {
+    FsChannelConfig channel_config;
+    channel_config.path = file_list[start_idx + file_idx];
+    channel_config.converter = _value_accesor->Converter(load_param).converter;
+    channel_config.deconverter =
+        _value_accesor->Converter(load_param).deconverter;
+    int err_no = 0;
+    std::string line_data;
+    auto read_channel = _afs_client.open_r(channel_config, 0, &err_no);
+    while (read_channel->read_line(line_data) == 0 && line_data.size() > 1) {
+      line_func(&line_data);
+    }
+    read_channel->close();
+    return err_no == -1 ? -1 : 0;
+  };
+  auto parse_func = [&](size_t file_idx, const std::string& line,
+                        uint64_t* key, float* value) -> int {
+    char* end = NULL;
+    *key = std::strtoul(line.data(), &end, 10);
+    if (FLAGS_pserver_open_strict_check &&
+        *key % _sparse_table_shard_num != start_idx + file_idx) {
+      LOG(WARNING) << "SSDSparseTable key:" << *key << " not match shard,"
+                   << " file_idx:" << start_idx + file_idx
+                   << " shard num:" << _sparse_table_shard_num
+                   << " file:" << file_list[start_idx + file_idx];
+      return -1;
+    }
+    return _value_accesor->ParseFromString(++end, value);
+  };
+  auto shard_func = [this](uint64_t key) -> size_t {
+    return (key % _sparse_table_shard_num) % _avg_local_shard_num;
+  };
+
+  std::atomic<uint64_t> mem_count{0};
+  std::atomic<uint64_t> ssd_count{0};
+  std::atomic<uint64_t> mem_mf_count{0};
+  std::atomic<uint64_t> ssd_mf_count{0};
+  auto insert_func = [&](int thread_idx, const SparseLoadBlock& block) {
+    // rows going to rocksdb are written in one batch per shard
+    std::map<size_t, std::vector<std::pair<char*, int>>> ssd_keys;
+    std::map<size_t, std::vector<std::pair<char*, int>>> ssd_values;
+    for (size_t i = 0; i < block.size(); ++i) {
+      size_t shard_id = block.shard_ids[i];
+      int value_size = block.value_size(i);
+      float* value_data = const_cast<float*>(block.value(i));
+      bool is_mf = value_size > feature_value_size - mf_value_size;
+      if (_value_accesor->SaveSSD(value_data)) {
+        ssd_keys[shard_id].emplace_back(
+            std::make_pair((char*)&block.keys[i], sizeof(uint64_t)));
+        ssd_values[shard_id].emplace_back(
+            std::make_pair((char*)value_data, value_size * sizeof(float)));
+        ssd_count++;
+        ssd_mf_count += is_mf;
+      } else {
+        auto& value = _local_shards[shard_id][block.keys[i]];
+        value.resize(value_size);
+        memcpy(value.data(), value_data, value_size * sizeof(float));
+        mem_count++;
+        mem_mf_count += is_mf;
+      }
+    }
+    for (auto& it : ssd_keys) {
+      _db->put_batch(it.first, it.second, ssd_values[it.first],
+                     it.second.size());
+    }
+  };
+
+  int32_t ret = pipeline.Run(end_idx - start_idx, read_func, parse_func,
+                             shard_func, insert_func);
+  for (size_t i = start_idx; i < end_idx; ++i) {
+    _db->flush(i % _avg_local_shard_num);
+  }
+  LOG(INFO) << "Table>> load done. ALL[" << mem_count + ssd_count << "] MEM["
+            << mem_count << "] MEM_MF[" << mem_mf_count << "] SSD["
+            << ssd_count << "] SSD_MF[" << ssd_mf_count << "].";
+  return ret;
+}
+
 }  // namespace distributed
 }  // namespace paddle
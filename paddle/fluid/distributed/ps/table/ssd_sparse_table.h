@@ -14,7 +14,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "gflags/gflags.h"
+#include "paddle/fluid/distributed/ps/table/depends/frequency_sketch.h"
 #include "paddle/fluid/distributed/ps/table/depends/rocksdb_warpper.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 
@@ -25,7 +31,7 @@ class SSDSparseTable : public MemorySparseTable {
  public:
   typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
   SSDSparseTable() {}
-  virtual ~SSDSparseTable() {}
+  virtual ~SSDSparseTable() { WaitShardTasks(); }
 
   int32_t Initialize() override;
   int32_t InitializeShard() override;
@@ -44,6 +50,20 @@ class SSDSparseTable : public MemorySparseTable {
     const uint64_t* keys = context.push_context.keys;
     const float* values = context.push_context.values;
     size_t num = context.num;
+    if (context.push_context.wire_values != nullptr) {
+      size_t update_dim = _value_accesor->GetAccessorInfo().update_dim;
+      size_t exact_dim = _value_accesor->UpdateExactDim();
+      int wire_type = context.push_context.wire_type;
+      size_t row_size = SparseWireRowSize(wire_type, exact_dim, update_dim);
+      thread_local std::vector<float> decoded;
+      decoded.resize(num * update_dim);
+      for (size_t i = 0; i < num; ++i) {
+        SparseWireDecode(wire_type, exact_dim, update_dim,
+                         context.push_context.wire_values + i * row_size,
+                         decoded.data() + i * update_dim);
+      }
+      values = decoded.data();
+    }
     return PushSparse(keys, values, num);
   }
 
@@ -52,9 +72,14 @@ class SSDSparseTable : public MemorySparseTable {
   virtual int32_t PushSparse(const uint64_t* keys, const float* values,
                              size_t num);
 
-  int32_t Flush() override { return 0; }
+  // wait for the values being demoted to rocksdb
+  int32_t Flush() override {
+    WaitShardTasks();
+    return 0;
+  }
   virtual int32_t Shrink(const std::string& param) override;
   virtual void Clear() override {
+    WaitShardTasks();
     for (size_t i = 0; i < _real_local_shard_num; ++i) {
       _local_shards[i].clear();
     }
@@ -83,11 +108,48 @@ class SSDSparseTable : public MemorySparseTable {
                        const std::vector<std::string>& file_list,
                        const std::string& param);
   int64_t LocalSize();
+  std::pair<int64_t, int64_t> PrintTableStat() override;
+
+ protected:
+  // pull the keys of a local shard, keys missing in mem are read from
+  // rocksdb in one batch
+  int32_t PullSparseShard(size_t shard_id,
+                          const std::vector<std::pair<uint64_t, int>>& keys,
+                          float* pull_values,
+                          std::atomic<uint32_t>* missed_keys);
+  // whether a key found in rocksdb should be moved into memory
+  bool Admit(size_t shard_id, uint64_t key);
+  // schedule DemoteShard if the shard is over its memory capacity
+  void TryDemote(size_t shard_id);
+  // move the least frequently used values of a shard to rocksdb
+  int32_t DemoteShard(size_t shard_id);
+  // wait for the background demotion of all shards
+  void WaitShardTasks();
+  // text files [start_idx, end_idx) loaded in a SparseLoadPipeline, values
+  // chosen by SaveSSD are written to rocksdb by the insert threads
+  int32_t LoadPipelined(size_t start_idx, size_t end_idx,
+                        const std::vector<std::string>& file_list,
+                        int load_param);
 
  private:
   RocksDBHandler* _db;
   int64_t _cache_tk_size;
   double _local_show_threshold{0.0};
+
+  // max number of values kept in memory per shard, 0 means unlimited
+  size_t _shard_mem_capacity{0};
+  // tiering state of each shard, only touched by the shard's task thread
+  std::vector<std::shared_ptr<FrequencySketch>> _sketches;
+  std::vector<uint32_t> _admit_freq;
+  std::vector<size_t> _clock_hand;
+  std::vector<char> _demote_pending;
+
+  std::atomic<uint64_t> _mem_hit_num{0};
+  std::atomic<uint64_t> _ssd_hit_num{0};
+  std::atomic<uint64_t> _miss_num{0};
+  std::atomic<uint64_t> _promote_num{0};
+  std::atomic<uint64_t> _reject_num{0};
+  std::atomic<uint64_t> _demote_num{0};
 };
 
 }  // namespace distributed
@@ -53,6 +53,10 @@ struct TablePushContext {
   const float **ptr_values = nullptr;
   const int64_t *push_steps = nullptr;  // for global step
   bool is_param = false;  // true: push param, false: push gradient
+  // rows encoded by SparseWireEncode instead of values, decoded by the
+  // table before the update
+  const char *wire_values = nullptr;
+  int wire_type = 0;
 };
 
 struct TableContext {
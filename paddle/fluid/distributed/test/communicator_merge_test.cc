@@ -0,0 +1,362 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps/service/communicator/communicator.h"
+#include "paddle/fluid/distributed/ps/service/ps_local_client.h"
+
+DECLARE_bool(communicator_adaptive_send);
+DECLARE_double(communicator_geo_sparse_threshold);
+DECLARE_int32(communicator_geo_sparse_max_hold_rounds);
+
+namespace paddle {
+namespace distributed {
+
+static std::shared_ptr<Variable> MakeSelectedRows(
+    const std::vector<int64_t> &rows, int64_t width, float base) {
+  auto var = std::make_shared<Variable>();
+  auto *slr = var->GetMutable<phi::SelectedRows>();
+  slr->set_height(100);
+  slr->set_rows(rows);
+  auto *data = slr->mutable_value()->mutable_data<float>(
+      phi::make_ddim({static_cast<int64_t>(rows.size()), width}),
+      platform::CPUPlace());
+  for (size_t i = 0; i < rows.size() * width; i++) {
+    data[i] = base + i;
+  }
+  return var;
+}
+
+TEST(CommunicatorMerge, SparseAdd) {
+  const int64_t width = 3;
+  std::vector<std::shared_ptr<Variable>> vars;
+  vars.push_back(MakeSelectedRows({5, 1, 5}, width, 0));
+  vars.push_back(MakeSelectedRows({}, width, 0));
+  vars.push_back(MakeSelectedRows({7, 1}, width, 100));
+
+  std::map<int64_t, std::vector<float>> expected;
+  for (auto &var : vars) {
+    auto &slr = var->Get<phi::SelectedRows>();
+    for (size_t i = 0; i < slr.rows().size(); i++) {
+      auto &sum = expected[slr.rows()[i]];
+      sum.resize(width, 0);
+      for (int64_t j = 0; j < width; j++) {
+        sum[j] += slr.value().data<float>()[i * width + j];
+      }
+    }
+  }
+
+  Scope scope;
+  MergeVars<float>("emb@GRAD", vars, &scope);
+  auto &out = scope.FindVar("emb@GRAD")->Get<phi::SelectedRows>();
+  ASSERT_EQ(out.height(), 100);
+  ASSERT_EQ(out.rows(), std::vector<int64_t>({5, 1, 7}));
+  ASSERT_EQ(out.value().dims(), phi::make_ddim({3, width}));
+  for (size_t i = 0; i < out.rows().size(); i++) {
+    for (int64_t j = 0; j < width; j++) {
+      ASSERT_FLOAT_EQ(out.value().data<float>()[i * width + j],
+                      expected[out.rows()[i]][j]);
+    }
+  }
+}
+
+TEST(CommunicatorMerge, AdaptivePolicy) {
+  AdaptiveMergePolicy policy(20, 50);
+  // the configured merge until measured
+  ASSERT_EQ(policy.MergeNum(3), 20);
+  ASSERT_EQ(policy.WaitMs(), 50);
+
+  // a gradient every 1ms, a send of 5ms
+  double start_us = 0;
+  for (int i = 0; i < 100; i++) {
+    int merge_num = policy.MergeNum(1);
+    policy.Update(start_us, merge_num, 5);
+    start_us += merge_num * 1000;
+  }
+  ASSERT_GE(policy.MergeNum(1), 4);
+  ASSERT_LE(policy.MergeNum(1), 6);
+  ASSERT_LE(policy.WaitMs(), 6);
+  // a backlog is sent at once, within the limit
+  ASSERT_EQ(policy.MergeNum(12), 12);
+  ASSERT_EQ(policy.MergeNum(100), 20);
+
+  // a gradient every 100ms is sent alone
+  for (int i = 0; i < 100; i++) {
+    policy.Update(start_us, 1, 5);
+    start_us += 100000;
+  }
+  ASSERT_EQ(policy.MergeNum(0), 1);
+}
+
+TEST(CommunicatorMerge, GeoDeltaRows) {
+  const int64_t dim = 2;
+  // row norms 5, 0.1, 13, 1, 0
+  std::vector<float> deltas = {3, 4, 0.1, 0, 5, -12, 0, 1, 0, 0};
+  std::vector<size_t> kept;
+  SelectGeoDeltaRows(deltas.data(), 5, dim, 1.0, 0, &kept);
+  ASSERT_EQ(kept, std::vector<size_t>({0, 1, 2, 3, 4}));
+  SelectGeoDeltaRows(deltas.data(), 5, dim, 1.0, 0.5, &kept);
+  ASSERT_EQ(kept, std::vector<size_t>({0, 2, 3}));
+  SelectGeoDeltaRows(deltas.data(), 5, dim, 0.4, 0, &kept);
+  ASSERT_EQ(kept, std::vector<size_t>({0, 2}));
+  SelectGeoDeltaRows(deltas.data(), 5, dim, 0.5, 2, &kept);
+  ASSERT_EQ(kept, std::vector<size_t>({0, 2}));
+  SelectGeoDeltaRows(deltas.data(), 5, dim, 0.1, 20, &kept);
+  ASSERT_TRUE(kept.empty());
+}
+
+// keeps every merged sparse gradient the communicator sends
+class TestAsyncCommunicator : public AsyncCommunicator {
+ public:
+  explicit TestAsyncCommunicator(
+      const std::map<std::string, std::string> &envs)
+      : AsyncCommunicator(envs) {}
+  void RpcSendSparse(const std::string &var_name, int table_id,
+                     const Scope &scope) override {
+    auto &slr = scope.FindVar(var_name)->Get<phi::SelectedRows>();
+    int64_t width = slr.value().dims()[1];
+    std::map<int64_t, std::vector<float>> sent;
+    for (size_t i = 0; i < slr.rows().size(); i++) {
+      const float *row = slr.value().data<float>() + i * width;
+      // MergeSparseAdd leaves every row once
+      EXPECT_EQ(sent.count(slr.rows()[i]), 0u);
+      sent[slr.rows()[i]].assign(row, row + width);
+    }
+    sends.push_back(std::move(sent));
+  }
+  void Push(std::shared_ptr<Variable> var) {
+    send_varname_to_queue_["emb@GRAD"]->Push(var);
+  }
+  size_t QueueSize() { return send_varname_to_queue_["emb@GRAD"]->Size(); }
+  void WaitSends() {
+    for (auto &iter : send_tasks_) {
+      if (iter.second.valid()) iter.second.wait();
+    }
+  }
+  std::vector<std::map<int64_t, std::vector<float>>> sends;
+};
+
+// queues grad_num gradients, lets the communicator send them all and
+// returns the merges it sent. Every gradient has row 0 set to {1, 0}, so
+// the merged row 0 counts the gradients of a merge, and a row 1 + i % 3
+// set to {i, 1}.
+static std::vector<std::map<int64_t, std::vector<float>>> SendAll(
+    bool adaptive, int grad_num, int max_merge_num) {
+  google::FlagSaver flag_saver;
+  FLAGS_communicator_adaptive_send = adaptive;
+  std::map<std::string, std::string> envs = {
+      {"communicator_independent_recv_thread", "0"},
+      {"communicator_min_send_grad_num_before_recv", "0"},
+      {"communicator_thread_pool_size", "2"},
+      {"communicator_max_merge_var_num", std::to_string(max_merge_num)},
+      {"communicator_send_wait_times", "1"},
+      {"communicator_send_queue_size", std::to_string(grad_num)},
+      {"need_global_step", "0"}};
+  TestAsyncCommunicator communicator(envs);
+  communicator.InitEnvs();
+  RpcCtxMap send_ctx;
+  send_ctx.emplace("emb@GRAD",
+                   CommContext("emb@GRAD", {"emb@GRAD"}, {"ps0"}, {100},
+                               {"emb@GRAD"}, 0, true, true, false, 0));
+  Scope scope;
+  communicator.InitImpl(send_ctx, RecvCtxMap(), &scope);
+
+  for (int i = 0; i < grad_num; i++) {
+    auto var = MakeSelectedRows({0, 1 + i % 3}, 2, 0);
+    float *data =
+        var->GetMutable<phi::SelectedRows>()->mutable_value()->data<float>();
+    data[0] = 1;
+    data[1] = 0;
+    data[2] = i;
+    data[3] = 1;
+    communicator.Push(var);
+  }
+  for (int round = 0; round < 2 * grad_num; round++) {
+    if (communicator.QueueSize() == 0) break;
+    communicator.SendByCommunicator();
+    communicator.WaitSends();
+  }
+  EXPECT_EQ(communicator.QueueSize(), 0u);
+  return communicator.sends;
+}
+
+// with adaptive send the gradients are merged and sent in the order they
+// came, every merge summing exactly its own gradients, as the send rounds
+// do without it
+TEST(CommunicatorMerge, AdaptiveSend) {
+  const int grad_num = 10, max_merge_num = 4;
+  for (bool adaptive : {false, true}) {
+    auto sends = SendAll(adaptive, grad_num, max_merge_num);
+    std::vector<int> batches;
+    int next = 0;
+    for (auto &sent : sends) {
+      ASSERT_EQ(sent.count(0), 1u);
+      int batch = static_cast<int>(sent[0][0]);
+      ASSERT_FLOAT_EQ(sent[0][1], 0);
+      batches.push_back(batch);
+      std::map<int64_t, std::vector<float>> expected;
+      expected[0] = {static_cast<float>(batch), 0};
+      for (int i = next; i < next + batch; i++) {
+        auto &sum = expected[1 + i % 3];
+        sum.resize(2, 0);
+        sum[0] += i;
+        sum[1] += 1;
+      }
+      next += batch;
+      ASSERT_EQ(sent.size(), expected.size());
+      for (auto &row : expected) {
+        ASSERT_EQ(sent.count(row.first), 1u);
+        ASSERT_FLOAT_EQ(sent[row.first][0], row.second[0]);
+        ASSERT_FLOAT_EQ(sent[row.first][1], row.second[1]);
+      }
+    }
+    ASSERT_EQ(next, grad_num);
+    // a full queue is sent in merges of the configured size, the first
+    // adaptive one included as nothing is measured yet, and the backlog
+    // left is sent at once
+    ASSERT_EQ(batches, std::vector<int>({4, 4, 2})) << "adaptive " << adaptive;
+  }
+}
+
+// keeps the sparse rows a geo trainer pushes
+class GeoPushRecorder : public PsLocalClient {
+ public:
+  std::future<int32_t> PushSparseRawGradientPartial(
+      size_t table_id, const uint64_t *keys, const float **update_values,
+      uint32_t num, void *done, int pserver_idx) override {
+    for (uint32_t i = 0; i < num; i++) {
+      pushed[keys[i]].assign(update_values[i], update_values[i] + dim);
+    }
+    delete static_cast<PSClientClosure *>(done);
+    return PsLocalClient::PushSparseRawGradientPartial(
+        table_id, keys, update_values, num, nullptr, pserver_idx);
+  }
+  std::future<int32_t> PushSparseParam(size_t table_id, const uint64_t *keys,
+                                       const float **update_values,
+                                       size_t num, void *done) override {
+    delete static_cast<PSClientClosure *>(done);
+    return PsLocalClient::PushSparseParam(table_id, keys, update_values, num,
+                                          nullptr);
+  }
+  int64_t dim = 0;
+  std::map<uint64_t, std::vector<float>> pushed;
+};
+
+class TestGeoCommunicator : public GeoCommunicator {
+ public:
+  explicit TestGeoCommunicator(const std::map<std::string, std::string> &envs)
+      : GeoCommunicator(envs) {}
+  void SetClient(std::shared_ptr<PSClient> client) { _worker_ptr = client; }
+};
+
+// a row whose delta is below the threshold is held back, and sent with the
+// delta added up once it grows over the threshold, once it has been held
+// back too long, or when the communicator stops
+TEST(CommunicatorMerge, GeoResidualDelta) {
+  google::FlagSaver flag_saver;
+  const int64_t row_num = 10, dim = 2;
+  std::map<std::string, std::string> envs = {
+      {"barrier_table_id", "0"},
+      {"trainer_id", "0"},
+      {"trainers", "1"},
+      {"communicator_send_wait_times", "1"},
+      {"communicator_thread_pool_size", "1"},
+      {"communicator_max_merge_var_num", "1"}};
+  TestGeoCommunicator communicator(envs);
+  communicator.InitEnvs();
+  auto client = std::make_shared<GeoPushRecorder>();
+  client->dim = dim;
+  communicator.SetClient(client);
+
+  Scope scope;
+  auto *param = scope.Var("emb")->GetMutable<framework::LoDTensor>();
+  float *latest = param->mutable_data<float>(phi::make_ddim({row_num, dim}),
+                                             platform::CPUPlace());
+  std::fill_n(latest, row_num * dim, 0);
+  RpcCtxMap send_ctx;
+  send_ctx.emplace("emb@GRAD",
+                   CommContext("emb@GRAD", {"emb.block0"}, {"ps0"}, {row_num},
+                               {"emb@GRAD"}, 0, true, true, false, 0));
+  communicator.InitImpl(send_ctx, RecvCtxMap(), &scope);
+  communicator.InitSparse("emb", 0);
+
+  FLAGS_communicator_geo_sparse_threshold = 1.0;
+  // row 3 moves by a delta of norm 0.5
+  latest[3 * dim] = 0.3;
+  latest[3 * dim + 1] = 0.4;
+  std::vector<int64_t> ids = {3};
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_TRUE(client->pushed.empty());
+
+  // row 3 moves again, its delta adds up to a norm of 1.5, row 5 moves by
+  // a small delta
+  latest[3 * dim] = 0.9;
+  latest[3 * dim + 1] = 1.2;
+  latest[5 * dim] = 0.1;
+  ids = {5};
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_EQ(client->pushed.size(), 1u);
+  ASSERT_EQ(client->pushed.count(3), 1u);
+  ASSERT_FLOAT_EQ(client->pushed[3][0], 0.9);
+  ASSERT_FLOAT_EQ(client->pushed[3][1], 1.2);
+
+  // row 5 is still held back, once it grows it is sent alone
+  client->pushed.clear();
+  latest[5 * dim] = 1.1;
+  ids.clear();
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_EQ(client->pushed.size(), 1u);
+  ASSERT_FLOAT_EQ(client->pushed[5][0], 1.1);
+  ASSERT_FLOAT_EQ(client->pushed[5][1], 0);
+
+  // row 7 stays below the threshold, it is held back for two rounds and
+  // sent in the third
+  FLAGS_communicator_geo_sparse_max_hold_rounds = 2;
+  client->pushed.clear();
+  latest[7 * dim] = 0.2;
+  ids = {7};
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ids.clear();
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_TRUE(client->pushed.empty());
+  ids.clear();
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_EQ(client->pushed.size(), 1u);
+  ASSERT_FLOAT_EQ(client->pushed[7][0], 0.2);
+  ids.clear();
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_EQ(client->pushed.size(), 1u);
+
+  // row 8 is held back, and sent when the communicator stops
+  client->pushed.clear();
+  latest[8 * dim + 1] = 0.3;
+  ids = {8};
+  communicator.SendSparse("emb.block0", ids, 0, 0);
+  ASSERT_TRUE(client->pushed.empty());
+  communicator.Stop();
+  ASSERT_EQ(client->pushed.size(), 1u);
+  ASSERT_FLOAT_EQ(client->pushed[8][0], 0);
+  ASSERT_FLOAT_EQ(client->pushed[8][1], 0.3);
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -14,8 +14,11 @@ limitations under the License. */
 
 #include "paddle/fluid/distributed/ps/table/ctr_accessor.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
+#include <random>
 
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/common/registerer.h"
@@ -303,5 +306,204 @@ TEST(downpour_feature_value_accessor_test, test_string_related) {
     ASSERT_FLOAT_EQ(value[i], 0);
   }
 }
+
+TableAccessorParameter gen_quant_param(int embedx_dim, int quant_bits) {
+  TableAccessorParameter param = gen_param();
+  param.set_fea_dim(embedx_dim + 3);
+  param.set_embedx_dim(embedx_dim);
+  param.set_embedx_threshold(0);
+  param.mutable_ctr_accessor_param()->set_embedx_quant_bits(quant_bits);
+  param.mutable_embedx_sgd_param()->set_name("SparseAdaGradSGDRule");
+  auto* adagrad_param = param.mutable_embedx_sgd_param()->mutable_adagrad();
+  adagrad_param->set_learning_rate(0.1);
+  adagrad_param->set_initial_range(0.3);
+  adagrad_param->set_initial_g2sum(3.0);
+  adagrad_param->add_weight_bounds(-10.0);
+  adagrad_param->add_weight_bounds(10.0);
+  return param;
+}
+
+TEST(downpour_feature_value_accessor_test, test_quant_memory) {
+  const int embedx_dim = 64;
+  std::vector<size_t> sizes;
+  for (int bits : {32, 16, 8}) {
+    CtrCommonAccessor acc;
+    ASSERT_EQ(acc.Configure(gen_quant_param(embedx_dim, bits)), 0);
+    ASSERT_EQ(acc.Initialize(), 0);
+    // slot, unseen_days, delta_score, show, click, embed_w, embed_g2sum,
+    // embedx_g2sum
+    size_t fixed_dim = 8;
+    size_t embedx_w_dim = acc.common_feature_value.EmbedxWDim();
+    ASSERT_EQ(acc.GetAccessorInfo().dim, fixed_dim + embedx_w_dim);
+    ASSERT_EQ(acc.GetAccessorInfo().size,
+              (fixed_dim + embedx_w_dim) * sizeof(float));
+    // pull and push stay fp32
+    ASSERT_EQ(acc.GetAccessorInfo().select_dim, 3u + embedx_dim);
+    ASSERT_EQ(acc.GetAccessorInfo().update_dim, 4u + embedx_dim);
+    sizes.push_back(acc.GetAccessorInfo().size);
+    VLOG(3) << "quant bits: " << bits
+            << " value size: " << acc.GetAccessorInfo().size;
+  }
+  ASSERT_EQ(sizes[0], (8u + embedx_dim) * sizeof(float));
+  ASSERT_EQ(sizes[1], (8u + embedx_dim / 2) * sizeof(float));
+  ASSERT_EQ(sizes[2], (8u + 1 + embedx_dim / 4) * sizeof(float));
+}
+
+TEST(downpour_feature_value_accessor_test, test_quant_drift) {
+  const int embedx_dim = 8;
+  const int item_size = 20;
+  const int step_num = 100;
+  std::vector<std::unique_ptr<CtrCommonAccessor>> accs;
+  for (int bits : {32, 16, 8}) {
+    accs.emplace_back(new CtrCommonAccessor());
+    ASSERT_EQ(accs.back()->Configure(gen_quant_param(embedx_dim, bits)), 0);
+    ASSERT_EQ(accs.back()->Initialize(), 0);
+  }
+  const size_t select_dim = accs[0]->GetAccessorInfo().select_dim;
+  const size_t update_dim = accs[0]->GetAccessorInfo().update_dim;
+
+  // every accessor starts from the same fp32 values, passed through text
+  std::vector<std::vector<std::vector<float>>> values(accs.size());
+  std::vector<float> init(accs[0]->GetAccessorInfo().dim);
+  for (int i = 0; i < item_size; ++i) {
+    float* init_ptr = init.data();
+    accs[0]->Create(&init_ptr, 1);
+    accs[0]->common_feature_value.Show(init_ptr) = 100;
+    accs[0]->common_feature_value.Click(init_ptr) = 10;
+    std::string str = accs[0]->ParseToString(init_ptr, init.size());
+    for (size_t k = 0; k < accs.size(); ++k) {
+      std::vector<float> value(accs[k]->GetAccessorInfo().dim);
+      ASSERT_EQ(accs[k]->ParseFromString(str, value.data()),
+                static_cast<int>(value.size()));
+      values[k].push_back(value);
+    }
+  }
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float> grad(update_dim);
+  const float* grad_ptr = grad.data();
+  for (int step = 0; step < step_num; ++step) {
+    for (int i = 0; i < item_size; ++i) {
+      grad[0] = 0;
+      grad[1] = 1;
+      grad[2] = 0;
+      for (size_t j = 3; j < update_dim; ++j) {
+        grad[j] = dist(rng);
+      }
+      for (size_t k = 0; k < accs.size(); ++k) {
+        float* value_ptr = values[k][i].data();
+        accs[k]->Update(&value_ptr, &grad_ptr, 1);
+      }
+    }
+  }
+
+  // compare what the trainers would pull
+  std::vector<float> max_diff(accs.size(), 0);
+  std::vector<float> base(select_dim), select(select_dim);
+  for (int i = 0; i < item_size; ++i) {
+    float* base_ptr = base.data();
+    const float* value_ptr = values[0][i].data();
+    accs[0]->Select(&base_ptr, &value_ptr, 1);
+    for (size_t k = 1; k < accs.size(); ++k) {
+      float* select_ptr = select.data();
+      value_ptr = values[k][i].data();
+      accs[k]->Select(&select_ptr, &value_ptr, 1);
+      // show, click and embed_w are never quantized
+      for (size_t j = 0; j < 3; ++j) {
+        ASSERT_FLOAT_EQ(select[j], base[j]);
+      }
+      for (size_t j = 3; j < select_dim; ++j) {
+        max_diff[k] = std::max(max_diff[k], std::fabs(select[j] - base[j]));
+      }
+    }
+  }
+  VLOG(0) << "embedx drift after " << step_num
+          << " updates, fp16: " << max_diff[1] << " int8: " << max_diff[2];
+  ASSERT_LT(max_diff[1], 0.1);
+  ASSERT_LT(max_diff[2], 0.2);
+}
+
+// With a small learning rate every update is below half an int8 step, it
+// is kept on average only because the updates round stochastically.
+TEST(downpour_feature_value_accessor_test, test_quant_small_lr) {
+  const int embedx_dim = 8;
+  const int item_size = 20;
+  const int step_num = 400;
+  std::vector<std::unique_ptr<CtrCommonAccessor>> accs;
+  for (int bits : {32, 16, 8}) {
+    auto param = gen_quant_param(embedx_dim, bits);
+    param.mutable_embedx_sgd_param()->mutable_adagrad()->set_learning_rate(
+        0.0005);
+    accs.emplace_back(new CtrCommonAccessor());
+    ASSERT_EQ(accs.back()->Configure(param), 0);
+    ASSERT_EQ(accs.back()->Initialize(), 0);
+  }
+  const size_t select_dim = accs[0]->GetAccessorInfo().select_dim;
+  const size_t update_dim = accs[0]->GetAccessorInfo().update_dim;
+
+  // the mean change of the pulled embedx weights after the same gradient
+  // is pushed step_num times to every item
+  std::vector<double> moves;
+  for (auto& acc : accs) {
+    std::vector<float> grad(update_dim, 1);
+    grad[0] = 0;
+    grad[2] = 0;
+    const float* grad_ptr = grad.data();
+    std::vector<float> value(acc->GetAccessorInfo().dim);
+    std::vector<float> before(select_dim), after(select_dim);
+    double move = 0;
+    for (int i = 0; i < item_size; ++i) {
+      float* value_ptr = value.data();
+      acc->Create(&value_ptr, 1);
+      float* select_ptr = before.data();
+      const float* const_value_ptr = value_ptr;
+      acc->Select(&select_ptr, &const_value_ptr, 1);
+      for (int step = 0; step < step_num; ++step) {
+        acc->Update(&value_ptr, &grad_ptr, 1);
+      }
+      select_ptr = after.data();
+      acc->Select(&select_ptr, &const_value_ptr, 1);
+      for (size_t j = 3; j < select_dim; ++j) {
+        move += after[j] - before[j];
+      }
+    }
+    moves.push_back(move / (item_size * embedx_dim));
+  }
+  VLOG(0) << "mean embedx move after " << step_num
+          << " updates, fp32: " << moves[0] << " fp16: " << moves[1]
+          << " int8: " << moves[2];
+  // lr * sum of sqrt(3 / (3 + k)) for k < step_num is about 0.032
+  ASSERT_LT(moves[0], -0.03);
+  ASSERT_NEAR(moves[1], moves[0], 0.1 * std::fabs(moves[0]));
+  ASSERT_NEAR(moves[2], moves[0], 0.1 * std::fabs(moves[0]));
+}
+
+TEST(downpour_feature_value_accessor_test, test_quant_string_related) {
+  const int embedx_dim = 8;
+  CtrCommonAccessor acc;
+  ASSERT_EQ(acc.Configure(gen_quant_param(embedx_dim, 8)), 0);
+  ASSERT_EQ(acc.Initialize(), 0);
+  std::vector<float> value(acc.GetAccessorInfo().dim);
+  float* value_ptr = value.data();
+  acc.Create(&value_ptr, 1);
+  acc.common_feature_value.Show(value_ptr) = 100;
+
+  // text holds fp32 weights and reloads to the same quantized value
+  std::string str = acc.ParseToString(value_ptr, value.size());
+  std::vector<float> loaded(value.size());
+  ASSERT_EQ(acc.ParseFromString(str, loaded.data()),
+            static_cast<int>(value.size()));
+  std::vector<float> embedx(embedx_dim), loaded_embedx(embedx_dim);
+  EmbedxQuantDecode(8, embedx_dim,
+                    value_ptr + acc.common_feature_value.EmbedxWIndex(),
+                    embedx.data());
+  EmbedxQuantDecode(8, embedx_dim,
+                    loaded.data() + acc.common_feature_value.EmbedxWIndex(),
+                    loaded_embedx.data());
+  for (int i = 0; i < embedx_dim; ++i) {
+    ASSERT_NEAR(loaded_embedx[i], embedx[i], 1e-6);
+  }
+}
 }  // namespace distributed
 }  // namespace paddle
@@ -225,7 +225,6 @@ void testFeatureNodeSerializeFloat64() {
 //   }
 // }
 
-// void testCache();
 void testGraphToBuffer();
 
 std::string edges[] = {
@@ -400,7 +399,6 @@ void RunClient(
 }
 
 void RunBrpcPushSparse() {
-  // testCache();
   setenv("http_proxy", "", 1);
   setenv("https_proxy", "", 1);
   prepare_file(edge_file_name, 1);
@@ -574,6 +572,30 @@ void RunBrpcPushSparse() {
                                        true, false);
 
   ASSERT_EQ(res.first[1].size(), 1);
+
+  // 96 and 37 are on different servers, the items have no edges to follow
+  VLOG(0) << "start to sample subgraph";
+  res = client1.sample_subgraph(std::string("user2item"), {96, 37, 96}, {4, 4},
+                                true);
+  ASSERT_EQ(res.first[0].size(), 8);
+  ASSERT_EQ(res.first[0][0], 96);
+  ASSERT_EQ(res.first[0][1], 37);
+  ASSERT_EQ(res.first[3], std::vector<int64_t>({0, 6, 6}));
+  ASSERT_EQ(res.second.size(), 6);
+  std::unordered_set<int64_t> sampled_items;
+  for (size_t i = 0; i < res.first[1].size(); i++) {
+    int64_t src = res.first[0][res.first[1][i]];
+    int64_t dst = res.first[0][res.first[2][i]];
+    ASSERT_TRUE(src == 96 || src == 37);
+    ASSERT_EQ(src == 96, dst == 48 || dst == 247 || dst == 111);
+    sampled_items.insert(dst);
+  }
+  ASSERT_EQ(sampled_items.size(), 6);
+
+  // the tables of the test run without the neighbor sample cache
+  auto cache_stat = client1.get_sample_cache_stat();
+  ASSERT_EQ(cache_stat["size"], 0);
+  ASSERT_NE(client1.save_sample_cache("graph_sample_cache_snapshot"), 0);
   std::vector<int64_t> nodes_ids = client2.random_sample_nodes("user", 0, 6);
   ASSERT_EQ(nodes_ids.size(), 2);
   ASSERT_EQ(true, (nodes_ids[0] == 59 && nodes_ids[1] == 37) ||
@@ -639,59 +661,6 @@ void RunBrpcPushSparse() {
   client1.StopServer();
 }
 
-/*void testCache() {
-  ::paddle::distributed::ScaledLRU<::paddle::distributed::SampleKey,
-                                   ::paddle::distributed::SampleResult>
-      st(1, 2, 4);
-  char* str = new char[7];
-  strcpy(str, "54321");
-  ::paddle::distributed::SampleResult* result =
-      new ::paddle::distributed::SampleResult(5, str);
-  ::paddle::distributed::SampleKey skey = {6, 1, false};
-  std::vector<std::pair<::paddle::distributed::SampleKey,
-                        paddle::distributed::SampleResult>>
-      r;
-  st.query(0, &skey, 1, r);
-  ASSERT_EQ((int)r.size(), 0);
-
-  st.insert(0, &skey, result, 1);
-  for (size_t i = 0; i < st.get_ttl(); i++) {
-    st.query(0, &skey, 1, r);
-    ASSERT_EQ((int)r.size(), 1);
-    char* p = (char*)r[0].second.buffer.get();
-    for (size_t j = 0; j < r[0].second.actual_size; j++)
-      ASSERT_EQ(p[j], str[j]);
-    r.clear();
-  }
-  st.query(0, &skey, 1, r);
-  ASSERT_EQ((int)r.size(), 0);
-  str = new char[10];
-  strcpy(str, "54321678");
-  result = new ::paddle::distributed::SampleResult(strlen(str), str);
-  st.insert(0, &skey, result, 1);
-  for (size_t i = 0; i < st.get_ttl() / 2; i++) {
-    st.query(0, &skey, 1, r);
-    ASSERT_EQ((int)r.size(), 1);
-    char* p = (char*)r[0].second.buffer.get();
-    for (size_t j = 0; j < r[0].second.actual_size; j++)
-      ASSERT_EQ(p[j], str[j]);
-    r.clear();
-  }
-  str = new char[18];
-  strcpy(str, "343332d4321");
-  result = new ::paddle::distributed::SampleResult(strlen(str), str);
-  st.insert(0, &skey, result, 1);
-  for (size_t i = 0; i < st.get_ttl(); i++) {
-    st.query(0, &skey, 1, r);
-    ASSERT_EQ((int)r.size(), 1);
-    char* p = (char*)r[0].second.buffer.get();
-    for (int j = 0; j < (int)r[0].second.actual_size; j++)
-      ASSERT_EQ(p[j], str[j]);
-    r.clear();
-  }
-  st.query(0, &skey, 1, r);
-  ASSERT_EQ((int)r.size(), 0);
-}*/
 void testGraphToBuffer() {
   ::paddle::distributed::GraphNode s, s1;
   s.set_feature_size(1);
@@ -0,0 +1,221 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/graph/graph_sample_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+// a sample holding the id of its node
+static SampleResult MakeSample(int64_t id) {
+  char *buffer = new char[sizeof(int64_t)];
+  memcpy(buffer, &id, sizeof(int64_t));
+  return SampleResult(sizeof(int64_t), buffer);
+}
+
+static int64_t SampleId(const SampleResult &result) {
+  int64_t id;
+  memcpy(&id, result.buffer.get(), sizeof(int64_t));
+  return id;
+}
+
+static bool Lookup(GraphSampleCache *cache, int64_t id) {
+  SampleResult result(0, static_cast<char *>(nullptr));
+  if (!cache->query(SampleKey(0, id, 10, false), &result)) {
+    return false;
+  }
+  EXPECT_EQ(SampleId(result), id);
+  return true;
+}
+
+// a miss, then the insert of the sample, as GraphTable does
+static bool Access(GraphSampleCache *cache, int64_t id) {
+  if (Lookup(cache, id)) {
+    return true;
+  }
+  cache->insert(SampleKey(0, id, 10, false), MakeSample(id));
+  return false;
+}
+
+TEST(GraphSampleCache, AdmissionAndTtl) {
+  GraphSampleCache cache(1, 100, 3, 2);
+  // the first miss is not admitted, the second is
+  ASSERT_FALSE(Access(&cache, 1));
+  ASSERT_FALSE(Access(&cache, 1));
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(Lookup(&cache, 1));
+  }
+  // served ttl times
+  ASSERT_FALSE(Lookup(&cache, 1));
+  // the key of an other sample size is an other entry
+  ASSERT_FALSE(cache.query(SampleKey(0, 1, 5, false), nullptr));
+
+  auto stat = cache.get_stat();
+  ASSERT_EQ(stat.hit, 3u);
+  ASSERT_EQ(stat.miss, 4u);
+  ASSERT_EQ(stat.reject, 1u);
+  ASSERT_EQ(stat.insert, 1u);
+  ASSERT_EQ(stat.expire, 1u);
+  ASSERT_EQ(stat.size, 0u);
+  ASSERT_NEAR(stat.hit_rate(), 3.0 / 7, 1e-9);
+}
+
+// hot nodes stay cached while a scan of nodes seen once passes by
+TEST(GraphSampleCache, ScanResistance) {
+  const int hot_num = 50;
+  GraphSampleCache cache(4, 200, 1000000, 2);
+  for (int round = 0; round < 3; round++) {
+    for (int64_t id = 0; id < hot_num; id++) {
+      Access(&cache, id);
+    }
+  }
+  int hot_hit = 0;
+  for (int64_t id = 1000; id < 100000; id++) {
+    Access(&cache, id);
+    hot_hit += Access(&cache, id % hot_num);
+  }
+  ASSERT_GT(hot_hit, 99000 * 0.95);
+  auto scan_stat = cache.get_stat();
+  ASSERT_GT(scan_stat.reject, scan_stat.insert);
+
+  // nodes seen often do displace the entries not used since
+  GraphSampleCache full(1, 10, 1000000, 1);
+  for (int64_t id = 0; id < 10; id++) {
+    Access(&full, id);
+  }
+  for (int64_t id = 10; id < 20; id++) {
+    for (int i = 0; i < 4; i++) {
+      Access(&full, id);
+    }
+  }
+  auto stat = full.get_stat();
+  ASSERT_EQ(stat.size, 10u);
+  ASSERT_EQ(stat.evict, 10u);
+  for (int64_t id = 10; id < 20; id++) {
+    ASSERT_TRUE(Lookup(&full, id));
+  }
+}
+
+TEST(GraphSampleCache, Snapshot) {
+  std::string path = "graph_sample_cache_snapshot.bin";
+  GraphSampleCache cache(3, 1000, 5, 1);
+  for (int64_t id = 0; id < 300; id++) {
+    Access(&cache, id);
+  }
+  Lookup(&cache, 7);
+  ASSERT_EQ(cache.save(path), 0);
+
+  // warm start into a cache of an other stripe number
+  GraphSampleCache warm(5, 1000, 5, 2);
+  ASSERT_EQ(warm.load(path), 0);
+  ASSERT_EQ(warm.get_stat().size, 300u);
+  for (int64_t id = 0; id < 300; id++) {
+    ASSERT_TRUE(Lookup(&warm, id));
+  }
+  // the ttl left is kept
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(Lookup(&warm, 7));
+  }
+  ASSERT_FALSE(Lookup(&warm, 7));
+  ASSERT_NE(warm.load("graph_sample_cache_missing.bin"), 0);
+  remove(path.c_str());
+}
+
+TEST(GraphSampleCache, BrokenSnapshot) {
+  std::string path = "graph_sample_cache_broken.bin";
+  GraphSampleCache cache(1, 10, 5, 1);
+  Access(&cache, 1);
+  ASSERT_EQ(cache.save(path), 0);
+  std::string data;
+  {
+    FILE *fp = fopen(path.c_str(), "rb");
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      data.append(buf, n);
+    }
+    fclose(fp);
+  }
+  auto write_file = [&path](const std::string &content) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    fwrite(content.data(), 1, content.size(), fp);
+    fclose(fp);
+  };
+  // version, entry number, then idx, node_key, sample_size, is_weighted and
+  // ttl before the sample bytes
+  size_t actual_size_offset = sizeof(uint32_t) + sizeof(uint64_t) +
+                              sizeof(int32_t) + sizeof(int64_t) +
+                              sizeof(uint64_t) + sizeof(uint8_t) +
+                              sizeof(uint64_t);
+  // more bytes than sample_size samples take
+  std::string broken = data;
+  uint64_t huge_size = uint64_t(1) << 60;
+  memcpy(&broken[actual_size_offset], &huge_size, sizeof(huge_size));
+  write_file(broken);
+  GraphSampleCache warm(1, 10, 5, 1);
+  ASSERT_NE(warm.load(path), 0);
+  // a sample_size that agrees with the huge byte count
+  size_t sample_size_offset = sizeof(uint32_t) + sizeof(uint64_t) +
+                              sizeof(int32_t) + sizeof(int64_t);
+  memcpy(&broken[sample_size_offset], &huge_size, sizeof(huge_size));
+  write_file(broken);
+  ASSERT_NE(warm.load(path), 0);
+  // a truncated sample
+  write_file(data.substr(0, data.size() - 1));
+  ASSERT_NE(warm.load(path), 0);
+  ASSERT_EQ(warm.get_stat().size, 0u);
+  write_file(data);
+  ASSERT_EQ(warm.load(path), 0);
+  ASSERT_TRUE(Lookup(&warm, 1));
+  remove(path.c_str());
+}
+
+TEST(GraphSampleCache, Threads) {
+  GraphSampleCache cache(8, 5000, 4, 2);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&cache, t]() {
+      std::mt19937_64 rng(t);
+      // a skewed access pattern
+      for (int i = 0; i < 10000; i++) {
+        int64_t id = rng() % ((rng() % 2) ? 1000 : 1000000);
+        Access(&cache, id);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto stat = cache.get_stat();
+  ASSERT_EQ(stat.hit + stat.miss, 80000u);
+  ASSERT_LE(stat.size, 5000u);
+  ASSERT_GT(stat.hit_rate(), 0.2);
+  VLOG(1) << "hit rate " << stat.hit_rate() << ", insert " << stat.insert
+          << ", reject " << stat.reject << ", evict " << stat.evict
+          << ", expire " << stat.expire;
+}
+
+}  // namespace distributed
+}  // namespace paddle
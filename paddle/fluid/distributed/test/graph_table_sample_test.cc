@@ -12,12 +12,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <malloc.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>  // NOLINT
 #include <fstream>
+#include <functional>
 #include <iomanip>
+#include <memory>
+#include <random>
 #include <string>
 #include <thread>  // NOLINT
 #include <unordered_set>
@@ -81,3 +86,408 @@ void testGraphSample() {
 }
 
 TEST(testGraphSample, Run) { testGraphSample(); }
+
+// heap bytes in use, mmapped blocks included, 0 if unknown
+static size_t heap_bytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+  struct mallinfo info = mallinfo();
+  return static_cast<unsigned int>(info.uordblks) +
+         static_cast<unsigned int>(info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+// node_num nodes of degree random in [1, 2 * avg_degree), loaded as
+// GraphTable::load_edges does
+static void fill_shard(distributed::GraphShard *shard, int node_num,
+                       int avg_degree, bool is_weighted) {
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < node_num; i++) {
+    int64_t id = i * 7 + 3;
+    int degree = 1 + rng() % (2 * avg_degree - 1);
+    for (int j = 0; j < degree; j++) {
+      shard->add_graph_node(id)->build_edges(is_weighted);
+      shard->add_neighbor(id, rng() % 100000000, 0.1 + (rng() % 100) / 10.0);
+    }
+  }
+}
+
+TEST(testGraphSample, CsrShard) {
+  distributed::GraphShard node_shard, csr_shard;
+  fill_shard(&node_shard, 1000, 10, true);
+  fill_shard(&csr_shard, 1000, 10, true);
+  for (auto *node : node_shard.get_bucket()) {
+    node->build_sampler("weighted");
+  }
+  csr_shard.build_csr();
+  ASSERT_TRUE(csr_shard.get_csr() != nullptr);
+  ASSERT_EQ(csr_shard.get_size(), node_shard.get_size());
+  ASSERT_TRUE(csr_shard.find_node(4) == nullptr);
+
+  auto rng = std::make_shared<std::mt19937_64>(0);
+  for (auto *node : node_shard.get_bucket()) {
+    auto *csr_node = csr_shard.find_node(node->get_id());
+    ASSERT_TRUE(csr_node != nullptr);
+    ASSERT_EQ(csr_node->get_neighbor_size(), node->get_neighbor_size());
+    for (size_t i = 0; i < node->get_neighbor_size(); i++) {
+      ASSERT_EQ(csr_node->get_neighbor_id(i), node->get_neighbor_id(i));
+      ASSERT_EQ(csr_node->get_neighbor_weight(i), node->get_neighbor_weight(i));
+    }
+    auto res = csr_node->sample_k(5, rng);
+    ASSERT_EQ(res.size(), std::min<size_t>(5, node->get_neighbor_size()));
+    std::unordered_set<int> distinct(res.begin(), res.end());
+    ASSERT_EQ(distinct.size(), res.size());
+    for (int x : res) {
+      ASSERT_LT(x, static_cast<int>(node->get_neighbor_size()));
+    }
+  }
+
+  // a change frees the csr and keeps the edges
+  int64_t id = node_shard.get_bucket()[0]->get_id();
+  size_t degree = node_shard.get_bucket()[0]->get_neighbor_size();
+  csr_shard.add_neighbor(id, 5, 1.0);
+  ASSERT_TRUE(csr_shard.get_csr() == nullptr);
+  auto *node = csr_shard.find_node(id);
+  ASSERT_EQ(node->get_neighbor_size(), degree + 1);
+  ASSERT_EQ(node->get_neighbor_id(degree), 5u);
+  ASSERT_EQ(node->sample_k(3, rng).size(), std::min<size_t>(3, degree + 1));
+  auto drawn = node->sample_k_with_replacement(1000, rng);
+  ASSERT_TRUE(std::find(drawn.begin(), drawn.end(), degree) != drawn.end());
+  csr_shard.delete_node(id);
+  ASSERT_TRUE(csr_shard.find_node(id) == nullptr);
+  ASSERT_EQ(csr_shard.get_size(), node_shard.get_size() - 1);
+}
+
+// the csr rows are sorted by node id, the bucket keeps the insertion order
+// that the node samples and the batches by position read
+TEST(testGraphSample, CsrKeepsBucketOrder) {
+  distributed::GraphShard shard;
+  for (int64_t id = 100; id > 0; id--) {
+    shard.add_graph_node(id)->build_edges(false);
+    shard.add_neighbor(id, id + 1000, 1.0);
+  }
+  std::vector<int64_t> order = shard.get_all_id();
+  shard.build_csr();
+  ASSERT_TRUE(shard.get_csr() != nullptr);
+  ASSERT_EQ(shard.get_all_id(), order);
+  for (int64_t id = 1; id <= 100; id++) {
+    auto *node = shard.find_node(id);
+    ASSERT_TRUE(node != nullptr);
+    ASSERT_EQ(node->get_id(), static_cast<uint64_t>(id));
+    ASSERT_EQ(node->get_neighbor_id(0), static_cast<uint64_t>(id + 1000));
+  }
+  shard.add_neighbor(50, 2000, 1.0);
+  ASSERT_TRUE(shard.get_csr() == nullptr);
+  ASSERT_EQ(shard.get_all_id(), order);
+  ASSERT_EQ(shard.find_node(50)->get_neighbor_size(), 2u);
+}
+
+// the csr of a large shard keeps the neighbors of every node in order
+TEST(testGraphSample, CsrMatchesNodes) {
+  const int node_num = 20000;
+  const int avg_degree = 32;
+  for (bool is_weighted : {false, true}) {
+    distributed::GraphShard node_shard, csr_shard;
+    fill_shard(&node_shard, node_num, avg_degree, is_weighted);
+    fill_shard(&csr_shard, node_num, avg_degree, is_weighted);
+    csr_shard.build_csr();
+    const distributed::GraphCSR *csr = csr_shard.get_csr();
+    ASSERT_TRUE(csr != nullptr);
+    ASSERT_EQ(csr->is_weighted(), is_weighted);
+    ASSERT_EQ(csr->row_num(), node_shard.get_size());
+    size_t edge_num = 0;
+    for (auto *node : node_shard.get_bucket()) {
+      int64_t row = csr->find(node->get_id());
+      ASSERT_GE(row, 0);
+      ASSERT_EQ(csr->get_id(row), node->get_id());
+      ASSERT_EQ(csr->degree(row), node->get_neighbor_size());
+      for (size_t i = 0; i < node->get_neighbor_size(); i++) {
+        ASSERT_EQ(csr->get_neighbor_id(row, i), node->get_neighbor_id(i));
+        if (is_weighted) {
+          ASSERT_EQ(csr->get_neighbor_weight(row, i),
+                    node->get_neighbor_weight(i));
+        }
+      }
+      edge_num += node->get_neighbor_size();
+    }
+    ASSERT_EQ(csr->edge_num(), edge_num);
+  }
+}
+
+// memory of the edges and neighbor sampling qps of the nodes and the csr.
+// The heap is measured by mallinfo, which other threads disturb, so it is
+// kept out of ctest, run it with --gtest_also_run_disabled_tests.
+TEST(testGraphSample, DISABLED_CsrMemoryAndQps) {
+  const int node_num = 20000;
+  const int avg_degree = 32;
+  const int sample_size = 10;
+  const int query_num = 200000;
+  for (bool is_weighted : {false, true}) {
+    size_t start = heap_bytes();
+    auto *node_shard = new distributed::GraphShard();
+    fill_shard(node_shard, node_num, avg_degree, is_weighted);
+    for (auto *node : node_shard->get_bucket()) {
+      node->build_sampler(is_weighted ? "weighted" : "random");
+    }
+    size_t node_bytes = heap_bytes() - start;
+
+    start = heap_bytes();
+    auto *csr_shard = new distributed::GraphShard();
+    fill_shard(csr_shard, node_num, avg_degree, is_weighted);
+    csr_shard->build_csr();
+    size_t csr_bytes = heap_bytes() - start;
+
+    std::vector<int64_t> ids;
+    for (auto *node : node_shard->get_bucket()) {
+      ids.push_back(node->get_id());
+    }
+    auto rng = std::make_shared<std::mt19937_64>(0);
+    size_t sampled = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < query_num; i++) {
+      auto *node = node_shard->find_node(ids[(*rng)() % ids.size()]);
+      sampled += node->sample_k(sample_size, rng).size();
+    }
+    double node_sec = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - begin)
+                          .count();
+    const distributed::GraphCSR *csr = csr_shard->get_csr();
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < query_num; i++) {
+      int64_t row = csr->find(ids[(*rng)() % ids.size()]);
+      sampled += csr->sample_k(row, sample_size, rng).size();
+    }
+    double csr_sec = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    ASSERT_GT(sampled, 0u);
+
+    std::cout << (is_weighted ? "weighted" : "unweighted") << " graph of "
+              << csr->edge_num() << " edges: nodes " << node_bytes
+              << " bytes, " << query_num / node_sec << " qps; csr "
+              << csr_bytes << " bytes (arrays " << csr->memory_size()
+              << "), " << query_num / csr_sec << " qps" << std::endl;
+    if (start != 0) {
+      ASSERT_LT(csr_bytes, node_bytes);
+    }
+    delete node_shard;
+    delete csr_shard;
+  }
+}
+
+// inclusion probabilities of the alias sampler without replacement, against
+// the exact ones of drawing two edges one after another
+TEST(testGraphSample, AliasSampling) {
+  std::vector<float> weights = {1, 0, 2, 3, 4, 0.5};
+  int n = weights.size();
+  std::vector<float> prob(n);
+  std::vector<uint32_t> alias(n);
+  distributed::AliasSampler::build_table(weights.data(), n, prob.data(),
+                                         alias.data());
+  double total = 0;
+  for (float w : weights) {
+    total += w;
+  }
+  std::vector<double> expected(n, 0);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      if (i != j) {
+        double p = weights[i] / total * weights[j] / (total - weights[i]);
+        expected[i] += p;
+        expected[j] += p;
+      }
+    }
+  }
+  std::mt19937_64 rng(0);
+  const int rounds = 200000;
+  std::vector<int> drawn(n, 0), included(n, 0);
+  for (int r = 0; r < rounds; r++) {
+    drawn[distributed::AliasSampler::draw(prob.data(), alias.data(), n,
+                                          &rng)]++;
+    auto res = distributed::AliasSampler::sample_without_replacement(
+        weights.data(), prob.data(), alias.data(), n, 2, &rng);
+    ASSERT_EQ(res.size(), 2u);
+    ASSERT_NE(res[0], res[1]);
+    for (int x : res) {
+      included[x]++;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    ASSERT_NEAR(drawn[i] / static_cast<double>(rounds), weights[i] / total,
+                0.005);
+    ASSERT_NEAR(included[i] / static_cast<double>(rounds), expected[i], 0.01);
+  }
+
+  // an edge of zero weight comes after all the positive ones
+  for (int r = 0; r < 1000; r++) {
+    auto res = distributed::AliasSampler::sample_without_replacement(
+        weights.data(), prob.data(), alias.data(), n, 5, &rng);
+    std::unordered_set<int> distinct(res.begin(), res.end());
+    ASSERT_EQ(distinct.size(), 5u);
+    ASSERT_EQ(distinct.count(1), 0u);
+  }
+
+  // a large k takes the keys, the edges of zero weight fill what the
+  // positive ones leave uniformly, all of them when no weight is positive
+  const int big_n = 40, big_k = 35, big_rounds = 20000;
+  for (int positive_num : {0, 10}) {
+    std::vector<float> big_weights(big_n, 0);
+    for (int i = 0; i < positive_num; i++) {
+      big_weights[i] = i + 1;
+    }
+    std::vector<float> big_prob(big_n);
+    std::vector<uint32_t> big_alias(big_n);
+    distributed::AliasSampler::build_table(big_weights.data(), big_n,
+                                           big_prob.data(), big_alias.data());
+    std::vector<int> big_included(big_n, 0);
+    for (int r = 0; r < big_rounds; r++) {
+      auto res = distributed::AliasSampler::sample_without_replacement(
+          big_weights.data(), big_prob.data(), big_alias.data(), big_n, big_k,
+          &rng);
+      std::unordered_set<int> distinct(res.begin(), res.end());
+      ASSERT_EQ(distinct.size(), static_cast<size_t>(big_k));
+      for (int x : res) {
+        big_included[x]++;
+      }
+    }
+    double zero_expected = static_cast<double>(big_k - positive_num) /
+                           (big_n - positive_num);
+    for (int i = 0; i < big_n; i++) {
+      double freq = big_included[i] / static_cast<double>(big_rounds);
+      if (i < positive_num) {
+        ASSERT_EQ(freq, 1.0);
+      } else {
+        ASSERT_NEAR(freq, zero_expected, 0.02) << "edge " << i;
+      }
+    }
+  }
+
+  // with replacement from the csr of a shard
+  distributed::GraphShard shard;
+  fill_shard(&shard, 100, 10, true);
+  shard.build_csr();
+  auto shared_rng = std::make_shared<std::mt19937_64>(0);
+  for (auto *node : shard.get_bucket()) {
+    auto res = node->sample_k_with_replacement(50, shared_rng);
+    ASSERT_EQ(res.size(), 50u);
+    for (int x : res) {
+      ASSERT_LT(x, static_cast<int>(node->get_neighbor_size()));
+    }
+  }
+}
+
+// draws with replacement of the alias sampler and of the csr follow the
+// edge weights, by a chi-square test at the 0.001 level
+TEST(testGraphSample, AliasDrawFrequencies) {
+  std::vector<float> weights = {1, 0, 2, 3, 4, 0.5, 7, 0.25};
+  int n = weights.size();
+  distributed::WeightedGraphEdgeBlob blob;
+  distributed::GraphShard shard;
+  for (int i = 0; i < n; i++) {
+    blob.add_edge(100 + i, weights[i]);
+    shard.add_graph_node(1)->build_edges(true);
+    shard.add_neighbor(1, 100 + i, weights[i]);
+  }
+  distributed::AliasSampler sampler;
+  sampler.build(&blob);
+  shard.build_csr();
+  const distributed::GraphCSR *csr = shard.get_csr();
+  int64_t row = csr->find(1);
+  ASSERT_GE(row, 0);
+
+  double total = 0;
+  for (float w : weights) {
+    total += w;
+  }
+  const int draw_num = 100000;
+  // the critical value of 6 degrees of freedom, one weight is zero
+  const double critical = 22.458;
+  auto rng = std::make_shared<std::mt19937_64>(0);
+  for (bool from_csr : {false, true}) {
+    auto res = from_csr ? csr->sample_k_with_replacement(row, draw_num, rng)
+                        : sampler.sample_k_with_replacement(draw_num, rng);
+    ASSERT_EQ(res.size(), static_cast<size_t>(draw_num));
+    std::vector<int> count(n, 0);
+    for (int x : res) {
+      ASSERT_GE(x, 0);
+      ASSERT_LT(x, n);
+      count[x]++;
+    }
+    ASSERT_EQ(count[1], 0);
+    double chi_square = 0;
+    for (int i = 0; i < n; i++) {
+      if (weights[i] > 0) {
+        double expected = draw_num * weights[i] / total;
+        chi_square += (count[i] - expected) * (count[i] - expected) / expected;
+      }
+    }
+    ASSERT_LT(chi_square, critical) << (from_csr ? "csr" : "alias sampler");
+  }
+}
+
+// weighted sampling qps of the tree sampler, the alias sampler and the csr,
+// kept out of ctest, run it with --gtest_also_run_disabled_tests
+TEST(testGraphSample, DISABLED_AliasQps) {
+  const int node_num = 20000;
+  const int avg_degree = 32;
+  const int query_num = 100000;
+  distributed::GraphShard shard;
+  fill_shard(&shard, node_num, avg_degree, true);
+  std::vector<std::unique_ptr<distributed::WeightedGraphEdgeBlob>> blobs;
+  std::vector<std::unique_ptr<distributed::Sampler>> trees, aliases;
+  for (auto *node : shard.get_bucket()) {
+    blobs.emplace_back(new distributed::WeightedGraphEdgeBlob());
+    for (size_t i = 0; i < node->get_neighbor_size(); i++) {
+      blobs.back()->add_edge(node->get_neighbor_id(i),
+                             node->get_neighbor_weight(i));
+    }
+    trees.emplace_back(new distributed::WeightedSampler());
+    trees.back()->build(blobs.back().get());
+    aliases.emplace_back(new distributed::AliasSampler());
+    aliases.back()->build(blobs.back().get());
+  }
+  shard.build_csr();
+  const distributed::GraphCSR *csr = shard.get_csr();
+
+  auto rng = std::make_shared<std::mt19937_64>(0);
+  auto run = [&](std::function<size_t(size_t)> sample) {
+    size_t sampled = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < query_num; i++) {
+      sampled += sample((*rng)() % csr->row_num());
+    }
+    double sec = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - begin)
+                     .count();
+    EXPECT_GT(sampled, 0u);
+    return query_num / sec;
+  };
+  for (int k : {5, 10, 50}) {
+    for (bool with_replacement : {false, true}) {
+      double tree_qps = run([&](size_t row) {
+        return with_replacement
+                   ? trees[row]->sample_k_with_replacement(k, rng).size()
+                   : trees[row]->sample_k(k, rng).size();
+      });
+      double alias_qps = run([&](size_t row) {
+        return with_replacement
+                   ? aliases[row]->sample_k_with_replacement(k, rng).size()
+                   : aliases[row]->sample_k(k, rng).size();
+      });
+      double csr_qps = run([&](size_t row) {
+        return with_replacement
+                   ? csr->sample_k_with_replacement(row, k, rng).size()
+                   : csr->sample_k(row, k, rng).size();
+      });
+      std::cout << "weighted sample " << k
+                << (with_replacement ? " with" : " without")
+                << " replacement: tree " << tree_qps << " qps, alias "
+                << alias_qps << " qps, csr " << csr_qps << " qps"
+                << std::endl;
+    }
+  }
+}
@@ -17,13 +17,35 @@ limitations under the License. */
 #include <ThreadPool.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <thread>  // NOLINT
+#include <utility>
 
+#include "gflags/gflags.h"
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_load_pipeline.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_wire_codec.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
+#include "paddle/fluid/framework/io/fs.h"
+
+DEFINE_int64(sparse_table_bench_key_num, 100000,
+             "key num of the synthetic table in save/load benchmark, "
+             "set to 100000000 for a 100M-key table");
+DEFINE_int32(sparse_table_bench_thread_num, 8,
+             "client thread num of the concurrent pull benchmark");
+DECLARE_bool(pserver_sparse_concurrent_pull);
+DECLARE_bool(pserver_load_pipeline);
+DECLARE_int32(pserver_shrink_bucket_num_per_step);
+DECLARE_bool(pserver_delta_save_dirty_bucket_only);
 
 namespace paddle {
 namespace distributed {
@@ -155,5 +177,873 @@ TEST(MemorySparseTable, SGD) {
   ctr_table->SaveLocalFS("./work/table.save", "0", "test");
 }
 
+// save param 0 is written in text, save params 1, 2 and 3 in binary
+static Table *CreateCtrTable(int shard_num) {
+  TableParameter table_config;
+  table_config.set_table_class("MemorySparseTable");
+  table_config.set_shard_num(shard_num);
+  FsClientParameter fs_config;
+  Table *table = new MemorySparseTable();
+  table->SetShard(0, 1);
+
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(11);
+  accessor_config->set_embedx_dim(8);
+  accessor_config->set_embedx_threshold(5);
+  for (int param : {1, 2, 3}) {
+    auto *save_param = accessor_config->add_table_accessor_save_param();
+    save_param->set_param(param);
+    save_param->set_binary(true);
+  }
+
+  accessor_config->mutable_embed_sgd_param()->set_name("SparseAdaGradSGDRule");
+  auto *adagrad_param =
+      accessor_config->mutable_embed_sgd_param()->mutable_adagrad();
+  adagrad_param->set_learning_rate(0.1);
+  adagrad_param->set_initial_range(0.3);
+  accessor_config->mutable_embedx_sgd_param()->set_name(
+      "SparseAdaGradSGDRule");
+  adagrad_param =
+      accessor_config->mutable_embedx_sgd_param()->mutable_adagrad();
+  adagrad_param->set_learning_rate(0.1);
+  adagrad_param->set_initial_range(0.3);
+
+  auto ret = table->Initialize(table_config, fs_config);
+  CHECK_EQ(ret, 0);
+  return table;
+}
+
+static void FillCtrTable(Table *table, size_t key_num, size_t key_step = 1) {
+  const size_t batch_size = 100000;
+  std::vector<uint64_t> keys(batch_size);
+  std::vector<char *> pull_values(batch_size);
+  for (size_t start = 0; start < key_num; start += batch_size) {
+    size_t num = std::min(batch_size, key_num - start);
+    for (size_t i = 0; i < num; ++i) {
+      keys[i] = (start + i) * key_step;
+    }
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.use_ptr = true;
+    table_context.pull_context.keys = keys.data();
+    table_context.pull_context.ptr_values = pull_values.data();
+    table_context.num = num;
+    table->Pull(table_context);
+  }
+}
+
+static void ExpectTableEqual(MemorySparseTable *a, MemorySparseTable *b,
+                             int shard_num) {
+  for (int shard_id = 0; shard_id < shard_num; ++shard_id) {
+    auto *shard_a =
+        static_cast<MemorySparseTable::shard_type *>(a->GetShard(shard_id));
+    auto *shard_b =
+        static_cast<MemorySparseTable::shard_type *>(b->GetShard(shard_id));
+    ASSERT_EQ(shard_a->size(), shard_b->size());
+    for (auto it = shard_a->begin(); it != shard_a->end(); ++it) {
+      auto itr = shard_b->find(it.key());
+      ASSERT_TRUE(itr != shard_b->end());
+      ASSERT_EQ(it.value().size(), itr.value().size());
+      for (size_t i = 0; i < it.value().size(); ++i) {
+        ASSERT_EQ(it.value().data()[i], itr.value().data()[i]);
+      }
+    }
+  }
+}
+
+TEST(MemorySparseTable, BinarySaveLoad) {
+  int shard_num = 10;
+  std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+  FillCtrTable(table.get(), 10000);
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table.get());
+
+  std::string path = "./work/binary_table";
+  paddle::framework::localfs_mkdir(path + "/000");
+  ASSERT_EQ(ctr_table->SaveLocalFS(path, "3", "binary"), 0);
+
+  std::unique_ptr<Table> load_table(CreateCtrTable(shard_num));
+  MemorySparseTable *load_ctr_table =
+      dynamic_cast<MemorySparseTable *>(load_table.get());
+  ASSERT_EQ(load_ctr_table->LoadLocalFS(path, "3"), 0);
+  ExpectTableEqual(ctr_table, load_ctr_table, shard_num);
+  paddle::framework::localfs_remove(path);
+}
+
+TEST(MemorySparseTable, BinarySaveFailure) {
+  int shard_num = 10;
+  Table *table = CreateCtrTable(shard_num);
+  FillCtrTable(table, 100);
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table);
+  // the table directory is not created, so no shard file can be written
+  ASSERT_EQ(ctr_table->SaveLocalFS("./work/binary_table_no_dir", "3", "binary"),
+            -1);
+  delete table;
+}
+
+TEST(SparseBinaryReader, BrokenValueSizes) {
+  std::string data;
+  SparseBinaryWriter writer([&data](const char *buf, size_t size) {
+    data.append(buf, size);
+    return 0;
+  });
+  ASSERT_EQ(writer.WriteHeader(32, 4), 0);
+  std::vector<float> value(4, 1.0);
+  ASSERT_EQ(writer.Append(1, value.data(), 4), 0);
+  ASSERT_EQ(writer.Append(2, value.data(), 4), 0);
+  ASSERT_EQ(writer.Flush(), 0);
+
+  SparseBinaryFileHeader file_header;
+  SparseBinaryBlock block;
+  {
+    SparseBinaryReader reader(data.data(), data.size());
+    ASSERT_EQ(reader.ReadHeader(&file_header), 0);
+    ASSERT_EQ(file_header.quant_bits, 32u);
+    ASSERT_EQ(file_header.value_dim, 4u);
+    ASSERT_EQ(reader.Next(&block), 1);
+    ASSERT_EQ(reader.Next(&block), 0);
+  }
+  // the second key claims more values than the block holds
+  size_t sizes_offset = sizeof(SparseBinaryFileHeader) +
+                        sizeof(SparseBinaryBlockHeader) + 2 * sizeof(uint64_t);
+  uint32_t broken_size = 1 << 20;
+  memcpy(&data[sizes_offset + sizeof(uint32_t)], &broken_size,
+         sizeof(broken_size));
+  {
+    SparseBinaryReader reader(data.data(), data.size());
+    ASSERT_EQ(reader.ReadHeader(&file_header), 0);
+    ASSERT_EQ(reader.Next(&block), -1);
+  }
+
+  // a block header claiming about 2^59 values fails at the end of a
+  // stream instead of allocating them
+  uint64_t huge_value_num = 1ULL << 59;
+  memcpy(&data[sizeof(SparseBinaryFileHeader) +
+               offsetof(SparseBinaryBlockHeader, value_num)],
+         &huge_value_num, sizeof(huge_value_num));
+  size_t offset = 0;
+  SparseBinaryReader reader([&data, &offset](char *buf, size_t size) {
+    size_t read_size = std::min(size, data.size() - offset);
+    memcpy(buf, data.data() + offset, read_size);
+    offset += read_size;
+    return read_size;
+  });
+  ASSERT_EQ(reader.ReadHeader(&file_header), 0);
+  ASSERT_EQ(reader.Next(&block), -1);
+}
+
+// the save and load times of the text and binary formats, kept out of
+// ctest, run it with --gtest_also_run_disabled_tests
+TEST(MemorySparseTable, DISABLED_BinarySaveLoadBenchmark) {
+  int shard_num = 10;
+  std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+  FillCtrTable(table.get(), FLAGS_sparse_table_bench_key_num);
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table.get());
+
+  auto elapsed_ms = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  std::vector<std::pair<std::string, std::string>> modes = {{"text", "0"},
+                                                            {"binary", "3"}};
+  for (auto &mode : modes) {
+    std::string path = "./work/bench_table_" + mode.first;
+    paddle::framework::localfs_mkdir(path + "/000");
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(ctr_table->SaveLocalFS(path, mode.second, mode.first), 0);
+    auto save_ms = elapsed_ms(start);
+
+    std::unique_ptr<Table> load_table(CreateCtrTable(shard_num));
+    MemorySparseTable *load_ctr_table =
+        dynamic_cast<MemorySparseTable *>(load_table.get());
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ(load_ctr_table->LoadLocalFS(path, mode.second), 0);
+    auto load_ms = elapsed_ms(start);
+    ASSERT_EQ(load_ctr_table->LocalSize(), ctr_table->LocalSize());
+
+    LOG(INFO) << "MemorySparseTable " << mode.first << " format, key_num "
+              << FLAGS_sparse_table_bench_key_num << ", save " << save_ms
+              << " ms, load " << load_ms << " ms";
+    paddle::framework::localfs_remove(path);
+  }
+}
+
+// push show 10 and click 1 to the keys, enough for an xbox base or delta
+static void PushShowClick(Table *table, const std::vector<uint64_t> &keys) {
+  const int emb_dim = 8;
+  // slot, show, click, embed_g, embedx_g
+  std::vector<float> grads(keys.size() * (emb_dim + 4), 0.01);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    grads[i * (emb_dim + 4) + 1] = 10;
+    grads[i * (emb_dim + 4) + 2] = 1;
+  }
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.push_context.keys = keys.data();
+  table_context.push_context.values = grads.data();
+  table_context.num = keys.size();
+  table->Push(table_context);
+}
+
+// the shard and bucket of every dirty bucket
+static std::set<std::pair<int, size_t>> DirtyBuckets(MemorySparseTable *table,
+                                                     int shard_num) {
+  std::set<std::pair<int, size_t>> dirty;
+  for (int shard_id = 0; shard_id < shard_num; ++shard_id) {
+    auto *shard = static_cast<MemorySparseTable::shard_type *>(
+        table->GetShard(shard_id));
+    for (size_t bucket = 0; bucket < shard->bucket_count(); ++bucket) {
+      if (shard->dirty(bucket)) {
+        dirty.insert({shard_id, bucket});
+      }
+    }
+  }
+  return dirty;
+}
+
+// a delta only holds the keys pushed since the last delta or base, the base
+// followed by the deltas restores the table
+TEST(MemorySparseTable, DeltaSaveLoad) {
+  google::FlagSaver flag_saver;
+  int shard_num = 10;
+  size_t key_num = 10000;
+  Table *table = CreateCtrTable(shard_num);
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table);
+  std::vector<uint64_t> keys(key_num);
+  for (size_t i = 0; i < key_num; ++i) {
+    keys[i] = i;
+  }
+  PushShowClick(table, keys);
+  std::string path = "./work/delta_table";
+  ASSERT_EQ(table->Save(path + "/base", "2"), 0);
+  ASSERT_TRUE(DirtyBuckets(ctr_table, shard_num).empty());
+
+  std::vector<uint64_t> delta_keys;
+  std::set<std::pair<int, size_t>> delta_buckets;
+  for (size_t i = 0; i < key_num; i += 211) {
+    delta_keys.push_back(i);
+    auto *shard = static_cast<MemorySparseTable::shard_type *>(
+        ctr_table->GetShard(i % shard_num));
+    delta_buckets.insert({i % shard_num, shard->bucket_of(i)});
+  }
+  PushShowClick(table, delta_keys);
+  ASSERT_EQ(DirtyBuckets(ctr_table, shard_num), delta_buckets);
+  ASSERT_EQ(table->Save(path + "/delta_1", "1"), 0);
+  ASSERT_TRUE(DirtyBuckets(ctr_table, shard_num).empty());
+  ASSERT_EQ(table->Save(path + "/delta_2", "1"), 0);
+
+  std::map<std::string, size_t> expect_sizes = {
+      {"/base", key_num}, {"/delta_1", delta_keys.size()}, {"/delta_2", 0}};
+  for (auto &expect : expect_sizes) {
+    Table *load_table = CreateCtrTable(shard_num);
+    std::string param = expect.first == "/base" ? "2" : "1";
+    ASSERT_EQ(load_table->Load(path + expect.first, param), 0);
+    ASSERT_EQ(dynamic_cast<MemorySparseTable *>(load_table)->LocalSize(),
+              static_cast<int64_t>(expect.second));
+    if (expect.first == "/delta_1") {
+      for (auto key : delta_keys) {
+        auto *shard = static_cast<MemorySparseTable::shard_type *>(
+            load_table->GetShard(key % shard_num));
+        ASSERT_TRUE(shard->find(key) != shard->end());
+      }
+    }
+    delete load_table;
+  }
+
+  Table *load_table = CreateCtrTable(shard_num);
+  MemorySparseTable *load_ctr_table =
+      dynamic_cast<MemorySparseTable *>(load_table);
+  std::vector<std::string> delta_paths = {path + "/delta_1",
+                                          path + "/delta_2"};
+  ASSERT_EQ(
+      load_ctr_table->LoadWithDelta(path + "/base", "2", delta_paths, "1"), 0);
+  // the delta score is reset in the table after the saves
+  const int delta_score_idx = 2;
+  for (int shard_id = 0; shard_id < shard_num; ++shard_id) {
+    auto *shard = static_cast<MemorySparseTable::shard_type *>(
+        ctr_table->GetShard(shard_id));
+    auto *load_shard = static_cast<MemorySparseTable::shard_type *>(
+        load_ctr_table->GetShard(shard_id));
+    ASSERT_EQ(shard->size(), load_shard->size());
+    for (auto it = shard->begin(); it != shard->end(); ++it) {
+      auto itr = load_shard->find(it.key());
+      ASSERT_TRUE(itr != load_shard->end());
+      ASSERT_EQ(it.value().size(), itr.value().size());
+      for (size_t i = 0; i < it.value().size(); ++i) {
+        if (i != delta_score_idx) {
+          ASSERT_EQ(it.value().data()[i], itr.value().data()[i]);
+        }
+      }
+    }
+  }
+  delete load_table;
+
+  // the local fs saves clear the dirty bits as well, a second delta with
+  // no push in between visits no bucket, so writes no row even though the
+  // local fs save keeps the delta scores
+  FLAGS_pserver_delta_save_dirty_bucket_only = true;
+  std::string local_path = path + "/local";
+  paddle::framework::localfs_mkdir(local_path + "/base/000");
+  ASSERT_EQ(ctr_table->SaveLocalFS(local_path + "/base", "2", "base"), 0);
+  std::unique_ptr<Table> local_table(CreateCtrTable(shard_num));
+  MemorySparseTable *local_ctr_table =
+      dynamic_cast<MemorySparseTable *>(local_table.get());
+  ASSERT_EQ(local_ctr_table->LoadLocalFS(local_path + "/base", "2"), 0);
+  ASSERT_FALSE(DirtyBuckets(local_ctr_table, shard_num).empty());
+  paddle::framework::localfs_mkdir(local_path + "/base_1/000");
+  ASSERT_EQ(local_ctr_table->SaveLocalFS(local_path + "/base_1", "2", "base"),
+            0);
+  ASSERT_TRUE(DirtyBuckets(local_ctr_table, shard_num).empty());
+  PushShowClick(local_table.get(), delta_keys);
+  ASSERT_EQ(DirtyBuckets(local_ctr_table, shard_num), delta_buckets);
+  for (std::string delta : {"/delta_1", "/delta_2"}) {
+    paddle::framework::localfs_mkdir(local_path + delta + "/000");
+    ASSERT_EQ(local_ctr_table->SaveLocalFS(local_path + delta, "1", "delta"),
+              0);
+    ASSERT_TRUE(DirtyBuckets(local_ctr_table, shard_num).empty());
+  }
+  expect_sizes = {{"/delta_1", delta_keys.size()}, {"/delta_2", 0}};
+  for (auto &expect : expect_sizes) {
+    std::unique_ptr<Table> load_local_table(CreateCtrTable(shard_num));
+    ASSERT_EQ(dynamic_cast<MemorySparseTable *>(load_local_table.get())
+                  ->LoadLocalFS(local_path + expect.first, "1"),
+              0);
+    ASSERT_EQ(dynamic_cast<MemorySparseTable *>(load_local_table.get())
+                  ->LocalSize(),
+              static_cast<int64_t>(expect.second))
+        << expect.first;
+  }
+
+  delete table;
+  paddle::framework::localfs_remove(path);
+}
+
+// a row written through the pointer of PullSparsePtr, as the gpu ps
+// write-back does, is in the next delta that only visits dirty buckets
+TEST(MemorySparseTable, DeltaSavePullSparsePtr) {
+  google::FlagSaver flag_saver;
+  FLAGS_pserver_delta_save_dirty_bucket_only = true;
+  int shard_num = 10;
+  size_t key_num = 1000;
+  std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table.get());
+  std::vector<uint64_t> keys(key_num);
+  for (size_t i = 0; i < key_num; ++i) {
+    keys[i] = i;
+  }
+  PushShowClick(table.get(), keys);
+  std::string path = "./work/delta_ptr_table";
+  ASSERT_EQ(table->Save(path + "/base", "2"), 0);
+  ASSERT_TRUE(DirtyBuckets(ctr_table, shard_num).empty());
+
+  // an existing key and a key created by the pull
+  std::vector<uint64_t> ptr_keys = {7, key_num + 3};
+  std::vector<char *> ptrs(ptr_keys.size());
+  ASSERT_EQ(
+      ctr_table->PullSparsePtr(ptrs.data(), ptr_keys.data(), ptr_keys.size()),
+      0);
+  // unseen_days, delta_score, show and click of CtrCommonFeatureValue
+  const int delta_score_idx = 2;
+  const int show_idx = 3;
+  const int click_idx = 4;
+  for (auto *ptr : ptrs) {
+    float *row = reinterpret_cast<FixedFeatureValue *>(ptr)->data();
+    row[delta_score_idx] = 1;
+    row[show_idx] = 20;
+    row[click_idx] = 2;
+  }
+  ASSERT_EQ(table->Save(path + "/delta", "1"), 0);
+
+  std::unique_ptr<Table> load_table(CreateCtrTable(shard_num));
+  ASSERT_EQ(load_table->Load(path + "/delta", "1"), 0);
+  ASSERT_EQ(dynamic_cast<MemorySparseTable *>(load_table.get())->LocalSize(),
+            static_cast<int64_t>(ptr_keys.size()));
+  for (auto key : ptr_keys) {
+    auto *shard = static_cast<MemorySparseTable::shard_type *>(
+        load_table->GetShard(key % shard_num));
+    auto itr = shard->find(key);
+    ASSERT_TRUE(itr != shard->end());
+    ASSERT_EQ(itr.value().data()[show_idx], 20);
+    ASSERT_EQ(itr.value().data()[click_idx], 2);
+  }
+  paddle::framework::localfs_remove(path);
+}
+
+// file f holds keys f, f + file_num, ..., the first read of file 1 fails
+// half way and is retried
+TEST(SparseLoadPipeline, RouteAndRetry) {
+  const size_t file_num = 4;
+  const size_t shard_num = 3;
+  const size_t key_num = 10000;
+  SparseLoadPipeline::Option option;
+  option.block_size = 7;
+  option.channel_capacity = 2;
+  SparseLoadPipeline pipeline(option, shard_num, 2);
+
+  std::atomic<int> file1_reads{0};
+  auto read_func = [&](size_t file_idx,
+                       const std::function<void(std::string *)> &line_func) {
+    bool fail = file_idx == 1 && file1_reads++ == 0;
+    for (size_t key = file_idx; key < key_num; key += file_num) {
+      if (fail && key > key_num / 2) {
+        return -1;
+      }
+      std::string line = std::to_string(key) + " " + std::to_string(key % 10);
+      line_func(&line);
+    }
+    return 0;
+  };
+  auto parse_func = [](size_t file_idx, const std::string &line,
+                       uint64_t *key, float *value) {
+    char *end = NULL;
+    *key = std::strtoul(line.data(), &end, 10);
+    if (*key % 100 == 99) {
+      return -1;
+    }
+    value[0] = std::strtof(end, NULL);
+    value[1] = file_idx;
+    return 2;
+  };
+  auto shard_func = [&](uint64_t key) -> size_t { return key % shard_num; };
+  std::vector<std::map<uint64_t, std::vector<float>>> shards(shard_num);
+  auto insert_func = [&](int thread_idx, const SparseLoadBlock &block) {
+    for (size_t i = 0; i < block.size(); ++i) {
+      size_t shard_id = block.shard_ids[i];
+      ASSERT_EQ(pipeline.InsertThreadOf(shard_id), thread_idx);
+      shards[shard_id][block.keys[i]].assign(
+          block.value(i), block.value(i) + block.value_size(i));
+    }
+  };
+  ASSERT_EQ(pipeline.Run(file_num, read_func, parse_func, shard_func,
+                         insert_func),
+            0);
+  ASSERT_EQ(file1_reads, 2);
+
+  size_t loaded = 0;
+  for (size_t shard_id = 0; shard_id < shard_num; ++shard_id) {
+    for (auto &it : shards[shard_id]) {
+      ASSERT_EQ(it.first % shard_num, shard_id);
+      ASSERT_EQ(it.second[0], it.first % 10);
+      ASSERT_EQ(it.second[1], it.first % file_num);
+    }
+    loaded += shards[shard_id].size();
+  }
+  ASSERT_EQ(loaded, key_num - key_num / 100);
+}
+
+// saves a text checkpoint of key_num keys, loads it with the per file loop
+// and with the pipeline into load_tables and returns the load times in ms
+static std::vector<int64_t> RunTextLoad(
+    int shard_num, size_t key_num, const std::string &path,
+    std::vector<std::unique_ptr<Table>> *load_tables) {
+  google::FlagSaver flag_saver;
+  std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+  FillCtrTable(table.get(), key_num);
+  MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table.get());
+  paddle::framework::localfs_mkdir(path + "/000");
+  EXPECT_EQ(ctr_table->SaveLocalFS(path, "0", "text"), 0);
+
+  std::vector<int64_t> load_ms;
+  for (bool pipeline : {false, true}) {
+    FLAGS_pserver_load_pipeline = pipeline;
+    load_tables->emplace_back(CreateCtrTable(shard_num));
+    MemorySparseTable *load_ctr_table =
+        dynamic_cast<MemorySparseTable *>(load_tables->back().get());
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(load_ctr_table->LoadLocalFS(path, "0"), 0);
+    load_ms.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+    EXPECT_EQ(load_ctr_table->LocalSize(), ctr_table->LocalSize());
+  }
+  paddle::framework::localfs_remove(path);
+  return load_ms;
+}
+
+// the pipeline and the per file loop load the same text checkpoint
+TEST(MemorySparseTable, TextLoadPipeline) {
+  int shard_num = 10;
+  std::vector<std::unique_ptr<Table>> load_tables;
+  RunTextLoad(shard_num, 10000, "./work/text_table", &load_tables);
+  ASSERT_EQ(load_tables.size(), 2u);
+  ExpectTableEqual(dynamic_cast<MemorySparseTable *>(load_tables[0].get()),
+                   dynamic_cast<MemorySparseTable *>(load_tables[1].get()),
+                   shard_num);
+}
+
+// the text load time of the per file loop and the pipeline, kept out of
+// ctest, run it with --gtest_also_run_disabled_tests
+TEST(MemorySparseTable, DISABLED_TextLoadPipelineBenchmark) {
+  std::vector<std::unique_ptr<Table>> load_tables;
+  auto load_ms = RunTextLoad(10, FLAGS_sparse_table_bench_key_num,
+                             "./work/text_table_bench", &load_tables);
+  LOG(INFO) << "MemorySparseTable text load of "
+            << FLAGS_sparse_table_bench_key_num << " keys, file loop "
+            << load_ms[0] << " ms, pipeline " << load_ms[1] << " ms";
+}
+
+// pull from many client threads while one thread keeps pushing, all keys
+// fall into local shard 0 to model a hot shard, return pulled keys per second
+static double RunConcurrentPull(Table *table, int shard_num, size_t key_num,
+                                int thread_num, int rounds) {
+  const size_t batch_size = 1000;
+  const int emb_dim = 8;
+  std::atomic<bool> stop_push{false};
+  std::thread push_thread([&]() {
+    std::vector<uint64_t> keys(batch_size);
+    std::vector<float> grads(batch_size * (emb_dim + 4), 0.01);
+    for (size_t i = 0; i < batch_size; ++i) {
+      keys[i] = (i % key_num) * shard_num;
+    }
+    while (!stop_push) {
+      TableContext table_context;
+      table_context.value_type = Sparse;
+      table_context.push_context.keys = keys.data();
+      table_context.push_context.values = grads.data();
+      table_context.num = keys.size();
+      table->Push(table_context);
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pull_threads;
+  for (int t = 0; t < thread_num; ++t) {
+    pull_threads.emplace_back([&, t]() {
+      std::vector<uint64_t> keys(batch_size);
+      std::vector<uint32_t> fres(batch_size, 1);
+      std::vector<float> values(batch_size * (emb_dim + 3));
+      for (int r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < batch_size; ++i) {
+          keys[i] = ((t * rounds + r) * batch_size + i) % key_num * shard_num;
+        }
+        auto value = PullSparseValue(keys, fres, emb_dim);
+        TableContext table_context;
+        table_context.value_type = Sparse;
+        table_context.pull_context.pull_value = value;
+        table_context.pull_context.values = values.data();
+        table->Pull(table_context);
+      }
+    });
+  }
+  for (auto &t : pull_threads) {
+    t.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  stop_push = true;
+  push_thread.join();
+  return static_cast<double>(thread_num) * rounds * batch_size / seconds;
+}
+
+TEST(MemorySparseTable, ConcurrentPull) {
+  int shard_num = 10;
+  size_t key_num = 10000;
+  for (bool concurrent : {false, true}) {
+    FLAGS_pserver_sparse_concurrent_pull = concurrent;
+    Table *table = CreateCtrTable(shard_num);
+    FillCtrTable(table, key_num, shard_num);
+    RunConcurrentPull(table, shard_num, key_num, 4, 10);
+    MemorySparseTable *ctr_table = dynamic_cast<MemorySparseTable *>(table);
+    ASSERT_EQ(ctr_table->LocalSize(), static_cast<int64_t>(key_num));
+    delete table;
+  }
+  FLAGS_pserver_sparse_concurrent_pull = false;
+}
+
+// the pull rate of a hot shard with and without concurrent pull, kept out
+// of ctest, run it with --gtest_also_run_disabled_tests
+TEST(MemorySparseTable, DISABLED_ConcurrentPullBenchmark) {
+  int shard_num = 10;
+  size_t key_num = FLAGS_sparse_table_bench_key_num;
+  for (bool concurrent : {false, true}) {
+    FLAGS_pserver_sparse_concurrent_pull = concurrent;
+    Table *table = CreateCtrTable(shard_num);
+    FillCtrTable(table, key_num, shard_num);
+    double qps = RunConcurrentPull(table, shard_num, key_num,
+                                   FLAGS_sparse_table_bench_thread_num, 100);
+    LOG(INFO) << "MemorySparseTable hot shard pull, "
+              << (concurrent ? "concurrent pull" : "shard task pool")
+              << ", threads " << FLAGS_sparse_table_bench_thread_num << ", "
+              << qps << " keys/s";
+    delete table;
+  }
+  FLAGS_pserver_sparse_concurrent_pull = false;
+}
+
+// the latency of the pushes made while a table is shrinked
+struct StreamingShrinkResult {
+  int64_t shrink_ms = 0;
+  int64_t max_push_ms = 0;
+  // pushes of the hot keys, the one before the shrink included
+  size_t push_num = 0;
+};
+
+// pushes the hot keys with large shows once, then over and over while
+// the table is shrinked, cold keys only pulled have a zero score and are
+// erased
+static StreamingShrinkResult RunStreamingShrink(
+    Table *table, const std::vector<uint64_t> &hot_keys, int emb_dim) {
+  // slot, show, click, embed_g, embedx_g
+  std::vector<float> grads(hot_keys.size() * (emb_dim + 4), 0.01);
+  for (size_t i = 0; i < hot_keys.size(); ++i) {
+    grads[i * (emb_dim + 4) + 1] = 10;
+    grads[i * (emb_dim + 4) + 2] = 1;
+  }
+  auto push_hot_keys = [&]() {
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.push_context.keys = hot_keys.data();
+    table_context.push_context.values = grads.data();
+    table_context.num = hot_keys.size();
+    table->Push(table_context);
+  };
+  StreamingShrinkResult result;
+  push_hot_keys();
+  result.push_num = 1;
+
+  std::atomic<bool> shrink_done{false};
+  std::thread push_thread([&]() {
+    while (!shrink_done) {
+      auto start = std::chrono::steady_clock::now();
+      push_hot_keys();
+      int64_t push_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      result.max_push_ms = std::max(result.max_push_ms, push_ms);
+      ++result.push_num;
+    }
+  });
+  auto start = std::chrono::steady_clock::now();
+  CHECK_EQ(table->Shrink("0"), 0);
+  result.shrink_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  shrink_done = true;
+  push_thread.join();
+  return result;
+}
+
+static float *FindCtrValue(MemorySparseTable *table, int shard_num,
+                           uint64_t key) {
+  for (int shard_id = 0; shard_id < shard_num; ++shard_id) {
+    auto *shard = static_cast<MemorySparseTable::shard_type *>(
+        table->GetShard(shard_id));
+    auto it = shard->find(key);
+    if (it != shard->end()) {
+      return it.value().data();
+    }
+  }
+  return nullptr;
+}
+
+// the cold keys are erased, and every push made while the table is
+// shrinked shows up in the hot keys
+TEST(MemorySparseTable, StreamingShrink) {
+  google::FlagSaver flag_saver;
+  int shard_num = 10;
+  const int emb_dim = 8;
+  const size_t key_num = 10000;
+  const size_t hot_key_num = 1000;
+  // unseen_days, delta_score, show and click of CtrCommonFeatureValue
+  const int delta_score_idx = 2;
+  std::vector<uint64_t> hot_keys(hot_key_num);
+  for (size_t i = 0; i < hot_key_num; ++i) {
+    hot_keys[i] = i;
+  }
+  for (int step_bucket_num : {1, 64}) {
+    FLAGS_pserver_shrink_bucket_num_per_step = step_bucket_num;
+    std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+    FillCtrTable(table.get(), key_num);
+    MemorySparseTable *ctr_table =
+        dynamic_cast<MemorySparseTable *>(table.get());
+
+    auto result = RunStreamingShrink(table.get(), hot_keys, emb_dim);
+
+    auto stat = ctr_table->GetShrinkStat();
+    ASSERT_EQ(stat.shrinked_bucket_num, stat.total_bucket_num);
+    ASSERT_EQ(stat.erased_num, key_num - hot_key_num);
+    ASSERT_GT(stat.reclaimed_bytes, stat.erased_num * sizeof(float));
+    ASSERT_EQ(ctr_table->LocalSize(), static_cast<int64_t>(hot_key_num));
+    for (uint64_t key = 0; key < key_num; ++key) {
+      ASSERT_EQ(FindCtrValue(ctr_table, shard_num, key) != nullptr,
+                key < hot_key_num)
+          << "key " << key;
+    }
+
+    // a push adds the same score to the delta score, which the shrink
+    // does not decay, so the hot keys hold the sum of all the pushes
+    float push_score = 0;
+    {
+      std::unique_ptr<Table> one_push_table(CreateCtrTable(shard_num));
+      FillCtrTable(one_push_table.get(), hot_key_num);
+      std::vector<float> grads(emb_dim + 4, 0.01);
+      grads[1] = 10;
+      grads[2] = 1;
+      TableContext table_context;
+      table_context.value_type = Sparse;
+      table_context.push_context.keys = hot_keys.data();
+      table_context.push_context.values = grads.data();
+      table_context.num = 1;
+      one_push_table->Push(table_context);
+      push_score = FindCtrValue(
+          dynamic_cast<MemorySparseTable *>(one_push_table.get()), shard_num,
+          hot_keys[0])[delta_score_idx];
+    }
+    ASSERT_GT(push_score, 0);
+    float expected = 0;
+    for (size_t i = 0; i < result.push_num; ++i) {
+      expected += push_score;
+    }
+    for (uint64_t key : hot_keys) {
+      ASSERT_EQ(FindCtrValue(ctr_table, shard_num, key)[delta_score_idx],
+                expected)
+          << "key " << key << ", " << result.push_num << " pushes";
+    }
+  }
+}
+
+// the latency of the pushes while the table is shrinked in steps of 1 and
+// 64 buckets, kept out of ctest, run it with
+// --gtest_also_run_disabled_tests
+TEST(MemorySparseTable, DISABLED_StreamingShrinkBenchmark) {
+  google::FlagSaver flag_saver;
+  int shard_num = 10;
+  const int emb_dim = 8;
+  size_t key_num = FLAGS_sparse_table_bench_key_num;
+  std::vector<uint64_t> hot_keys(1000);
+  for (size_t i = 0; i < hot_keys.size(); ++i) {
+    hot_keys[i] = i;
+  }
+  for (int step_bucket_num : {1, 64}) {
+    FLAGS_pserver_shrink_bucket_num_per_step = step_bucket_num;
+    std::unique_ptr<Table> table(CreateCtrTable(shard_num));
+    FillCtrTable(table.get(), key_num);
+    MemorySparseTable *ctr_table =
+        dynamic_cast<MemorySparseTable *>(table.get());
+    size_t pool_bytes = FeatureRowPool::MemorySize();
+    auto result = RunStreamingShrink(table.get(), hot_keys, emb_dim);
+    auto stat = ctr_table->GetShrinkStat();
+    LOG(INFO) << "MemorySparseTable shrink of " << key_num << " keys, "
+              << step_bucket_num << " buckets per step: " << result.shrink_ms
+              << " ms, " << result.push_num << " pushes, max push latency "
+              << result.max_push_ms << " ms, reclaimed "
+              << stat.reclaimed_bytes << " bytes, row pool "
+              << pool_bytes << " -> " << FeatureRowPool::MemorySize()
+              << " bytes";
+  }
+}
+
+TEST(SparseWireCodec, RoundTrip) {
+  const size_t dim = 12;
+  const size_t exact_dim = 3;
+  std::vector<float> value(dim);
+  for (size_t i = 0; i < dim; ++i) {
+    value[i] = (i % 2 ? -0.1 : 0.1) * (i + 1) / 3;
+  }
+  value[1] = 123457;  // show, kept exact
+  // max error relative to the max abs of the coded values
+  std::map<int, float> max_error = {{kSparseWireFp32, 0},
+                                    {kSparseWireFp16, 1e-3},
+                                    {kSparseWireBf16, 5e-3},
+                                    {kSparseWireInt8, 5e-3}};
+  std::map<int, size_t> row_size = {{kSparseWireFp32, 48},
+                                    {kSparseWireFp16, 30},
+                                    {kSparseWireBf16, 30},
+                                    {kSparseWireInt8, 25}};
+  for (auto &it : max_error) {
+    int type = it.first;
+    ASSERT_EQ(SparseWireRowSize(type, exact_dim, dim), row_size[type]);
+    std::vector<char> wire(row_size[type]);
+    std::vector<float> decoded(dim);
+    SparseWireEncode(type, exact_dim, dim, value.data(), wire.data());
+    SparseWireDecode(type, exact_dim, dim, wire.data(), decoded.data());
+    for (size_t i = 0; i < exact_dim; ++i) {
+      ASSERT_EQ(decoded[i], value[i]);
+    }
+    for (size_t i = exact_dim; i < dim; ++i) {
+      ASSERT_NEAR(decoded[i], value[i], it.second * 0.4) << type;
+    }
+  }
+  ASSERT_FALSE(IsValidSparseWireType(4));
+}
+
+// pushes of rows in a wire type update the table as the fp32 ones, up to the
+// precision of the type
+TEST(MemorySparseTable, WirePush) {
+  const size_t emb_dim = 8;
+  const size_t update_dim = emb_dim + 4;
+  const size_t select_dim = emb_dim + 3;
+  const size_t key_num = 1000;
+  std::vector<uint64_t> keys(key_num);
+  std::vector<uint32_t> fres(key_num, 1);
+  for (size_t i = 0; i < key_num; ++i) {
+    keys[i] = i * 7;
+  }
+  // slot, show, click, embed_g, embedx_g, the first push creates the embedx
+  std::vector<float> grads(key_num * update_dim);
+  for (size_t i = 0; i < grads.size(); ++i) {
+    grads[i] = 0.05 + 0.1 * (i % 11) / 10;
+  }
+  for (size_t i = 0; i < key_num; ++i) {
+    grads[i * update_dim + 1] = 100;
+    grads[i * update_dim + 2] = 10;
+  }
+  auto push = [&](Table *table, int wire_type) {
+    size_t row_size = SparseWireRowSize(wire_type, 3, update_dim);
+    std::vector<char> wire(key_num * row_size);
+    for (size_t i = 0; i < key_num; ++i) {
+      SparseWireEncode(wire_type, 3, update_dim, grads.data() + i * update_dim,
+                       wire.data() + i * row_size);
+    }
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.push_context.keys = keys.data();
+    table_context.push_context.wire_values = wire.data();
+    table_context.push_context.wire_type = wire_type;
+    table_context.num = key_num;
+    ASSERT_EQ(table->Push(table_context), 0);
+  };
+  auto pull = [&](Table *table) {
+    std::vector<float> values(key_num * select_dim);
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.pull_context.pull_value =
+        PullSparseValue(keys, fres, select_dim);
+    table_context.pull_context.values = values.data();
+    table->Pull(table_context);
+    return values;
+  };
+
+  for (int type = kSparseWireFp32; type <= kSparseWireInt8; ++type) {
+    // the initial weights are random, compare the updates of the tables
+    std::vector<std::vector<float>> deltas;
+    std::vector<std::vector<float>> values;
+    for (int wire_type : {static_cast<int>(kSparseWireFp32), type}) {
+      Table *table = CreateCtrTable(10);
+      push(table, wire_type);
+      auto before = pull(table);
+      push(table, wire_type);
+      auto after = pull(table);
+      for (size_t i = 0; i < after.size(); ++i) {
+        before[i] = after[i] - before[i];
+      }
+      deltas.push_back(before);
+      values.push_back(after);
+      delete table;
+    }
+    for (size_t i = 0; i < key_num * select_dim; ++i) {
+      if (i % select_dim < 2) {
+        // show and click are sent exactly
+        ASSERT_EQ(values[0][i], values[1][i]);
+      } else {
+        ASSERT_NEAR(deltas[0][i], deltas[1][i], 2e-4) << type;
+      }
+    }
+  }
+}
+
 }  // namespace distributed
 }  // namespace paddle
@@ -0,0 +1,154 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/service/sparse_key_router.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+// batch of key_num keys, about dup_ratio of them repeat an earlier key
+static std::vector<uint64_t> MakeBatch(size_t key_num, double dup_ratio,
+                                       uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<uint64_t> keys;
+  keys.reserve(key_num);
+  std::uniform_real_distribution<double> dist(0, 1);
+  for (size_t i = 0; i < key_num; ++i) {
+    if (!keys.empty() && dist(rng) < dup_ratio) {
+      keys.push_back(keys[rng() % keys.size()]);
+    } else {
+      keys.push_back(rng());
+    }
+  }
+  return keys;
+}
+
+TEST(SparseKeyRouter, RouteAndScatter) {
+  const size_t shard_num = 7;
+  const size_t dim = 3;
+  auto shard_of = [](uint64_t key) { return key % shard_num; };
+  SparseKeyRouter router;
+  for (int round = 0; round < 3; ++round) {
+    auto keys = MakeBatch(10000, 0.6, round);
+    std::vector<float> outputs(keys.size() * dim, -1);
+    router.Clear();
+    for (size_t i = 0; i < keys.size(); ++i) {
+      router.Add(keys[i], outputs.data() + i * dim);
+    }
+    router.Route(shard_num, shard_of);
+
+    std::set<uint64_t> unique_keys(keys.begin(), keys.end());
+    ASSERT_EQ(router.UniqueNum(), unique_keys.size());
+    ASSERT_EQ(router.ShardNum(), shard_num);
+    size_t count_sum = 0;
+    std::set<uint64_t> routed_keys;
+    for (size_t shard = 0; shard < shard_num; ++shard) {
+      size_t begin = router.ShardBegin(shard);
+      for (size_t pos = begin; pos < begin + router.ShardSize(shard); ++pos) {
+        uint64_t key = router.RoutedKeys()[pos];
+        ASSERT_EQ(shard_of(key), shard);
+        ASSERT_EQ(router.RoutedCounts()[pos],
+                  std::count(keys.begin(), keys.end(), key));
+        count_sum += router.RoutedCounts()[pos];
+        routed_keys.insert(key);
+      }
+    }
+    ASSERT_EQ(count_sum, keys.size());
+    ASSERT_EQ(routed_keys, unique_keys);
+
+    // the value of a key is its low bits
+    float **value_ptrs = router.RoutedValuePtrs(dim);
+    for (size_t pos = 0; pos < router.UniqueNum(); ++pos) {
+      for (size_t j = 0; j < dim; ++j) {
+        value_ptrs[pos][j] = (router.RoutedKeys()[pos] & 0xffff) + j;
+      }
+    }
+    router.Scatter(dim);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      for (size_t j = 0; j < dim; ++j) {
+        ASSERT_EQ(outputs[i * dim + j], (keys[i] & 0xffff) + j);
+      }
+    }
+  }
+}
+
+// compare with the per-shard vectors sorted to find the repeated keys, kept
+// out of ctest, run it with --gtest_also_run_disabled_tests
+TEST(SparseKeyRouter, DISABLED_Benchmark) {
+  const size_t shard_num = 16;
+  const size_t key_num = 1000000;
+  const size_t dim = 8;
+  auto shard_of = [](uint64_t key) { return key % shard_num; };
+  auto keys = MakeBatch(key_num, 0.55, 0);
+  std::vector<float> outputs(key_num * dim);
+  std::vector<float *> output_ptrs(key_num);
+  for (size_t i = 0; i < key_num; ++i) {
+    output_ptrs[i] = outputs.data() + i * dim;
+  }
+  const int rounds = 5;
+
+  auto start = std::chrono::steady_clock::now();
+  size_t sorted_unique_num = 0;
+  for (int round = 0; round < rounds; ++round) {
+    std::vector<std::vector<std::pair<uint64_t, float *>>> shard_kvs(
+        shard_num);
+    for (size_t i = 0; i < key_num; ++i) {
+      shard_kvs[shard_of(keys[i])].push_back({keys[i], output_ptrs[i]});
+    }
+    sorted_unique_num = 0;
+    for (auto &kvs : shard_kvs) {
+      std::sort(kvs.begin(), kvs.end(),
+                [](const std::pair<uint64_t, float *> &k1,
+                   const std::pair<uint64_t, float *> &k2) {
+                  return k1.first < k2.first;
+                });
+      for (size_t i = 0; i < kvs.size(); ++i) {
+        sorted_unique_num += i == 0 || kvs[i].first != kvs[i - 1].first;
+      }
+    }
+  }
+  auto sort_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  SparseKeyRouter router;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    router.Clear();
+    for (size_t i = 0; i < key_num; ++i) {
+      router.Add(keys[i], output_ptrs[i]);
+    }
+    router.Route(shard_num, shard_of);
+  }
+  auto route_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  ASSERT_EQ(router.UniqueNum(), sorted_unique_num);
+  LOG(INFO) << "SparseKeyRouter " << key_num << " keys, "
+            << router.UniqueNum() << " unique: route " << route_ms / rounds
+            << " ms, sort by shard " << sort_ms / rounds << " ms";
+}
+
+}  // namespace distributed
+}  // namespace paddle
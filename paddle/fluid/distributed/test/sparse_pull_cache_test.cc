@@ -0,0 +1,224 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/service/sparse_pull_cache.h"
+
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/service/env.h"
+#include "paddle/fluid/distributed/ps/service/ps_client.h"
+#include "paddle/fluid/distributed/ps/service/server.h"
+
+DECLARE_int32(pserver_client_sparse_cache_capacity);
+DECLARE_int32(pserver_client_sparse_cache_staleness_steps);
+
+namespace paddle {
+namespace distributed {
+
+TEST(SparsePullCache, StalenessAndInvalidate) {
+  const size_t value_num = 4;
+  SparsePullCache cache(64, 3, value_num * sizeof(float));
+  uint64_t key = 7;
+  std::vector<float> value(value_num, 1.0);
+  std::vector<float> out(value_num, 0.0);
+  float* out_ptr = out.data();
+  std::vector<size_t> miss_idx;
+
+  // a key seen once is not admitted
+  uint64_t step = cache.NextStep();
+  cache.Lookup(&key, 1, &out_ptr, step, &miss_idx);
+  ASSERT_EQ(miss_idx.size(), 1u);
+  cache.Put(key, value.data(), step);
+  ASSERT_EQ(cache.Size(), 0u);
+
+  miss_idx.clear();
+  step = cache.NextStep();
+  cache.Lookup(&key, 1, &out_ptr, step, &miss_idx);
+  ASSERT_EQ(miss_idx.size(), 1u);
+  cache.Put(key, value.data(), step);
+  ASSERT_EQ(cache.Size(), 1u);
+
+  // served in the 3 steps from the pull, then missed
+  uint64_t put_step = step;
+  for (int i = 1; i <= 3; ++i) {
+    miss_idx.clear();
+    step = cache.NextStep();
+    cache.Lookup(&key, 1, &out_ptr, step, &miss_idx);
+    ASSERT_EQ(miss_idx.size(), step < put_step + 3 ? 0u : 1u);
+  }
+  ASSERT_EQ(out[0], 1.0);
+
+  value[0] = 2.0;
+  cache.Put(key, value.data(), step);
+  cache.Invalidate();
+  ASSERT_EQ(cache.Size(), 0u);
+  // a pull started before Invalidate is not cached
+  cache.Put(key, value.data(), step);
+  ASSERT_EQ(cache.Size(), 0u);
+
+  auto stat = cache.GetStat();
+  ASSERT_EQ(stat.lookup_num, 5u);
+  ASSERT_EQ(stat.hit_num, 2u);
+  ASSERT_EQ(stat.request_bytes, 5 * (12 + value_num * sizeof(float)));
+}
+
+// keep the capacity most frequent keys
+TEST(SparsePullCache, KeepHotKeys) {
+  const size_t capacity = 1024;
+  SparsePullCache cache(capacity, 1000, sizeof(float));
+  std::vector<float> values(1, 0.0);
+  std::vector<float*> value_ptrs(1, values.data());
+  std::vector<size_t> miss_idx;
+  std::mt19937_64 rng(0);
+  for (int round = 0; round < 20; ++round) {
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; key < capacity / 2; ++key) {
+      keys.push_back(key);
+    }
+    for (size_t i = 0; i < capacity * 4; ++i) {
+      keys.push_back(capacity + rng() % 1000000);
+    }
+    value_ptrs.resize(keys.size(), values.data());
+    uint64_t step = cache.NextStep();
+    miss_idx.clear();
+    cache.Lookup(keys.data(), keys.size(), value_ptrs.data(), step,
+                 &miss_idx);
+    for (auto i : miss_idx) {
+      cache.Put(keys[i], values.data(), step);
+    }
+  }
+  ASSERT_LE(cache.Size(), capacity + capacity / 4);
+  uint64_t step = cache.NextStep();
+  std::vector<uint64_t> hot_keys;
+  for (uint64_t key = 0; key < capacity / 2; ++key) {
+    hot_keys.push_back(key);
+  }
+  miss_idx.clear();
+  cache.Lookup(hot_keys.data(), hot_keys.size(), value_ptrs.data(), step,
+               &miss_idx);
+  ASSERT_EQ(miss_idx.size(), 0u);
+}
+
+static void GetSparseTableProto(TableParameter* table_proto) {
+  table_proto->set_table_id(0);
+  table_proto->set_table_class("MemorySparseTable");
+  table_proto->set_shard_num(10);
+  table_proto->set_type(PS_SPARSE_TABLE);
+  auto* accessor_config = table_proto->mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(11);
+  accessor_config->set_embedx_dim(8);
+  accessor_config->set_embedx_threshold(5);
+  accessor_config->mutable_embed_sgd_param()->set_name("SparseAdaGradSGDRule");
+  accessor_config->mutable_embed_sgd_param()
+      ->mutable_adagrad()
+      ->set_learning_rate(0.1);
+  accessor_config->mutable_embedx_sgd_param()->set_name(
+      "SparseAdaGradSGDRule");
+  accessor_config->mutable_embedx_sgd_param()
+      ->mutable_adagrad()
+      ->set_learning_rate(0.1);
+}
+
+static std::shared_ptr<PSClient> CreateLocalClient() {
+  PSParameter ps_proto;
+  auto* downpour_server_proto =
+      ps_proto.mutable_server_param()->mutable_downpour_server_param();
+  auto* service_proto = downpour_server_proto->mutable_service_param();
+  service_proto->set_server_class("PsLocalServer");
+  service_proto->set_client_class("PsLocalClient");
+  GetSparseTableProto(downpour_server_proto->add_downpour_table_param());
+
+  static PaddlePSEnvironment ps_env;
+  std::shared_ptr<PSServer> server(PSServerFactory::Create(ps_proto));
+  EXPECT_TRUE(server != nullptr);
+  std::shared_ptr<PSClient> client(PSClientFactory::Create(ps_proto));
+  std::map<uint64_t, std::vector<Region>> dense_regions;
+  client->Configure(ps_proto, dense_regions, ps_env, 0);
+  return client;
+}
+
+// the hot keys of every minibatch are served by the cache, the values equal
+// the ones of the table until a push, and are refreshed after the staleness
+TEST(SparsePullCache, PsLocalClient) {
+  FLAGS_pserver_client_sparse_cache_capacity = 10000;
+  FLAGS_pserver_client_sparse_cache_staleness_steps = 10;
+  auto client = CreateLocalClient();
+  FLAGS_pserver_client_sparse_cache_capacity = 0;
+  auto* cache = client->GetSparsePullCache(0);
+  ASSERT_TRUE(cache != NULL);
+
+  const size_t select_dim = 3 + 8;
+  const size_t hot_key_num = 1000;
+  const size_t batch_size = 2000;
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(batch_size);
+  std::vector<float> values(batch_size * select_dim);
+  std::vector<float*> value_ptrs(batch_size);
+  for (size_t i = 0; i < batch_size; ++i) {
+    value_ptrs[i] = values.data() + i * select_dim;
+  }
+  // half of every minibatch is the hot keys, the rest rarely repeats
+  auto pull_batch = [&]() {
+    for (size_t i = 0; i < batch_size; ++i) {
+      keys[i] = i < hot_key_num ? i : hot_key_num + rng() % 100000000;
+    }
+    client->PullSparse(value_ptrs.data(), 0, keys.data(), batch_size, true)
+        .wait();
+  };
+  for (int step = 0; step < 100; ++step) {
+    pull_batch();
+  }
+  auto stat = cache->GetStat();
+  LOG(INFO) << "SparsePullCache hit ratio " << stat.HitRatio()
+            << ", bytes sent " << stat.sent_bytes << " of "
+            << stat.request_bytes;
+  ASSERT_GT(stat.HitRatio(), 0.35);
+  ASSERT_LT(stat.sent_bytes, stat.request_bytes * 0.65);
+
+  std::vector<float> cached(values.begin(), values.begin() + select_dim);
+  cache->Invalidate();
+  pull_batch();
+  for (size_t i = 0; i < select_dim; ++i) {
+    ASSERT_EQ(values[i], cached[i]);
+  }
+
+  // push to hot key 0, the stale value is served until it expires
+  std::vector<float> grad(4 + 8, 0.5);
+  const float* grad_ptr = grad.data();
+  uint64_t key = 0;
+  client->PushSparse(0, &key, &grad_ptr, 1).wait();
+  pull_batch();
+  for (size_t i = 0; i < select_dim; ++i) {
+    ASSERT_EQ(values[i], cached[i]);
+  }
+  for (int step = 0; step < FLAGS_pserver_client_sparse_cache_staleness_steps;
+       ++step) {
+    pull_batch();
+  }
+  ASSERT_NE(values[2], cached[2]);
+
+  client->Clear(0).wait();
+  ASSERT_EQ(cache->Size(), 0u);
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,298 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/table/depends/frequency_sketch.h"
+#include "paddle/fluid/distributed/ps/table/table.h"
+
+DEFINE_int64(ssd_table_bench_key_num, 200000,
+             "key num written to rocksdb in the multi get benchmark");
+DEFINE_int32(ssd_table_bench_batch_size, 1000,
+             "keys looked up per batch in the multi get benchmark");
+DECLARE_string(rocksdb_path);
+DECLARE_uint64(pserver_ssd_table_mem_capacity);
+
+namespace paddle {
+namespace distributed {
+
+static const int kEmbDim = 8;
+
+static std::shared_ptr<SSDSparseTable> CreateSSDTable(int shard_num) {
+  TableParameter table_config;
+  table_config.set_table_class("SSDSparseTable");
+  table_config.set_shard_num(shard_num);
+  FsClientParameter fs_config;
+  std::shared_ptr<SSDSparseTable> table(new SSDSparseTable());
+  table->SetShard(0, 1);
+
+  TableAccessorParameter *accessor_config = table_config.mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(kEmbDim + 3);
+  accessor_config->set_embedx_dim(kEmbDim);
+  accessor_config->set_embedx_threshold(5);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.2);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_base_threshold(0.5);
+  ctr_param->set_delta_threshold(0.2);
+  ctr_param->set_delta_keep_days(16);
+  ctr_param->set_show_click_decay_rate(0.99);
+
+  for (auto *sgd_param : {accessor_config->mutable_embed_sgd_param(),
+                          accessor_config->mutable_embedx_sgd_param()}) {
+    sgd_param->set_name("SparseNaiveSGDRule");
+    auto *naive_param = sgd_param->mutable_naive();
+    naive_param->set_learning_rate(0.1);
+    naive_param->set_initial_range(0.3);
+    naive_param->add_weight_bounds(-10.0);
+    naive_param->add_weight_bounds(10.0);
+  }
+
+  EXPECT_EQ(table->Initialize(table_config, fs_config), 0);
+  return table;
+}
+
+static void PullKeys(Table *table, const std::vector<uint64_t> &keys,
+                     std::vector<float> *values) {
+  std::vector<uint32_t> fres(keys.size(), 1);
+  values->resize(keys.size() * (kEmbDim + 3));
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.pull_context.pull_value =
+      PullSparseValue(keys, fres, kEmbDim);
+  table_context.pull_context.values = values->data();
+  ASSERT_EQ(table->Pull(table_context), 0);
+}
+
+static void PushKeys(Table *table, const std::vector<uint64_t> &keys) {
+  // slot, show, click, embed_g, embedx_g
+  std::vector<float> grads(keys.size() * (kEmbDim + 4), 0.1);
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.push_context.keys = keys.data();
+  table_context.push_context.values = grads.data();
+  table_context.num = keys.size();
+  ASSERT_EQ(table->Push(table_context), 0);
+}
+
+TEST(FrequencySketch, HotAndCold) {
+  FrequencySketch sketch(1024);
+  for (int i = 0; i < 10; ++i) {
+    sketch.Increment(42);
+  }
+  sketch.Increment(7);
+  ASSERT_GE(sketch.Frequency(42), 10u);
+  ASSERT_LT(sketch.Frequency(7), sketch.Frequency(42));
+  for (int i = 0; i < 100; ++i) {
+    sketch.Increment(42);
+  }
+  ASSERT_EQ(sketch.Frequency(42), FrequencySketch::MAX_FREQUENCY);
+  sketch.Reset();
+  ASSERT_EQ(sketch.Frequency(42), FrequencySketch::MAX_FREQUENCY / 2);
+}
+
+TEST(SSDSparseTable, Tiering) {
+  const int shard_num = 10;
+  const uint64_t capacity = 1000;
+  FLAGS_rocksdb_path =
+      "/tmp/ssd_sparse_table_test_" + std::to_string(getpid());
+  FLAGS_pserver_ssd_table_mem_capacity = capacity;
+  auto table = CreateSSDTable(shard_num);
+
+  // hot keys are accessed often
+  std::vector<uint64_t> hot_keys;
+  for (uint64_t key = 0; key < 200; ++key) {
+    hot_keys.push_back(key);
+  }
+  std::vector<float> hot_values;
+  for (int i = 0; i < 5; ++i) {
+    PullKeys(table.get(), hot_keys, &hot_values);
+    PushKeys(table.get(), hot_keys);
+  }
+  PullKeys(table.get(), hot_keys, &hot_values);
+
+  // a stream of cold keys much larger than the memory capacity
+  std::vector<uint64_t> cold_keys;
+  std::vector<float> cold_values;
+  for (uint64_t key = 1000; key < 1000 + 20 * capacity; ++key) {
+    cold_keys.push_back(key);
+    if (cold_keys.size() == 500) {
+      PullKeys(table.get(), cold_keys, &cold_values);
+      PushKeys(table.get(), cold_keys);
+      cold_keys.clear();
+    }
+  }
+  table->Flush();
+  ASSERT_LE(table->LocalSize(), static_cast<int64_t>(capacity));
+
+  // values demoted to rocksdb are pulled back unchanged
+  std::vector<float> values;
+  PullKeys(table.get(), hot_keys, &values);
+  ASSERT_EQ(values, hot_values);
+
+  // pushing to keys in rocksdb updates them
+  PushKeys(table.get(), hot_keys);
+  PullKeys(table.get(), hot_keys, &values);
+  ASSERT_NE(values, hot_values);
+  table->PrintTableStat();
+
+  table.reset();
+  FLAGS_pserver_ssd_table_mem_capacity = 0;
+  std::string rm_cmd = "rm -rf " + FLAGS_rocksdb_path;
+  system(rm_cmd.c_str());
+}
+
+static std::set<uint64_t> MemKeys(SSDSparseTable *table) {
+  auto *shard = static_cast<SSDSparseTable::shard_type *>(table->GetShard(0));
+  std::set<uint64_t> keys;
+  for (auto it = shard->begin(); it != shard->end(); ++it) {
+    keys.insert(it.key());
+  }
+  return keys;
+}
+
+// once all the counters are saturated the keys in rocksdb are still admitted
+TEST(SSDSparseTable, SaturatedSketch) {
+  const uint64_t capacity = 100;
+  FLAGS_rocksdb_path =
+      "/tmp/ssd_sparse_table_saturated_test_" + std::to_string(getpid());
+  FLAGS_pserver_ssd_table_mem_capacity = capacity;
+  auto table = CreateSSDTable(1);
+
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 2 * capacity; ++key) {
+    keys.push_back(key);
+  }
+  std::vector<float> values;
+  for (uint32_t round = 0; round < FrequencySketch::MAX_FREQUENCY + 2;
+       ++round) {
+    PullKeys(table.get(), keys, &values);
+    table->Flush();
+  }
+  auto mem_keys = MemKeys(table.get());
+  ASSERT_LE(mem_keys.size(), capacity);
+
+  // the hot keys in rocksdb are promoted and demote others in turn
+  PullKeys(table.get(), keys, &values);
+  table->Flush();
+  ASSERT_NE(MemKeys(table.get()), mem_keys);
+
+  table.reset();
+  FLAGS_pserver_ssd_table_mem_capacity = 0;
+  std::string rm_cmd = "rm -rf " + FLAGS_rocksdb_path;
+  system(rm_cmd.c_str());
+}
+
+// the time of single gets and of sorted multi_gets of cold keys, kept out
+// of ctest, run it with --gtest_also_run_disabled_tests
+TEST(SSDSparseTable, DISABLED_MultiGetBenchmark) {
+  const int value_dim = kEmbDim + 10;
+  const int64_t key_num = FLAGS_ssd_table_bench_key_num;
+  const int batch_size = FLAGS_ssd_table_bench_batch_size;
+  std::string path =
+      "/tmp/ssd_sparse_table_bench_" + std::to_string(getpid());
+  RocksDBHandler db;
+  db.initialize(path, 1);
+
+  std::vector<uint64_t> keys(batch_size);
+  std::vector<float> values(batch_size * value_dim);
+  std::vector<std::pair<char *, int>> ssd_keys(batch_size);
+  std::vector<std::pair<char *, int>> ssd_values(batch_size);
+  for (int64_t start = 0; start < key_num; start += batch_size) {
+    int n = std::min<int64_t>(batch_size, key_num - start);
+    for (int i = 0; i < n; ++i) {
+      keys[i] = start + i;
+      std::fill_n(values.data() + i * value_dim, value_dim, keys[i]);
+      ssd_keys[i] = {(char *)&keys[i], sizeof(uint64_t)};  // NOLINT
+      ssd_values[i] = {(char *)(values.data() + i * value_dim),  // NOLINT
+                       value_dim * sizeof(float)};
+    }
+    db.put_batch(0, ssd_keys, ssd_values, n);
+  }
+  // read from sst files as after a restart
+  db.flush(0);
+
+  // cold keys arrive in random order, some are missing
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> pull_keys(key_num / 10);
+  for (auto &key : pull_keys) {
+    key = rng() % (key_num + key_num / 10);
+  }
+
+  std::string value;
+  int64_t found = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (auto key : pull_keys) {
+    if (db.get(0, (char *)&key, sizeof(uint64_t), value) == 0) {  // NOLINT
+      ++found;
+      ASSERT_EQ(*(const float *)value.data(), static_cast<float>(key));
+    }
+  }
+  double get_ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+
+  int64_t multi_found = 0;
+  std::vector<rocksdb::Slice> slices;
+  std::vector<rocksdb::PinnableSlice> pinned(batch_size);
+  std::vector<int> status(batch_size);
+  begin = std::chrono::steady_clock::now();
+  for (size_t start = 0; start < pull_keys.size(); start += batch_size) {
+    size_t n = std::min<size_t>(batch_size, pull_keys.size() - start);
+    std::vector<uint64_t> batch(pull_keys.begin() + start,
+                                pull_keys.begin() + start + n);
+    std::sort(batch.begin(), batch.end(), [](uint64_t a, uint64_t b) {
+      return memcmp(&a, &b, sizeof(uint64_t)) < 0;
+    });
+    slices.clear();
+    for (auto &key : batch) {
+      slices.emplace_back((const char *)&key, sizeof(uint64_t));  // NOLINT
+    }
+    db.multi_get(0, n, slices.data(), pinned.data(), status.data(), true);
+    for (size_t i = 0; i < n; ++i) {
+      if (status[i] == 0) {
+        ++multi_found;
+        ASSERT_EQ(*(const float *)pinned[i].data(),  // NOLINT
+                  static_cast<float>(batch[i]));
+      }
+      pinned[i].Reset();
+    }
+  }
+  double multi_get_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - begin)
+                            .count();
+  ASSERT_EQ(found, multi_found);
+  LOG(INFO) << "rocksdb lookup of " << pull_keys.size() << " keys, found "
+            << found << ": get " << get_ms << " ms, sorted multi_get "
+            << multi_get_ms << " ms, batch size " << batch_size;
+
+  std::string rm_cmd = "rm -rf " + path;
+  system(rm_cmd.c_str());
+}
+
+}  // namespace distributed
+}  // namespace paddle
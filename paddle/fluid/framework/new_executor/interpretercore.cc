@@ -14,6 +14,7 @@
 
 #include "paddle/fluid/framework/new_executor/interpretercore.h"
 
+#include <algorithm>
 #include <unordered_set>
 
 #include "paddle/fluid/framework/details/nan_inf_utils.h"
@@ -34,6 +35,9 @@ PADDLE_DEFINE_EXPORTED_bool(new_executor_use_inplace, true,
 PADDLE_DEFINE_EXPORTED_bool(new_executor_use_local_scope, true,
                             "Use local_scope in new executor(especially used "
                             "in UT), can turn off for better performance");
+PADDLE_DEFINE_EXPORTED_bool(new_executor_use_priority, true,
+                            "Run the ready ops on the longest remaining chain "
+                            "first in new executor");
 
 DECLARE_bool(check_nan_inf);
 DECLARE_bool(benchmark);
@@ -218,6 +222,57 @@ void InterpreterCore::BuildOperatorDependences() {
       dependecy_count_[inst_id]++;
     }
   }
+  BuildOperatorPriority(op2downstream);
+}
+
+void InterpreterCore::BuildOperatorPriority(
+    const std::map<int, std::list<int>>& op2downstream) {
+  // the cost of an op is estimated by the elements of the tensors it reads
+  // and writes, as they were in the run that built the instructions. The
+  // dims are kept when that run frees the memory of a tensor, so they are
+  // read whether the tensor is initialized or not.
+  auto numel = [this](int var_id) -> size_t {
+    auto* var = global_scope_->Var(var_id);
+    if (var == nullptr) return 0;
+    const phi::DenseTensor* tensor = nullptr;
+    if (var->IsType<LoDTensor>()) {
+      tensor = &var->Get<LoDTensor>();
+    } else if (var->IsType<phi::SelectedRows>()) {
+      tensor = &var->Get<phi::SelectedRows>().value();
+    }
+    return tensor == nullptr ? 0 : std::max<int64_t>(tensor->numel(), 0);
+  };
+  // an op only depends on ops before it, so the chains are summed up from
+  // the last op
+  auto op_nums = vec_instruction_.size();
+  op_priority_.assign(op_nums, 0);
+  for (size_t op = op_nums; op-- > 0;) {
+    size_t cost = 1;
+    for (auto* vars : {&vec_instruction_[op].Inputs(),
+                       &vec_instruction_[op].Outputs()}) {
+      for (auto& item : *vars) {
+        for (auto var_id : item.second) {
+          cost += numel(var_id);
+        }
+      }
+    }
+    size_t longest_downstream = 0;
+    auto iter = op2downstream.find(static_cast<int>(op));
+    if (iter != op2downstream.end()) {
+      for (auto next_op : iter->second) {
+        longest_downstream =
+            std::max(longest_downstream, op_priority_[next_op]);
+      }
+    }
+    op_priority_[op] = cost + longest_downstream;
+  }
+}
+
+void InterpreterCore::SortByPriority(std::vector<size_t>* op_ids) const {
+  if (!FLAGS_new_executor_use_priority || op_ids->size() < 2) return;
+  std::stable_sort(op_ids->begin(), op_ids->end(), [this](size_t a, size_t b) {
+    return op_priority_[a] > op_priority_[b];
+  });
 }
 
 void InterpreterCore::Convert(
@@ -585,16 +640,21 @@ void InterpreterCore::ExecuteInstructionList(
 
   exception_holder_.Clear();
 
+  std::vector<size_t> first_ops;
   for (size_t i = 0; i < dependecy_count_.size(); ++i) {
     if (dependecy_count_[i] == 0) {
-      async_work_queue_->AddTask(vec_instr.at(i).KernelType(),
-                                 [this, i, atomic_deps = atomic_deps.get(),
-                                  atomic_var_ref = atomic_var_ref.get()] {
-                                   RunInstructionAsync(i, atomic_deps,
-                                                       atomic_var_ref);
-                                 });
+      first_ops.push_back(i);
     }
   }
+  SortByPriority(&first_ops);
+  for (auto i : first_ops) {
+    async_work_queue_->AddTask(vec_instr.at(i).KernelType(),
+                               [this, i, atomic_deps = atomic_deps.get(),
+                                atomic_var_ref = atomic_var_ref.get()] {
+                                 RunInstructionAsync(i, atomic_deps,
+                                                     atomic_var_ref);
+                               });
+  }
 
   auto event_name = main_thread_blocker_.WaitEvent();
   VLOG(1) << "event_name: " << event_name;
@@ -630,59 +690,53 @@ void InterpreterCore::RunNextInstructions(
             << ", remain deps: " << (*atomic_deps)[next_id];
     return (*atomic_deps)[next_id].fetch_sub(1, std::memory_order_relaxed) == 1;
   };
+  // the ready ones of ids, the highest priority first
+  auto ReadyOps = [this, &IsReady](const std::vector<size_t>& ids) {
+    std::vector<size_t> ready_ops;
+    for (auto next_id : ids) {
+      if (IsReady(next_id)) {
+        ready_ops.push_back(next_id);
+      }
+    }
+    SortByPriority(&ready_ops);
+    return ready_ops;
+  };
+  auto AddTask = [this, atomic_deps, atomic_var_ref](size_t next_id) {
+    async_work_queue_->AddTask(
+        vec_instruction_[next_id].KernelType(),
+        [this, next_id, atomic_deps, atomic_var_ref] {
+          RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
+        });
+  };
 
   if (instr.KernelType() == OpFuncType::kQueueAsync) {
     // move all sync_ops into other threads
-    for (auto next_id : next_instr.SyncRunIds()) {
-      if (IsReady(next_id)) {
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref]() {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
-      }
+    for (auto next_id : ReadyOps(next_instr.SyncRunIds())) {
+      AddTask(next_id);
     }
     // keep all async_ops running in current thread
-    for (auto next_id : next_instr.DirectRunIds()) {
-      if (IsReady(next_id)) {
-        reserved_next_ops->push(next_id);
-      }
-    }
-    for (auto next_id : next_instr.EventRunIds()) {
-      if (IsReady(next_id)) {
-        reserved_next_ops->push(next_id);
-      }
+    auto async_run_ops = interpreter::merge_vector(next_instr.DirectRunIds(),
+                                                   next_instr.EventRunIds());
+    for (auto next_id : ReadyOps(async_run_ops)) {
+      reserved_next_ops->push(next_id);
     }
   } else {
     // move async_ops into async_thread
-    for (auto next_id : next_instr.EventRunIds()) {
-      if (IsReady(next_id)) {
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref] {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
-      }
+    for (auto next_id : ReadyOps(next_instr.EventRunIds())) {
+      AddTask(next_id);
     }
     auto direct_run_ops = interpreter::merge_vector(next_instr.SyncRunIds(),
                                                     next_instr.DirectRunIds());
-    size_t first_op = 0;
-    for (auto next_id : direct_run_ops) {
-      if (IsReady(next_id)) {
-        // only keep one op running in current thread
-        if (first_op == 0) {
-          first_op = next_id;
-          continue;
-        }
-        // move rest ops into other threads
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref] {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
-      }
-    }
-    if (first_op != 0) reserved_next_ops->push(first_op);
+    auto ready_ops = ReadyOps(direct_run_ops);
+    // only keep the op of the highest priority running in current thread,
+    // move rest ops into other threads. A task added by a worker is pushed
+    // to the front of its own queue and popped by the worker from the
+    // front, so the rest are added from the lowest priority up to have the
+    // next highest run first.
+    for (size_t i = ready_ops.size(); i-- > 1;) {
+      AddTask(ready_ops[i]);
+    }
+    if (!ready_ops.empty()) reserved_next_ops->push(ready_ops[0]);
   }
 }
 
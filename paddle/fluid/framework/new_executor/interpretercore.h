@@ -13,12 +13,15 @@
 // limitations under the License.
 #pragma once
 
+#include <list>
 #include <map>
 #include <queue>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <gtest/gtest_prod.h>
+
 #include "paddle/fluid/framework/details/exception_holder.h"
 #include "paddle/fluid/framework/new_executor/event_manager.h"
 #include "paddle/fluid/framework/new_executor/garbage_collector/garbage_collector.h"
@@ -56,6 +59,8 @@ class InterpreterCore {
   void SetCopyProgram(std::shared_ptr<ProgramDesc> prog);
 
  private:
+  FRIEND_TEST(InterpreterCore, priority);
+
   void Convert(std::vector<paddle::framework::OpFuncNode>* op_func_nodes);
 
   void BuildAndCacheInstructionCtx(Instruction* instr_node);
@@ -91,6 +96,12 @@ class InterpreterCore {
 
   void BuildOperatorDependences();
 
+  void BuildOperatorPriority(
+      const std::map<int, std::list<int>>& op2downstream);
+
+  // sorts op_ids by op_priority_, the highest first
+  void SortByPriority(std::vector<size_t>* op_ids) const;
+
   void SetFeedVarsInplaceSkip(const std::vector<std::string>& feed_names);
 
   void ClearLoDTensorArrayInLocalScope();
@@ -115,6 +126,9 @@ class InterpreterCore {
   std::map<size_t, std::set<size_t>> last_live_ops_;
 
   std::vector<size_t> dependecy_count_;
+  // op_priority_[i] is the estimated cost of the longest chain of ops from
+  // op[i] to the end, ready ops of a higher priority are run first
+  std::vector<size_t> op_priority_;
   std::atomic<size_t> unfinished_op_numer_{0};
   std::vector<std::vector<size_t>> input_var2op_info_;
 
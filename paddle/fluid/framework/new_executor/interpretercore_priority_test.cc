@@ -0,0 +1,103 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/new_executor/interpretercore.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/phi/core/kernel_registry.h"
+
+USE_OP_ITSELF(fill_constant);
+USE_OP_ITSELF(scale);
+PD_DECLARE_KERNEL(full, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(scale, CPU, ALL_LAYOUT);
+
+DECLARE_bool(new_executor_use_priority);
+
+namespace paddle {
+namespace framework {
+
+static void AppendFill(BlockDesc* block, const std::string& out,
+                       const std::vector<int64_t>& shape) {
+  block->Var(out)->SetType(proto::VarType::LOD_TENSOR);
+  auto* op = block->AppendOp();
+  op->SetType("fill_constant");
+  op->SetOutput("Out", {out});
+  op->SetAttr("shape", shape);
+  op->SetAttr("value", 1.0f);
+  op->SetAttr("dtype", static_cast<int>(proto::VarType::FP32));
+}
+
+static void AppendScale(BlockDesc* block, const std::string& x,
+                        const std::string& out) {
+  block->Var(out)->SetType(proto::VarType::LOD_TENSOR);
+  auto* op = block->AppendOp();
+  op->SetType("scale");
+  op->SetInput("X", {x});
+  op->SetOutput("Out", {out});
+  op->SetAttr("scale", 2.0f);
+}
+
+TEST(InterpreterCore, priority) {
+  // op 0 and 1 are a short branch on a small tensor, op 2, 3 and 4 are a
+  // longer chain on a large one, both branches are ready at the start
+  ProgramDesc program;
+  auto* block = program.MutableBlock(0);
+  AppendFill(block, "a", {1});
+  AppendScale(block, "a", "b");
+  AppendFill(block, "c", {64, 64});
+  AppendScale(block, "c", "d");
+  AppendScale(block, "d", "e");
+  block->Var("e")->SetPersistable(true);
+
+  Scope scope;
+  VariableScope var_scope(&scope);
+  InterpreterCore core(platform::CPUPlace(), *block, &var_scope);
+  // the first run builds the instructions and their priorities
+  core.Run({}, {});
+
+  auto& priority = core.op_priority_;
+  ASSERT_EQ(priority.size(), 5UL);
+  // every op costs 1 plus the elements it reads and writes, and the cost
+  // of the longest chain after it
+  EXPECT_EQ(priority[4], 1UL + 2 * 4096);
+  EXPECT_EQ(priority[3], 1UL + 2 * 4096 + priority[4]);
+  EXPECT_EQ(priority[2], 1UL + 4096 + priority[3]);
+  EXPECT_EQ(priority[1], 1UL + 2);
+  EXPECT_EQ(priority[0], 1UL + 1 + priority[1]);
+
+  // the head of the critical path is dispatched first
+  std::vector<size_t> first_ops = {0, 2};
+  core.SortByPriority(&first_ops);
+  EXPECT_EQ(first_ops, std::vector<size_t>({2, 0}));
+
+  // turning the flag off keeps the order the ops were found in
+  FLAGS_new_executor_use_priority = false;
+  first_ops = {0, 2};
+  core.SortByPriority(&first_ops);
+  EXPECT_EQ(first_ops, std::vector<size_t>({0, 2}));
+  FLAGS_new_executor_use_priority = true;
+
+  // a second run dispatches by the built priorities
+  core.Run({}, {});
+  auto& e = scope.FindVar("e")->Get<LoDTensor>();
+  ASSERT_EQ(e.numel(), 4096);
+  EXPECT_EQ(e.data<float>()[0], 4.0f);
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -1117,21 +1117,97 @@ class RuntimeInferShapeContext : public InferShapeContext {
   const RuntimeContext& ctx_;
 };
 
+// The contexts of an op whose RuntimeContext is cached, they are built at the
+// first run and reused while the inputs keep what the kernel and the data
+// transform were chosen by.
 struct OperatorWithKernel::CacheImpl {
-  explicit CacheImpl(phi::KernelContext* kernel_ctx,
-                     RuntimeInferShapeContext* infer_shape_ctx)
-      : kernel_ctx_(kernel_ctx), infer_shape_ctx_(infer_shape_ctx) {}
+  CacheImpl(phi::KernelContext* kernel_ctx,
+            RuntimeInferShapeContext* infer_shape_ctx,
+            const RuntimeContext& runtime_ctx)
+      : kernel_ctx_(kernel_ctx), infer_shape_ctx_(infer_shape_ctx) {
+    for (auto& var_name_item : runtime_ctx.inputs) {
+      for (auto* var : var_name_item.second) {
+        input_metas_.emplace_back(var);
+      }
+    }
+  }
 
   phi::KernelContext* getKernelContext() { return kernel_ctx_.get(); }
   RuntimeInferShapeContext* getRuntimeInferShapeContext() {
     return infer_shape_ctx_.get();
   }
 
+  bool InputsChanged(const RuntimeContext& runtime_ctx) const {
+    size_t i = 0;
+    for (auto& var_name_item : runtime_ctx.inputs) {
+      for (auto* var : var_name_item.second) {
+        if (i == input_metas_.size() ||
+            !input_metas_[i++].Matches(InputMeta(var))) {
+          return true;
+        }
+      }
+    }
+    return i != input_metas_.size();
+  }
+
  private:
+  struct InputMeta {
+    explicit InputMeta(const Variable* var) {
+      if (var != nullptr && VarIsTensor(*var)) {
+        type = var->Type();
+        auto* tensor = GetLoDTensorOrSelectedRowsValueFromVar(*var);
+        dtype = tensor->dtype();
+        layout = tensor->layout();
+        if (tensor->IsInitialized()) {
+          place = tensor->place();
+        }
+      }
+    }
+
+    // the place of a tensor freed by the garbage collector is unknown
+    bool Matches(const InputMeta& other) const {
+      return type == other.type && dtype == other.dtype &&
+             layout == other.layout &&
+             (other.place.GetType() == phi::AllocationType::UNDEFINED ||
+              place == other.place);
+    }
+
+    int type = -1;
+    phi::DataType dtype = phi::DataType::UNDEFINED;
+    phi::DataLayout layout = phi::DataLayout::UNDEFINED;
+    platform::Place place;
+  };
+
   std::unique_ptr<phi::KernelContext> kernel_ctx_;
   std::unique_ptr<RuntimeInferShapeContext> infer_shape_ctx_;
+  std::vector<InputMeta> input_metas_;
 };
 
+// The KernelContext keeps the tensors of the variables, so it can not be
+// reused when it holds the tensors of an array or an attribute read from an
+// input.
+static bool CanCacheKernelContext(const RuntimeContext& ctx,
+                                  const phi::KernelSignature& signature,
+                                  const AttributeMap& attrs) {
+  for (auto* var_map : {&ctx.inputs, &ctx.outputs}) {
+    for (auto& var_name_item : *var_map) {
+      for (auto* var : var_name_item.second) {
+        if (var != nullptr && !VarIsTensor(*var)) {
+          return false;
+        }
+      }
+    }
+  }
+  for (auto* attr_name : signature.attr_names) {
+    if (attrs.find(attr_name) == attrs.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+OperatorWithKernel::~OperatorWithKernel() = default;
+
 static void CheckTensorNANOrInf(const std::string& op_type,
                                 const std::string& name,
                                 const framework::Tensor& tensor) {
@@ -1266,6 +1342,7 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
       std::lock_guard<std::mutex> lock(cache_update_mutex_);
       if (runtime_ctx_.get() == nullptr || pre_scope_ != cur_scope) {
         runtime_ctx_.reset(new RuntimeContext(Inputs(), Outputs(), scope));
+        impl_.reset();
         pre_scope_ = cur_scope;
       }
     }
@@ -1289,6 +1366,23 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
   }
 #endif
 
+  // The cached contexts are shared by the runs of the op, a run keeps the
+  // ones it started with. When an input changes, the kernel is kept as on
+  // the runs without the cache, and the inputs are transformed to it.
+  std::shared_ptr<CacheImpl> cache;
+  {
+    std::lock_guard<std::mutex> lock(cache_update_mutex_);
+    if (impl_ != nullptr && runtime_ctx == runtime_ctx_.get()) {
+      if (impl_->InputsChanged(*runtime_ctx)) {
+        VLOG(4) << "Operator(" << Type() << "): inputs changed, drop the "
+                << "cached kernel context";
+        impl_.reset();
+        need_prepare_data_ = true;
+      }
+      cache = impl_;
+    }
+  }
+
   auto exe_ctx = ExecutionContext(*this, scope, *dev_ctx, *runtime_ctx);
   // using cache
   if (kernel_type_.get()) {
@@ -1308,7 +1402,8 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
   // phase
   phi::KernelKey pt_kernel_key;
   std::string pt_kernel_name;
-  if (phi::KernelFactory::Instance().HasCompatiblePhiKernel(type_)) {
+  if (cache == nullptr &&
+      phi::KernelFactory::Instance().HasCompatiblePhiKernel(type_)) {
     if (kernel_signature_ == nullptr || pt_kernel_ == nullptr) {
       kernel_signature_.reset(new phi::KernelSignature(
           std::move(GetExpectedPhiKernelArgs(exe_ctx))));
@@ -1510,8 +1605,12 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
     platform::RecordEvent record_event("infer_shape",
                                        platform::TracerEventType::OperatorInner,
                                        1, platform::EventRole::kInnerOp);
-    RuntimeInferShapeContext infer_shape_ctx(*this, *runtime_ctx);
-    this->Info().infer_shape_(&infer_shape_ctx);
+    if (cache != nullptr) {
+      this->Info().infer_shape_(cache->getRuntimeInferShapeContext());
+    } else {
+      RuntimeInferShapeContext infer_shape_ctx(*this, *runtime_ctx);
+      this->Info().infer_shape_(&infer_shape_ctx);
+    }
   }
 
   if (FLAGS_enable_unused_var_check) {
@@ -1524,13 +1623,34 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
     platform::RecordEvent record_event("compute",
                                        platform::TracerEventType::OperatorInner,
                                        1, platform::EventRole::kInnerOp);
-    if (run_phi_kernel_) {
-      phi::KernelContext pt_kernel_context;
+    if (run_phi_kernel_ && cache != nullptr) {
+      (*pt_kernel_)(cache->getKernelContext());
+    } else if (run_phi_kernel_) {
       // Do data transform before building KernelContext
       // TODO(zhiqiu): support TransferInplaceVarsBack
-      PreparePhiData(exec_scope, *pt_kernel_, *kernel_signature_, runtime_ctx);
-      BuildPhiKernelContext(*runtime_ctx, dev_ctx, &pt_kernel_context);
-      (*pt_kernel_)(&pt_kernel_context);
+      auto* phi_transfer_scope = PreparePhiData(exec_scope, *pt_kernel_,
+                                                *kernel_signature_, runtime_ctx);
+      // the KernelContext is kept only when no input is transferred, the
+      // transferred variables are created again at each run
+      if (enable_cache_runtime_context_ &&
+          runtime_ctx == runtime_ctx_.get() && !need_prepare_data_ &&
+          transfer_scope == nullptr && phi_transfer_scope == nullptr &&
+          CanCacheKernelContext(*runtime_ctx, *kernel_signature_, Attrs())) {
+        cache = std::make_shared<CacheImpl>(
+            new phi::KernelContext(),
+            new RuntimeInferShapeContext(*this, *runtime_ctx), *runtime_ctx);
+        BuildPhiKernelContext(*runtime_ctx, dev_ctx,
+                              cache->getKernelContext());
+        {
+          std::lock_guard<std::mutex> lock(cache_update_mutex_);
+          impl_ = cache;
+        }
+        (*pt_kernel_)(cache->getKernelContext());
+      } else {
+        phi::KernelContext pt_kernel_context;
+        BuildPhiKernelContext(*runtime_ctx, dev_ctx, &pt_kernel_context);
+        (*pt_kernel_)(&pt_kernel_context);
+      }
     } else {
       (*kernel_func_)(
           ExecutionContext(*this, exec_scope, *dev_ctx, *runtime_ctx));
@@ -87,7 +87,9 @@ constexpr char kNewGradSuffix[] = "@NEWGRAD@";
 /// If an Op has attribute kEnableCacheRuntimeContext, it means that in a same
 /// name scope, since the input/output names of this Op do not change in the
 /// execution, RuntimeContext could be created only at the first iteration of
-/// this Op's execution to save the elapsed time.
+/// this Op's execution to save the elapsed time. The phi KernelContext built
+/// on it is kept as well, until an input changes its dtype, layout or place,
+/// then the inputs are transformed to the kernel chosen at the first run.
 constexpr char kEnableCacheRuntimeContext[] = "@ENABLE_CACHE_RUNTIME_CONTEXT@";
 
 /// If an Op has this attribute, all its kernels should calculate output
@@ -559,6 +561,8 @@ class OperatorWithKernel : public OperatorBase {
                      const VariableNameMap& outputs, const AttributeMap& attrs)
       : OperatorBase(type, inputs, outputs, attrs) {}
 
+  virtual ~OperatorWithKernel();
+
   static paddle::flat_hash_map<std::string /* op_type */, OpKernelMap>&
   AllOpKernels() {
     static paddle::flat_hash_map<std::string, OpKernelMap> g_all_op_kernels;
@@ -649,6 +653,12 @@ class OperatorWithKernel : public OperatorBase {
     kernel_type_.reset(kernel_type);
   }
 
+  // whether the kernel context of the last run is cached, for the tests
+  bool HasCachedKernelContext() const {
+    std::lock_guard<std::mutex> lock(cache_update_mutex_);
+    return impl_ != nullptr;
+  }
+
  private:
   void RunImpl(const Scope& scope, const platform::Place& place) const final;
   void RunImpl(const Scope& scope, const platform::Place& place,
@@ -711,8 +721,9 @@ class OperatorWithKernel : public OperatorBase {
   mutable std::unique_ptr<phi::Kernel> pt_kernel_;
   mutable std::unique_ptr<phi::ArgumentMappingFn> arg_map_fn_;
 
+  // guarded by cache_update_mutex_, a run holds its own reference
   struct CacheImpl;
-  mutable CacheImpl* impl_{nullptr};
+  mutable std::shared_ptr<CacheImpl> impl_;
 };
 
 extern bool OpSupportGPU(const std::string& op_type);
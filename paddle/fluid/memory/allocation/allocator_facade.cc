@@ -23,6 +23,7 @@
 #include "paddle/fluid/memory/allocation/naive_best_fit_allocator.h"
 #include "paddle/fluid/memory/allocation/retry_allocator.h"
 #include "paddle/fluid/memory/allocation/stat_allocator.h"
+#include "paddle/fluid/memory/allocation/thread_cache_cpu_allocator.h"
 #include "paddle/fluid/platform/enforce.h"
 #include "paddle/fluid/platform/place.h"
 
@@ -94,6 +95,15 @@ PADDLE_DEFINE_EXPORTED_bool(use_cuda_managed_memory, false,
                             "managed memory, only available for auto_growth "
                             "strategy");
 
+PADDLE_DEFINE_EXPORTED_bool(use_thread_cache_cpu_allocator, false,
+                            "Whether to cache the small CPU allocations "
+                            "per thread with ThreadCacheCPUAllocator, "
+                            "available for all strategies");
+
+PADDLE_DEFINE_EXPORTED_bool(thread_cache_cpu_allocator_numa, false,
+                            "Whether ThreadCacheCPUAllocator shares the "
+                            "freed blocks only within a NUMA node");
+
 DECLARE_string(allocator_strategy);
 
 namespace paddle {
@@ -489,6 +499,12 @@ class AllocatorFacadePrivate {
   void InitNaiveBestFitCPUAllocator() {
     allocators_[platform::CPUPlace()] =
         std::make_shared<NaiveBestFitAllocator>(platform::CPUPlace());
+    if (FLAGS_use_thread_cache_cpu_allocator) {
+      allocators_[platform::CPUPlace()] =
+          std::make_shared<ThreadCacheCPUAllocator>(
+              allocators_[platform::CPUPlace()],
+              FLAGS_thread_cache_cpu_allocator_numa);
+    }
   }
 
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
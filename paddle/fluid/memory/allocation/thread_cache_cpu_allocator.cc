@@ -0,0 +1,337 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/thread_cache_cpu_allocator.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "paddle/fluid/memory/stats.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+constexpr size_t ThreadCacheCPUAllocator::kMinClassSize;
+constexpr size_t ThreadCacheCPUAllocator::kMaxClassSize;
+
+// bytes moved between a thread cache and a transfer cache at once
+static constexpr size_t kBatchBytes = 64 << 10;
+static constexpr size_t kMaxBatchCount = 32;
+// bytes of a size class a transfer cache keeps
+static constexpr size_t kTransferBytes = 1 << 20;
+// the size class of the allocations not cached
+static constexpr size_t kNoSizeClass = static_cast<size_t>(-1);
+
+// four classes for every power of two, so at most a quarter is wasted
+static const std::vector<size_t>& ClassSizes() {
+  static const std::vector<size_t> class_sizes = [] {
+    std::vector<size_t> sizes;
+    for (size_t base = ThreadCacheCPUAllocator::kMinClassSize;
+         base < ThreadCacheCPUAllocator::kMaxClassSize; base <<= 1) {
+      for (size_t step = 0; step < 4; ++step) {
+        sizes.push_back(base + step * base / 4);
+      }
+    }
+    sizes.push_back(ThreadCacheCPUAllocator::kMaxClassSize);
+    return sizes;
+  }();
+  return class_sizes;
+}
+
+static size_t SizeClassOf(size_t size) {
+  auto& sizes = ClassSizes();
+  return std::lower_bound(sizes.begin(), sizes.end(), size) - sizes.begin();
+}
+
+static size_t BatchCount(size_t size_class) {
+  return std::min(kMaxBatchCount,
+                  std::max<size_t>(2, kBatchBytes / ClassSizes()[size_class]));
+}
+
+static size_t NumaNodeNum() {
+  size_t node_num = 0;
+#ifdef __linux__
+  char path[64];
+  while (node_num < 64) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu",
+             node_num);
+    if (access(path, F_OK) != 0) {
+      break;
+    }
+    ++node_num;
+  }
+#endif
+  return std::max<size_t>(node_num, 1);
+}
+
+class ThreadCacheCentral {
+ public:
+  ThreadCacheCentral(std::shared_ptr<Allocator> underlying_allocator,
+                     size_t arena_num)
+      : underlying_allocator_(std::move(underlying_allocator)),
+        arena_num_(arena_num) {
+    for (size_t i = 0; i < arena_num_ * ClassSizes().size(); ++i) {
+      lists_.emplace_back(new TransferList());
+    }
+  }
+
+  // the stats are not updated here, they may be gone at exit
+  ~ThreadCacheCentral() {
+    for (auto& list : lists_) {
+      for (auto* block : list->blocks) {
+        delete block;
+      }
+    }
+  }
+
+  Allocator* underlying_allocator() { return underlying_allocator_.get(); }
+
+  // the NUMA node the calling thread runs on
+  size_t CurrentArena() const {
+#ifdef __linux__
+    if (arena_num_ > 1) {
+      int cpu = sched_getcpu();
+      char path[64];
+      for (size_t node = 0; cpu >= 0 && node < arena_num_; ++node) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%zu",
+                 cpu, node);
+        if (access(path, F_OK) == 0) {
+          return node;
+        }
+      }
+    }
+#endif
+    return 0;
+  }
+
+  // appends up to a batch of blocks of the class to blocks
+  void Fetch(size_t arena, size_t size_class,
+             std::vector<ThreadCacheCPUAllocation*>* blocks) {
+    auto& list = GetList(arena, size_class);
+    std::lock_guard<std::mutex> guard(list.mutex);
+    size_t count = std::min(BatchCount(size_class), list.blocks.size());
+    blocks->insert(blocks->end(), list.blocks.end() - count,
+                   list.blocks.end());
+    list.blocks.resize(list.blocks.size() - count);
+  }
+
+  // takes the first count blocks, the ones over the limit are freed when
+  // bounded, returns the bytes freed
+  size_t Put(size_t arena, size_t size_class,
+             std::vector<ThreadCacheCPUAllocation*>* blocks, size_t count,
+             bool bounded) {
+    std::vector<ThreadCacheCPUAllocation*> to_free;
+    {
+      auto& list = GetList(arena, size_class);
+      std::lock_guard<std::mutex> guard(list.mutex);
+      size_t limit = std::max(2 * BatchCount(size_class),
+                              kTransferBytes / ClassSizes()[size_class]);
+      size_t kept = count;
+      if (bounded) {
+        kept = std::min(count, limit - std::min(limit, list.blocks.size()));
+      }
+      list.blocks.insert(list.blocks.end(), blocks->begin(),
+                         blocks->begin() + kept);
+      to_free.assign(blocks->begin() + kept, blocks->begin() + count);
+    }
+    blocks->erase(blocks->begin(), blocks->begin() + count);
+    for (auto* block : to_free) {
+      delete block;
+    }
+    return to_free.size() * ClassSizes()[size_class];
+  }
+
+  size_t FreeAll() {
+    size_t freed = 0;
+    for (auto& list : lists_) {
+      std::vector<ThreadCacheCPUAllocation*> blocks;
+      {
+        std::lock_guard<std::mutex> guard(list->mutex);
+        blocks.swap(list->blocks);
+      }
+      for (auto* block : blocks) {
+        freed += block->size();
+        delete block;
+      }
+    }
+    return freed;
+  }
+
+ private:
+  struct TransferList {
+    std::mutex mutex;
+    std::vector<ThreadCacheCPUAllocation*> blocks;
+  };
+
+  TransferList& GetList(size_t arena, size_t size_class) {
+    return *lists_[arena * ClassSizes().size() + size_class];
+  }
+
+  std::shared_ptr<Allocator> underlying_allocator_;
+  size_t arena_num_;
+  std::vector<std::unique_ptr<TransferList>> lists_;
+};
+
+namespace {
+
+struct ThreadCache {
+  ThreadCache(std::shared_ptr<ThreadCacheCentral> central, size_t arena)
+      : central(std::move(central)),
+        arena(arena),
+        lists(ClassSizes().size()) {}
+
+  // the blocks go back to the transfer cache when the thread exits
+  ~ThreadCache() { Flush(); }
+
+  void Flush() {
+    for (size_t size_class = 0; size_class < lists.size(); ++size_class) {
+      central->Put(arena, size_class, &lists[size_class],
+                   lists[size_class].size(), false);
+    }
+  }
+
+  std::shared_ptr<ThreadCacheCentral> central;
+  size_t arena;
+  std::vector<std::vector<ThreadCacheCPUAllocation*>> lists;
+};
+
+// the caches of a thread, by the id of their allocator
+struct ThreadCacheRegistry {
+  ~ThreadCacheRegistry();
+
+  uint64_t last_id = 0;
+  ThreadCache* last = nullptr;
+  std::unordered_map<uint64_t, std::unique_ptr<ThreadCache>> caches;
+};
+
+// allocations may be freed by thread local objects destroyed after the
+// registry
+thread_local bool registry_destroyed = false;
+
+ThreadCacheRegistry::~ThreadCacheRegistry() { registry_destroyed = true; }
+
+ThreadCache* GetThreadCache(
+    uint64_t id, const std::shared_ptr<ThreadCacheCentral>& central) {
+  static thread_local ThreadCacheRegistry registry;
+  if (UNLIKELY(registry_destroyed)) {
+    return nullptr;
+  }
+  if (registry.last_id != id) {
+    auto& cache = registry.caches[id];
+    if (cache == nullptr) {
+      cache.reset(new ThreadCache(central, central->CurrentArena()));
+    }
+    registry.last_id = id;
+    registry.last = cache.get();
+  }
+  return registry.last;
+}
+
+std::atomic<uint64_t> next_allocator_id{1};
+
+}  // namespace
+
+ThreadCacheCPUAllocator::ThreadCacheCPUAllocator(
+    std::shared_ptr<Allocator> underlying_allocator, bool numa_arena)
+    : central_(std::make_shared<ThreadCacheCentral>(
+          std::move(underlying_allocator), numa_arena ? NumaNodeNum() : 1)),
+      id_(next_allocator_id++) {}
+
+// the thread caches hold the transfer caches until their threads exit
+ThreadCacheCPUAllocator::~ThreadCacheCPUAllocator() = default;
+
+size_t ThreadCacheCPUAllocator::ClassSize(size_t size) {
+  return size > kMaxClassSize ? size : ClassSizes()[SizeClassOf(size)];
+}
+
+phi::Allocation* ThreadCacheCPUAllocator::AllocateImpl(size_t size) {
+  if (size > kMaxClassSize) {
+    return new ThreadCacheCPUAllocation(
+        static_unique_ptr_cast<Allocation>(
+            central_->underlying_allocator()->Allocate(size)),
+        kNoSizeClass);
+  }
+  size_t size_class = SizeClassOf(size);
+  auto* cache = GetThreadCache(id_, central_);
+  if (cache != nullptr) {
+    auto& list = cache->lists[size_class];
+    if (list.empty()) {
+      central_->Fetch(cache->arena, size_class, &list);
+    }
+    if (!list.empty()) {
+      auto* block = list.back();
+      list.pop_back();
+      HOST_MEMORY_STAT_UPDATE(Cached, 0, -block->size());
+      return block;
+    }
+  }
+  auto underlying_allocation =
+      central_->underlying_allocator()->Allocate(ClassSizes()[size_class]);
+  return new ThreadCacheCPUAllocation(
+      static_unique_ptr_cast<Allocation>(std::move(underlying_allocation)),
+      size_class);
+}
+
+void ThreadCacheCPUAllocator::FreeImpl(phi::Allocation* allocation) {
+  auto* block = static_cast<ThreadCacheCPUAllocation*>(allocation);
+  size_t size_class = block->size_class();
+  if (size_class == kNoSizeClass) {
+    delete block;
+    return;
+  }
+  HOST_MEMORY_STAT_UPDATE(Cached, 0, block->size());
+  auto* cache = GetThreadCache(id_, central_);
+  size_t freed = 0;
+  if (cache == nullptr) {
+    std::vector<ThreadCacheCPUAllocation*> blocks{block};
+    freed = central_->Put(0, size_class, &blocks, 1, true);
+  } else {
+    auto& list = cache->lists[size_class];
+    list.push_back(block);
+    // the coldest blocks, at the front, go to the transfer cache
+    size_t batch = BatchCount(size_class);
+    if (list.size() > 2 * batch) {
+      freed = central_->Put(cache->arena, size_class, &list, batch, true);
+    }
+  }
+  if (freed > 0) {
+    HOST_MEMORY_STAT_UPDATE(Cached, 0, -freed);
+  }
+}
+
+uint64_t ThreadCacheCPUAllocator::ReleaseImpl(const platform::Place& place) {
+  auto* cache = GetThreadCache(id_, central_);
+  if (cache != nullptr) {
+    cache->Flush();
+  }
+  size_t freed = central_->FreeAll();
+  if (freed > 0) {
+    HOST_MEMORY_STAT_UPDATE(Cached, 0, -freed);
+  }
+  return central_->underlying_allocator()->Release(place);
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -0,0 +1,82 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "paddle/fluid/memory/allocation/allocator.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+class ThreadCacheCentral;
+
+class ThreadCacheCPUAllocation : public Allocation {
+ public:
+  ThreadCacheCPUAllocation(DecoratedAllocationPtr underlying_allocation,
+                           size_t size_class)
+      : Allocation(underlying_allocation->ptr(),
+                   underlying_allocation->base_ptr(),
+                   underlying_allocation->size(),
+                   underlying_allocation->place()),
+        underlying_allocation_(std::move(underlying_allocation)),
+        size_class_(size_class) {}
+
+  size_t size_class() const { return size_class_; }
+
+ private:
+  DecoratedAllocationPtr underlying_allocation_;
+  size_t size_class_;
+};
+
+// CPU allocator that keeps freed blocks for reuse, so that most requests
+// do not take the lock of the underlying allocator. Sizes up to
+// kMaxClassSize are rounded up to a size class. Every thread keeps a list
+// of free blocks per size class, and moves blocks in batches from and to
+// a transfer cache shared by all threads, one per NUMA node when
+// numa_arena is set. Larger sizes go to the underlying allocator. The
+// bytes held for reuse are reported as the Cached host memory stat.
+class ThreadCacheCPUAllocator : public Allocator {
+ public:
+  static constexpr size_t kMinClassSize = 64;
+  static constexpr size_t kMaxClassSize = 256 << 10;
+
+  explicit ThreadCacheCPUAllocator(
+      std::shared_ptr<Allocator> underlying_allocator,
+      bool numa_arena = false);
+  ~ThreadCacheCPUAllocator() override;
+
+  bool IsAllocThreadSafe() const override { return true; }
+
+  // the size the blocks of the class of size have
+  static size_t ClassSize(size_t size);
+
+ protected:
+  phi::Allocation* AllocateImpl(size_t size) override;
+  void FreeImpl(phi::Allocation* allocation) override;
+  // frees the blocks of the calling thread and of the transfer caches,
+  // the caches of the other threads are kept
+  uint64_t ReleaseImpl(const platform::Place& place) override;
+
+ private:
+  std::shared_ptr<ThreadCacheCentral> central_;
+  uint64_t id_;
+};
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
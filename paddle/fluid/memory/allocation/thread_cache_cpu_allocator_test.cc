@@ -0,0 +1,160 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/thread_cache_cpu_allocator.h"
+
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/memory/allocation/naive_best_fit_allocator.h"
+#include "paddle/fluid/memory/stats.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+static std::shared_ptr<Allocator> MakeNaiveBestFitAllocator() {
+  return std::make_shared<NaiveBestFitAllocator>(platform::CPUPlace());
+}
+
+TEST(ThreadCacheCPUAllocator, size_class) {
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(1), 64u);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(64), 64u);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(65), 80u);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(1000), 1024u);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(1025), 1280u);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize(256 << 10), 256u << 10);
+  ASSERT_EQ(ThreadCacheCPUAllocator::ClassSize((256 << 10) + 1),
+            (256u << 10) + 1);
+
+  ThreadCacheCPUAllocator allocator(MakeNaiveBestFitAllocator());
+  for (size_t size : {1, 100, 4000, 100000, 1 << 20}) {
+    auto allocation = allocator.Allocate(size);
+    ASSERT_EQ(allocation->size(), ThreadCacheCPUAllocator::ClassSize(size));
+    memset(allocation->ptr(), 0, allocation->size());
+  }
+  allocator.Release(platform::CPUPlace());
+}
+
+TEST(ThreadCacheCPUAllocator, reuse_and_release) {
+  ThreadCacheCPUAllocator allocator(MakeNaiveBestFitAllocator());
+  int64_t cached = HOST_MEMORY_STAT_CURRENT_VALUE(Cached, 0);
+
+  void* ptr = nullptr;
+  {
+    auto allocation = allocator.Allocate(1000);
+    ptr = allocation->ptr();
+  }
+  ASSERT_EQ(HOST_MEMORY_STAT_CURRENT_VALUE(Cached, 0), cached + 1024);
+  {
+    // the block freed last is given first
+    auto allocation = allocator.Allocate(900);
+    ASSERT_EQ(allocation->ptr(), ptr);
+    ASSERT_EQ(HOST_MEMORY_STAT_CURRENT_VALUE(Cached, 0), cached);
+  }
+  // large sizes are not cached
+  allocator.Allocate(1 << 20);
+  ASSERT_EQ(HOST_MEMORY_STAT_CURRENT_VALUE(Cached, 0), cached + 1024);
+
+  allocator.Release(platform::CPUPlace());
+  ASSERT_EQ(HOST_MEMORY_STAT_CURRENT_VALUE(Cached, 0), cached);
+}
+
+TEST(ThreadCacheCPUAllocator, cross_thread_free) {
+  auto allocator = std::make_shared<ThreadCacheCPUAllocator>(
+      MakeNaiveBestFitAllocator(), true);
+  const size_t thread_num = 4;
+  const size_t alloc_num = 10000;
+  std::vector<std::vector<AllocationPtr>> allocations(thread_num);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads.emplace_back([&, i]() {
+      std::mt19937 rng(i);
+      for (size_t j = 0; j < alloc_num; ++j) {
+        auto allocation = allocator->Allocate(rng() % 5000 + 1);
+        *static_cast<size_t*>(allocation->ptr()) = i;
+        allocations[i].emplace_back(std::move(allocation));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+
+  // the blocks are freed by an other thread than the one allocating them
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads.emplace_back([&, i]() {
+      auto& to_free = allocations[(i + 1) % thread_num];
+      for (auto& allocation : to_free) {
+        ASSERT_EQ(*static_cast<size_t*>(allocation->ptr()),
+                  (i + 1) % thread_num);
+        allocation.reset();
+      }
+      for (size_t j = 0; j < alloc_num; ++j) {
+        allocator->Allocate(j % 5000 + 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  allocator->Release(platform::CPUPlace());
+}
+
+// NOTE: the benchmark is not checked, it prints the time of the threads
+// allocating and freeing small blocks with and without the thread caches.
+// It is disabled to keep it out of ctest, run it with
+// --gtest_also_run_disabled_tests.
+template <typename Allocator>
+static double RunContention(Allocator* allocator, size_t thread_num) {
+  const size_t round_num = 20000;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_num; ++i) {
+    threads.emplace_back([allocator, i]() {
+      std::mt19937 rng(i);
+      std::vector<AllocationPtr> live(16);
+      for (size_t j = 0; j < round_num; ++j) {
+        live[rng() % live.size()] = allocator->Allocate(rng() % 4096 + 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+TEST(ThreadCacheCPUAllocator, DISABLED_contention_benchmark) {
+  auto naive_best_fit = MakeNaiveBestFitAllocator();
+  ThreadCacheCPUAllocator thread_cache(MakeNaiveBestFitAllocator());
+  for (size_t thread_num : {1, 4, 16}) {
+    double naive_ms = RunContention(naive_best_fit.get(), thread_num);
+    double cache_ms = RunContention(&thread_cache, thread_num);
+    std::cout << thread_num << " threads: naive_best_fit " << naive_ms
+              << " ms, thread_cache " << cache_ms << " ms" << std::endl;
+  }
+  thread_cache.Release(platform::CPUPlace());
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -200,6 +200,8 @@ DEVICE_MEMORY_STAT_DECLARE(Reserved);
 
 HOST_MEMORY_STAT_DECLARE(Allocated);
 HOST_MEMORY_STAT_DECLARE(Reserved);
+// the bytes kept for reuse by ThreadCacheCPUAllocator
+HOST_MEMORY_STAT_DECLARE(Cached);
 
 }  // namespace memory
 }  // namespace paddle
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #pragma once
+#include <algorithm>
 #include <vector>
 
 #include "paddle/fluid/framework/eigen.h"
@@ -20,6 +21,7 @@ limitations under the License. */
 #include "paddle/fluid/operators/jit/kernels.h"
 #include "paddle/fluid/operators/math/cpu_vec.h"
 #include "paddle/fluid/platform/cpu_info.h"
+#include "paddle/phi/backends/cpu/cpu_context.h"
 
 namespace paddle {
 namespace operators {
@@ -217,7 +219,19 @@ void SoftmaxFunctor<DeviceContext, T, is_test, Enable>::operator()(
 
 template <class DeviceContext>
 using enable_if_CPU = typename std::enable_if<
-    std::is_same<DeviceContext, platform::CPUDeviceContext>::value>::type;
+    std::is_base_of<phi::CPUContext, DeviceContext>::value>::type;
+
+// the rows are independent, f(first_row, last_row) is called on chunks of
+// them in the intra-op pool
+template <typename DeviceContext, typename F>
+void ParallelForRows(const DeviceContext& context, int batch_size,
+                     int num_classes, const F& f) {
+  context.ParallelFor(
+      0, batch_size,
+      std::max<int64_t>(
+          1, phi::kDefaultParallelGrainSize / std::max(num_classes, 1)),
+      f);
+}
 
 template <typename DeviceContext, typename T, bool is_test>
 class SoftmaxFunctor<DeviceContext, T, is_test, enable_if_CPU<DeviceContext>> {
@@ -233,26 +247,36 @@ class SoftmaxFunctor<DeviceContext, T, is_test, enable_if_CPU<DeviceContext>> {
     const int num_remain = num_classes / axis_dim;
 
     if (num_remain == 1 && platform::MayIUse(platform::avx)) {
-      const T* in_data = X->data<T>();
-      T* out_data = Y->data<T>();
-      for (int bs = 0; bs < batch_size; ++bs) {
-        T max_val = *std::max_element(in_data, in_data + num_classes);
-        max_val *= static_cast<T>(-1);
-        vec_add_bias<T, platform::avx>(num_classes, max_val, in_data, out_data);
-        vec_clip<T, platform::avx>(num_classes, static_cast<T>(-64), out_data,
-                                   out_data);
-        vec_exp<T>(num_classes, out_data, out_data);
-
-        T sum = 0;
-        vec_sum<T, platform::avx>(num_classes, out_data, &sum);
-        sum = static_cast<T>(1) / sum;
-        vec_scal<T, platform::avx>(num_classes, sum, out_data, out_data);
-
-        in_data += num_classes;
-        out_data += num_classes;
-      }
+      ParallelForRows(context, batch_size, num_classes, [&](int64_t first,
+                                                            int64_t last) {
+        const T* in_data = X->data<T>() + first * num_classes;
+        T* out_data = Y->data<T>() + first * num_classes;
+        for (int64_t bs = first; bs < last; ++bs) {
+          T max_val = *std::max_element(in_data, in_data + num_classes);
+          max_val *= static_cast<T>(-1);
+          vec_add_bias<T, platform::avx>(num_classes, max_val, in_data,
+                                         out_data);
+          vec_clip<T, platform::avx>(num_classes, static_cast<T>(-64),
+                                     out_data, out_data);
+          vec_exp<T>(num_classes, out_data, out_data);
+
+          T sum = 0;
+          vec_sum<T, platform::avx>(num_classes, out_data, &sum);
+          sum = static_cast<T>(1) / sum;
+          vec_scal<T, platform::avx>(num_classes, sum, out_data, out_data);
+
+          in_data += num_classes;
+          out_data += num_classes;
+        }
+      });
     } else {
-      SoftmaxEigen<DeviceContext, T, is_test>()(context, axis_dim, X, Y);
+      ParallelForRows(context, batch_size, num_classes, [&](int64_t first,
+                                                            int64_t last) {
+        framework::Tensor x_rows = X->Slice(first, last);
+        framework::Tensor y_rows = Y->Slice(first, last);
+        SoftmaxEigen<DeviceContext, T, is_test>()(context, axis_dim, &x_rows,
+                                                  &y_rows);
+      });
     }
   }
 };
@@ -271,8 +295,14 @@ class SoftmaxFunctor<DeviceContext, float, true, enable_if_CPU<DeviceContext>> {
     auto compute_softmax =
         jit::KernelFuncs<jit::SoftmaxTuple<float>, platform::CPUPlace>::Cache()
             .At(in_dims[kClassDim]);
-    compute_softmax(in_data, out_data, in_dims[kClassDim], in_dims[kBatchDim],
-                    in_dims[kClassDim] / axis_dim);
+    const int num_classes = in_dims[kClassDim];
+    ParallelForRows(
+        context, in_dims[kBatchDim], num_classes,
+        [&](int64_t first, int64_t last) {
+          compute_softmax(in_data + first * num_classes,
+                          out_data + first * num_classes, num_classes,
+                          last - first, num_classes / axis_dim);
+        });
   }
 };
 
@@ -398,20 +428,34 @@ class SoftmaxGradFunctor<DeviceContext, T, enable_if_CPU<DeviceContext>> {
       const T* out_data = y->data<T>();
       const T* out_grad = y_grad->data<T>();
       T* in_grad = x_grad->data<T>();
-      for (int bs = 0; bs < batch_size; ++bs) {
-        T scalar;
-        vec_mul_reduce<T, platform::avx>(num_classes, out_grad, out_data,
-                                         &scalar);
-        scalar *= static_cast<T>(-1);
-        vec_add_bias<T, platform::avx>(num_classes, scalar, out_grad, in_grad);
-        vec_mul<T, platform::avx>(num_classes, out_data, in_grad, in_grad);
-        out_data += num_classes;
-        out_grad += num_classes;
-        in_grad += num_classes;
-      }
+      ParallelForRows(context, batch_size, num_classes, [&](int64_t first,
+                                                            int64_t last) {
+        const T* row_out_data = out_data + first * num_classes;
+        const T* row_out_grad = out_grad + first * num_classes;
+        T* row_in_grad = in_grad + first * num_classes;
+        for (int64_t bs = first; bs < last; ++bs) {
+          T scalar;
+          vec_mul_reduce<T, platform::avx>(num_classes, row_out_grad,
+                                           row_out_data, &scalar);
+          scalar *= static_cast<T>(-1);
+          vec_add_bias<T, platform::avx>(num_classes, scalar, row_out_grad,
+                                         row_in_grad);
+          vec_mul<T, platform::avx>(num_classes, row_out_data, row_in_grad,
+                                    row_in_grad);
+          row_out_data += num_classes;
+          row_out_grad += num_classes;
+          row_in_grad += num_classes;
+        }
+      });
     } else {
-      SoftmaxGradEigen<DeviceContext, T>()(context, axis_dim, y, y_grad,
-                                           x_grad);
+      ParallelForRows(context, batch_size, num_classes, [&](int64_t first,
+                                                            int64_t last) {
+        framework::Tensor y_rows = y->Slice(first, last);
+        framework::Tensor y_grad_rows = y_grad->Slice(first, last);
+        framework::Tensor x_grad_rows = x_grad->Slice(first, last);
+        SoftmaxGradEigen<DeviceContext, T>()(context, axis_dim, &y_rows,
+                                             &y_grad_rows, &x_grad_rows);
+      });
     }
   }
 };
@@ -0,0 +1,176 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>  // NOLINT
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/phi/core/kernel_registry.h"
+
+USE_OP_ITSELF(elementwise_add);
+PD_DECLARE_KERNEL(add, CPU, ALL_LAYOUT);
+
+namespace paddle {
+namespace operators {
+
+using OpChain = std::vector<std::unique_ptr<framework::OperatorBase>>;
+
+static std::string ChainVarName(int i) { return "v" + std::to_string(i); }
+
+// v(i + 1) = v(i) + y
+static OpChain MakeAddChain(framework::Scope* scope, int op_num,
+                            bool cache_runtime_context) {
+  framework::AttributeMap attrs;
+  if (cache_runtime_context) {
+    attrs[framework::kEnableCacheRuntimeContext] = true;
+  }
+  scope->Var("y")->GetMutable<framework::LoDTensor>();
+  scope->Var(ChainVarName(0))->GetMutable<framework::LoDTensor>();
+  OpChain ops;
+  for (int i = 0; i < op_num; ++i) {
+    scope->Var(ChainVarName(i + 1))->GetMutable<framework::LoDTensor>();
+    ops.emplace_back(framework::OpRegistry::CreateOp(
+        "elementwise_add", {{"X", {ChainVarName(i)}}, {"Y", {"y"}}},
+        {{"Out", {ChainVarName(i + 1)}}}, attrs));
+  }
+  return ops;
+}
+
+template <typename T>
+static void FillChainInputs(framework::Scope* scope,
+                            const framework::DDim& dims) {
+  for (auto* name : {"y", "v0"}) {
+    auto* tensor = scope->FindVar(name)->GetMutable<framework::LoDTensor>();
+    tensor->Resize(dims);
+    T* data = tensor->mutable_data<T>(platform::CPUPlace());
+    for (int64_t i = 0; i < tensor->numel(); ++i) {
+      data[i] = static_cast<T>(1);
+    }
+  }
+}
+
+static void RunChain(const OpChain& ops, const framework::Scope& scope) {
+  for (auto& op : ops) {
+    op->Run(scope, platform::CPUPlace());
+  }
+}
+
+template <typename T>
+static void CheckChainOutput(const framework::Scope& scope, int op_num,
+                             const framework::DDim& dims) {
+  auto& out = scope.FindVar(ChainVarName(op_num))->Get<framework::LoDTensor>();
+  ASSERT_EQ(out.dims(), dims);
+  ASSERT_EQ(out.dtype(), paddle::experimental::CppTypeToDataType<T>::Type());
+  for (int64_t i = 0; i < out.numel(); ++i) {
+    ASSERT_EQ(out.data<T>()[i], static_cast<T>(op_num + 1));
+  }
+}
+
+// every op runs the kernel of data_type, and keeps the kernel context it
+// built for it if cached
+static void CheckChainCached(const OpChain& ops,
+                             framework::proto::VarType::Type data_type,
+                             bool cached) {
+  for (auto& op : ops) {
+    auto* kernel_op =
+        dynamic_cast<const framework::OperatorWithKernel*>(op.get());
+    ASSERT_NE(kernel_op, nullptr);
+    EXPECT_EQ(kernel_op->HasCachedKernelContext(), cached);
+    ASSERT_NE(kernel_op->kernel_type(), nullptr);
+    EXPECT_EQ(kernel_op->kernel_type()->data_type_, data_type);
+  }
+}
+
+TEST(op_runtime_context_cache, reuse_and_invalidate) {
+  const int op_num = 10;
+  framework::Scope scope;
+  auto ops = MakeAddChain(&scope, op_num, true);
+
+  FillChainInputs<float>(&scope, {2, 3});
+  for (int step = 0; step < 3; ++step) {
+    RunChain(ops, scope);
+    CheckChainOutput<float>(scope, op_num, {2, 3});
+    CheckChainCached(ops, framework::proto::VarType::FP32, true);
+  }
+
+  // the cached kernel context follows the new shapes
+  FillChainInputs<float>(&scope, {4, 5});
+  RunChain(ops, scope);
+  CheckChainOutput<float>(scope, op_num, {4, 5});
+
+  CheckChainCached(ops, framework::proto::VarType::FP32, true);
+
+  // as without the cache, the kernel is kept for a new dtype and the inputs
+  // are transformed to it, the transformed inputs are not cached
+  FillChainInputs<double>(&scope, {4, 5});
+  for (int step = 0; step < 2; ++step) {
+    RunChain(ops, scope);
+    CheckChainOutput<float>(scope, op_num, {4, 5});
+    CheckChainCached(ops, framework::proto::VarType::FP32, false);
+  }
+
+  // the context is cached again once the inputs need no transform
+  FillChainInputs<float>(&scope, {4, 5});
+  RunChain(ops, scope);
+  CheckChainOutput<float>(scope, op_num, {4, 5});
+  CheckChainCached(ops, framework::proto::VarType::FP32, true);
+}
+
+// the ops without the cached contexts choose the same kernel on a dtype
+// change
+TEST(op_runtime_context_cache, dtype_change_without_cache) {
+  const int op_num = 3;
+  framework::Scope scope;
+  auto ops = MakeAddChain(&scope, op_num, false);
+  FillChainInputs<float>(&scope, {2, 3});
+  RunChain(ops, scope);
+  CheckChainCached(ops, framework::proto::VarType::FP32, false);
+  FillChainInputs<double>(&scope, {2, 3});
+  RunChain(ops, scope);
+  CheckChainOutput<float>(scope, op_num, {2, 3});
+  CheckChainCached(ops, framework::proto::VarType::FP32, false);
+}
+
+// NOTE: the benchmark is not checked, it prints the time spent in the
+// dispatch of tiny ops with and without the cached contexts. It is
+// disabled to keep it out of ctest, run it with
+// --gtest_also_run_disabled_tests.
+TEST(op_runtime_context_cache, DISABLED_dispatch_benchmark) {
+  const int op_num = 1000;
+  const int repeat = 20;
+  for (bool cache_runtime_context : {false, true}) {
+    framework::Scope scope;
+    auto ops = MakeAddChain(&scope, op_num, cache_runtime_context);
+    FillChainInputs<float>(&scope, {1});
+    RunChain(ops, scope);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) {
+      RunChain(ops, scope);
+    }
+    double us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start)
+                    .count() /
+                (repeat * op_num);
+    CheckChainOutput<float>(scope, op_num, {1});
+    std::cout << op_num << " elementwise_add ops, cache runtime context "
+              << cache_runtime_context << ": " << us << " us per op"
+              << std::endl;
+  }
+}
+
+}  // namespace operators
+}  // namespace paddle
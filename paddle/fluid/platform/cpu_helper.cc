@@ -14,6 +14,8 @@ limitations under the License. */
 
 #include "paddle/fluid/platform/cpu_helper.h"
 
+#include "paddle/phi/backends/cpu/cpu_context.h"
+
 #ifdef PADDLE_WITH_MKLML
 #include <omp.h>
 
@@ -28,6 +30,7 @@ namespace paddle {
 namespace platform {
 
 void SetNumThreads(int num_threads) {
+  phi::CPUContext::SetIntraOpNumThreads(num_threads);
 #ifdef PADDLE_USE_OPENBLAS
 // windows has no support for openblas multi-thread
 // please refer to: https://github.com/PaddlePaddle/Paddle/issues/7234
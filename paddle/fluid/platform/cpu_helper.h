@@ -19,7 +19,8 @@ limitations under the License. */
 namespace paddle {
 namespace platform {
 
-//! Set the number of threads in use.
+//! Set the number of threads in use by the math library and the intra-op
+//! pool of phi::CPUContext.
 void SetNumThreads(int num_threads);
 
 }  // namespace platform
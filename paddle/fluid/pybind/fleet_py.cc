@@ -209,6 +209,10 @@ void BindGraphPyClient(py::module* m) {
       .def("start_client", &GraphPyClient::start_client)
       .def("batch_sample_neighboors", &GraphPyClient::batch_sample_neighbors)
       .def("batch_sample_neighbors", &GraphPyClient::batch_sample_neighbors)
+      .def("sample_subgraph", &GraphPyClient::sample_subgraph)
+      .def("save_sample_cache", &GraphPyClient::save_sample_cache)
+      .def("load_sample_cache", &GraphPyClient::load_sample_cache)
+      .def("get_sample_cache_stat", &GraphPyClient::get_sample_cache_stat)
       // .def("use_neighbors_sample_cache",
       //      &GraphPyClient::use_neighbors_sample_cache)
       .def("remove_graph_node", &GraphPyClient::remove_graph_node)
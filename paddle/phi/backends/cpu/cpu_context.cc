@@ -12,8 +12,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// The ThreadPoolDevice of the intra-op pool is only defined with
+// EIGEN_USE_THREADS.
+#define EIGEN_USE_THREADS
+
 #include "paddle/phi/backends/cpu/cpu_context.h"
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 #include "paddle/phi/api/ext/exception.h"
 #include "paddle/phi/common/place.h"
 
@@ -24,6 +33,36 @@
 
 namespace phi {
 
+namespace {
+
+// set per thread like the MKL and OMP thread numbers, so the predictors of
+// a process each keep their own
+thread_local int intra_op_num_threads = 1;
+// set while the thread runs a chunk of ParallelFor
+thread_local bool in_parallel_for = false;
+
+// Created on the first parallel call and never destroyed, the threads of
+// the process may run kernels until it exits.
+Eigen::ThreadPool* GetIntraOpPool() {
+  static Eigen::ThreadPool* pool = new Eigen::ThreadPool(
+      std::max<int>(1, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+// the threads a call may use, the calling thread included
+int UsableThreads(int num_threads) {
+  if (num_threads <= 1) {
+    return 1;
+  }
+  auto* pool = GetIntraOpPool();
+  if (in_parallel_for || pool->CurrentThreadId() != -1) {
+    return 1;
+  }
+  return std::min(num_threads, pool->NumThreads() + 1);
+}
+
+}  // namespace
+
 struct CPUContext::Impl {
   Impl() : place_(CPUPlace()) {}
 
@@ -70,6 +109,87 @@ Eigen::DefaultDevice* CPUContext::eigen_device() const {
 
 const Place& CPUContext::GetPlace() const { return impl_->place_; }
 
+void CPUContext::SetIntraOpNumThreads(int num_threads) {
+  intra_op_num_threads = std::max(num_threads, 1);
+}
+
+int CPUContext::GetIntraOpNumThreads() { return intra_op_num_threads; }
+
+Eigen::ThreadPoolDevice* CPUContext::eigen_pool_device() const {
+  thread_local std::unique_ptr<Eigen::ThreadPoolDevice> device;
+  int num_threads = std::max(UsableThreads(GetIntraOpNumThreads()), 1);
+  if (device == nullptr || device->numThreads() != num_threads) {
+    device.reset(new Eigen::ThreadPoolDevice(GetIntraOpPool(), num_threads));
+  }
+  return device.get();
+}
+
+int64_t CPUContext::ParallelChunkSize(int64_t n, int64_t grain_size) const {
+  int num_threads = GetIntraOpNumThreads();
+  if (num_threads <= 1 || n <= grain_size) {
+    return std::max<int64_t>(n, 1);
+  }
+  int64_t chunk_num = std::min<int64_t>(UsableThreads(num_threads),
+                                        n / std::max<int64_t>(grain_size, 1));
+  chunk_num = std::max<int64_t>(chunk_num, 1);
+  return (n + chunk_num - 1) / chunk_num;
+}
+
+void CPUContext::ParallelFor(
+    int64_t begin,
+    int64_t end,
+    int64_t grain_size,
+    const std::function<void(int64_t, int64_t)>& f) const {
+  if (begin >= end) {
+    return;
+  }
+  ParallelForChunks(
+      begin, end, ParallelChunkSize(end - begin, grain_size), f);
+}
+
+void CPUContext::ParallelForChunks(
+    int64_t begin,
+    int64_t end,
+    int64_t chunk_size,
+    const std::function<void(int64_t, int64_t)>& f) const {
+  if (begin >= end) {
+    return;
+  }
+  if (chunk_size >= end - begin) {
+    f(begin, end);
+    return;
+  }
+  int64_t chunk_num = (end - begin + chunk_size - 1) / chunk_size;
+  Eigen::Barrier barrier(chunk_num - 1);
+  std::mutex mutex;
+  std::exception_ptr error;
+  auto run = [&](int64_t first, int64_t last) {
+    in_parallel_for = true;
+    try {
+      f(first, last);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (error == nullptr) {
+        error = std::current_exception();
+      }
+    }
+    in_parallel_for = false;
+  };
+  auto* pool = GetIntraOpPool();
+  for (int64_t i = 0; i + 1 < chunk_num; ++i) {
+    int64_t first = begin + i * chunk_size;
+    pool->Schedule([&, first]() {
+      run(first, first + chunk_size);
+      barrier.Notify();
+    });
+  }
+  run(begin + (chunk_num - 1) * chunk_size, end);
+  barrier.Wait();
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
 void CPUContext::SetEigenDevice(Eigen::DefaultDevice* device) {
   impl_->eigen_device_ = device;
 }
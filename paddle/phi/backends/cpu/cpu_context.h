@@ -14,6 +14,7 @@ limitations under the License. */
 
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include "paddle/phi/backends/cpu/forwards.h"
@@ -24,6 +25,10 @@ limitations under the License. */
 
 namespace phi {
 
+// The elements a chunk of ParallelFor takes at least, for the kernels that
+// do a few operations per element.
+constexpr int64_t kDefaultParallelGrainSize = 32768;
+
 class PADDLE_API CPUContext : public DeviceContext {
  public:
   CPUContext();
@@ -34,6 +39,57 @@ class PADDLE_API CPUContext : public DeviceContext {
   Eigen::DefaultDevice* eigen_device() const;
   const Place& GetPlace() const override;
 
+  // The intra-op pool is shared by the CPU contexts of the process. The
+  // number of its threads a kernel uses is set for the calling thread, as
+  // platform::SetNumThreads sets MKL and OMP, and is 1 until set.
+  static void SetIntraOpNumThreads(int num_threads);
+  static int GetIntraOpNumThreads();
+
+  // An Eigen device on the intra-op pool, the translation units evaluating
+  // expressions on it have to define EIGEN_USE_THREADS.
+  Eigen::ThreadPoolDevice* eigen_pool_device() const;
+
+  // Calls f(chunk_begin, chunk_end) on the chunks of [begin, end), at
+  // most one per thread and, but the last, of grain_size elements at
+  // least, and waits for them. The calling thread runs a chunk, an
+  // exception thrown by f is rethrown here. Nested calls run serially.
+  void ParallelFor(int64_t begin,
+                   int64_t end,
+                   int64_t grain_size,
+                   const std::function<void(int64_t, int64_t)>& f) const;
+
+  // The size of the chunks ParallelFor splits n elements into.
+  int64_t ParallelChunkSize(int64_t n, int64_t grain_size) const;
+
+  // f(chunk_begin, chunk_end) gives the result of a chunk, the results
+  // are combined in the order of the chunks with reduce.
+  template <typename T, typename F, typename R>
+  T ParallelReduce(int64_t begin,
+                   int64_t end,
+                   int64_t grain_size,
+                   T identity,
+                   const F& f,
+                   const R& reduce) const {
+    int64_t chunk_size = ParallelChunkSize(end - begin, grain_size);
+    if (chunk_size >= end - begin) {
+      return begin < end ? reduce(identity, f(begin, end)) : identity;
+    }
+    // not a std::vector, the elements of std::vector<bool> share bytes
+    int64_t chunk_num = (end - begin + chunk_size - 1) / chunk_size;
+    std::unique_ptr<T[]> results(new T[chunk_num]);
+    // the chunks are the ones results is sized for, even if the thread
+    // number is set again meanwhile
+    ParallelForChunks(
+        begin, end, chunk_size, [&](int64_t first, int64_t last) {
+          results[(first - begin) / chunk_size] = f(first, last);
+        });
+    T result = identity;
+    for (int64_t i = 0; i < chunk_num; ++i) {
+      result = reduce(result, results[i]);
+    }
+    return result;
+  }
+
  public:
   // NOTE: DeviceContext hold resources. Used in training scenarios.
   // The interface used by the training scene, DeviceContext will initialize
@@ -47,6 +103,12 @@ class PADDLE_API CPUContext : public DeviceContext {
   void SetEigenDevice(Eigen::DefaultDevice* device);
 
  private:
+  // Calls f on the chunks of chunk_size elements of [begin, end).
+  void ParallelForChunks(int64_t begin,
+                         int64_t end,
+                         int64_t chunk_size,
+                         const std::function<void(int64_t, int64_t)>& f) const;
+
   struct Impl;
   std::unique_ptr<Impl> impl_;
 };
@@ -14,6 +14,8 @@
 
 #include "paddle/phi/kernels/layer_norm_kernel.h"
 
+#include <algorithm>
+
 #include "paddle/phi/kernels/cpu/elementwise.h"
 #include "paddle/phi/kernels/funcs/layer_norm_util.h"
 #if !defined(PADDLE_WITH_CUDA) && !defined(_WIN32) && !defined(__APPLE__) && \
@@ -128,6 +130,8 @@ void LayerNormKernel(const Context& dev_ctx,
                  paddle::operators::jit::LayerNormTuple<T>,
                  phi::CPUPlace>::Cache()
                  .At(right);
+#ifdef PADDLE_WITH_MKLML
+  // the rows are split by omp in the kernel
   ker(x_tmp.data<T>(),
       out.data<T>(),
       mean->data<T>(),
@@ -137,6 +141,27 @@ void LayerNormKernel(const Context& dev_ctx,
       static_cast<int>(left),
       static_cast<const float>(epsilon),
       right);
+#else
+  T* x_data = x_tmp.data<T>();
+  T* out_data = out.data<T>();
+  T* mean_data = mean->data<T>();
+  T* var_data = var->data<T>();
+  dev_ctx.ParallelFor(
+      0,
+      left,
+      std::max<int64_t>(1, kDefaultParallelGrainSize / std::max(right, 1)),
+      [&](int64_t begin, int64_t end) {
+        ker(x_data + begin * right,
+            out_data + begin * right,
+            mean_data + begin,
+            var_data + begin,
+            scale ? scale->data<T>() : nullptr,
+            bias ? bias->data<T>() : nullptr,
+            static_cast<int>(end - begin),
+            static_cast<const float>(epsilon),
+            right);
+      });
+#endif
 #endif
 }
 
@@ -14,7 +14,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <set>
+#include <type_traits>
 
 #include "paddle/phi/backends/cpu/cpu_context.h"
 #include "paddle/phi/core/dense_tensor.h"
@@ -26,6 +28,72 @@
 #include "paddle/fluid/operators/eigen/eigen_function.h"
 namespace phi {
 
+template <typename DeviceContext,
+          typename T,
+          size_t D,
+          size_t R_D,
+          typename Functor>
+void ReduceFunctor(const DeviceContext& context,
+                   const phi::DenseTensor& input,
+                   phi::DenseTensor* output,
+                   const std::vector<int64_t>& dims,
+                   bool keep_dim);
+
+// Other contexts reduce the whole input at once.
+template <typename DeviceContext,
+          typename T,
+          size_t D,
+          size_t R_D,
+          typename Functor>
+std::enable_if_t<!std::is_base_of<CPUContext, DeviceContext>::value, bool>
+ReduceRowsInParallel(const DeviceContext& context,
+                     const phi::DenseTensor& input,
+                     phi::DenseTensor* output,
+                     const std::vector<int64_t>& dims,
+                     bool keep_dim) {
+  return false;
+}
+
+// When the first dim is not reduced, its rows are reduced independently,
+// so chunks of them are reduced in the intra-op pool.
+template <typename DeviceContext,
+          typename T,
+          size_t D,
+          size_t R_D,
+          typename Functor>
+std::enable_if_t<std::is_base_of<CPUContext, DeviceContext>::value, bool>
+ReduceRowsInParallel(const DeviceContext& context,
+                     const phi::DenseTensor& input,
+                     phi::DenseTensor* output,
+                     const std::vector<int64_t>& dims,
+                     bool keep_dim) {
+  const int64_t rows = D > 1 ? input.dims()[0] : 0;
+  if (rows <= 1 || output->dims().size() == 0 ||
+      output->dims()[0] != rows || input.numel() <= kDefaultParallelGrainSize) {
+    return false;
+  }
+  for (auto dim : dims) {
+    if (dim == 0 || dim == -static_cast<int64_t>(D)) {
+      return false;
+    }
+  }
+  const int64_t row_numel = input.numel() / rows;
+  const int64_t grain_size =
+      std::max<int64_t>(1,
+                        kDefaultParallelGrainSize /
+                            std::max<int64_t>(row_numel, 1));
+  if (context.ParallelChunkSize(rows, grain_size) >= rows) {
+    return false;
+  }
+  context.ParallelFor(0, rows, grain_size, [&](int64_t begin, int64_t end) {
+    phi::DenseTensor input_rows = input.Slice(begin, end);
+    phi::DenseTensor output_rows = output->Slice(begin, end);
+    ReduceFunctor<CPUContext, T, D, R_D, Functor>(
+        context, input_rows, &output_rows, dims, keep_dim);
+  });
+  return true;
+}
+
 template <typename DeviceContext,
           typename T,
           size_t D,
@@ -36,6 +104,10 @@ void ReduceFunctor(const DeviceContext& context,
                    phi::DenseTensor* output,
                    const std::vector<int64_t>& dims,
                    bool keep_dim) {
+  if (ReduceRowsInParallel<DeviceContext, T, D, R_D, Functor>(
+          context, input, output, dims, keep_dim)) {
+    return;
+  }
   auto x = EigenTensor<T, D>::From(input);
   auto x_rank = static_cast<int>(x.dimensions().size());
   auto reduce_dim = Eigen::array<int, R_D>();
@@ -0,0 +1,384 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PADDLE_TRANSPOSE_SSE2
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "paddle/phi/backends/cpu/cpu_context.h"
+#include "paddle/phi/core/ddim.h"
+
+namespace phi {
+namespace funcs {
+
+// The dims of a transpose with the dims of size 1 dropped and the input
+// dims that stay neighbours in the output merged. For example the dims
+// (8, 12, 64, 64) with the axis (0, 2, 3, 1) give the sizes (8, 12, 4096)
+// and the axis (0, 2, 1).
+struct CoalescedTransposeDims {
+  CoalescedTransposeDims(const DDim& in_dims, const std::vector<int>& axis) {
+    int rank = axis.size();
+    std::vector<int> kept;
+    for (int i = 0; i < rank; ++i) {
+      if (in_dims[axis[i]] != 1) {
+        kept.push_back(axis[i]);
+      }
+    }
+    // the input dims in output order, the runs of consecutive ones merged
+    std::vector<int64_t> out_sizes;
+    std::vector<int> out_first;
+    for (size_t i = 0; i < kept.size(); ++i) {
+      if (i > 0 && kept[i] == kept[i - 1] + 1) {
+        out_sizes.back() *= in_dims[kept[i]];
+      } else {
+        out_sizes.push_back(in_dims[kept[i]]);
+        out_first.push_back(kept[i]);
+      }
+    }
+    // the merged dims renumbered in input order
+    std::vector<int> order(out_first.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return out_first[a] < out_first[b];
+    });
+    sizes.resize(order.size());
+    perm.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      sizes[i] = out_sizes[order[i]];
+      perm[order[i]] = i;
+    }
+  }
+
+  bool IsIdentity() const {
+    for (size_t i = 0; i < perm.size(); ++i) {
+      if (perm[i] != static_cast<int>(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // the input sizes, output dim i is input dim perm[i]
+  std::vector<int64_t> sizes;
+  std::vector<int> perm;
+};
+
+// Transposes the rows x cols block of in with the leading dim in_ld to
+// out with the leading dim out_ld, out[c * out_ld + r] = in[r * in_ld + c].
+template <typename T>
+inline void TransposeBlockScalar(const T* in,
+                                 int64_t in_ld,
+                                 T* out,
+                                 int64_t out_ld,
+                                 int64_t rows,
+                                 int64_t cols) {
+  for (int64_t c = 0; c < cols; ++c) {
+    for (int64_t r = 0; r < rows; ++r) {
+      out[c * out_ld + r] = in[r * in_ld + c];
+    }
+  }
+}
+
+// The in-register transposes of a full tile, kTile x kTile elements of
+// kSize bytes. kTile is 0 when there is none.
+template <size_t kSize>
+struct TransposeTile {
+  static constexpr int64_t kTile = 0;
+  static void Run(const char*, int64_t, char*, int64_t) {}
+};
+
+#ifdef PADDLE_TRANSPOSE_SSE2
+template <>
+struct TransposeTile<1> {
+  static constexpr int64_t kTile = 16;
+  static void Run(const char* in, int64_t in_ld, char* out, int64_t out_ld) {
+    __m128i r[16], t[16];
+    for (int i = 0; i < 16; ++i) {
+      r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * in_ld));
+    }
+    for (int i = 0; i < 8; ++i) {
+      t[2 * i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm_unpackhi_epi8(r[2 * i], r[2 * i + 1]);
+    }
+    for (int q = 0; q < 4; ++q) {
+      r[4 * q] = _mm_unpacklo_epi16(t[4 * q], t[4 * q + 2]);
+      r[4 * q + 1] = _mm_unpackhi_epi16(t[4 * q], t[4 * q + 2]);
+      r[4 * q + 2] = _mm_unpacklo_epi16(t[4 * q + 1], t[4 * q + 3]);
+      r[4 * q + 3] = _mm_unpackhi_epi16(t[4 * q + 1], t[4 * q + 3]);
+    }
+    for (int o = 0; o < 2; ++o) {
+      for (int c = 0; c < 4; ++c) {
+        t[8 * o + 2 * c] = _mm_unpacklo_epi32(r[8 * o + c], r[8 * o + 4 + c]);
+        t[8 * o + 2 * c + 1] =
+            _mm_unpackhi_epi32(r[8 * o + c], r[8 * o + 4 + c]);
+      }
+    }
+    for (int k = 0; k < 8; ++k) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * k * out_ld),
+                       _mm_unpacklo_epi64(t[k], t[8 + k]));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + (2 * k + 1) * out_ld),
+                       _mm_unpackhi_epi64(t[k], t[8 + k]));
+    }
+  }
+};
+
+template <>
+struct TransposeTile<2> {
+  static constexpr int64_t kTile = 8;
+  static void Run(const char* in, int64_t in_ld, char* out, int64_t out_ld) {
+    __m128i r[8], t[8];
+    for (int i = 0; i < 8; ++i) {
+      r[i] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(in + i * in_ld * 2));
+    }
+    for (int i = 0; i < 4; ++i) {
+      t[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+    }
+    for (int q = 0; q < 2; ++q) {
+      r[4 * q] = _mm_unpacklo_epi32(t[4 * q], t[4 * q + 2]);
+      r[4 * q + 1] = _mm_unpackhi_epi32(t[4 * q], t[4 * q + 2]);
+      r[4 * q + 2] = _mm_unpacklo_epi32(t[4 * q + 1], t[4 * q + 3]);
+      r[4 * q + 3] = _mm_unpackhi_epi32(t[4 * q + 1], t[4 * q + 3]);
+    }
+    for (int k = 0; k < 4; ++k) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * k * out_ld * 2),
+                       _mm_unpacklo_epi64(r[k], r[4 + k]));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(out + (2 * k + 1) * out_ld * 2),
+          _mm_unpackhi_epi64(r[k], r[4 + k]));
+    }
+  }
+};
+
+template <>
+struct TransposeTile<4> {
+  static constexpr int64_t kTile = 8;
+  static void Run(const char* in, int64_t in_ld, char* out, int64_t out_ld) {
+    const float* src = reinterpret_cast<const float*>(in);
+    float* dst = reinterpret_cast<float*>(out);
+#ifdef __AVX__
+    __m256 r[8], t[8];
+    for (int i = 0; i < 8; ++i) {
+      r[i] = _mm256_loadu_ps(src + i * in_ld);
+    }
+    for (int i = 0; i < 4; ++i) {
+      t[2 * i] = _mm256_unpacklo_ps(r[2 * i], r[2 * i + 1]);
+      t[2 * i + 1] = _mm256_unpackhi_ps(r[2 * i], r[2 * i + 1]);
+    }
+    for (int q = 0; q < 2; ++q) {
+      r[4 * q] = _mm256_shuffle_ps(
+          t[4 * q], t[4 * q + 2], _MM_SHUFFLE(1, 0, 1, 0));
+      r[4 * q + 1] = _mm256_shuffle_ps(
+          t[4 * q], t[4 * q + 2], _MM_SHUFFLE(3, 2, 3, 2));
+      r[4 * q + 2] = _mm256_shuffle_ps(
+          t[4 * q + 1], t[4 * q + 3], _MM_SHUFFLE(1, 0, 1, 0));
+      r[4 * q + 3] = _mm256_shuffle_ps(
+          t[4 * q + 1], t[4 * q + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int k = 0; k < 4; ++k) {
+      _mm256_storeu_ps(dst + k * out_ld,
+                       _mm256_permute2f128_ps(r[k], r[4 + k], 0x20));
+      _mm256_storeu_ps(dst + (k + 4) * out_ld,
+                       _mm256_permute2f128_ps(r[k], r[4 + k], 0x31));
+    }
+#else
+    for (int bi = 0; bi < 8; bi += 4) {
+      for (int bj = 0; bj < 8; bj += 4) {
+        const float* block = src + bi * in_ld + bj;
+        __m128 r0 = _mm_loadu_ps(block);
+        __m128 r1 = _mm_loadu_ps(block + in_ld);
+        __m128 r2 = _mm_loadu_ps(block + 2 * in_ld);
+        __m128 r3 = _mm_loadu_ps(block + 3 * in_ld);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        float* target = dst + bj * out_ld + bi;
+        _mm_storeu_ps(target, r0);
+        _mm_storeu_ps(target + out_ld, r1);
+        _mm_storeu_ps(target + 2 * out_ld, r2);
+        _mm_storeu_ps(target + 3 * out_ld, r3);
+      }
+    }
+#endif
+  }
+};
+#endif
+
+// out[c * out_ld + r] = in[r * in_ld + c] for the rows x cols matrix,
+// tile by tile, a band of rows whose output fills whole cache lines at a
+// time.
+template <typename T>
+void TransposeMatrixBand(const T* in,
+                         int64_t in_ld,
+                         T* out,
+                         int64_t out_ld,
+                         int64_t rows,
+                         int64_t cols) {
+  using Tile = TransposeTile<sizeof(T)>;
+  constexpr int64_t kTile = Tile::kTile;
+  if (kTile == 0) {
+    constexpr int64_t kBlock = 8;
+    for (int64_t c = 0; c < cols; c += kBlock) {
+      TransposeBlockScalar(in + c,
+                           in_ld,
+                           out + c * out_ld,
+                           out_ld,
+                           rows,
+                           std::min(kBlock, cols - c));
+    }
+    return;
+  }
+  const int64_t full_rows = rows - rows % std::max<int64_t>(kTile, 1);
+  const int64_t full_cols = cols - cols % std::max<int64_t>(kTile, 1);
+  for (int64_t c = 0; c < full_cols; c += kTile) {
+    for (int64_t r = 0; r < full_rows; r += kTile) {
+      Tile::Run(reinterpret_cast<const char*>(in + r * in_ld + c),
+                in_ld,
+                reinterpret_cast<char*>(out + c * out_ld + r),
+                out_ld);
+    }
+    TransposeBlockScalar(in + full_rows * in_ld + c,
+                         in_ld,
+                         out + c * out_ld + full_rows,
+                         out_ld,
+                         rows - full_rows,
+                         kTile);
+  }
+  TransposeBlockScalar(in + full_cols,
+                       in_ld,
+                       out + full_cols * out_ld,
+                       out_ld,
+                       rows,
+                       cols - full_cols);
+}
+
+// Transposes x of in_dims by axis to out in the intra-op pool. The input
+// dims staying innermost are copied run by run, else the innermost dims of
+// the input and the output form a matrix transposed by SIMD tiles.
+template <typename T>
+void TransposeCPU(const CPUContext& ctx,
+                  const T* in,
+                  const DDim& in_dims,
+                  const std::vector<int>& axis,
+                  T* out) {
+  CoalescedTransposeDims dims(in_dims, axis);
+  const int rank = dims.sizes.size();
+  int64_t numel = 1;
+  for (auto size : dims.sizes) {
+    numel *= size;
+  }
+  if (numel == 0) {
+    return;
+  }
+  if (rank <= 1 || dims.IsIdentity()) {
+    ctx.ParallelFor(
+        0, numel, kDefaultParallelGrainSize, [&](int64_t begin, int64_t end) {
+          std::memcpy(out + begin, in + begin, (end - begin) * sizeof(T));
+        });
+    return;
+  }
+  std::vector<int64_t> in_strides(rank, 1), out_strides(rank, 1);
+  for (int i = rank - 2; i >= 0; --i) {
+    in_strides[i] = in_strides[i + 1] * dims.sizes[i + 1];
+    out_strides[i] = out_strides[i + 1] * dims.sizes[dims.perm[i + 1]];
+  }
+  // the input stride of the output dims
+  std::vector<int64_t> out_in_strides(rank);
+  for (int i = 0; i < rank; ++i) {
+    out_in_strides[i] = in_strides[dims.perm[i]];
+  }
+  if (dims.perm[rank - 1] == rank - 1) {
+    const int64_t run = dims.sizes[rank - 1];
+    ctx.ParallelFor(
+        0,
+        numel / run,
+        std::max<int64_t>(1, kDefaultParallelGrainSize / run),
+        [&](int64_t begin, int64_t end) {
+          for (int64_t task = begin; task < end; ++task) {
+            int64_t rest = task;
+            int64_t in_offset = 0;
+            for (int i = rank - 2; i >= 0; --i) {
+              int64_t size = dims.sizes[dims.perm[i]];
+              in_offset += rest % size * out_in_strides[i];
+              rest /= size;
+            }
+            std::memcpy(
+                out + task * run, in + in_offset, run * sizeof(T));
+          }
+        });
+    return;
+  }
+  // the output dim the innermost input dim goes to
+  int inner_out = 0;
+  while (dims.perm[inner_out] != rank - 1) {
+    ++inner_out;
+  }
+  // the output dims walked by the outer loop, in output order
+  std::vector<int> outer;
+  for (int i = 0; i < rank - 1; ++i) {
+    if (i != inner_out) {
+      outer.push_back(i);
+    }
+  }
+  const int64_t rows = dims.sizes[dims.perm[rank - 1]];
+  const int64_t cols = dims.sizes[rank - 1];
+  // a band of rows writes whole cache lines of the output
+  const int64_t band =
+      std::min<int64_t>(rows, std::max<int64_t>(8, 128 / sizeof(T)));
+  const int64_t bands = (rows + band - 1) / band;
+  int64_t outer_num = 1;
+  for (int i : outer) {
+    outer_num *= dims.sizes[dims.perm[i]];
+  }
+  ctx.ParallelFor(
+      0,
+      outer_num * bands,
+      std::max<int64_t>(1, kDefaultParallelGrainSize / (band * cols)),
+      [&](int64_t begin, int64_t end) {
+        for (int64_t task = begin; task < end; ++task) {
+          int64_t rest = task / bands;
+          int64_t row = task % bands * band;
+          int64_t in_offset = row * out_in_strides[rank - 1];
+          int64_t out_offset = row;
+          for (int k = outer.size() - 1; k >= 0; --k) {
+            int i = outer[k];
+            int64_t size = dims.sizes[dims.perm[i]];
+            int64_t index = rest % size;
+            rest /= size;
+            in_offset += index * out_in_strides[i];
+            out_offset += index * out_strides[i];
+          }
+          TransposeMatrixBand(in + in_offset,
+                              out_in_strides[rank - 1],
+                              out + out_offset,
+                              out_strides[inner_out],
+                              std::min(band, rows - row),
+                              cols);
+        }
+      });
+}
+
+}  // namespace funcs
+}  // namespace phi
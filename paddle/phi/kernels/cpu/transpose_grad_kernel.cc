@@ -26,8 +26,11 @@ PD_REGISTER_KERNEL(transpose_grad,
                    bool,
                    float,
                    double,
+                   int8_t,
+                   uint8_t,
                    int32_t,
                    int64_t,
+                   phi::dtype::float16,
                    phi::dtype::bfloat16,
                    phi::dtype::complex<float>,
                    phi::dtype::complex<double>) {}
@@ -272,6 +272,82 @@ class TransformFunctor {
   bool is_xsize_larger_;
 };
 
+// z = func(x, y) with x and y broadcast to the dims of z. The threads of
+// the intra-op pool split a dim of the coalesced dims, and the innermost
+// runs are tight loops with a unit or a zero stride the compiler
+// vectorizes.
+template <typename Functor, typename T, typename OutType>
+void BroadcastTransformCPU(const CPUContext &dev_ctx,
+                           const T *x,
+                           const T *y,
+                           OutType *z,
+                           const CoalescedBroadcastDims &dims,
+                           Functor func) {
+  if (dims.numel == 0) {
+    return;
+  }
+  auto run = [&](int64_t x_offset,
+                 int64_t y_offset,
+                 int64_t out_offset,
+                 int64_t len) {
+    const T *x_run = x + x_offset;
+    const T *y_run = y + y_offset;
+    OutType *z_run = z + out_offset;
+    bool x_unit = dims.sizes.empty() || dims.x_strides.back() != 0;
+    bool y_unit = dims.sizes.empty() || dims.y_strides.back() != 0;
+    if (x_unit && y_unit) {
+      for (int64_t i = 0; i < len; ++i) {
+        z_run[i] = func(x_run[i], y_run[i]);
+      }
+    } else if (x_unit) {
+      const T y_value = y_run[0];
+      for (int64_t i = 0; i < len; ++i) {
+        z_run[i] = func(x_run[i], y_value);
+      }
+    } else if (y_unit) {
+      const T x_value = x_run[0];
+      for (int64_t i = 0; i < len; ++i) {
+        z_run[i] = func(x_value, y_run[i]);
+      }
+    } else {
+      for (int64_t i = 0; i < len; ++i) {
+        z_run[i] = func(x_run[0], y_run[0]);
+      }
+    }
+  };
+  int split_dim = dims.SplitDim(dev_ctx.GetIntraOpNumThreads(), false);
+  if (split_dim < 0) {
+    dims.ForEachRun(-1, 0, 0, run);
+    return;
+  }
+  dev_ctx.ParallelFor(0,
+                      dims.sizes[split_dim],
+                      dims.SplitGrainSize(split_dim, kDefaultParallelGrainSize),
+                      [&](int64_t begin, int64_t end) {
+                        dims.ForEachRun(split_dim, begin, end, run);
+                      });
+}
+
+// z[i] = func(x[i], y[(i / post) % n]), x is the larger input
+template <typename Functor, typename T, typename OutType>
+void MidWiseTransformCPU(const CPUContext &dev_ctx,
+                         const T *x,
+                         const T *y,
+                         OutType *z,
+                         int64_t numel,
+                         int64_t n,
+                         int64_t post,
+                         Functor func) {
+  if (numel == 0) {
+    return;
+  }
+  const int64_t pre = numel / (n * post);
+  const int64_t x_dims_array[] = {pre, n, post};
+  const int64_t y_dims_array[] = {1, n, 1};
+  CoalescedBroadcastDims dims(x_dims_array, y_dims_array, x_dims_array, 3);
+  BroadcastTransformCPU<Functor, T, OutType>(dev_ctx, x, y, z, dims, func);
+}
+
 template <typename Functor, typename T, typename OutType = T>
 void CommonForwardBroadcastCPU(const DenseTensor &x,
                                const DenseTensor &y,
@@ -283,7 +359,6 @@ void CommonForwardBroadcastCPU(const DenseTensor &x,
                                const CPUContext &ctx,
                                Functor func,
                                const bool is_xsize_larger = true) {
-  std::vector<int> index_array(max_dim, 0);
   const T *x_data = x.data<T>();
   const T *y_data = y.data<T>();
   PADDLE_ENFORCE_NOT_NULL(
@@ -292,19 +367,20 @@ void CommonForwardBroadcastCPU(const DenseTensor &x,
       y_data, errors::InvalidArgument("The input Y should not be empty."));
   OutType *out_data = ctx.Alloc<OutType>(z);
 
-  const int out_size = std::accumulate(
-      out_dims_array, out_dims_array + max_dim, 1, std::multiplies<int>());
-  int x_index, y_index;
-  for (int out_index = 0; out_index < out_size; ++out_index) {
-    x_index = GetElementwiseIndex(x_dims_array, max_dim, index_array.data());
-    y_index = GetElementwiseIndex(y_dims_array, max_dim, index_array.data());
-    if (is_xsize_larger) {
-      out_data[out_index] = func(x_data[x_index], y_data[y_index]);
-    } else {
-      out_data[out_index] = func(y_data[y_index], x_data[x_index]);
-    }
-
-    UpdateElementwiseIndexArray(out_dims_array, max_dim, index_array.data());
+  std::vector<int64_t> x_dims(x_dims_array, x_dims_array + max_dim);
+  std::vector<int64_t> y_dims(y_dims_array, y_dims_array + max_dim);
+  std::vector<int64_t> out_dims(out_dims_array, out_dims_array + max_dim);
+  // func takes the larger input first
+  if (is_xsize_larger) {
+    CoalescedBroadcastDims dims(
+        x_dims.data(), y_dims.data(), out_dims.data(), max_dim);
+    BroadcastTransformCPU<Functor, T, OutType>(
+        ctx, x_data, y_data, out_data, dims, func);
+  } else {
+    CoalescedBroadcastDims dims(
+        y_dims.data(), x_dims.data(), out_dims.data(), max_dim);
+    BroadcastTransformCPU<Functor, T, OutType>(
+        ctx, y_data, x_data, out_data, dims, func);
   }
 }
 
@@ -380,10 +456,12 @@ void ElementwiseCompute(const CPUContext &dev_ctx,
     is_xsize_larger = false;
     max_dim = y_dims.size();
   }
-  TransformFunctor<Functor, T, CPUContext, OutType> functor(
-      x, y, z, dev_ctx, func, is_xsize_larger);
+  const T *large = is_xsize_larger ? x.data<T>() : y.data<T>();
+  const T *small = is_xsize_larger ? y.data<T>() : x.data<T>();
+  int64_t numel = is_xsize_larger ? x.numel() : y.numel();
   if (x_dims == y_dims) {
-    functor.Run();
+    MidWiseTransformCPU<Functor, T, OutType>(
+        dev_ctx, large, small, z->data<OutType>(), numel, numel, 1, func);
     return;
   }
 
@@ -432,13 +510,8 @@ void ElementwiseCompute(const CPUContext &dev_ctx,
     return;
   }
 
-  if (post == 1) {
-    functor.RunRowWise(n, pre);
-    return;
-  } else {
-    functor.RunMidWise(n, pre, post);
-    return;
-  }
+  MidWiseTransformCPU<Functor, T, OutType>(
+      dev_ctx, large, small, z->data<OutType>(), numel, n, post, func);
 }
 
 // for broadcast backwards
@@ -51,6 +51,125 @@ namespace phi {
 namespace funcs {
 using DDim = phi::DDim;
 
+// dx and dy of out = op(x, y) with x and y broadcast to the dims of out.
+// The gradient of an input broadcast on some dim is summed over it, the
+// other one is assigned, so that it may share the buffer of dout. The
+// threads of the intra-op pool split a dim neither input is broadcast on,
+// so every element of dx and dy is summed by one thread in the same order
+// whatever the number of threads. The innermost runs are tight loops.
+template <typename T, typename DX_OP, typename DY_OP, typename Tout = T>
+void GradBroadcastCPU(const CPUContext &ctx,
+                      const T *x,
+                      const T *y,
+                      const Tout *out,
+                      const Tout *dout,
+                      const CoalescedBroadcastDims &dims,
+                      int64_t x_numel,
+                      int64_t y_numel,
+                      DX_OP dx_op,
+                      DY_OP dy_op,
+                      T *dx,
+                      T *dy) {
+  const bool dx_sum = x_numel != dims.numel;
+  const bool dy_sum = y_numel != dims.numel;
+  if (dx != nullptr && dx_sum) {
+    memset(dx, 0, x_numel * sizeof(T));
+  }
+  if (dy != nullptr && dy_sum) {
+    memset(dy, 0, y_numel * sizeof(T));
+  }
+  if (dims.numel == 0) {
+    return;
+  }
+  const bool x_unit = dims.sizes.empty() || dims.x_strides.back() != 0;
+  const bool y_unit = dims.sizes.empty() || dims.y_strides.back() != 0;
+  auto run_dx = [&](int64_t x_offset,
+                    int64_t y_offset,
+                    int64_t out_offset,
+                    int64_t len) {
+    const T *x_run = x + x_offset;
+    const T *y_run = y + y_offset;
+    const Tout *out_run = out + out_offset;
+    const Tout *dout_run = dout + out_offset;
+    T *dx_run = dx + x_offset;
+    if (!x_unit) {
+      T sum = static_cast<T>(0);
+      for (int64_t i = 0; i < len; ++i) {
+        sum += dx_op(
+            x_run[0], y_run[y_unit ? i : 0], out_run[i], dout_run[i]);
+      }
+      dx_run[0] += sum;
+    } else if (!y_unit) {
+      const T y_value = y_run[0];
+      for (int64_t i = 0; i < len; ++i) {
+        T value = dx_op(x_run[i], y_value, out_run[i], dout_run[i]);
+        dx_run[i] = dx_sum ? dx_run[i] + value : value;
+      }
+    } else {
+      for (int64_t i = 0; i < len; ++i) {
+        T value = dx_op(x_run[i], y_run[i], out_run[i], dout_run[i]);
+        dx_run[i] = dx_sum ? dx_run[i] + value : value;
+      }
+    }
+  };
+  auto run_dy = [&](int64_t x_offset,
+                    int64_t y_offset,
+                    int64_t out_offset,
+                    int64_t len) {
+    const T *x_run = x + x_offset;
+    const T *y_run = y + y_offset;
+    const Tout *out_run = out + out_offset;
+    const Tout *dout_run = dout + out_offset;
+    T *dy_run = dy + y_offset;
+    if (!y_unit) {
+      T sum = static_cast<T>(0);
+      for (int64_t i = 0; i < len; ++i) {
+        sum += dy_op(
+            x_run[x_unit ? i : 0], y_run[0], out_run[i], dout_run[i]);
+      }
+      dy_run[0] += sum;
+    } else if (!x_unit) {
+      const T x_value = x_run[0];
+      for (int64_t i = 0; i < len; ++i) {
+        T value = dy_op(x_value, y_run[i], out_run[i], dout_run[i]);
+        dy_run[i] = dy_sum ? dy_run[i] + value : value;
+      }
+    } else {
+      for (int64_t i = 0; i < len; ++i) {
+        T value = dy_op(x_run[i], y_run[i], out_run[i], dout_run[i]);
+        dy_run[i] = dy_sum ? dy_run[i] + value : value;
+      }
+    }
+  };
+  // the gradient of the larger input is computed last, it may overwrite
+  // dout
+  auto run = [&](int64_t x_offset,
+                 int64_t y_offset,
+                 int64_t out_offset,
+                 int64_t len) {
+    if (dx != nullptr && x_numel < y_numel) {
+      run_dx(x_offset, y_offset, out_offset, len);
+    }
+    if (dy != nullptr) {
+      run_dy(x_offset, y_offset, out_offset, len);
+    }
+    if (dx != nullptr && x_numel >= y_numel) {
+      run_dx(x_offset, y_offset, out_offset, len);
+    }
+  };
+  int split_dim = dims.SplitDim(ctx.GetIntraOpNumThreads(), true);
+  if (split_dim < 0) {
+    dims.ForEachRun(-1, 0, 0, run);
+    return;
+  }
+  ctx.ParallelFor(0,
+                  dims.sizes[split_dim],
+                  dims.SplitGrainSize(split_dim, kDefaultParallelGrainSize),
+                  [&](int64_t begin, int64_t end) {
+                    dims.ForEachRun(split_dim, begin, end, run);
+                  });
+}
+
 template <typename T, typename DX_OP, typename DY_OP, typename Tout = T>
 void CommonGradBroadcastCPU(const DenseTensor &x,
                             const DenseTensor &y,
@@ -65,146 +184,54 @@ void CommonGradBroadcastCPU(const DenseTensor &x,
                             const CPUContext &ctx,
                             DX_OP dx_op,
                             DY_OP dy_op) {
-  std::vector<int> index_array(max_dim, 0);
-  const T *x_data = x.data<T>();
-  const T *y_data = y.data<T>();
-  const Tout *out_data = out.data<Tout>();
-  const Tout *dout_data = dout.data<Tout>();
-  T *dx_data = dx == nullptr ? nullptr : ctx.Alloc<T>(dx);
-  T *dy_data = dy == nullptr ? nullptr : ctx.Alloc<T>(dy);
-  if (dx_data != nullptr) {
-    memset(dx_data, 0, dx->numel() * sizeof(T));
-  }
-  if (dy_data != nullptr) {
-    memset(dy_data, 0, dy->numel() * sizeof(T));
-  }
-  const int out_size = std::accumulate(
-      out_dims_array, out_dims_array + max_dim, 1, std::multiplies<int>());
-  int x_index, y_index;
-  for (int out_index = 0; out_index < out_size; ++out_index) {
-    x_index = GetElementwiseIndex(x_dims_array, max_dim, index_array.data());
-    y_index = GetElementwiseIndex(y_dims_array, max_dim, index_array.data());
-    if (dx_data != nullptr) {
-      dx_data[x_index] += dx_op(x_data[x_index],
-                                y_data[y_index],
-                                out_data[out_index],
-                                dout_data[out_index]);
-    }
-    if (dy_data != nullptr) {
-      dy_data[y_index] += dy_op(x_data[x_index],
-                                y_data[y_index],
-                                out_data[out_index],
-                                dout_data[out_index]);
-    }
-
-    UpdateElementwiseIndexArray(out_dims_array, max_dim, index_array.data());
-  }
-}
-
-template <typename T, typename DX_OP, typename DY_OP, typename Tout = T>
-static void ElemwiseGradBroadcast1CPU(const T *x,
-                                      const T *y,
-                                      const Tout *out,
-                                      const Tout *dout,
-                                      int h,
-                                      int w,
-                                      bool is_xsize_larger,
-                                      DX_OP dx_op,
-                                      DY_OP dy_op,
-                                      T *dx,
-                                      T *dy) {
-  if (is_xsize_larger) {
-    for (int i = 0; i < h; ++i) {
-      for (int j = 0; j < w; ++j) {
-        int x_offset = i * w + j;
-        if (dx != nullptr) {
-          dx[x_offset] =
-              dx_op(x[x_offset], y[j], out[x_offset], dout[x_offset]);
-        }
-        if (dy != nullptr) {
-          T tmp = dy_op(x[x_offset], y[j], out[x_offset], dout[x_offset]);
-          if (i == 0) {
-            dy[j] = tmp;
-          } else {
-            dy[j] += tmp;
-          }
-        }
-      }
-    }
-  } else {  // x.dims < y.dims, broadcast for x.
-    for (int i = 0; i < h; ++i) {
-      for (int j = 0; j < w; ++j) {
-        int y_offset = i * w + j;
-        if (dy != nullptr) {
-          dy[y_offset] =
-              dy_op(x[j], y[y_offset], out[y_offset], dout[y_offset]);
-        }
-        if (dx != nullptr) {
-          T tmp = dx_op(x[j], y[y_offset], out[y_offset], dout[y_offset]);
-          if (i == 0) {
-            dx[j] = tmp;
-          } else {
-            dx[j] += tmp;
-          }
-        }
-      }
-    }
-  }
+  std::vector<int64_t> x_dims(x_dims_array, x_dims_array + max_dim);
+  std::vector<int64_t> y_dims(y_dims_array, y_dims_array + max_dim);
+  std::vector<int64_t> out_dims(out_dims_array, out_dims_array + max_dim);
+  CoalescedBroadcastDims dims(
+      x_dims.data(), y_dims.data(), out_dims.data(), max_dim);
+  GradBroadcastCPU<T, DX_OP, DY_OP, Tout>(
+      ctx,
+      x.data<T>(),
+      y.data<T>(),
+      out.data<Tout>(),
+      dout.data<Tout>(),
+      dims,
+      x.numel(),
+      y.numel(),
+      dx_op,
+      dy_op,
+      dx == nullptr ? nullptr : ctx.Alloc<T>(dx),
+      dy == nullptr ? nullptr : ctx.Alloc<T>(dy));
 }
 
+// the larger input is (pre, n, post), the other one (1, n, 1)
 template <typename T, typename DX_OP, typename DY_OP, typename Tout = T>
-static void ElemwiseGradBroadcast2CPU(const T *x,
-                                      const T *y,
-                                      const Tout *out,
-                                      const Tout *dout,
-                                      int pre,
-                                      int n,
-                                      int post,
-                                      bool is_xsize_larger,
-                                      DX_OP dx_op,
-                                      DY_OP dy_op,
-                                      T *dx,
-                                      T *dy) {
+static void ElemwiseGradBroadcastMidCPU(const CPUContext &ctx,
+                                        const T *x,
+                                        const T *y,
+                                        const Tout *out,
+                                        const Tout *dout,
+                                        int pre,
+                                        int n,
+                                        int post,
+                                        bool is_xsize_larger,
+                                        DX_OP dx_op,
+                                        DY_OP dy_op,
+                                        T *dx,
+                                        T *dy) {
+  const int64_t large_dims_array[] = {pre, n, post};
+  const int64_t small_dims_array[] = {1, n, 1};
+  const int64_t large_numel = static_cast<int64_t>(pre) * n * post;
   if (is_xsize_larger) {
-    for (int i = 0; i < pre; ++i) {
-      for (int j = 0; j < n; ++j) {
-        for (int k = 0; k < post; ++k) {
-          int x_offset = i * n * post + j * post + k;
-          if (dx != nullptr) {
-            dx[x_offset] =
-                dx_op(x[x_offset], y[j], out[x_offset], dout[x_offset]);
-          }
-          if (dy != nullptr) {
-            T tmp = dy_op(x[x_offset], y[j], out[x_offset], dout[x_offset]);
-            if (i == 0 && k == 0) {
-              dy[j] = tmp;
-            } else {
-              dy[j] += tmp;
-            }
-          }
-        }
-      }
-    }
-  } else {  // x.dims < y.dims, broadcast for x.
-    for (int i = 0; i < pre; ++i) {
-      for (int j = 0; j < n; ++j) {
-        for (int k = 0; k < post; ++k) {
-          int y_offset = i * n * post + j * post + k;
-          if (dy != nullptr) {
-            dy[y_offset] =
-                dy_op(x[j], y[y_offset], out[y_offset], dout[y_offset]);
-          }
-          if (dx != nullptr) {
-            T tmp = dx_op(x[j], y[y_offset], out[y_offset], dout[y_offset]);
-            if (i == 0 && k == 0) {
-              dx[j] = tmp;
-            } else {
-              dx[j] += tmp;
-            }
-          }
-        }
-      }
-    }
+    CoalescedBroadcastDims dims(
+        large_dims_array, small_dims_array, large_dims_array, 3);
+    GradBroadcastCPU<T, DX_OP, DY_OP, Tout>(
+        ctx, x, y, out, dout, dims, large_numel, n, dx_op, dy_op, dx, dy);
+  } else {
+    CoalescedBroadcastDims dims(
+        small_dims_array, large_dims_array, large_dims_array, 3);
+    GradBroadcastCPU<T, DX_OP, DY_OP, Tout>(
+        ctx, x, y, out, dout, dims, n, large_numel, dx_op, dy_op, dx, dy);
   }
 }
 
@@ -322,20 +349,8 @@ void ElemwiseGradComputeWithBroadcast(const CPUContext &ctx,
         ctx, x_dims, y_dims, x, y, out, dout, axis, dx, dy, dx_op, dy_op);
     return;
   }
-  if (post == 1) {
-    ElemwiseGradBroadcast1CPU(x.data<T>(),
-                              y.data<T>(),
-                              out.data<Tout>(),
-                              dout.data<Tout>(),
-                              pre,
-                              n,
-                              is_xsize_larger,
-                              dx_op,
-                              dy_op,
-                              dx == nullptr ? nullptr : ctx.Alloc<T>(dx),
-                              dy == nullptr ? nullptr : ctx.Alloc<T>(dy));
-  } else {
-    ElemwiseGradBroadcast2CPU(x.data<T>(),
+  ElemwiseGradBroadcastMidCPU(ctx,
+                              x.data<T>(),
                               y.data<T>(),
                               out.data<Tout>(),
                               dout.data<Tout>(),
@@ -347,7 +362,6 @@ void ElemwiseGradComputeWithBroadcast(const CPUContext &ctx,
                               dy_op,
                               dx == nullptr ? nullptr : ctx.Alloc<T>(dx),
                               dy == nullptr ? nullptr : ctx.Alloc<T>(dy));
-  }
 }
 
 template <typename T, typename DX_OP, typename DY_OP, typename Tout = T>
@@ -13,6 +13,9 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #pragma once
+#include <algorithm>
+#include <vector>
+
 #include "paddle/phi/core/dense_tensor.h"
 #include "paddle/phi/core/enforce.h"
 
@@ -117,5 +120,129 @@ inline void UpdateElementwiseIndexArray(const int *out_dims_array,
   }
 }
 
+/*
+ * The dims of a broadcast of X and Y for the CPU loops: the dims of size 1
+ * in Out are dropped and the neighbouring dims X and Y are both broadcast
+ * or not broadcast on are merged, so that the innermost dim is the longest
+ * run the loops go through with a unit or a zero stride. For example
+ * X = (8, 16, 7, 7) and Y = (1, 16, 1, 1) give the sizes (8, 16, 49), the
+ * strides of X (784, 49, 1) and the strides of Y (0, 1, 0).
+ */
+struct CoalescedBroadcastDims {
+  CoalescedBroadcastDims(const int64_t *x_dims_array,
+                         const int64_t *y_dims_array,
+                         const int64_t *out_dims_array,
+                         int max_dim) {
+    std::vector<bool> x_broadcast, y_broadcast;
+    numel = 1;
+    for (int i = 0; i < max_dim; ++i) {
+      numel *= out_dims_array[i];
+      if (out_dims_array[i] == 1) {
+        continue;
+      }
+      bool x_one = x_dims_array[i] == 1;
+      bool y_one = y_dims_array[i] == 1;
+      if (!sizes.empty() && x_one == x_broadcast.back() &&
+          y_one == y_broadcast.back()) {
+        sizes.back() *= out_dims_array[i];
+      } else {
+        sizes.push_back(out_dims_array[i]);
+        x_broadcast.push_back(x_one);
+        y_broadcast.push_back(y_one);
+      }
+    }
+    int rank = sizes.size();
+    x_strides.resize(rank);
+    y_strides.resize(rank);
+    int64_t x_stride = 1, y_stride = 1;
+    for (int i = rank - 1; i >= 0; --i) {
+      x_strides[i] = x_broadcast[i] ? 0 : x_stride;
+      y_strides[i] = y_broadcast[i] ? 0 : y_stride;
+      x_stride *= x_broadcast[i] ? 1 : sizes[i];
+      y_stride *= y_broadcast[i] ? 1 : sizes[i];
+    }
+  }
+
+  // The dim the threads split: the outermost one of num_threads indexes at
+  // least, or else the largest one. With disjoint only the dims X and Y are
+  // both not broadcast on are taken, so that no index of X or Y is reached
+  // from two threads. -1 if there is none.
+  int SplitDim(int num_threads, bool disjoint) const {
+    int split_dim = -1;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      if (disjoint && (x_strides[i] == 0 || y_strides[i] == 0)) {
+        continue;
+      }
+      if (sizes[i] >= num_threads) {
+        return i;
+      }
+      if (split_dim == -1 || sizes[i] > sizes[split_dim]) {
+        split_dim = i;
+      }
+    }
+    return split_dim;
+  }
+
+  // The indexes of split_dim that hold grain_size elements.
+  int64_t SplitGrainSize(int split_dim, int64_t grain_size) const {
+    int64_t split_numel = numel / std::max<int64_t>(sizes[split_dim], 1);
+    return std::max<int64_t>(1, grain_size / std::max<int64_t>(split_numel, 1));
+  }
+
+  // Calls f(x_offset, y_offset, out_offset, len) on every run of the
+  // innermost dim, in order, restricted to the indexes [begin, end) of
+  // split_dim when it is not -1.
+  template <typename F>
+  void ForEachRun(int split_dim, int64_t begin, int64_t end, F &&f) const {
+    int rank = sizes.size();
+    if (numel == 0 || (split_dim >= 0 && begin >= end)) {
+      return;
+    }
+    if (rank == 0) {
+      f(0, 0, 0, 1);
+      return;
+    }
+    int inner = rank - 1;
+    int64_t inner_begin = split_dim == inner ? begin : 0;
+    int64_t inner_end = split_dim == inner ? end : sizes[inner];
+    std::vector<int64_t> out_strides(rank, 1);
+    for (int i = rank - 2; i >= 0; --i) {
+      out_strides[i] = out_strides[i + 1] * sizes[i + 1];
+    }
+    std::vector<int64_t> index(rank, 0);
+    if (split_dim >= 0 && split_dim < inner) {
+      index[split_dim] = begin;
+    }
+    while (true) {
+      int64_t x_offset = inner_begin * x_strides[inner];
+      int64_t y_offset = inner_begin * y_strides[inner];
+      int64_t out_offset = inner_begin;
+      for (int i = 0; i < inner; ++i) {
+        x_offset += index[i] * x_strides[i];
+        y_offset += index[i] * y_strides[i];
+        out_offset += index[i] * out_strides[i];
+      }
+      f(x_offset, y_offset, out_offset, inner_end - inner_begin);
+      int i = inner - 1;
+      for (; i >= 0; --i) {
+        int64_t first = i == split_dim ? begin : 0;
+        int64_t last = i == split_dim ? end : sizes[i];
+        if (++index[i] < last) {
+          break;
+        }
+        index[i] = first;
+      }
+      if (i < 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<int64_t> sizes;
+  std::vector<int64_t> x_strides;
+  std::vector<int64_t> y_strides;
+  int64_t numel;
+};
+
 }  // namespace funcs
 }  // namespace phi
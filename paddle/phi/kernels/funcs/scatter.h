@@ -13,10 +13,12 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #pragma once
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <unordered_set>
 
+#include "paddle/phi/backends/cpu/cpu_context.h"
 #include "paddle/phi/common/place.h"
 #include "paddle/phi/core/ddim.h"
 #include "paddle/phi/core/dense_tensor.h"
@@ -64,6 +66,13 @@ elementwise_inner_add(const phi::CPUContext& ctx,
   eigen_dst += eigen_src;
 }
 
+// the columns of the slices a chunk takes at least, a chunk goes through
+// every index
+inline int64_t ScatterColumnGrainSize(int64_t index_size) {
+  return std::max<int64_t>(
+      64, kDefaultParallelGrainSize / std::max<int64_t>(index_size, 1));
+}
+
 /**
  * Return an updated tensor from source tensor, scattered according to index:
  * dst[i] = src[index[i]]
@@ -120,8 +129,6 @@ void ScatterAssign(const phi::CPUContext& ctx,
   size_t slice_size = 1;
   for (int i = 1; i < src_dims.size(); ++i) slice_size *= src_dims[i];
 
-  const size_t slice_bytes = slice_size * sizeof(T);
-
   for (int64_t i = 0; i < index_size; ++i) {
     IndexT index_ = p_index[i];
 
@@ -133,9 +140,21 @@ void ScatterAssign(const phi::CPUContext& ctx,
                           "input meet the requirements. It should "
                           "be greater than or equal to 0, but received [%d]",
                           index_));
-
-    memcpy(p_output + index_ * slice_size, p_src + i * slice_size, slice_bytes);
   }
+
+  // an index may repeat, so the threads take columns of the slices and
+  // every one copies them in the index order, the last write still wins
+  ctx.ParallelFor(0,
+                  slice_size,
+                  ScatterColumnGrainSize(index_size),
+                  [&](int64_t begin, int64_t end) {
+                    const size_t bytes = (end - begin) * sizeof(T);
+                    for (int64_t i = 0; i < index_size; ++i) {
+                      memcpy(p_output + p_index[i] * slice_size + begin,
+                             p_src + i * slice_size + begin,
+                             bytes);
+                    }
+                  });
 }
 
 template <typename T, typename IndexT = int>
@@ -181,8 +200,6 @@ void ScatterAssignAdd(const phi::CPUContext& ctx,
   size_t slice_size = 1;
   for (int i = 1; i < src_dims.size(); ++i) slice_size *= src_dims[i];
 
-  const size_t& slice_bytes = slice_size * sizeof(T);
-
   // if not in overwrite mode, need to init output data
   auto max_index = dst_dims[0];
   for (int64_t i = 0; i < index_size; ++i) {
@@ -204,15 +221,30 @@ void ScatterAssignAdd(const phi::CPUContext& ctx,
                           "be less than %d, but received %d",
                           max_index,
                           index_val));
-    memset(p_output + slice_size * index_val, 0, slice_bytes);
   }
 
-  // if not in overwrite mode, need to init output data
-  for (int64_t i = 0; i < index_size; ++i) {
-    const IndexT& index_val = p_index[i];
-    elementwise_inner_add<T, IndexT>(
-        ctx, p_src, p_output, i, index_val, slice_size);
-  }
+  // the threads take columns of the slices, so the adds to a repeated
+  // index do not race
+  ctx.ParallelFor(0,
+                  slice_size,
+                  ScatterColumnGrainSize(index_size),
+                  [&](int64_t begin, int64_t end) {
+                    const size_t bytes = (end - begin) * sizeof(T);
+                    for (int64_t i = 0; i < index_size; ++i) {
+                      memset(p_output + p_index[i] * slice_size + begin,
+                             0,
+                             bytes);
+                    }
+                    for (int64_t i = 0; i < index_size; ++i) {
+                      elementwise_inner_add<T, IndexT>(
+                          ctx,
+                          p_src + i * slice_size + begin,
+                          p_output + p_index[i] * slice_size + begin,
+                          0,
+                          0,
+                          end - begin);
+                    }
+                  });
 }
 
 // The function is only for scatter grad x,
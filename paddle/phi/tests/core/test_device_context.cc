@@ -12,6 +12,10 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License. */
 
+#include <stdexcept>
+#include <thread>  // NOLINT
+#include <vector>
+
 #include "gtest/gtest.h"
 
 // TODO(wilber): will remove after the cpu, gpu context megre.
@@ -50,5 +54,89 @@ TEST(DeviceContext, cpu_context) {
   delete device;
 }
 
+TEST(DeviceContext, cpu_parallel_for) {
+  phi::CPUContext ctx;
+  ctx.Init();
+  for (int num_threads : {1, 4}) {
+    phi::CPUContext::SetIntraOpNumThreads(num_threads);
+    EXPECT_EQ(ctx.GetIntraOpNumThreads(), num_threads);
+    // the number only holds for the thread that set it
+    int other_num_threads = 0;
+    std::thread other(
+        [&]() { other_num_threads = phi::CPUContext::GetIntraOpNumThreads(); });
+    other.join();
+    EXPECT_EQ(other_num_threads, 1);
+
+    std::vector<int> visits(100000, 0);
+    ctx.ParallelFor(0, visits.size(), 1000, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) {
+        ++visits[i];
+      }
+      // nested calls run in the chunk
+      ctx.ParallelFor(0, 10, 1, [](int64_t, int64_t) {});
+    });
+    for (int visit : visits) {
+      EXPECT_EQ(visit, 1);
+    }
+
+    int64_t sum = ctx.ParallelReduce<int64_t>(
+        0,
+        100000,
+        1000,
+        0,
+        [](int64_t begin, int64_t end) {
+          int64_t part = 0;
+          for (int64_t i = begin; i < end; ++i) {
+            part += i;
+          }
+          return part;
+        },
+        [](int64_t a, int64_t b) { return a + b; });
+    EXPECT_EQ(sum, int64_t{100000} * 99999 / 2);
+
+    EXPECT_THROW(ctx.ParallelFor(0,
+                                 100000,
+                                 1000,
+                                 [](int64_t begin, int64_t end) {
+                                   throw std::runtime_error("chunk");
+                                 }),
+                 std::runtime_error);
+  }
+  phi::CPUContext::SetIntraOpNumThreads(1);
+}
+
+TEST(DeviceContext, cpu_intra_op_threads_per_thread) {
+  phi::CPUContext ctx;
+  ctx.Init();
+  // threads of different predictors set their own numbers and reduce at
+  // the same time
+  const int thread_num = 4;
+  std::vector<int> seen(thread_num, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([&ctx, &seen, t]() {
+      phi::CPUContext::SetIntraOpNumThreads(2 * t + 1);
+      for (int round = 0; round < 100; ++round) {
+        int64_t sum = ctx.ParallelReduce<int64_t>(
+            0,
+            10000,
+            100,
+            0,
+            [](int64_t begin, int64_t end) { return end - begin; },
+            [](int64_t a, int64_t b) { return a + b; });
+        EXPECT_EQ(sum, 10000);
+      }
+      seen[t] = phi::CPUContext::GetIntraOpNumThreads();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < thread_num; ++t) {
+    EXPECT_EQ(seen[t], 2 * t + 1);
+  }
+  EXPECT_EQ(phi::CPUContext::GetIntraOpNumThreads(), 1);
+}
+
 }  // namespace tests
 }  // namespace phi
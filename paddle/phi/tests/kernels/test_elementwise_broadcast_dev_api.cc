@@ -0,0 +1,241 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "paddle/phi/backends/cpu/cpu_context.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "paddle/phi/core/kernel_registry.h"
+#include "paddle/phi/kernels/elementwise_add_grad_kernel.h"
+#include "paddle/phi/kernels/elementwise_add_kernel.h"
+#include "paddle/phi/kernels/elementwise_divide_grad_kernel.h"
+#include "paddle/phi/kernels/elementwise_divide_kernel.h"
+#include "paddle/phi/kernels/elementwise_multiply_grad_kernel.h"
+#include "paddle/phi/kernels/elementwise_multiply_kernel.h"
+#include "paddle/phi/kernels/elementwise_subtract_grad_kernel.h"
+#include "paddle/phi/kernels/elementwise_subtract_kernel.h"
+#include "paddle/phi/tests/kernels/cpu_kernel_test_helper.h"
+
+namespace phi {
+namespace tests {
+
+using DDim = phi::DDim;
+
+// x of x_dims and y of y_dims broadcast to out_dims, x_index and y_index
+// map an element of the output to the ones of x and y
+struct BroadcastCase {
+  std::string name;
+  DDim x_dims;
+  DDim y_dims;
+  DDim out_dims;
+  std::function<int64_t(int64_t)> x_index;
+  std::function<int64_t(int64_t)> y_index;
+};
+
+static std::vector<BroadcastCase> BroadcastCases() {
+  const int64_t n = 8, c = 32, h = 28, w = 28;
+  const int64_t b = 8, t = 128, hidden = 256;
+  return {{"NCHW + C",
+           phi::make_ddim({n, c, h, w}),
+           phi::make_ddim({1, c, 1, 1}),
+           phi::make_ddim({n, c, h, w}),
+           [](int64_t i) { return i; },
+           [=](int64_t i) { return (i / (h * w)) % c; }},
+          {"BTH + H",
+           phi::make_ddim({b, t, hidden}),
+           phi::make_ddim({hidden}),
+           phi::make_ddim({b, t, hidden}),
+           [](int64_t i) { return i; },
+           [=](int64_t i) { return i % hidden; }}};
+}
+
+// both inputs are broadcast, or y is the larger one
+static std::vector<BroadcastCase> BothBroadcastCases() {
+  return {{"[4, 1, 8] + [1, 6, 1]",
+           phi::make_ddim({4, 1, 8}),
+           phi::make_ddim({1, 6, 1}),
+           phi::make_ddim({4, 6, 8}),
+           [](int64_t i) { return i / 48 * 8 + i % 8; },
+           [](int64_t i) { return i / 8 % 6; }},
+          {"[16] + [4, 16]",
+           phi::make_ddim({16}),
+           phi::make_ddim({4, 16}),
+           phi::make_ddim({4, 16}),
+           [](int64_t i) { return i % 16; },
+           [](int64_t i) { return i; }}};
+}
+
+static DenseTensor RandomTensor(const phi::CPUContext& dev_ctx,
+                                const DDim& dims,
+                                std::mt19937* rng) {
+  DenseTensor tensor;
+  tensor.Resize(dims);
+  float* data = dev_ctx.template Alloc<float>(&tensor);
+  std::uniform_real_distribution<float> dist(1.0f, 2.0f);
+  for (int64_t i = 0; i < tensor.numel(); ++i) {
+    data[i] = dist(*rng);
+  }
+  return tensor;
+}
+
+static void ExpectNear(const DenseTensor& actual,
+                       const std::vector<double>& expect) {
+  ASSERT_EQ(actual.numel(), static_cast<int64_t>(expect.size()));
+  for (size_t i = 0; i < expect.size(); ++i) {
+    ASSERT_NEAR(actual.data<float>()[i],
+                expect[i],
+                1e-4 * std::max(1.0, std::abs(expect[i])));
+  }
+}
+
+// checks the forward and the grad kernels against sums in double
+static void CheckBroadcast(const phi::CPUContext& dev_ctx,
+                           const BroadcastCase& c,
+                           std::mt19937* rng) {
+  DenseTensor x = RandomTensor(dev_ctx, c.x_dims, rng);
+  DenseTensor y = RandomTensor(dev_ctx, c.y_dims, rng);
+  DenseTensor dout = RandomTensor(dev_ctx, c.out_dims, rng);
+  const float* x_data = x.data<float>();
+  const float* y_data = y.data<float>();
+  const float* dout_data = dout.data<float>();
+  const int64_t numel = dout.numel();
+
+  std::vector<double> add(numel), sub(numel), mul(numel), div(numel);
+  std::vector<double> sum_dx(x.numel()), mul_dx(x.numel()), div_dx(x.numel());
+  std::vector<double> sum_dy(y.numel()), sub_dy(y.numel());
+  std::vector<double> mul_dy(y.numel()), div_dy(y.numel());
+  for (int64_t i = 0; i < numel; ++i) {
+    int64_t k = c.x_index(i), j = c.y_index(i);
+    double xv = x_data[k], yv = y_data[j], dv = dout_data[i];
+    add[i] = xv + yv;
+    sub[i] = xv - yv;
+    mul[i] = xv * yv;
+    div[i] = xv / yv;
+    sum_dx[k] += dv;
+    mul_dx[k] += dv * yv;
+    div_dx[k] += dv / yv;
+    sum_dy[j] += dv;
+    sub_dy[j] -= dv;
+    mul_dy[j] += dv * xv;
+    div_dy[j] -= dv * xv / (yv * yv);
+  }
+
+  ExpectNear(phi::Add<float>(dev_ctx, x, y), add);
+  ExpectNear(phi::Subtract<float>(dev_ctx, x, y), sub);
+  ExpectNear(phi::Multiply<float>(dev_ctx, x, y), mul);
+  DenseTensor out = phi::Divide<float>(dev_ctx, x, y);
+  ExpectNear(out, div);
+
+  DenseTensor dx, dy;
+  dx.Resize(c.x_dims);
+  dy.Resize(c.y_dims);
+  phi::AddGradKernel<float>(dev_ctx, x, y, dout, -1, &dx, &dy);
+  ExpectNear(dx, sum_dx);
+  ExpectNear(dy, sum_dy);
+  phi::SubtractGradKernel<float>(dev_ctx, x, y, dout, -1, &dx, &dy);
+  ExpectNear(dx, sum_dx);
+  ExpectNear(dy, sub_dy);
+  phi::MultiplyGradKernel<float>(dev_ctx, x, y, dout, -1, &dx, &dy);
+  ExpectNear(dx, mul_dx);
+  ExpectNear(dy, mul_dy);
+  phi::DivideGradKernel<float>(dev_ctx, x, y, out, dout, -1, &dx, &dy);
+  ExpectNear(dx, div_dx);
+  ExpectNear(dy, div_dy);
+}
+
+TEST(DEV_API, elementwise_broadcast) {
+  phi::CPUContext dev_ctx;
+  InitContext(&dev_ctx);
+  std::mt19937 rng(0);
+  for (int num_threads : {1, 4}) {
+    phi::CPUContext::SetIntraOpNumThreads(num_threads);
+    for (auto& c : BroadcastCases()) {
+      CheckBroadcast(dev_ctx, c, &rng);
+    }
+  }
+  phi::CPUContext::SetIntraOpNumThreads(1);
+}
+
+TEST(DEV_API, elementwise_broadcast_both) {
+  phi::CPUContext dev_ctx;
+  InitContext(&dev_ctx);
+  std::mt19937 rng(0);
+  for (int num_threads : {1, 4}) {
+    phi::CPUContext::SetIntraOpNumThreads(num_threads);
+    for (auto& c : BothBroadcastCases()) {
+      CheckBroadcast(dev_ctx, c, &rng);
+    }
+  }
+  phi::CPUContext::SetIntraOpNumThreads(1);
+}
+
+// NOTE: the benchmark is not checked, it prints the time of the forward
+// and the grad kernels on the broadcast patterns with one thread and with
+// the threads of the machine. It is disabled to keep it out of ctest, run
+// it with --gtest_also_run_disabled_tests.
+TEST(DEV_API, DISABLED_elementwise_broadcast_benchmark) {
+  phi::CPUContext dev_ctx;
+  InitContext(&dev_ctx);
+  std::mt19937 rng(0);
+  int max_threads = std::max<int>(1, std::thread::hardware_concurrency());
+  for (int num_threads : {1, max_threads}) {
+    phi::CPUContext::SetIntraOpNumThreads(num_threads);
+    for (auto& c : BroadcastCases()) {
+      DenseTensor x = RandomTensor(dev_ctx, c.x_dims, &rng);
+      DenseTensor y = RandomTensor(dev_ctx, c.y_dims, &rng);
+      DenseTensor dout = RandomTensor(dev_ctx, c.x_dims, &rng);
+      DenseTensor out = phi::Divide<float>(dev_ctx, x, y);
+      DenseTensor dx, dy;
+      dx.Resize(c.x_dims);
+      dy.Resize(c.y_dims);
+      std::cout << c.name << ", " << num_threads << " threads:"
+                << " add "
+                << RunMs([&] { phi::Add<float>(dev_ctx, x, y); })
+                << " ms, sub "
+                << RunMs([&] { phi::Subtract<float>(dev_ctx, x, y); })
+                << " ms, mul "
+                << RunMs([&] { phi::Multiply<float>(dev_ctx, x, y); })
+                << " ms, div "
+                << RunMs([&] { phi::Divide<float>(dev_ctx, x, y); })
+                << " ms, add_grad " << RunMs([&] {
+                     phi::AddGradKernel<float>(
+                         dev_ctx, x, y, dout, -1, &dx, &dy);
+                   })
+                << " ms, sub_grad " << RunMs([&] {
+                     phi::SubtractGradKernel<float>(
+                         dev_ctx, x, y, dout, -1, &dx, &dy);
+                   })
+                << " ms, mul_grad " << RunMs([&] {
+                     phi::MultiplyGradKernel<float>(
+                         dev_ctx, x, y, dout, -1, &dx, &dy);
+                   })
+                << " ms, div_grad " << RunMs([&] {
+                     phi::DivideGradKernel<float>(
+                         dev_ctx, x, y, out, dout, -1, &dx, &dy);
+                   })
+                << " ms" << std::endl;
+    }
+  }
+  phi::CPUContext::SetIntraOpNumThreads(1);
+}
+
+}  // namespace tests
+}  // namespace phi
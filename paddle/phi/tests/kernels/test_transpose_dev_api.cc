@@ -0,0 +1,144 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <gtest/gtest.h>
+
+#include <utility>
+#include <vector>
+
+#include "paddle/phi/backends/cpu/cpu_context.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "paddle/phi/core/kernel_registry.h"
+#include "paddle/phi/kernels/funcs/math_function.h"
+#include "paddle/phi/kernels/transpose_grad_kernel.h"
+#include "paddle/phi/kernels/transpose_kernel.h"
+#include "paddle/phi/tests/kernels/cpu_kernel_test_helper.h"
+
+namespace phi {
+namespace tests {
+
+using DDim = phi::DDim;
+
+template <typename T>
+static DenseTensor IotaTensor(const phi::CPUContext& dev_ctx,
+                              const DDim& dims) {
+  DenseTensor tensor;
+  tensor.Resize(dims);
+  T* data = dev_ctx.template Alloc<T>(&tensor);
+  for (int64_t i = 0; i < tensor.numel(); ++i) {
+    data[i] = static_cast<T>(i % 127);
+  }
+  return tensor;
+}
+
+// the transpose of the Eigen shuffle the kernel used before
+template <typename T>
+static DenseTensor EigenTranspose(const phi::CPUContext& dev_ctx,
+                                  const DenseTensor& x,
+                                  const std::vector<int>& axis) {
+  DenseTensor out;
+  std::vector<int64_t> out_dims(axis.size());
+  for (size_t i = 0; i < axis.size(); ++i) {
+    out_dims[i] = x.dims()[axis[i]];
+  }
+  out.Resize(phi::make_ddim(out_dims));
+  dev_ctx.template Alloc<T>(&out);
+  switch (axis.size()) {
+    case 2:
+      funcs::Transpose<phi::CPUContext, T, 2>()(dev_ctx, x, &out, axis);
+      break;
+    case 3:
+      funcs::Transpose<phi::CPUContext, T, 3>()(dev_ctx, x, &out, axis);
+      break;
+    default:
+      funcs::Transpose<phi::CPUContext, T, 4>()(dev_ctx, x, &out, axis);
+  }
+  return out;
+}
+
+template <typename T>
+static void CheckTranspose(const phi::CPUContext& dev_ctx,
+                           const DDim& dims,
+                           const std::vector<int>& axis) {
+  DenseTensor x = IotaTensor<T>(dev_ctx, dims);
+  DenseTensor out = phi::Transpose<T>(dev_ctx, x, axis);
+  DenseTensor expect = EigenTranspose<T>(dev_ctx, x, axis);
+  ASSERT_EQ(out.dims(), expect.dims());
+  for (int64_t i = 0; i < out.numel(); ++i) {
+    ASSERT_EQ(out.data<T>()[i], expect.data<T>()[i]);
+  }
+
+  // the grad transposes back
+  DenseTensor x_grad;
+  x_grad.Resize(dims);
+  phi::TransposeGradKernel<T>(dev_ctx, out, axis, &x_grad);
+  for (int64_t i = 0; i < x.numel(); ++i) {
+    ASSERT_EQ(x_grad.data<T>()[i], x.data<T>()[i]);
+  }
+}
+
+TEST(DEV_API, transpose) {
+  phi::CPUContext dev_ctx;
+  InitContext(&dev_ctx);
+  const std::vector<std::pair<DDim, std::vector<int>>> cases = {
+      {phi::make_ddim({37, 53}), {1, 0}},
+      {phi::make_ddim({2, 33, 1, 17}), {0, 3, 2, 1}},
+      {phi::make_ddim({4, 20, 6, 16}), {0, 2, 1, 3}},
+      {phi::make_ddim({4, 20, 6, 16}), {0, 2, 3, 1}},
+      {phi::make_ddim({3, 40, 24}), {0, 2, 1}},
+      {phi::make_ddim({5, 7, 9}), {0, 1, 2}}};
+  for (int num_threads : {1, 4}) {
+    phi::CPUContext::SetIntraOpNumThreads(num_threads);
+    for (auto& c : cases) {
+      CheckTranspose<float>(dev_ctx, c.first, c.second);
+      CheckTranspose<phi::dtype::float16>(dev_ctx, c.first, c.second);
+      CheckTranspose<phi::dtype::bfloat16>(dev_ctx, c.first, c.second);
+      CheckTranspose<int8_t>(dev_ctx, c.first, c.second);
+      CheckTranspose<double>(dev_ctx, c.first, c.second);
+    }
+  }
+  phi::CPUContext::SetIntraOpNumThreads(1);
+}
+
+// NOTE: the benchmark is not checked, it prints the time of the kernel
+// and of the Eigen shuffle on the transposes of attention layers. It is
+// disabled to keep it out of ctest, run it with
+// --gtest_also_run_disabled_tests.
+template <typename T>
+static void BenchmarkTranspose(const phi::CPUContext& dev_ctx,
+                               const char* type,
+                               const std::vector<int>& axis) {
+  DenseTensor x = IotaTensor<T>(dev_ctx, phi::make_ddim({16, 512, 12, 64}));
+  std::cout << type << " [16, 512, 12, 64] axis (" << axis[0] << ", "
+            << axis[1] << ", " << axis[2] << ", " << axis[3]
+            << "): kernel "
+            << RunMs([&] { phi::Transpose<T>(dev_ctx, x, axis); })
+            << " ms, eigen "
+            << RunMs([&] { EigenTranspose<T>(dev_ctx, x, axis); }) << " ms"
+            << std::endl;
+}
+
+TEST(DEV_API, DISABLED_transpose_benchmark) {
+  phi::CPUContext dev_ctx;
+  InitContext(&dev_ctx);
+  for (auto& axis : std::vector<std::vector<int>>{{0, 2, 1, 3}, {0, 1, 3, 2}}) {
+    BenchmarkTranspose<float>(dev_ctx, "float32", axis);
+    BenchmarkTranspose<phi::dtype::float16>(dev_ctx, "float16", axis);
+    BenchmarkTranspose<phi::dtype::bfloat16>(dev_ctx, "bfloat16", axis);
+    BenchmarkTranspose<int8_t>(dev_ctx, "int8", axis);
+  }
+}
+
+}  // namespace tests
+}  // namespace phi
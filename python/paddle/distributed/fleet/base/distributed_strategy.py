@@ -525,7 +525,7 @@ class DistributedStrategy(object):
                                    'sparse_delete_after_unseen_days', 'sparse_show_click_decay_rate', 'sparse_delete_threshold', \
                                    'sparse_converter', 'sparse_deconverter', 'sparse_enable_cache', 'sparse_cache_rate', \
                                    'sparse_cache_file_num', 'sparse_beta1_decay_rate', 'sparse_beta2_decay_rate', \
-                                   'sparse_ada_epsilon', 'sparse_optimizer', 'sparse_ssd_unseenday_threshold',
+                                   'sparse_ada_epsilon', 'sparse_optimizer', 'sparse_ssd_unseenday_threshold', 'sparse_embedx_quant_bits', \
                                    'embed_sparse_optimizer', 'embed_sparse_learning_rate', 'embed_sparse_weight_bounds', \
                                    'embed_sparse_initial_range', 'embed_sparse_initial_g2sum', 'embed_sparse_beta1_decay_rate', \
                                    'embed_sparse_beta2_decay_rate', 'embedx_sparse_optimizer', 'embedx_sparse_learning_rate', \
@@ -653,6 +653,8 @@ class DistributedStrategy(object):
                 'sparse_delete_after_unseen_days', 30)
             table_data.accessor.ctr_accessor_param.ssd_unseenday_threshold = config.get(
                 'sparse_ssd_unseenday_threshold', 1)
+            table_data.accessor.ctr_accessor_param.embedx_quant_bits = config.get(
+                'sparse_embedx_quant_bits', 32)
             converter = config.get('sparse_converter', "")
             deconverter = config.get('sparse_deconverter', "")
 